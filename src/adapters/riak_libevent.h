@@ -30,19 +30,158 @@ struct _riak_libevent {
     struct event_base  *base;
     struct bufferevent *bevent;
     riak_operation     *rop;
+    riak_connection    *cxn; // Set when pipelining many operations over one bufferevent
+    riak_error          err; // First pipeline failure; no more requests are taken after one
+    struct event       *retry; // Backoff timer, created by the first pipeline retry
+    riak_boolean_t      retrying; // Waiting out a backoff; requests queue without touching the wire
 };
 
+void
+riak_libevent_pipeline_result_cb(struct bufferevent *bev,
+                                 void               *ptr);
+
+riak_error
+riak_libevent_bind(riak_libevent     *rev,
+                   riak_connection   *cxn,
+                   bufferevent_data_cb read_cb);
+
+void
+riak_libevent_arm_timeout(riak_libevent *rev);
+
+riak_ssize_t
+riak_libevent_write_cb(void       *ptr,
+                       void       *data,
+                       riak_size_t size);
+
+/**
+ * @brief Rewind what may be retried and wait out the backoff on a timer
+ * @param rev Riak Event, no longer watching a socket
+ * @param err Reason it broke
+ * @returns Error code; anything but ERIAK_OK means nothing was kept for a retry
+ */
+riak_error
+riak_libevent_pipeline_retry(riak_libevent *rev,
+                             riak_error     err);
+
+/**
+ * @brief Give up on a pipelined connection's socket, then retry or drop its outstanding operations
+ * @param rev Riak Event
+ * @param err Reason
+ * @note The stream is out of step, so the bufferevent goes rather than pairing later
+ *       requests with answers meant for the dropped ones
+ */
+void
+riak_libevent_pipeline_fail(riak_libevent *rev,
+                            riak_error     err) {
+    if (rev->err) {
+        return;
+    }
+    if (rev->bevent) {
+        bufferevent_free(rev->bevent);
+        rev->bevent = NULL;
+    }
+    rev->retrying = RIAK_FALSE;
+    if (riak_pipeline_get_depth(rev->cxn) > 0 && err != ERIAK_EVENT &&
+        riak_libevent_pipeline_retry(rev, err) == ERIAK_OK) {
+        return;
+    }
+    rev->err = err;
+    riak_pipeline_drop(rev->cxn, err);
+}
+
+/**
+ * @brief Once the backoff is over, reopen the socket and frame every request again
+ * @param fd Unused
+ * @param events Unused
+ * @param ptr Riak Event
+ * @note The socket may still be connecting; the bufferevent holds the frames until
+ *       it is writable, and a refused connect fails it like any other broken stream
+ */
+void
+riak_libevent_retry_cb(evutil_socket_t fd,
+                       short           events,
+                       void           *ptr) {
+    riak_libevent   *rev = (riak_libevent*)ptr;
+    riak_connection *cxn = rev->cxn;
+    rev->retrying = RIAK_FALSE;
+    // Counts as another try, so a node which stays down is given up on
+    riak_error err = riak_connection_reopen(cxn);
+    if (err) {
+        riak_libevent_pipeline_fail(rev, err);
+        return;
+    }
+    err = riak_libevent_bind(rev, cxn, riak_libevent_pipeline_result_cb);
+    if (err) {
+        riak_libevent_pipeline_fail(rev, err);
+        return;
+    }
+    // Anything queued during the backoff was never written; frame it all again
+    err = riak_pipeline_resend(cxn, riak_libevent_write_cb, rev);
+    if (err) {
+        riak_libevent_pipeline_fail(rev, err);
+        return;
+    }
+    riak_libevent_arm_timeout(rev);
+}
+
+riak_error
+riak_libevent_pipeline_retry(riak_libevent *rev,
+                             riak_error     err) {
+    riak_uint64_t backoff_usecs;
+    if (riak_pipeline_rewind(rev->cxn, err, &backoff_usecs) == 0) {
+        return err;
+    }
+    if (rev->retry == NULL) {
+        rev->retry = evtimer_new(rev->base, riak_libevent_retry_cb, rev);
+        if (rev->retry == NULL) {
+            riak_log_critical(rev->cxn, "%s", "Could not create retry timer");
+            return ERIAK_EVENT;
+        }
+    }
+    struct timeval tv;
+    tv.tv_sec  = backoff_usecs / 1000000;
+    tv.tv_usec = backoff_usecs % 1000000;
+    if (evtimer_add(rev->retry, &tv) != 0) {
+        riak_log_critical(rev->cxn, "%s", "Could not schedule retry");
+        return ERIAK_EVENT;
+    }
+    rev->retrying = RIAK_TRUE;
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Wake in time for the operation's deadline, or the pipeline's earliest one
+ * @param rev Riak Event
+ */
+void
+riak_libevent_arm_timeout(riak_libevent *rev) {
+    if (rev->bevent == NULL) {
+        return;
+    }
+    int remaining = (rev->cxn) ? riak_pipeline_get_timeout(rev->cxn)
+                               : riak_operation_get_timeout(rev->rop);
+    if (remaining < 0) {
+        bufferevent_set_timeouts(rev->bevent, NULL, NULL);
+        return;
+    }
+    struct timeval tv;
+    tv.tv_sec  = remaining / 1000;
+    tv.tv_usec = (remaining % 1000) * 1000;
+    bufferevent_set_timeouts(rev->bevent, &tv, NULL);
+}
+
 /**
  * @brief Called by Libevent each time a connection is established
  * @param bev Libevent buffer event
  * @param events Bitvector of events
- * @param ptr User-defined pointer (here riak_connection)
+ * @param ptr User-defined pointer (here riak_libevent)
  */
 void
 riak_libevent_connection_cb(struct bufferevent *bev,
                             short               events,
                             void               *ptr) {
-    riak_connection *cxn = (riak_connection*)ptr;
+    riak_libevent   *rev = (riak_libevent*)ptr;
+    riak_connection *cxn = (rev->cxn) ? rev->cxn : riak_operation_get_connection(rev->rop);
     if (events & BEV_EVENT_CONNECTED) {
          riak_log_debug(cxn, "%s","Connect okay.");
     } else if (events & (BEV_EVENT_ERROR|BEV_EVENT_EOF)) {
@@ -59,12 +198,38 @@ riak_libevent_connection_cb(struct bufferevent *bev,
          riak_log_debug(cxn, "Closing because of %s [read event=%p, write event=%p]",
                  reason, (void*)ev_read, (void*)ev_write);
 #endif
+         if (rev->cxn) {
+             riak_libevent_pipeline_fail(rev, ERIAK_READ);
+             // Keep the loop going while a retry is scheduled
+             if (rev->err) {
+                 event_base_loopexit(rev->base, NULL);
+             }
+             return;
+         }
+         riak_operation_fail(rev->rop, ERIAK_READ);
          bufferevent_free(bev);
-         event_base_loopexit(bufferevent_get_base(bev), NULL);
+         rev->bevent = NULL;
+         event_base_loopexit(rev->base, NULL);
     } else if (events & BEV_EVENT_TIMEOUT) {
         riak_log_debug(cxn, "%s","Timeout Event");
+        int remaining = (rev->cxn) ? riak_pipeline_get_timeout(cxn)
+                                   : riak_operation_get_timeout(rev->rop);
+        if (remaining != 0) {
+            // Libevent stopped reading; resume until the earliest deadline
+            bufferevent_enable(bev, EV_READ);
+            riak_libevent_arm_timeout(rev);
+            return;
+        }
+        if (rev->cxn) {
+            riak_libevent_pipeline_fail(rev, ERIAK_TIMEOUT);
+            event_base_loopexit(rev->base, NULL);
+            return;
+        }
+        riak_log_error(cxn, "%s", "Timed out waiting for response");
+        riak_operation_fail(rev->rop, ERIAK_TIMEOUT);
         bufferevent_free(bev);
-        event_base_loopexit(bufferevent_get_base(bev), NULL);
+        rev->bevent = NULL;
+        event_base_loopexit(rev->base, NULL);
     } else {
         riak_log_debug(cxn, "Event %d", events);
     }
@@ -105,6 +270,14 @@ riak_libevent_write_cb(void       *ptr,
                        riak_size_t size) {
     riak_libevent *event = (riak_libevent*)ptr;
     struct bufferevent *bev   = event->bevent;
+    // Waiting to retry: the request is framed again once the socket is reopened
+    if (event->retrying) {
+        return size;
+    }
+    // Gone once the server hung up
+    if (bev == NULL) {
+        return 0;
+    }
     int result = bufferevent_write(bev, data, size);
     if (result == 0) {
         return size;
@@ -124,8 +297,11 @@ riak_libevent_result_cb(struct bufferevent *bev,
                                &done_streaming,
                                riak_libevent_read_cb,
                                (void*)event);
-    // TODO: How do we communicate back a read error?
-    (void)err;
+    // A server error has been through the error callback already
+    if (err && err != ERIAK_SERVER_ERROR) {
+        riak_operation_fail(rop, err);
+        done_streaming = RIAK_TRUE;
+    }
 
 #ifdef _RIAK_DEBUG
     // What has been queued up
@@ -136,41 +312,55 @@ riak_libevent_result_cb(struct bufferevent *bev,
     if (done_streaming) {
         bufferevent_free(bev);
         event->bevent = NULL;
+        return;
     }
+    riak_libevent_arm_timeout(event);
 }
 
 /**
- * @brief Construct a Riak Event framework
- * @param rev Riak Event (out)
+ * @brief Called by libevent when pipelined responses are readable
+ * @param bev Libevent Bufferevent
+ * @param ptr User-supplied pointer (Libevent Operation)
+ */
+void
+riak_libevent_pipeline_result_cb(struct bufferevent *bev,
+                                 void               *ptr) {
+    riak_libevent   *event = (riak_libevent*)ptr;
+    riak_connection *cxn   = event->cxn;
+
+    riak_error err = riak_pipeline_read(cxn,
+                                        riak_libevent_read_cb,
+                                        (void*)event);
+    if (err) {
+        riak_libevent_pipeline_fail(event, err);
+        return;
+    }
+    riak_libevent_arm_timeout(event);
+}
+
+/**
+ * @brief Attach a bufferevent for the connection's socket to a Riak Event
+ * @param rev Riak Event
  * @param cxn Riak Connection
+ * @param read_cb Libevent read callback
  * @returns Error code
  */
 riak_error
-riak_libevent_new(riak_libevent    **rev_target,
-                  riak_operation    *rop,
-                  struct event_base *base) {
-    riak_config     *cfg = riak_operation_get_config(rop);
-    riak_connection *cxn = riak_operation_get_connection(rop);
-
-    riak_libevent *rev = (riak_libevent*)riak_config_clean_allocate(cfg, sizeof(riak_libevent));
-    if (rev == NULL) {
-        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_libevent");
-        return ERIAK_OUT_OF_MEMORY;
-    }
-    *rev_target = rev;
-    rev->rop    = rop;
-    rev->base   = base;
+riak_libevent_bind(riak_libevent     *rev,
+                   riak_connection   *cxn,
+                   bufferevent_data_cb read_cb) {
+    riak_config *cfg = riak_connection_get_config(cxn);
 
     rev->bevent = bufferevent_socket_new(rev->base,
                                          riak_connection_get_fd(cxn),
-                                         BEV_OPT_CLOSE_ON_FREE|BEV_OPT_DEFER_CALLBACKS|BEV_OPT_THREADSAFE);
+                                         BEV_OPT_DEFER_CALLBACKS|BEV_OPT_THREADSAFE);
     if (rev->bevent == NULL) {
         riak_log_critical_config(cfg,
                                  "Could not create bufferevent [fd %d]",
                                  riak_connection_get_fd(cxn));
         return ERIAK_OUT_OF_MEMORY;
     }
-    if (bufferevent_base_set(base, rev->bevent) < 0) {
+    if (bufferevent_base_set(rev->base, rev->bevent) < 0) {
         riak_log_critical_config(cfg,
                                  "Could not set the base on bufferevent [fd %d]",
                                  riak_connection_get_fd(cxn));
@@ -186,7 +376,7 @@ riak_libevent_new(riak_libevent    **rev_target,
 
     // Set the internal read and write callbacks
     bufferevent_setcb(rev->bevent,
-                      riak_libevent_result_cb,
+                      read_cb,
                       riak_libevent_write_event_cb,
                       riak_libevent_connection_cb,
                       rev);
@@ -194,6 +384,58 @@ riak_libevent_new(riak_libevent    **rev_target,
     return ERIAK_OK;
 }
 
+/**
+ * @brief Construct a Riak Event framework
+ * @param rev Riak Event (out)
+ * @param cxn Riak Connection
+ * @returns Error code
+ */
+riak_error
+riak_libevent_new(riak_libevent    **rev_target,
+                  riak_operation    *rop,
+                  struct event_base *base) {
+    riak_config     *cfg = riak_operation_get_config(rop);
+    riak_connection *cxn = riak_operation_get_connection(rop);
+
+    riak_libevent *rev = (riak_libevent*)riak_config_clean_allocate(cfg, sizeof(riak_libevent));
+    if (rev == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_libevent");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    *rev_target = rev;
+    rev->rop    = rop;
+    rev->base   = base;
+
+    return riak_libevent_bind(rev, cxn, riak_libevent_result_cb);
+}
+
+/**
+ * @brief Construct a Riak Event which pipelines many operations over one connection
+ * @param rev Riak Event (out)
+ * @param cxn Riak Connection
+ * @param base Libevent Event Base
+ * @returns Error code
+ * @note When a socket breaks, requests which riak_config_set_retry_policy() allows
+ *       are resent on a reopened socket after the backoff; the rest are abandoned
+ */
+riak_error
+riak_libevent_pipeline_new(riak_libevent    **rev_target,
+                           riak_connection   *cxn,
+                           struct event_base *base) {
+    riak_config *cfg = riak_connection_get_config(cxn);
+
+    riak_libevent *rev = (riak_libevent*)riak_config_clean_allocate(cfg, sizeof(riak_libevent));
+    if (rev == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_libevent");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    *rev_target = rev;
+    rev->cxn    = cxn;
+    rev->base   = base;
+
+    return riak_libevent_bind(rev, cxn, riak_libevent_pipeline_result_cb);
+}
+
 void
 riak_libevent_free(riak_config    *cfg,
                    riak_libevent **rev_target) {
@@ -205,16 +447,51 @@ riak_libevent_free(riak_config    *cfg,
         bufferevent_free(rev->bevent);
         rev->bevent = NULL;
     }
+    if (rev->retry) {
+        event_free(rev->retry);
+        rev->retry = NULL;
+    }
     riak_free(cfg, rev_target);
 }
 
 riak_error
 riak_libevent_send(riak_operation *rop,
                    riak_libevent  *rev) {
+    if (rev->bevent == NULL) {
+        return ERIAK_WRITE;
+    }
+    riak_error err = riak_write(rop,
+                                riak_libevent_write_cb,
+                                (void*)rev);
+    if (err == ERIAK_OK) {
+        riak_libevent_arm_timeout(rev);
+    }
+    return err;
+}
 
-    return riak_write(rop,
-                      riak_libevent_write_cb,
-                      (void*)rev);
+riak_error
+riak_libevent_pipeline_send(riak_operation *rop,
+                            riak_libevent  *rev) {
+    if (rev->err) {
+        return rev->err;
+    }
+    // Queued behind the requests being retried, and sent along with them
+    if (rev->retrying) {
+        return riak_pipeline_send(rop, riak_libevent_write_cb, (void*)rev);
+    }
+    if (rev->bevent == NULL || riak_connection_is_stale(rev->cxn)) {
+        return ERIAK_WRITE;
+    }
+    riak_error err = riak_pipeline_send(rop,
+                                        riak_libevent_write_cb,
+                                        (void*)rev);
+    if (err) {
+        // Part of the frame may already be buffered
+        riak_libevent_pipeline_fail(rev, err);
+        return err;
+    }
+    riak_libevent_arm_timeout(rev);
+    return ERIAK_OK;
 }
 #ifdef __cplusplus
 }
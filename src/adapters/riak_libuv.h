@@ -0,0 +1,411 @@
+/*********************************************************************
+ *
+ * riak_libuv.h: Management of the Riak Libuv Framework
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <fcntl.h>
+#include <uv.h>
+#include "riak.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Every read lands in the same buffer, so it is sized for many frames at once
+#define RIAK_LIBUV_READ_BUFFER_SIZE 65536
+
+typedef struct _riak_libuv riak_libuv;
+
+struct _riak_libuv {
+    uv_loop_t       *loop;
+    uv_tcp_t         tcp;        // Wraps a duplicate of the connection's socket
+    uv_write_t       write_req;  // At most one write is in flight
+    uv_timer_t       timer;      // Fires at the earliest operation deadline
+    int              open_handles; // Memory is released once both handles are closed
+    riak_connection *cxn;
+    riak_config     *config;
+    int              fd_flags;   // Restored when freed
+    riak_error       err;        // First failure; the connection is unusable after one
+
+    // Reused for every read
+    char            *read_buf;
+    riak_uint8_t    *in_data;
+    riak_size_t      in_len;
+
+    // Requests queued while a write is in flight; swapped with write_buf when it completes
+    riak_uint8_t    *out_buf;
+    riak_size_t      out_len;
+    riak_size_t      out_capacity;
+    riak_uint8_t    *write_buf;
+    riak_size_t      write_capacity;
+    riak_boolean_t   writing;
+};
+
+/**
+ * @brief Give up on a connection and drop its outstanding operations
+ * @param ruv Riak Libuv Event
+ * @param err Reason
+ */
+void
+riak_libuv_fail(riak_libuv *ruv,
+                riak_error  err) {
+    riak_connection *cxn = ruv->cxn;
+    if (ruv->err) {
+        return;
+    }
+    ruv->err     = err;
+    ruv->out_len = 0;
+    uv_read_stop((uv_stream_t*)&(ruv->tcp));
+    uv_timer_stop(&(ruv->timer));
+    riak_pipeline_drop(cxn, err);
+}
+
+void
+riak_libuv_timeout_cb(uv_timer_t *timer);
+
+/**
+ * @brief Wake in time for the earliest deadline among outstanding operations
+ * @param ruv Riak Libuv Event
+ */
+void
+riak_libuv_arm_timeout(riak_libuv *ruv) {
+    int remaining = riak_pipeline_get_timeout(ruv->cxn);
+    if (remaining < 0) {
+        uv_timer_stop(&(ruv->timer));
+        return;
+    }
+    uv_timer_start(&(ruv->timer), riak_libuv_timeout_cb, remaining, 0);
+}
+
+/**
+ * @brief Called by libuv at the earliest deadline among outstanding operations
+ * @param timer Libuv timer handle
+ */
+void
+riak_libuv_timeout_cb(uv_timer_t *timer) {
+    riak_libuv *ruv = (riak_libuv*)timer->data;
+    if (ruv->err) {
+        return;
+    }
+    if (riak_pipeline_get_timeout(ruv->cxn) == 0) {
+        riak_libuv_fail(ruv, ERIAK_TIMEOUT);
+        return;
+    }
+    riak_libuv_arm_timeout(ruv);
+}
+
+/**
+ * @brief Called by libuv before each read; always lends the same buffer
+ * @param handle Libuv TCP handle
+ * @param suggested_size Ignored
+ * @param buf Buffer to read into (out)
+ */
+void
+riak_libuv_alloc_cb(uv_handle_t *handle,
+                    size_t       suggested_size,
+                    uv_buf_t    *buf) {
+    riak_libuv *ruv = (riak_libuv*)handle->data;
+    buf->base = ruv->read_buf;
+    buf->len  = RIAK_LIBUV_READ_BUFFER_SIZE;
+}
+
+/**
+ * @brief Copy out of the read being processed; 0 bytes once it is used up
+ */
+riak_ssize_t
+riak_libuv_read_cb(void       *ptr,
+                   void       *data,
+                   riak_size_t size) {
+    riak_libuv *ruv = (riak_libuv*)ptr;
+    if (size > ruv->in_len) {
+        size = ruv->in_len;
+    }
+    memcpy(data, ruv->in_data, size);
+    ruv->in_data += size;
+    ruv->in_len  -= size;
+    return size;
+}
+
+/**
+ * @brief Called by libuv with each read; answers as many pipelined operations as it can
+ * @param stream Libuv TCP handle
+ * @param nread Bytes read or a negative libuv error
+ * @param buf Buffer from riak_libuv_alloc_cb()
+ */
+void
+riak_libuv_result_cb(uv_stream_t    *stream,
+                     ssize_t         nread,
+                     const uv_buf_t *buf) {
+    riak_libuv      *ruv = (riak_libuv*)stream->data;
+    riak_connection *cxn = ruv->cxn;
+    if (nread < 0) {
+        if (nread != UV_EOF) {
+            riak_log_error(cxn, "Read failed [%s]", uv_strerror((int)nread));
+        }
+        riak_libuv_fail(ruv, ERIAK_READ);
+        return;
+    }
+    ruv->in_data = (riak_uint8_t*)buf->base;
+    ruv->in_len  = nread;
+    riak_error err = riak_pipeline_read(cxn, riak_libuv_read_cb, (void*)ruv);
+    if (err == ERIAK_OK && ruv->in_len > 0) {
+        riak_log_error(cxn, "Received %d bytes nobody asked for", (int)ruv->in_len);
+        err = ERIAK_READ;
+    }
+    ruv->in_len = 0;
+    if (err) {
+        riak_libuv_fail(ruv, err);
+        return;
+    }
+    riak_libuv_arm_timeout(ruv);
+}
+
+void
+riak_libuv_write_done_cb(uv_write_t *req,
+                         int         status);
+
+/**
+ * @brief Write everything queued, unless a write is already in flight
+ * @param ruv Riak Libuv Event
+ * @returns Error code
+ */
+riak_error
+riak_libuv_flush(riak_libuv *ruv) {
+    if (ruv->writing || ruv->out_len == 0) {
+        return ERIAK_OK;
+    }
+    // Swap buffers so new requests never move memory libuv is writing
+    riak_uint8_t *buf      = ruv->write_buf;
+    riak_size_t   capacity = ruv->write_capacity;
+    ruv->write_buf      = ruv->out_buf;
+    ruv->write_capacity = ruv->out_capacity;
+    ruv->out_buf        = buf;
+    ruv->out_capacity   = capacity;
+
+    uv_buf_t wbuf = uv_buf_init((char*)ruv->write_buf, (unsigned int)ruv->out_len);
+    ruv->out_len = 0;
+    int result = uv_write(&(ruv->write_req), (uv_stream_t*)&(ruv->tcp), &wbuf, 1, riak_libuv_write_done_cb);
+    if (result < 0) {
+        riak_log_error(ruv->cxn, "Write failed [%s]", uv_strerror(result));
+        return ERIAK_WRITE;
+    }
+    ruv->writing = RIAK_TRUE;
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Called by libuv when a write completes; sends whatever queued up meanwhile
+ * @param req Libuv write request
+ * @param status 0 or a negative libuv error
+ */
+void
+riak_libuv_write_done_cb(uv_write_t *req,
+                         int         status) {
+    riak_libuv *ruv = (riak_libuv*)req->data;
+    ruv->writing = RIAK_FALSE;
+    if (ruv->err) {
+        return;
+    }
+    riak_error err = ERIAK_OK;
+    if (status < 0) {
+        riak_log_error(ruv->cxn, "Write failed [%s]", uv_strerror(status));
+        err = ERIAK_WRITE;
+    } else {
+        err = riak_libuv_flush(ruv);
+    }
+    if (err) {
+        riak_libuv_fail(ruv, err);
+    }
+}
+
+/**
+ * @brief Append part of a framed request to the output buffer
+ * @returns `size`, or 0 if out of memory
+ */
+riak_ssize_t
+riak_libuv_write_cb(void       *ptr,
+                    void       *data,
+                    riak_size_t size) {
+    riak_libuv *ruv = (riak_libuv*)ptr;
+    if (ruv->out_len + size > ruv->out_capacity) {
+        riak_size_t capacity = (ruv->out_capacity > 0) ? ruv->out_capacity : 4096;
+        while (capacity < ruv->out_len + size) {
+            capacity *= 2;
+        }
+        riak_uint8_t *grown = (riak_uint8_t*)riak_config_allocate(ruv->config, capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        if (ruv->out_len > 0) {
+            memcpy(grown, ruv->out_buf, ruv->out_len);
+        }
+        riak_free(ruv->config, &(ruv->out_buf));
+        ruv->out_buf      = grown;
+        ruv->out_capacity = capacity;
+    }
+    memcpy(ruv->out_buf + ruv->out_len, data, size);
+    ruv->out_len += size;
+    return size;
+}
+
+/**
+ * @brief Construct a Riak Libuv Event which pipelines operations over one connection
+ * @param ruv_target Riak Libuv Event (out)
+ * @param cxn Riak Connection; its socket is non-blocking until the event is freed
+ * @param loop Libuv loop
+ * @returns Error code
+ * @note Once `ruv_target` is set it must be released with riak_libuv_free(), even on error
+ * @note Failed requests are not retried, whatever riak_config_set_retry_policy()
+ *       allows: a broken socket fails every outstanding operation. To retry,
+ *       riak_pipeline_rewind(), riak_connection_reopen() and riak_pipeline_resend()
+ *       onto a new Riak Libuv Event, as riak_epoll does
+ */
+riak_error
+riak_libuv_new(riak_libuv     **ruv_target,
+               riak_connection *cxn,
+               uv_loop_t       *loop) {
+    riak_config  *cfg = riak_connection_get_config(cxn);
+    riak_socket_t fd  = riak_connection_get_fd(cxn);
+
+    riak_libuv *ruv = (riak_libuv*)riak_config_clean_allocate(cfg, sizeof(riak_libuv));
+    if (ruv == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_libuv");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    ruv->read_buf = (char*)riak_config_allocate(cfg, RIAK_LIBUV_READ_BUFFER_SIZE);
+    if (ruv->read_buf == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_libuv read buffer");
+        riak_free(cfg, &ruv);
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    ruv->loop     = loop;
+    ruv->cxn      = cxn;
+    ruv->config   = cfg;
+    ruv->fd_flags = fcntl(fd, F_GETFL, 0);
+
+    // Libuv closes what it wraps, so give it a duplicate and let the connection keep its own
+    int dup_fd = dup(fd);
+    if (dup_fd < 0) {
+        riak_log_critical_config(cfg, "Could not duplicate socket [fd %d]", fd);
+        riak_free(cfg, &(ruv->read_buf));
+        riak_free(cfg, &ruv);
+        return ERIAK_EVENT;
+    }
+    uv_tcp_init(loop, &(ruv->tcp));
+    uv_timer_init(loop, &(ruv->timer));
+    ruv->tcp.data       = ruv;
+    ruv->timer.data     = ruv;
+    ruv->write_req.data = ruv;
+    ruv->open_handles   = 2;
+    int result = uv_tcp_open(&(ruv->tcp), dup_fd);
+    if (result == 0) {
+        uv_tcp_nodelay(&(ruv->tcp), 1);
+        result = uv_read_start((uv_stream_t*)&(ruv->tcp), riak_libuv_alloc_cb, riak_libuv_result_cb);
+    } else {
+        // Not wrapped, so closing the handle would leave the duplicate open
+        close(dup_fd);
+    }
+    if (result < 0) {
+        riak_log_critical_config(cfg, "Could not attach socket to libuv [fd %d, %s]", fd, uv_strerror(result));
+        riak_libuv_fail(ruv, ERIAK_EVENT);
+    }
+    *ruv_target = ruv;
+
+    return ruv->err;
+}
+
+/**
+ * @brief Called by libuv as each handle is closed; releases the event after the last
+ * @param handle Libuv TCP or timer handle
+ */
+void
+riak_libuv_close_cb(uv_handle_t *handle) {
+    riak_libuv  *ruv = (riak_libuv*)handle->data;
+    riak_config *cfg = ruv->config;
+    if (--(ruv->open_handles) > 0) {
+        return;
+    }
+    riak_free(cfg, &(ruv->read_buf));
+    riak_free(cfg, &(ruv->out_buf));
+    riak_free(cfg, &(ruv->write_buf));
+    riak_free(cfg, &ruv);
+}
+
+/**
+ * @brief Free a Riak Libuv Event, dropping outstanding operations
+ * @param ruv_target Riak Libuv Event (NULLed on return)
+ * @note Memory is released from the loop once libuv has closed the handle
+ */
+void
+riak_libuv_free(riak_libuv **ruv_target) {
+    if (ruv_target == NULL || *ruv_target == NULL) {
+        return;
+    }
+    riak_libuv *ruv = *ruv_target;
+    riak_libuv_fail(ruv, ERIAK_EVENT);
+    if (ruv->fd_flags >= 0) {
+        fcntl(riak_connection_get_fd(ruv->cxn), F_SETFL, ruv->fd_flags);
+    }
+    uv_close((uv_handle_t*)&(ruv->tcp), riak_libuv_close_cb);
+    uv_close((uv_handle_t*)&(ruv->timer), riak_libuv_close_cb);
+    *ruv_target = NULL;
+}
+
+/**
+ * @brief Why the event gave up on its connection
+ * @param ruv Riak Libuv Event
+ * @returns ERIAK_OK while the connection is usable
+ */
+riak_error
+riak_libuv_get_error(riak_libuv *ruv) {
+    return ruv->err;
+}
+
+/**
+ * @brief Send an asynchronous message without waiting for earlier responses
+ * @param rop Riak Operation (owned by the connection until it is answered)
+ * @param ruv Riak Libuv Event
+ * @returns Error code; `rop` still belongs to the caller unless ERIAK_OK
+ * @note Requests sent while a write is in flight go out together in the next one;
+ *       an operation outliving its deadline fails the connection with ERIAK_TIMEOUT
+ */
+riak_error
+riak_libuv_send(riak_operation *rop,
+                riak_libuv     *ruv) {
+    if (ruv->err) {
+        return ruv->err;
+    }
+    riak_error err = riak_pipeline_queue(rop, riak_libuv_write_cb, (void*)ruv, &(ruv->out_len));
+    if (err) {
+        return err;
+    }
+    // Once queued, a failure reaches this operation through its abandon callback
+    err = riak_libuv_flush(ruv);
+    if (err) {
+        riak_libuv_fail(ruv, err);
+        return ERIAK_OK;
+    }
+    riak_libuv_arm_timeout(ruv);
+    return ERIAK_OK;
+}
+
+#ifdef __cplusplus
+}
+#endif
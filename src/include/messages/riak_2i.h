@@ -30,6 +30,8 @@ extern "C" {
 typedef struct _riak_2i_response riak_2i_response;
 typedef struct _riak_2i_options riak_2i_options;
 typedef void (*riak_2i_response_callback)(riak_2i_response *response, void *ptr);
+// Chunk, its keys and its results are borrowed: valid only until the callback returns
+typedef void (*riak_2i_stream_callback)(riak_2i_response *chunk, void *ptr);
 
 /**
  * @brief Free Secondary Index response
@@ -29,6 +29,8 @@ extern "C" {
 
 typedef struct _riak_listkeys_response riak_listkeys_response;
 typedef void (*riak_listkeys_response_callback)(riak_listkeys_response *response, void *ptr);
+// Chunk and its keys are borrowed: valid only until the callback returns
+typedef void (*riak_listkeys_stream_callback)(riak_listkeys_response *chunk, void *ptr);
 
 /**
  * @brief Print a summary of a `riak_listkeys_response`
@@ -31,19 +31,29 @@
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include "riak_types.h"
 #include "riak_log_config.h"
 #include "riak_error.h"
 #include "riak_config.h"
+#include "riak_metrics.h"
 #include "riak_binary.h"
+#include "riak_trace.h"
 #include "riak_connection.h"
+#include "riak_connection_pool.h"
+#include "riak_cluster.h"
 #include "riak_operation.h"
 #include "riak_print.h"
 #include "riak_object.h"
 #include "riak_bucketprops.h"
 #include "riak_messages.h"
+#include "riak_batch.h"
+#include "riak_hedge.h"
+#include "riak_completion_queue.h"
+#include "riak_timer_wheel.h"
 #include "riak_log.h"
+#include "riak_log_buffer.h"
 #include "riak_array.h"
 
 #ifdef __cplusplus
@@ -89,6 +99,25 @@ riak_get(riak_connection           *cxn,
          riak_get_options          *opts,
          riak_get_response        **response);
 
+/**
+ * @brief Synchronous Fetch request returning a view of the wire response
+ * @param cxn Riak Connection
+ * @param bucket_type Name of Riak bucket type
+ * @param bucket Name of Riak bucket
+ * @param key Name of Riak key
+ * @param opts Fetch options
+ * @param response Returned Fetched data; values, vclock and metadata point
+ *        into the received frame, which is released by riak_get_response_free
+ * @returns Error code
+ */
+riak_error
+riak_get_view(riak_connection           *cxn,
+              riak_binary               *bucket_type,
+              riak_binary               *bucket,
+              riak_binary               *key,
+              riak_get_options          *opts,
+              riak_get_response        **response);
+
 /**
  * @brief Synchronous Store request
  * @param cxn Riak Connection
@@ -145,6 +174,25 @@ riak_listkeys(riak_connection         *cxn,
               riak_uint32_t            timeout,
               riak_listkeys_response **repsonse);
 
+/**
+ * @brief List all of the keys in a bucket, one chunk at a time
+ * @param cxn Riak Connection
+ * @param bucket_type Name of bucket type
+ * @param bucket Name of bucket
+ * @param timeout How long to wait for a response
+ * @param cb Called with each chunk of keys; the chunk is freed on return,
+ *        so memory stays bounded no matter how large the bucket is
+ * @param cb_data Pointer passed to `cb` when it is called
+ * @return Error code
+ */
+riak_error
+riak_listkeys_stream(riak_connection              *cxn,
+                     riak_binary                  *bucket_type,
+                     riak_binary                  *bucket,
+                     riak_uint32_t                 timeout,
+                     riak_listkeys_stream_callback cb,
+                     void                         *cb_data);
+
 /**
  * @brief Synchronous setting of client ID request
  * @param cxn Riak Connection
@@ -222,6 +270,27 @@ riak_2i(riak_connection       *cxn,
             riak_2i_options   *opts,
             riak_2i_response **response);
 
+/**
+ * @brief Query using Secondary Index, one chunk at a time
+ * @param cxn Riak Connection
+ * @param bucket_type Name of bucket type
+ * @param bucket Name of bucket
+ * @param index Name of Secondary Index
+ * @param opts Secondary Index options
+ * @param cb Called with each chunk of keys or results; the chunk is freed on return
+ * @param cb_data Pointer passed to `cb` when it is called
+ * @param response Returned completion status and continuation (optional)
+ * @return Error code */
+riak_error
+riak_2i_stream(riak_connection        *cxn,
+               riak_binary            *bucket_type,
+               riak_binary            *bucket,
+               riak_binary            *index,
+               riak_2i_options        *opts,
+               riak_2i_stream_callback cb,
+               void                   *cb_data,
+               riak_2i_response      **response);
+
 /**
  * @brief Synchronous Map/Reduce request
  * @param cxn Riak Connection
@@ -277,6 +346,14 @@ riak_async_register_get(riak_operation        *rop,
                         riak_get_options      *get_options,
                         riak_response_callback cb);
 
+riak_error
+riak_async_register_get_view(riak_operation        *rop,
+                             riak_binary           *bucket_type,
+                             riak_binary           *bucket,
+                             riak_binary           *key,
+                             riak_get_options      *get_options,
+                             riak_response_callback cb);
+
 riak_error
 riak_async_register_put(riak_operation        *rop,
                         riak_object           *riak_obj,
@@ -303,6 +380,15 @@ riak_async_register_listkeys(riak_operation        *rop,
                              riak_uint32_t          timeout,
                              riak_response_callback cb );
 
+riak_error
+riak_async_register_listkeys_stream(riak_operation               *rop,
+                                    riak_binary                  *bucket_type,
+                                    riak_binary                  *bucket,
+                                    riak_uint32_t                 timeout,
+                                    riak_listkeys_stream_callback stream_cb,
+                                    void                         *stream_data,
+                                    riak_response_callback        cb);
+
 riak_error
 riak_async_register_get_clientid(riak_operation        *rop,
                                  riak_response_callback cb);
@@ -362,6 +448,27 @@ riak_async_register_2i(riak_operation        *rop,
                            riak_2i_options   *index_options,
                            riak_response_callback cb);
 
+/**
+ * @brief Register an asynchronous Secondary Index job delivering each chunk
+ * @param rop Riak Operation
+ * @param bucket Riak bucket name
+ * @param index Riak Secondary Index name
+ * @param index_options Optional parameters to tweak the 2i query
+ * @param stream_cb Called with each chunk; the chunk is freed on return
+ * @param stream_data Pointer passed to `stream_cb`
+ * @param cb User-defined callback for the final status and continuation
+ * @returns Error Code
+ */
+riak_error
+riak_async_register_2i_stream(riak_operation         *rop,
+                              riak_binary            *bucket_type,
+                              riak_binary            *bucket,
+                              riak_binary            *index,
+                              riak_2i_options        *index_options,
+                              riak_2i_stream_callback stream_cb,
+                              void                   *stream_data,
+                              riak_response_callback  cb);
+
 /**
  * @brief Register an asynchronous Riak Search job
  * @param rop Riak Operation
@@ -394,11 +501,263 @@ riak_read(riak_operation   *rop,
           riak_io_cb        read_cb,
           void             *read_cb_data);
 
+/**
+ * @brief Read through the connection's receive buffer, decoding every
+ *        complete frame it holds before asking `read_cb` for more
+ * @param rop Riak Operation
+ * @param done_streaming Set when the operation expects no further frames
+ * @param read_cb Function used to pull bytes off the wire
+ * @param read_cb_data User data passed to `read_cb`
+ * @returns Error code
+ * @note Bytes past the end of this operation's response stay buffered
+ *       for the next operation on the connection
+ */
+riak_error
+riak_read_buffered(riak_operation *rop,
+                   riak_boolean_t *done_streaming,
+                   riak_io_cb      read_cb,
+                   void           *read_cb_data);
+
+/**
+ * @brief Frame a request and hand header and body to `write_cb`
+ * @param rop Riak Operation with an encoded request
+ * @param write_cb Function used to put bytes on the wire
+ * @param write_cb_data User data passed to `write_cb`
+ * @returns Error code
+ * @note Starts the clock on the operation's timeout; see riak_operation_get_timeout()
+ */
 riak_error
 riak_write(riak_operation *rop,
            riak_io_cb      write_cb,
            void           *write_cb_data);
 
+/**
+  @param ptr Private data for user
+  @param iov Array of buffers to be written in order
+  @param iovcnt Number of entries in `iov`
+  @returns The Number of bytes written (may be short), or <= 0 on failure
+ */
+typedef riak_ssize_t (*riak_iov_cb)(void         *ptr,
+                                    struct iovec *iov,
+                                    int           iovcnt);
+
+// Most operations framed into a single gathered write
+#define RIAK_WRITEV_MAX_OPS 64
+
+/**
+ * @brief Frame a request and hand header and body to one gathered write
+ * @param rop Riak Operation with an encoded request
+ * @param writev_cb Function used to put buffers on the wire
+ * @param writev_cb_data User data passed to `writev_cb`
+ * @returns Error code
+ * @note Short writes are resumed until the whole frame is sent
+ */
+riak_error
+riak_writev(riak_operation *rop,
+            riak_iov_cb     writev_cb,
+            void           *writev_cb_data);
+
+/**
+ * @brief Frame many requests into as few gathered writes as possible
+ * @param rops Riak Operations with encoded requests
+ * @param n_rops Number of operations
+ * @param writev_cb Function used to put buffers on the wire
+ * @param writev_cb_data User data passed to `writev_cb`
+ * @returns Error code; on failure any number of the frames may already have been sent
+ */
+riak_error
+riak_writev_batch(riak_operation **rops,
+                  riak_uint32_t    n_rops,
+                  riak_iov_cb      writev_cb,
+                  void            *writev_cb_data);
+
+//
+// Pipelining
+//
+
+/**
+ * @brief Write a request without waiting for earlier responses
+ * @param rop Riak Operation with an encoded request
+ * @param write_cb Function used to put bytes on the wire
+ * @param write_cb_data User data passed to `write_cb`
+ * @returns Error code
+ * @note The connection takes ownership of `rop` and frees it once its
+ *       response (or server error) has been delivered to its callbacks
+ */
+riak_error
+riak_pipeline_send(riak_operation *rop,
+                   riak_io_cb      write_cb,
+                   void           *write_cb_data);
+
+/**
+ * @brief Decode as many pipelined responses as the available bytes allow
+ * @param cxn Riak Connection
+ * @param read_cb Function used to pull bytes off the wire
+ * @param read_cb_data User data passed to `read_cb`
+ * @returns Error code; on anything but ERIAK_OK the stream is out of step
+ *          and riak_pipeline_reset() should be called before closing
+ * @note Each frame is handed to the oldest outstanding operation, since
+ *       Riak answers requests on one socket in the order they were sent
+ */
+riak_error
+riak_pipeline_read(riak_connection *cxn,
+                   riak_io_cb       read_cb,
+                   void            *read_cb_data);
+
+/**
+ * @brief Blocking riak_pipeline_send() on the connection's socket
+ * @param rop Riak Operation with an encoded request
+ * @returns Error code
+ * @note Ownership is as for riak_pipeline_send_batch()
+ */
+riak_error
+riak_pipeline_sync_send(riak_operation *rop);
+
+/**
+ * @brief Write a batch of requests with gathered writes and queue them all
+ * @param rops Riak Operations with encoded requests, all on one connection
+ * @param n_rops Number of operations
+ * @param writev_cb Function used to put buffers on the wire
+ * @param writev_cb_data User data passed to `writev_cb`
+ * @returns Error code
+ * @note On success the connection takes ownership of every operation in `rops`.
+ *       On error none is queued and all remain the caller's to free, while the
+ *       connection is marked stale, since part of the batch may be on the wire
+ */
+riak_error
+riak_pipeline_send_batch(riak_operation **rops,
+                         riak_uint32_t    n_rops,
+                         riak_iov_cb      writev_cb,
+                         void            *writev_cb_data);
+
+/**
+ * @brief Blocking riak_pipeline_send_batch() on the connection's socket
+ * @param rops Riak Operations with encoded requests, all on one connection
+ * @param n_rops Number of operations
+ * @returns Error code
+ * @note Ownership is as for riak_pipeline_send_batch()
+ */
+riak_error
+riak_pipeline_sync_send_batch(riak_operation **rops,
+                              riak_uint32_t    n_rops);
+
+/**
+ * @brief Block until every pipelined operation has been answered
+ * @param cxn Riak Connection
+ * @returns Error code; ERIAK_TIMEOUT if an operation's deadline passed, or
+ *          ERIAK_READ if the server hung up, in either case after every
+ *          outstanding operation has been failed and the connection marked stale
+ * @note If the server hangs up, outstanding operations are retried as
+ *       riak_config_set_retry_policy() allows, and only the rest are failed
+ */
+riak_error
+riak_pipeline_sync_wait(riak_connection *cxn);
+
+/**
+ * @brief Number of operations written but not yet answered
+ * @param cxn Riak Connection
+ * @returns Pipeline depth
+ */
+riak_uint32_t
+riak_pipeline_get_depth(riak_connection *cxn);
+
+/**
+ * @brief Time until the earliest deadline among outstanding operations
+ * @param cxn Riak Connection
+ * @returns Milliseconds remaining, 0 once a deadline has passed (the caller
+ *          should riak_pipeline_fail() with ERIAK_TIMEOUT), or -1 if no
+ *          outstanding operation has a timeout
+ */
+int
+riak_pipeline_get_timeout(riak_connection *cxn);
+
+/**
+ * @brief Discard every outstanding operation without calling back
+ * @param cxn Riak Connection
+ * @returns Number of operations discarded
+ */
+riak_uint32_t
+riak_pipeline_reset(riak_connection *cxn);
+
+/**
+ * @brief Discard every outstanding operation, telling each abandon callback why
+ * @param cxn Riak Connection
+ * @param err Reason passed to riak_operation_set_abandon_cb() callbacks
+ * @returns Number of operations discarded
+ */
+riak_uint32_t
+riak_pipeline_fail(riak_connection *cxn,
+                   riak_error       err);
+
+/**
+ * @brief riak_pipeline_fail() on behalf of an event loop, logging what is dropped
+ * @param cxn Riak Connection
+ * @param err Reason; responses arrive in order, so on ERIAK_TIMEOUT everything
+ *        behind the late operation is late too
+ * @returns Number of operations discarded
+ */
+riak_uint32_t
+riak_pipeline_drop(riak_connection *cxn,
+                   riak_error       err);
+
+/**
+ * @brief riak_pipeline_send() into an event loop's output buffer
+ * @param rop Riak Operation with an encoded request
+ * @param write_cb Function which appends bytes to the buffer
+ * @param write_cb_data User data passed to `write_cb`
+ * @param buffered End of the buffered bytes, which `write_cb` advances (in/out)
+ * @returns Error code; `rop` still belongs to the caller unless ERIAK_OK
+ * @note On error `buffered` is put back, forgetting any half-queued frame,
+ *       so the stream stays in step
+ */
+riak_error
+riak_pipeline_queue(riak_operation *rop,
+                    riak_io_cb      write_cb,
+                    void           *write_cb_data,
+                    riak_size_t    *buffered);
+
+/**
+ * @brief Reopen a failed connection and resend the operations that may be retried
+ * @param cxn Riak Connection whose stream broke
+ * @param err Reason, passed to the abandon callbacks of operations not retried
+ * @returns ERIAK_OK once every retried operation is back on the wire; otherwise
+ *          the error every outstanding operation has been failed with
+ * @note Operations are resent, in order and without being encoded again, after
+ *       the backoff set by riak_config_set_retry_policy(). Blocking writes are
+ *       used on the new socket, which an event loop must start watching.
+ */
+riak_error
+riak_pipeline_retry(riak_connection *cxn,
+                    riak_error       err);
+
+/**
+ * @brief Prepare a failed connection's operations to be retried, without blocking
+ * @param cxn Riak Connection whose stream broke
+ * @param err Reason, passed to the abandon callbacks of operations not retried
+ * @param backoff_usecs How long to wait before reopening the connection (out)
+ * @returns Number of operations kept, in order, on the pipeline
+ * @note For event loops: wait out the backoff on a timer, call riak_connection_reopen(),
+ *       then riak_pipeline_resend() once the new socket is writable. Each rewind uses
+ *       up a try, so a node which stays down is eventually given up on.
+ */
+riak_uint32_t
+riak_pipeline_rewind(riak_connection *cxn,
+                     riak_error       err,
+                     riak_uint64_t   *backoff_usecs);
+
+/**
+ * @brief Frame every outstanding operation again for a reopened connection
+ * @param cxn Riak Connection
+ * @param write_cb Function which queues or writes the frames
+ * @param write_cb_data User data passed to `write_cb`
+ * @returns Error code; the operations stay on the pipeline either way
+ * @note Deadlines restart from now
+ */
+riak_error
+riak_pipeline_resend(riak_connection *cxn,
+                     riak_io_cb       write_cb,
+                     void            *write_cb_data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -61,11 +61,41 @@ riak_libevent_free(riak_config    *cfg,
  * @param Riak Operation
  * @param Riak Libevent Event
  * @returns Error Code
+ * @note If the operation has a timeout and is not answered in time, or the
+ *       server hangs up first, its error callback is called with a NULL
+ *       response and riak_operation_get_error() says why
  */
 riak_error
 riak_libevent_send(riak_operation *rop,
                     riak_libevent *rev);
 
+/**
+ * @brief Create a Libevent Event which pipelines operations over one connection
+ * @param Resulting Riak Libevent Event
+ * @param Riak Connection
+ * @param Libevent Event Base
+ * @returns Error Code
+ */
+riak_error
+riak_libevent_pipeline_new(riak_libevent    **rev,
+                           riak_connection   *cxn,
+                           struct event_base *base);
+
+/**
+ * @brief Send an asynchronous message without waiting for earlier responses
+ * @param Riak Operation (owned by the connection until it is answered)
+ * @param Riak Libevent Event from riak_libevent_pipeline_new()
+ * @returns Error Code; the operation still belongs to the caller unless ERIAK_OK
+ * @note When the server hangs up or sends something unreadable, operations which
+ *       riak_config_set_retry_policy() allows are resent on a reopened socket after
+ *       the backoff, and sends in the meantime queue behind them. Otherwise, or once
+ *       an operation's deadline passes, every outstanding operation is abandoned and
+ *       the bufferevent is freed. Later sends return that first error.
+ */
+riak_error
+riak_libevent_pipeline_send(riak_operation *rop,
+                            riak_libevent  *rev);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,148 @@
+/*********************************************************************
+ *
+ * riak_batch.h: Pipelined fan-out of many requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_BATCH_H
+#define _RIAK_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Requests kept in flight per connection when no window is given
+#define RIAK_BATCH_DEFAULT_WINDOW 32
+
+// One key of a riak_multiget() batch
+typedef struct _riak_multiget_item {
+    riak_binary       *bucket_type; // NULL for the default bucket type
+    riak_binary       *bucket;
+    riak_binary       *key;
+    riak_error         err;         // ERIAK_OK, ERIAK_SERVER_ERROR or the connection's error (out)
+    riak_get_response *response;    // Fetched data; caller frees with riak_get_response_free (out)
+} riak_multiget_item;
+
+typedef void (*riak_multiget_callback)(riak_multiget_item *item, riak_uint32_t index, void *ptr);
+
+// One object of a riak_multiput() batch
+typedef struct _riak_multiput_item {
+    riak_object       *object;
+    riak_error         err;      // ERIAK_OK, ERIAK_SERVER_ERROR or the connection's error (out)
+    riak_put_response *response; // Vclock, key and body; caller frees with riak_put_response_free (out)
+} riak_multiput_item;
+
+typedef void (*riak_multiput_callback)(riak_multiput_item *item, riak_uint32_t index, void *ptr);
+
+/**
+ * @brief Fetch many keys by pipelining requests over one connection
+ * @param cxn Riak Connection
+ * @param items Keys to fetch; results are written back in input order
+ * @param n_items Number of items
+ * @param opts Fetch options shared by every key (may be NULL)
+ * @param window Most requests in flight at once (0 for RIAK_BATCH_DEFAULT_WINDOW)
+ * @param cb Called with each item as soon as it completes (may be NULL)
+ * @param cb_data Pointer passed to `cb` when it is called
+ * @returns ERIAK_OK once every key has been answered, even if some answers
+ *          were server errors; otherwise the connection-level error, which
+ *          is also stored in each unanswered item
+ */
+riak_error
+riak_multiget(riak_connection       *cxn,
+              riak_multiget_item    *items,
+              riak_uint32_t          n_items,
+              riak_get_options      *opts,
+              riak_uint32_t          window,
+              riak_multiget_callback cb,
+              void                  *cb_data);
+
+/**
+ * @brief Fetch many keys spread over several pooled, pipelined connections
+ * @param pool Riak Connection Pool
+ * @param max_connections Most connections to borrow from `pool`
+ * @param items Keys to fetch; results are written back in input order
+ * @param n_items Number of items
+ * @param opts Fetch options shared by every key (may be NULL)
+ * @param window Most requests in flight per connection (0 for RIAK_BATCH_DEFAULT_WINDOW)
+ * @param cb Called with each item as soon as it completes (may be NULL)
+ * @param cb_data Pointer passed to `cb` when it is called
+ * @returns As riak_multiget(); keys on a failed connection move to the others
+ *          only if they had not been sent yet
+ */
+riak_error
+riak_multiget_pool(riak_connection_pool  *pool,
+                   riak_uint32_t          max_connections,
+                   riak_multiget_item    *items,
+                   riak_uint32_t          n_items,
+                   riak_get_options      *opts,
+                   riak_uint32_t          window,
+                   riak_multiget_callback cb,
+                   void                  *cb_data);
+
+/**
+ * @brief Store many objects by pipelining requests over one connection
+ * @param cxn Riak Connection
+ * @param items Objects to store; outcomes are written back in input order
+ * @param n_items Number of items
+ * @param opts Store options shared by every object (may be NULL)
+ * @param window Most requests in flight at once (0 for RIAK_BATCH_DEFAULT_WINDOW)
+ * @param cb Called with each item as soon as it completes (may be NULL)
+ * @param cb_data Pointer passed to `cb` when it is called
+ * @returns ERIAK_OK once every object has been answered, even if some answers
+ *          were server errors; otherwise the connection-level error, which
+ *          is also stored in each unanswered item
+ * @note Requests are encoded just ahead of being written, so at most
+ *       `window` encoded requests exist at any time
+ */
+riak_error
+riak_multiput(riak_connection       *cxn,
+              riak_multiput_item    *items,
+              riak_uint32_t          n_items,
+              riak_put_options      *opts,
+              riak_uint32_t          window,
+              riak_multiput_callback cb,
+              void                  *cb_data);
+
+/**
+ * @brief Store many objects spread over several pooled, pipelined connections
+ * @param pool Riak Connection Pool
+ * @param max_connections Most connections to borrow from `pool`
+ * @param items Objects to store; outcomes are written back in input order
+ * @param n_items Number of items
+ * @param opts Store options shared by every object (may be NULL)
+ * @param window Most requests in flight per connection (0 for RIAK_BATCH_DEFAULT_WINDOW)
+ * @param cb Called with each item as soon as it completes (may be NULL)
+ * @param cb_data Pointer passed to `cb` when it is called
+ * @returns As riak_multiput()
+ */
+riak_error
+riak_multiput_pool(riak_connection_pool  *pool,
+                   riak_uint32_t          max_connections,
+                   riak_multiput_item    *items,
+                   riak_uint32_t          n_items,
+                   riak_put_options      *opts,
+                   riak_uint32_t          window,
+                   riak_multiput_callback cb,
+                   void                  *cb_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_BATCH_H
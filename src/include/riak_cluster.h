@@ -0,0 +1,144 @@
+/*********************************************************************
+ *
+ * riak_cluster.h: Load-balanced access to a ring of Riak nodes
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_CLUSTER_H
+#define _RIAK_CLUSTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _riak_cluster riak_cluster;
+
+// How the next node is picked for an operation
+typedef enum {
+    /** each node in turn */                    RIAK_CLUSTER_ROUND_ROBIN,
+    /** fewest checked-out connections */        RIAK_CLUSTER_LEAST_OUTSTANDING,
+    /** lowest moving-average latency x load */  RIAK_CLUSTER_LATENCY_WEIGHTED
+} riak_cluster_policy;
+
+// Default time a failed node is left alone before it may be probed
+#define RIAK_CLUSTER_DEFAULT_RETRY_MSECS 5000
+
+/**
+ * @brief Construct an empty Riak cluster
+ * @param cfg Riak Configuration
+ * @param cluster Riak Cluster (out)
+ * @param policy Load balancing policy
+ * @returns Error code
+ */
+riak_error
+riak_cluster_new(riak_config         *cfg,
+                 riak_cluster       **cluster,
+                 riak_cluster_policy  policy);
+
+/**
+ * @brief Add a node (and its own connection pool) to the cluster
+ * @param cluster Riak Cluster
+ * @param hostname Name of Riak server
+ * @param portnum Riak PBC port number
+ * @param resolver IP Address resolving function (NULL for default)
+ * @param min_connections Connections pre-opened to this node
+ * @param max_connections Upper bound on connections to this node
+ * @returns Error code
+ * @note Not thread-safe; add every node before the cluster is shared.
+ *       A node which cannot be reached yet is added in the down state.
+ */
+riak_error
+riak_cluster_add_node(riak_cluster      *cluster,
+                      const char        *hostname,
+                      const char        *portnum,
+                      riak_addr_resolver resolver,
+                      riak_uint32_t      min_connections,
+                      riak_uint32_t      max_connections);
+
+/**
+ * @brief Close every node's connections and release the cluster
+ * @param cluster Riak Cluster
+ */
+void
+riak_cluster_free(riak_cluster **cluster);
+
+/**
+ * @brief Borrow a connection to a healthy node chosen by the cluster's policy
+ * @param cluster Riak Cluster
+ * @param cxn Borrowed Riak Connection (out)
+ * @returns ERIAK_NO_NODES when no node is up or has a free connection
+ */
+riak_error
+riak_cluster_checkout(riak_cluster     *cluster,
+                      riak_connection **cxn);
+
+/**
+ * @brief Return a borrowed connection, recording its latency and health
+ * @param cluster Riak Cluster
+ * @param cxn Borrowed Riak Connection (NULLed on return)
+ * @param err Result of the last operation; connection-level failures
+ *        (ERIAK_CONNECT, ERIAK_READ or ERIAK_WRITE) mark the node down
+ * @note The latency recorded is the average time, from send to answer, of the
+ *       requests made while the connection was borrowed; time spent holding
+ *       it for anything else does not count against the node
+ */
+void
+riak_cluster_checkin(riak_cluster     *cluster,
+                     riak_connection **cxn,
+                     riak_error        err);
+
+/**
+ * @brief Ping every down node whose retry interval has elapsed
+ * @param cluster Riak Cluster
+ * @returns Number of nodes brought back up
+ * @note Call periodically, e.g. from a timer or a housekeeping thread
+ */
+riak_uint32_t
+riak_cluster_probe(riak_cluster *cluster);
+
+/**
+ * @brief Set how long a failed node is skipped before it is probed again
+ * @param cluster Riak Cluster
+ * @param msecs Retry interval in milliseconds
+ */
+void
+riak_cluster_set_retry_interval(riak_cluster *cluster,
+                                riak_uint32_t msecs);
+
+/**
+ * @brief Number of nodes in the cluster
+ * @param cluster Riak Cluster
+ * @returns Count of nodes
+ */
+riak_uint32_t
+riak_cluster_get_n_nodes(riak_cluster *cluster);
+
+/**
+ * @brief Number of nodes currently considered healthy
+ * @param cluster Riak Cluster
+ * @returns Count of nodes which are up
+ */
+riak_uint32_t
+riak_cluster_get_n_up(riak_cluster *cluster);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_CLUSTER_H
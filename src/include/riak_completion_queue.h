@@ -0,0 +1,133 @@
+/*********************************************************************
+ *
+ * riak_completion_queue.h: Submit operations from any thread and harvest their results
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_COMPLETION_QUEUE_H
+#define _RIAK_COMPLETION_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _riak_completion_queue riak_completion_queue;
+
+// One finished operation
+typedef struct _riak_completion {
+    void       *tag;      // As given to riak_completion_queue_submit()
+    riak_error  err;      // ERIAK_OK, ERIAK_SERVER_ERROR or why the operation was dropped
+    void       *response; // Decoded response; caller frees with the matching riak_*_response_free. On
+                          // ERIAK_SERVER_ERROR a riak_server_error the caller frees with riak_server_error_free
+                          // (NULL if it could not be copied); NULL on any other error
+} riak_completion;
+
+/**
+ * @brief Put one operation on the wire, e.g. riak_epoll_send() or riak_libevent_pipeline_send()
+ * @param rop Riak Operation
+ * @param ptr User data given to riak_completion_queue_process()
+ * @returns Error code; on error `rop` still belongs to the caller
+ */
+typedef riak_error (*riak_completion_send_fn)(riak_operation *rop, void *ptr);
+
+/**
+ * @brief Construct a completion queue
+ * @param cq_target Riak Completion Queue (out)
+ * @param cfg Riak Configuration; its allocator must be thread-safe
+ * @returns Error code
+ */
+riak_error
+riak_completion_queue_new(riak_completion_queue **cq_target,
+                          riak_config            *cfg);
+
+/**
+ * @brief Free a completion queue, along with operations it has not sent yet
+ * @param cq_target Riak Completion Queue (NULLed on return)
+ * @note No submitted operation may still be in flight, and responses
+ *       of unharvested completions are not freed
+ */
+void
+riak_completion_queue_free(riak_completion_queue **cq_target);
+
+/**
+ * @brief Hand an encoded operation to the I/O thread; safe from any thread and lock-free
+ * @param cq Riak Completion Queue
+ * @param rop Riak Operation from one of the riak_async_register_* calls; its
+ *        callbacks are replaced and the queue owns it from here on
+ * @param tag Identifies the operation in its completion
+ * @returns Error code
+ */
+riak_error
+riak_completion_queue_submit(riak_completion_queue *cq,
+                             riak_operation        *rop,
+                             void                  *tag);
+
+/**
+ * @brief Called by the I/O thread on each pass of its loop: sends everything
+ *        submitted since the last call, then publishes every completion
+ *        gathered meanwhile with a single wakeup
+ * @param cq Riak Completion Queue
+ * @param send Function which puts an operation on the wire
+ * @param send_data User data passed to `send`
+ * @returns Number of operations sent
+ */
+riak_uint32_t
+riak_completion_queue_process(riak_completion_queue  *cq,
+                              riak_completion_send_fn send,
+                              void                   *send_data);
+
+/**
+ * @brief Descriptor which is readable while submissions wait for riak_completion_queue_process()
+ * @param cq Riak Completion Queue
+ * @returns File descriptor to watch from the I/O thread's loop
+ */
+int
+riak_completion_queue_get_fd(riak_completion_queue *cq);
+
+/**
+ * @brief Harvest finished operations without waiting
+ * @param cq Riak Completion Queue
+ * @param completions Filled in oldest first (out)
+ * @param max Room in `completions`
+ * @returns Number of completions harvested
+ */
+riak_uint32_t
+riak_completion_queue_poll(riak_completion_queue *cq,
+                           riak_completion       *completions,
+                           riak_uint32_t          max);
+
+/**
+ * @brief Harvest finished operations, waiting for at least one
+ * @param cq Riak Completion Queue
+ * @param completions Filled in oldest first (out)
+ * @param max Room in `completions`
+ * @param timeout_ms Longest wait in milliseconds (-1 waits indefinitely)
+ * @returns Number of completions harvested; 0 on timeout
+ */
+riak_uint32_t
+riak_completion_queue_wait(riak_completion_queue *cq,
+                           riak_completion       *completions,
+                           riak_uint32_t          max,
+                           int                    timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_COMPLETION_QUEUE_H
@@ -73,6 +73,41 @@ riak_config_set_logging(riak_config        *cfg,
                         riak_log_init_fn    log_init,
                         riak_log_cleanup_fn log_cleanup);
 
+/**
+ * @brief Drop log messages less severe than a level before they are formatted
+ * @param cfg Riak Configuration
+ * @param level Least severe level passed to the log function; RIAK_LOG_DEBUG by default
+ * @returns ERIAK_OUT_OF_RANGE for an unknown level
+ * @note Messages are only ever formatted once a log function is set with
+ *       riak_config_set_logging(). RIAK_LOG_MIN_LEVEL removes less severe
+ *       messages from the build altogether.
+ */
+riak_error
+riak_config_set_log_level(riak_config     *cfg,
+                          riak_log_level_t level);
+
+// Defaults applied by riak_config_set_retry_policy() when a delay of 0 is given
+#define RIAK_RETRY_DEFAULT_BASE_MSECS 50
+#define RIAK_RETRY_DEFAULT_MAX_MSECS  2000
+
+/**
+ * @brief Retry connects and requests which fail on the network
+ * @param cfg Riak Configuration
+ * @param max_attempts Tries including the first; 1 (the default) never retries
+ * @param base_delay_ms Longest wait before the first retry, doubled for each retry after
+ * @param max_delay_ms Cap on the wait before any one retry
+ * @returns ERIAK_OUT_OF_RANGE if `max_attempts` is 0
+ * @note Each wait is picked at random up to its backoff, so clients cut off
+ *       by the same node restart do not all reconnect at once. Only requests
+ *       which can safely be applied twice are resent, and only if nothing of
+ *       their response has been seen; a PUT without a vector clock never is.
+ */
+riak_error
+riak_config_set_retry_policy(riak_config  *cfg,
+                             riak_uint32_t max_attempts,
+                             riak_uint32_t base_delay_ms,
+                             riak_uint32_t max_delay_ms);
+
 /**
  * @brief Use the default allocator to claim some memory
  * @param cfg Riak Config
@@ -100,6 +135,40 @@ riak_config_clean_allocate(riak_config *cfg,
 void
 riak_config_free(riak_config **cfg);
 
+// Default size of each chunk claimed by an arena
+#define RIAK_ARENA_DEFAULT_BLOCK_SIZE 16384
+
+/**
+ * @brief Construct a Riak Configuration whose memory comes from an arena
+ * @param parent Riak Configuration supplying the arena's memory and logging
+ * @param cfg Arena Configuration (out)
+ * @param block_size Bytes claimed from `parent` at a time (0 for default)
+ * @returns Error code
+ * @note Everything allocated through the arena, including protocol buffer
+ *       unpacking, is released at once by riak_config_free() or
+ *       riak_config_arena_reset(); individual frees are no-ops. `parent` may
+ *       itself be an arena, in which case both draw on its allocator directly
+ */
+riak_error
+riak_config_new_arena(riak_config  *parent,
+                      riak_config **cfg,
+                      riak_size_t   block_size);
+
+/**
+ * @brief Release everything allocated from an arena, keeping one block for reuse
+ * @param cfg Arena Configuration
+ */
+void
+riak_config_arena_reset(riak_config *cfg);
+
+/**
+ * @brief Bytes handed out by an arena since it was created or last reset
+ * @param cfg Arena Configuration
+ * @returns Byte count (0 if `cfg` is not an arena)
+ */
+riak_size_t
+riak_config_arena_get_allocated(riak_config *cfg);
+
 /**
  * @brief Generic memory de-allocation function
  * @param cfg Riak Configuration
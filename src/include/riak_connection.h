@@ -37,6 +37,7 @@ typedef struct _riak_connection riak_connection;
  * @param portnum Riak PBC port number
  * @param resolver IP Address resolving function (NULL for default)
  * @returns Error code
+ * @note The connect is retried as riak_config_set_retry_policy() allows
  */
 riak_error
 riak_connection_new(riak_config       *cfg,
@@ -54,9 +55,81 @@ riak_connection_free(riak_connection** re);
 riak_socket_t
 riak_connection_get_fd(riak_connection *cxn);
 
+/**
+ * @brief Set the timeout given to operations subsequently created on this connection
+ * @param cxn Riak Connection
+ * @param timeout_ms Milliseconds allowed per operation (0 for no limit)
+ */
+void
+riak_connection_set_timeout(riak_connection *cxn,
+                            riak_uint32_t    timeout_ms);
+
+/**
+ * @brief Report whether a failure, such as a timeout, left the stream out of step
+ * @param cxn Riak Connection
+ * @returns True if the socket must be reopened before the connection is reused
+ */
+riak_boolean_t
+riak_connection_is_stale(riak_connection *cxn);
+
+/**
+ * @brief Close the socket and open a fresh one to the same address
+ * @param cxn Riak Connection
+ * @returns Error code
+ * @note Outstanding pipelined operations are failed with ERIAK_CONNECT;
+ *       synchronous calls reopen a stale connection automatically
+ */
+riak_error
+riak_connection_reconnect(riak_connection *cxn);
+
+/**
+ * @brief Close the socket and start connecting a fresh, non-blocking one to the same address
+ * @param cxn Riak Connection
+ * @returns Error code
+ * @note Unlike riak_connection_reconnect(), outstanding pipelined operations are kept,
+ *       ready for riak_pipeline_resend() once the new socket becomes writable
+ */
+riak_error
+riak_connection_reopen(riak_connection *cxn);
+
 riak_config*
 riak_connection_get_config(riak_connection *cxn);
 
+/**
+ * @brief Set where responses on this connection are decoded, e.g. an arena
+ * @param cxn Riak Connection
+ * @param cfg Riak Configuration (NULL to use the connection's own)
+ * @note Individual operations may override this with
+ *       riak_operation_set_response_config()
+ */
+void
+riak_connection_set_response_config(riak_connection *cxn,
+                                    riak_config     *cfg);
+
+/**
+ * @brief Return the Riak Configuration responses are decoded into by default
+ * @param cxn Riak Connection
+ * @returns Response configuration
+ */
+riak_config*
+riak_connection_get_response_config(riak_connection *cxn);
+
+// Receive buffer cache activity on one connection
+typedef struct _riak_buffer_stats {
+    riak_uint64_t heap_allocs; // Buffers that had to come from the allocator
+    riak_uint64_t reuses;      // Buffers served from the cache
+    riak_uint64_t heap_frees;  // Buffers handed back to the allocator
+} riak_buffer_stats;
+
+/**
+ * @brief Report how often receive buffers were reused rather than allocated
+ * @param cxn Riak Connection
+ * @param stats Copy of the connection's counters (out)
+ */
+void
+riak_connection_get_buffer_stats(riak_connection   *cxn,
+                                 riak_buffer_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
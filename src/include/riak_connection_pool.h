@@ -0,0 +1,121 @@
+/*********************************************************************
+ *
+ * riak_connection_pool.h: Pool of Riak Connections to a single node
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_CONNECTION_POOL_H
+#define _RIAK_CONNECTION_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _riak_connection_pool riak_connection_pool;
+
+/**
+ * @brief Construct a pool of connections to a single Riak node
+ * @param cfg Riak config for memory allocation
+ * @param pool Riak Connection Pool (out)
+ * @param hostname Name of Riak server
+ * @param portnum Riak PBC port number
+ * @param resolver IP Address resolving function (NULL for default)
+ * @param min_connections Number of connections opened up front and kept open
+ * @param max_connections Upper bound on the number of open connections
+ * @returns Error code
+ * @note The pool is returned even when opening the first `min_connections` fails
+ */
+riak_error
+riak_connection_pool_new(riak_config           *cfg,
+                         riak_connection_pool **pool,
+                         const char            *hostname,
+                         const char            *portnum,
+                         riak_addr_resolver     resolver,
+                         riak_uint32_t          min_connections,
+                         riak_uint32_t          max_connections);
+
+/**
+ * @brief Close every pooled connection and release the pool
+ * @param pool Riak Connection Pool
+ * @note All connections must have been checked back in first
+ */
+void
+riak_connection_pool_free(riak_connection_pool **pool);
+
+/**
+ * @brief Borrow a connection from the pool (thread-safe, lock-free)
+ * @param pool Riak Connection Pool
+ * @param cxn Borrowed Riak Connection (out)
+ * @returns ERIAK_POOL_EXHAUSTED if all `max_connections` are in use
+ */
+riak_error
+riak_connection_pool_checkout(riak_connection_pool *pool,
+                              riak_connection     **cxn);
+
+/**
+ * @brief Return a borrowed connection to the pool (thread-safe, lock-free)
+ * @param pool Riak Connection Pool
+ * @param cxn Borrowed Riak Connection (NULLed on return)
+ * @param err Result of the last operation on `cxn`; on a connection-level
+ *        failure (ERIAK_CONNECT, ERIAK_READ, ERIAK_WRITE or ERIAK_TIMEOUT),
+ *        or if the connection is otherwise stale, the socket is closed and
+ *        evicted from the pool instead
+ */
+void
+riak_connection_pool_checkin(riak_connection_pool *pool,
+                             riak_connection     **cxn,
+                             riak_error            err);
+
+/**
+ * @brief Close idle connections until only `min_connections` remain open
+ * @param pool Riak Connection Pool
+ * @returns Number of connections closed
+ */
+riak_uint32_t
+riak_connection_pool_shrink(riak_connection_pool *pool);
+
+/**
+ * @brief Number of open connections (idle or checked out)
+ * @param pool Riak Connection Pool
+ * @returns Count of open connections
+ */
+riak_uint32_t
+riak_connection_pool_get_n_open(riak_connection_pool *pool);
+
+/**
+ * @brief Number of open connections currently checked out
+ * @param pool Riak Connection Pool
+ * @returns Count of busy connections
+ */
+riak_uint32_t
+riak_connection_pool_get_n_busy(riak_connection_pool *pool);
+
+/**
+ * @brief Find the pool a connection was borrowed from
+ * @param cxn Riak Connection
+ * @returns Owning pool or NULL for a stand-alone connection
+ */
+riak_connection_pool*
+riak_connection_get_pool(riak_connection *cxn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_CONNECTION_POOL_H
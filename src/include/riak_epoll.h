@@ -0,0 +1,128 @@
+/*********************************************************************
+ *
+ * riak_epoll.h: Native Linux epoll reactor
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_EPOLL_H
+#define _RIAK_EPOLL_H
+
+#include "riak.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _riak_epoll riak_epoll;
+typedef struct _riak_epoll_connection riak_epoll_connection;
+
+/**
+ * @brief Construct an epoll reactor which drives pipelined connections
+ * @param ep_target Riak Epoll reactor (out)
+ * @param cfg Riak Configuration
+ * @returns Error code
+ */
+riak_error
+riak_epoll_new(riak_epoll  **ep_target,
+               riak_config  *cfg);
+
+/**
+ * @brief Release a reactor and every connection still attached to it
+ * @param ep_target Riak Epoll reactor (NULLed on return)
+ */
+void
+riak_epoll_free(riak_epoll **ep_target);
+
+/**
+ * @brief Attach a connection's socket to the reactor
+ * @param econn_target Attached connection (out)
+ * @param ep Riak Epoll reactor
+ * @param cxn Riak Connection; its socket is non-blocking until detached
+ * @returns Error code
+ * @note If the socket breaks, the reactor reconnects and resends what
+ *       riak_pipeline_rewind() allows. The backoff runs on the reactor's
+ *       timers and the new socket connects without blocking, so other
+ *       connections carry on meanwhile
+ */
+riak_error
+riak_epoll_connection_new(riak_epoll_connection **econn_target,
+                          riak_epoll             *ep,
+                          riak_connection        *cxn);
+
+/**
+ * @brief Detach a connection, dropping any operations it still has outstanding
+ * @param econn_target Attached connection (NULLed on return)
+ */
+void
+riak_epoll_connection_free(riak_epoll_connection **econn_target);
+
+/**
+ * @brief Why the reactor gave up on a connection
+ * @param econn Attached connection
+ * @returns ERIAK_OK while the connection is usable, otherwise its read or write error
+ */
+riak_error
+riak_epoll_connection_get_error(riak_epoll_connection *econn);
+
+/**
+ * @brief Queue an operation on an attached connection
+ * @param rop Riak Operation for the connection behind `econn`; freed by the reactor once answered
+ * @param econn Attached connection
+ * @returns Error code
+ * @note The request is written on the next riak_epoll_run_once(), together with
+ *       every other request queued on the connection since the last one
+ */
+riak_error
+riak_epoll_send(riak_operation        *rop,
+                riak_epoll_connection *econn);
+
+/**
+ * @brief Flush queued requests, then handle whichever sockets become ready
+ * @param ep Riak Epoll reactor
+ * @param timeout_ms Longest wait in milliseconds (-1 waits indefinitely, 0 polls);
+ *        shortened to wake for the nearest operation deadline
+ * @returns Error code; failures of a single connection, including
+ *          ERIAK_TIMEOUT once an operation outlives its deadline, are
+ *          reported through riak_epoll_connection_get_error() instead
+ */
+riak_error
+riak_epoll_run_once(riak_epoll *ep,
+                    int         timeout_ms);
+
+/**
+ * @brief Keep the reactor running until no attached connection awaits a response
+ * @param ep Riak Epoll reactor
+ * @returns Error code
+ */
+riak_error
+riak_epoll_run(riak_epoll *ep);
+
+/**
+ * @brief Count the operations awaiting responses across attached connections
+ * @param ep Riak Epoll reactor
+ * @returns Outstanding operations
+ */
+riak_uint32_t
+riak_epoll_get_pending(riak_epoll *ep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_EPOLL_H
@@ -45,6 +45,9 @@ typedef enum riak_error_enum {
     ERIAK_MESSAGE_FORMAT,
     ERIAK_THREAD,
     ERIAK_INVALID,
+    ERIAK_POOL_EXHAUSTED,
+    ERIAK_NO_NODES,
+    ERIAK_TIMEOUT,
     ERIAK_LAST_ERRORNUM
 } riak_error;
 
@@ -67,6 +70,9 @@ static const char* errmsgs[] = {
     "Message Format Error",
     "Threading Error",
     "Invalid Value",
+    "No connections available in pool",
+    "No Riak nodes are available",
+    "Operation timed out",
     "SENTINEL FOR LAST ERROR MESSAGE"
 };
 #endif
@@ -0,0 +1,81 @@
+/*********************************************************************
+ *
+ * riak_hedge.h: Hedged requests across the nodes of a Riak cluster
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_HEDGE_H
+#define _RIAK_HEDGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Timed GETs needed before the latency percentile replaces the minimum delay
+#define RIAK_CLUSTER_HEDGE_MIN_SAMPLES 100
+
+/**
+ * @brief Send a second copy of slow GETs to another node
+ * @param cluster Riak Cluster
+ * @param percentile GET latency percentile (1-100) after which to hedge, 0 to turn hedging off
+ * @param min_delay_ms Shortest wait before hedging; also used until enough GETs have been timed
+ * @returns ERIAK_OUT_OF_RANGE if `percentile` is over 100
+ * @note Not thread-safe; set the policy before the cluster is shared.
+ *       Hedging is off by default.
+ */
+riak_error
+riak_cluster_set_hedge_policy(riak_cluster *cluster,
+                              riak_uint32_t percentile,
+                              riak_uint32_t min_delay_ms);
+
+/**
+ * @brief Current wait before a GET is hedged
+ * @param cluster Riak Cluster
+ * @returns Delay in milliseconds, or -1 when hedging is off
+ */
+int
+riak_cluster_get_hedge_delay(riak_cluster *cluster);
+
+/**
+ * @brief Synchronous fetch of a key from the cluster, hedged to a second node when slow
+ * @param cluster Riak Cluster
+ * @param bucket_type Name of Riak bucket type (may be NULL)
+ * @param bucket Name of Riak bucket
+ * @param key Name of Riak key
+ * @param opts Fetch options (may be NULL)
+ * @param response Fetched data from the first node to answer (out)
+ * @returns Error code
+ * @note If the first node has not answered within riak_cluster_get_hedge_delay(),
+ *       or has failed, the same encoded request is sent to another node.
+ *       Protocol Buffers cannot cancel a request, so a connection still waiting
+ *       on the slower node is closed rather than returned to its pool.
+ */
+riak_error
+riak_cluster_get(riak_cluster       *cluster,
+                 riak_binary        *bucket_type,
+                 riak_binary        *bucket,
+                 riak_binary        *key,
+                 riak_get_options   *opts,
+                 riak_get_response **response);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_HEDGE_H
@@ -51,54 +51,77 @@ riak_log_internal(riak_config         *cfg,
                   const char          *format,
                   ...);
 
+/**
+ * @brief Whether a message would reach the configuration's log function
+ * @param cfg Riak Configuration
+ * @param level Logging level of the message
+ * @returns False below the level set by riak_config_set_log_level() or with no log function
+ */
+riak_boolean_t
+riak_log_is_enabled(riak_config      *cfg,
+                    riak_log_level_t  level);
+
+// Least severe level compiled in at all, e.g. -DRIAK_LOG_MIN_LEVEL=RIAK_LOG_WARN
+#ifndef RIAK_LOG_MIN_LEVEL
+#define RIAK_LOG_MIN_LEVEL RIAK_LOG_DEBUG
+#endif
+
+// Library sources read the threshold straight from the configuration instead
+#ifndef riak_log_enabled
+#define riak_log_enabled(cfg,level) riak_log_is_enabled((cfg), (level))
+#endif
+
+// Filter before any argument is evaluated or formatted
+#define riak_log_at(cfg,level,format, ...) \
+        do { \
+            riak_config *riak_log_cfg_ = (cfg); \
+            if ((level) <= RIAK_LOG_MIN_LEVEL && riak_log_enabled(riak_log_cfg_, (level))) { \
+                riak_log_internal(riak_log_cfg_, (level), __FILE__, sizeof(__FILE__)-1, \
+                __func__, sizeof(__func__)-1, __LINE__, format, __VA_ARGS__); \
+            } \
+        } while (0)
+
 #define riak_log_emergency(cxn,format, ...) \
-        riak_log_internal(riak_connection_get_config(cxn), RIAK_LOG_EMERG, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, ("[%d] " format), riak_connection_get_fd(cxn), __VA_ARGS__)
+        riak_log_at(riak_connection_get_config(cxn), RIAK_LOG_EMERG, ("[%d] " format), \
+        riak_connection_get_fd(cxn), __VA_ARGS__)
 #define riak_log_alert(cxn,format, ...) \
-        riak_log_internal(riak_connection_get_config(cxn), RIAK_LOG_ALERT, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, ("[%d] " format), riak_connection_get_fd(cxn), __VA_ARGS__)
+        riak_log_at(riak_connection_get_config(cxn), RIAK_LOG_ALERT, ("[%d] " format), \
+        riak_connection_get_fd(cxn), __VA_ARGS__)
 #define riak_log_critical(cxn,format, ...) \
-        riak_log_internal(riak_connection_get_config(cxn), RIAK_LOG_CRITICAL, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, ("[%d] " format), riak_connection_get_fd(cxn), __VA_ARGS__)
+        riak_log_at(riak_connection_get_config(cxn), RIAK_LOG_CRITICAL, ("[%d] " format), \
+        riak_connection_get_fd(cxn), __VA_ARGS__)
 #define riak_log_error(cxn,format, ...) \
-        riak_log_internal(riak_connection_get_config(cxn), RIAK_LOG_ERROR, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, ("[%d] " format), riak_connection_get_fd(cxn), __VA_ARGS__)
+        riak_log_at(riak_connection_get_config(cxn), RIAK_LOG_ERROR, ("[%d] " format), \
+        riak_connection_get_fd(cxn), __VA_ARGS__)
 #define riak_log_warn(cxn,format, ...) \
-        riak_log_internal(riak_connection_get_config(cxn), RIAK_LOG_WARN, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, ("[%d] " format), riak_connection_get_fd(cxn), __VA_ARGS__)
+        riak_log_at(riak_connection_get_config(cxn), RIAK_LOG_WARN, ("[%d] " format), \
+        riak_connection_get_fd(cxn), __VA_ARGS__)
 #define riak_log_notice(cxn,format, ...) \
-        riak_log_internal(riak_connection_get_config(cxn), RIAK_LOG_NOTICE, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, ("[%d] " format), riak_connection_get_fd(cxn), __VA_ARGS__)
+        riak_log_at(riak_connection_get_config(cxn), RIAK_LOG_NOTICE, ("[%d] " format), \
+        riak_connection_get_fd(cxn), __VA_ARGS__)
 #ifdef _RIAK_DEBUG
 #define riak_log_debug(cxn,format, ...) \
-        riak_log_internal(riak_connection_get_config(cxn), RIAK_LOG_DEBUG, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, ("[%d] " format), riak_connection_get_fd(cxn), __VA_ARGS__)
+        riak_log_at(riak_connection_get_config(cxn), RIAK_LOG_DEBUG, ("[%d] " format), \
+        riak_connection_get_fd(cxn), __VA_ARGS__)
 #else
 #define riak_log_debug(cxn,format, ...) ((void)cxn)// No-Op
 #endif
 
 #define riak_log_emergency_config(cfg,format, ...) \
-        riak_log_internal((cfg), RIAK_LOG_EMERG, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, (format), __VA_ARGS__)
+        riak_log_at((cfg), RIAK_LOG_EMERG, (format), __VA_ARGS__)
 #define riak_log_alert_config(cfg,format, ...) \
-        riak_log_internal((cfg), RIAK_LOG_ALERT, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, (format), __VA_ARGS__)
+        riak_log_at((cfg), RIAK_LOG_ALERT, (format), __VA_ARGS__)
 #define riak_log_critical_config(cfg,format, ...) \
-        riak_log_internal((cfg), RIAK_LOG_CRITICAL, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, (format), __VA_ARGS__)
-#define riak_log_error_config(cxn,format, ...) \
-        riak_log_internal((cfg), RIAK_LOG_ERROR, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, (format), __VA_ARGS__)
-#define riak_log_warn_config(cxn,format, ...) \
-        riak_log_internal(cfg), RIAK_LOG_WARN, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, (format), __VA_ARGS__)
-#define riak_log_notice_config(cxn,format, ...) \
-        riak_log_internal((cfg), RIAK_LOG_NOTICE, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, (format), __VA_ARGS__)
+        riak_log_at((cfg), RIAK_LOG_CRITICAL, (format), __VA_ARGS__)
+#define riak_log_error_config(cfg,format, ...) \
+        riak_log_at((cfg), RIAK_LOG_ERROR, (format), __VA_ARGS__)
+#define riak_log_warn_config(cfg,format, ...) \
+        riak_log_at((cfg), RIAK_LOG_WARN, (format), __VA_ARGS__)
+#define riak_log_notice_config(cfg,format, ...) \
+        riak_log_at((cfg), RIAK_LOG_NOTICE, (format), __VA_ARGS__)
 #ifdef _RIAK_DEBUG
 #define riak_log_debug_config(cfg,format, ...) \
-        riak_log_internal((cfg), RIAK_LOG_DEBUG, __FILE__, sizeof(__FILE__)-1, \
-        __func__, sizeof(__func__)-1, __LINE__, (format), __VA_ARGS__)
+        riak_log_at((cfg), RIAK_LOG_DEBUG, (format), __VA_ARGS__)
 #else
 #define riak_log_debug_config(cxn,format, ...) ((void)cxn)
 #endif
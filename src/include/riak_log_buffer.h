@@ -0,0 +1,117 @@
+/*********************************************************************
+ *
+ * riak_log_buffer.h: In-memory log ring buffers drained by a background thread
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_LOG_BUFFER_H
+#define _RIAK_LOG_BUFFER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _riak_log_buffer riak_log_buffer;
+
+// Records kept for each logging thread unless told otherwise
+#define RIAK_LOG_BUFFER_DEFAULT_RECORDS 1024
+// Most records kept for any one logging thread
+#define RIAK_LOG_BUFFER_MAX_RECORDS     (1 << 20)
+// How often the drain thread wakes up
+#define RIAK_LOG_BUFFER_DRAIN_MSECS     50
+
+/**
+ * @brief Construct a log sink which never blocks or formats on the logging thread
+ * @param buffer_target Riak Log Buffer (out)
+ * @param cfg Riak Configuration whose allocator is used; it need not outlive the buffer
+ * @param out Stream the formatted lines are written to
+ * @param records Records per logging thread, rounded up to a power of two; 0 for the default
+ * @returns Error code; ERIAK_OUT_OF_RANGE if `records` is over RIAK_LOG_BUFFER_MAX_RECORDS
+ * @note Hook the buffer up with
+ *       riak_config_set_logging(cfg, buffer, riak_log_buffer_log, riak_log_buffer_start, riak_log_buffer_stop).
+ *       Each message keeps at most a few arguments and a short copy of its
+ *       strings, so very long messages come out truncated. A thread's ring is
+ *       freed by the drain once the thread has exited and its messages are out.
+ */
+riak_error
+riak_log_buffer_new(riak_log_buffer **buffer_target,
+                    riak_config      *cfg,
+                    FILE             *out,
+                    riak_uint32_t     records);
+
+/**
+ * @brief Free a log buffer, writing out whatever is still queued
+ * @param buffer_target Riak Log Buffer (NULLed on return)
+ * @note The drain thread must have been stopped and no thread may still be logging
+ */
+void
+riak_log_buffer_free(riak_log_buffer **buffer_target);
+
+/**
+ * @brief Log function which copies a message into the calling thread's ring buffer
+ * @note Has the signature of a `riak_log_fn`; `ptr` is the riak_log_buffer.
+ *       When the ring is full the message is dropped and counted.
+ */
+void
+riak_log_buffer_log(void            *ptr,
+                    riak_log_level_t level,
+                    const char      *file,
+                    riak_size_t      filelen,
+                    const char      *func,
+                    riak_size_t      funclen,
+                    riak_uint32_t    line,
+                    const char      *format,
+                    va_list          args);
+
+/**
+ * @brief Start the background thread which formats and writes out messages
+ * @param ptr Riak Log Buffer
+ * @returns 0 on success; has the signature of a `riak_log_init_fn`
+ */
+riak_int32_t
+riak_log_buffer_start(void *ptr);
+
+/**
+ * @brief Stop the background thread after writing out everything queued
+ * @param ptr Riak Log Buffer; has the signature of a `riak_log_cleanup_fn`
+ */
+void
+riak_log_buffer_stop(void *ptr);
+
+/**
+ * @brief Format and write out every queued message now, e.g. before dumping state
+ * @param buffer Riak Log Buffer
+ * @returns Number of messages written
+ */
+riak_uint32_t
+riak_log_buffer_flush(riak_log_buffer *buffer);
+
+/**
+ * @brief Messages dropped because a thread's ring buffer was full
+ * @param buffer Riak Log Buffer
+ * @returns Count since the buffer was created
+ */
+riak_uint64_t
+riak_log_buffer_get_dropped(riak_log_buffer *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_LOG_BUFFER_H
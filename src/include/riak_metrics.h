@@ -0,0 +1,107 @@
+/*********************************************************************
+ *
+ * riak_metrics.h: Latency histograms and counters of Riak requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_METRICS_H
+#define _RIAK_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kinds of request measured separately
+typedef enum {
+    /** riak_get */                       RIAK_METRICS_GET,
+    /** riak_put */                       RIAK_METRICS_PUT,
+    /** riak_delete */                    RIAK_METRICS_DELETE,
+    /** secondary index queries */        RIAK_METRICS_2I,
+    /** map/reduce jobs */                RIAK_METRICS_MAPREDUCE,
+    /** search queries */                 RIAK_METRICS_SEARCH,
+    /** everything else */                RIAK_METRICS_OTHER,
+    RIAK_METRICS_N_TYPES
+} riak_metrics_type;
+
+// Stages of an operation, timed only when built with RIAK_PHASE_TIMING
+typedef enum {
+    /** riak_operation_new() until the request is encoded */      RIAK_PHASE_ENCODE,
+    /** encoded until the request has been written */             RIAK_PHASE_QUEUE,
+    /** written until each response frame has been read */        RIAK_PHASE_WIRE,
+    /** unpacking frames into responses */                        RIAK_PHASE_DECODE,
+    /** response, error and chunk callbacks */                    RIAK_PHASE_CALLBACK,
+    RIAK_PHASE_N_PHASES
+} riak_phase;
+
+// Latencies are bucketed in microseconds, 2^RIAK_METRICS_SUB_BITS buckets per power of two
+#define RIAK_METRICS_SUB_BITS 3
+#define RIAK_METRICS_BUCKETS  272
+
+typedef struct _riak_metrics_histogram {
+    riak_uint64_t count;
+    riak_uint64_t sum_usecs;
+    riak_uint64_t max_usecs;
+    riak_uint64_t buckets[RIAK_METRICS_BUCKETS];
+} riak_metrics_histogram;
+
+typedef struct _riak_metrics_snapshot {
+    riak_uint64_t          requests[RIAK_METRICS_N_TYPES]; // Requests sent, retries not counted again
+    riak_metrics_histogram latency[RIAK_METRICS_N_TYPES];  // Send to last response frame of answered requests
+    riak_uint64_t          outcomes[ERIAK_LAST_ERRORNUM];  // Finished requests by result, ERIAK_OK included
+    riak_metrics_histogram phases[RIAK_PHASE_N_PHASES];    // Answered requests of every type, empty without RIAK_PHASE_TIMING
+    riak_uint64_t          bytes_written;
+    riak_uint64_t          bytes_read;
+    riak_int64_t           in_flight;                      // Sent but not yet finished or freed
+} riak_metrics_snapshot;
+
+/**
+ * @brief Start recording metrics for every connection built on a configuration
+ * @param cfg Riak Configuration
+ * @returns Error code
+ * @note Not thread-safe; enable metrics before any connection is opened.
+ *       Counters are sharded by thread and updated without locks.
+ */
+riak_error
+riak_config_enable_metrics(riak_config *cfg);
+
+/**
+ * @brief Merge every thread's shard into one consistent-enough copy
+ * @param cfg Riak Configuration
+ * @param snapshot Totals since metrics were enabled (out)
+ * @returns ERIAK_UNINITIALIZED if metrics were never enabled
+ */
+riak_error
+riak_config_get_metrics(riak_config           *cfg,
+                        riak_metrics_snapshot *snapshot);
+
+/**
+ * @brief Estimate a latency percentile from a histogram
+ * @param histogram Latency histogram from a snapshot
+ * @param percentile Percentile wanted, e.g. 99.9
+ * @returns Upper bound of the bucket holding the percentile in microseconds, 0 if empty
+ */
+riak_uint64_t
+riak_metrics_get_percentile(riak_metrics_histogram *histogram,
+                            double                  percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_METRICS_H
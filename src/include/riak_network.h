@@ -53,6 +53,17 @@ riak_socket_t
 riak_just_open_a_socket(riak_config  *cfg,
                         riak_addrinfo *addrinfo);
 
+/**
+ * @brief Opens a non-blocking socket and starts connecting it to a host
+ * @param cfg Riak Configuration
+ * @param addrinfo Address of machine to connect to
+ * @returns A socket file descriptor, possibly still connecting (or -1)
+ * @note The connect has finished once the socket becomes writable; SO_ERROR tells how
+ */
+riak_socket_t
+riak_just_start_a_socket(riak_config  *cfg,
+                         riak_addrinfo *addrinfo);
+
 /**
  * @brief Prints a human-readable version of addrinfo
  * @param addrinfo Address to be printed
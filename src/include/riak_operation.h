@@ -32,6 +32,12 @@ typedef struct _riak_operation riak_operation;
 // Generic placeholder for message-specific callbacks
 typedef void (*riak_response_callback)(void *response, void *ptr);
 
+// Generic placeholder for per-chunk callbacks of streaming messages
+typedef void (*riak_stream_callback)(void *chunk, void *ptr);
+
+// Told why an operation was dropped before it was answered
+typedef void (*riak_abandon_callback)(riak_error err, void *ptr);
+
 /**
  * @brief Construct a Riak event
  * @param cxn Riak Connection
@@ -74,6 +80,51 @@ void
 riak_operation_set_error_cb(riak_operation         *rop,
                             riak_response_callback  cb);
 
+/**
+ * @brief Set the callback for an operation dropped by riak_pipeline_fail()
+ * @param rop Riak Operation
+ * @param cb Function pointer to abandon callback; called with the event's callback data
+ */
+void
+riak_operation_set_abandon_cb(riak_operation        *rop,
+                              riak_abandon_callback  cb);
+
+/**
+ * @brief Give up on the operation if it has not been answered in time
+ * @param rop Riak Operation
+ * @param timeout_ms Milliseconds allowed from sending the request until the
+ *        response is complete (0 for no limit); defaults to the connection's
+ *        riak_connection_set_timeout()
+ * @note An expired operation fails with ERIAK_TIMEOUT, and so does everything
+ *       pipelined behind it, since the connection is left out of step
+ */
+void
+riak_operation_set_timeout(riak_operation *rop,
+                           riak_uint32_t   timeout_ms);
+
+/**
+ * @brief Deliver each chunk of a streaming response as it arrives
+ * @param rop Riak Operation
+ * @param cb Function pointer to chunk callback; the chunk is only valid
+ *        until the callback returns and is not accumulated
+ * @param stream_data Pointer passed to `cb` when it is called
+ */
+void
+riak_operation_set_stream_cb(riak_operation       *rop,
+                             riak_stream_callback  cb,
+                             void                 *stream_data);
+
+/**
+ * @brief Time an operation has spent in one phase so far
+ * @param rop Riak Operation
+ * @param phase Phase of interest
+ * @returns Microseconds, always 0 unless built with RIAK_PHASE_TIMING
+ * @note From a response callback every phase but RIAK_PHASE_CALLBACK is final
+ */
+riak_uint64_t
+riak_operation_get_phase_usecs(riak_operation *rop,
+                               riak_phase      phase);
+
 /**
  * @brief Cleanup memory used by a Riak Operation
  * @param re Riak Operation
@@ -97,6 +148,23 @@ riak_operation_get_config(riak_operation *rop);
 riak_connection*
 riak_operation_get_connection(riak_operation *rop);
 
+/**
+ * @brief Choose where the decoded response is allocated, e.g. an arena
+ * @param rop Riak Operation
+ * @param cfg Riak Configuration used to build (and later free) the response
+ */
+void
+riak_operation_set_response_config(riak_operation *rop,
+                                   riak_config    *cfg);
+
+/**
+ * @brief Return the Riak Configuration responses are decoded into
+ * @param rop Riak Operation
+ * @returns Response configuration, or the connection's default
+ */
+riak_config*
+riak_operation_get_response_config(riak_operation *rop);
+
 /**
  * @brief Get the optional server error
  * @param rop Riak Operation
@@ -105,6 +173,34 @@ riak_operation_get_connection(riak_operation *rop);
 riak_server_error*
 riak_operation_get_server_error(riak_operation *rop);
 
+/**
+ * @brief Why an operation failed
+ * @param rop Riak Operation
+ * @returns ERIAK_SERVER_ERROR once the server refused it, the reason given to
+ *          riak_operation_fail(), otherwise ERIAK_OK
+ */
+riak_error
+riak_operation_get_error(riak_operation *rop);
+
+/**
+ * @brief Milliseconds left until a sent operation is due
+ * @param rop Riak Operation
+ * @returns 0 once its deadline has passed, or -1 if it has no timeout
+ */
+int
+riak_operation_get_timeout(riak_operation *rop);
+
+/**
+ * @brief Give up on an operation sent with riak_write() before it was answered
+ * @param rop Riak Operation, which still belongs to the caller
+ * @param err Reason, e.g. ERIAK_TIMEOUT or the error riak_read() returned
+ * @note The error callback is called with a NULL response, so event loops
+ *       report a dropped operation through the same callback as a server error
+ */
+void
+riak_operation_fail(riak_operation *rop,
+                    riak_error      err);
+
 /**
  * @brief Set the bucket on the current operation
  * @param rop Riak Operation
@@ -0,0 +1,112 @@
+/*********************************************************************
+ *
+ * riak_timer_wheel.h: Hierarchical timer wheel for operation deadlines
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_TIMER_WHEEL_H
+#define _RIAK_TIMER_WHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Granularity used by the library's own reactors
+#define RIAK_TIMER_WHEEL_DEFAULT_TICK_MS 1
+
+typedef struct _riak_timer_wheel riak_timer_wheel;
+
+/**
+ * @brief Called for each operation whose deadline has passed
+ * @param rop Riak Operation, no longer scheduled; the callback may free it
+ *        or fail its connection
+ * @param ptr User data given to riak_timer_wheel_add()
+ */
+typedef void (*riak_timer_callback)(riak_operation *rop, void *ptr);
+
+/**
+ * @brief Construct a timer wheel
+ * @param tw_target Riak Timer Wheel (out)
+ * @param cfg Riak Configuration
+ * @param tick_ms Granularity in milliseconds; deadlines fire up to one tick late
+ * @returns Error code
+ * @note Not thread-safe; drive it from the thread running the event loop
+ */
+riak_error
+riak_timer_wheel_new(riak_timer_wheel **tw_target,
+                     riak_config       *cfg,
+                     riak_uint32_t      tick_ms);
+
+/**
+ * @brief Free a timer wheel; operations still scheduled are simply forgotten
+ * @param tw_target Riak Timer Wheel (NULLed on return)
+ */
+void
+riak_timer_wheel_free(riak_timer_wheel **tw_target);
+
+/**
+ * @brief Schedule an operation to expire at its deadline, in constant time
+ * @param tw Riak Timer Wheel
+ * @param rop Riak Operation whose request has been sent; ignored if it has no timeout
+ * @param ptr User data passed to the expiry callback
+ * @note Rescheduling moves the operation; freeing it cancels its timer
+ */
+void
+riak_timer_wheel_add(riak_timer_wheel *tw,
+                     riak_operation   *rop,
+                     void             *ptr);
+
+/**
+ * @brief Remove an operation from whichever wheel it is on, in constant time
+ * @param rop Riak Operation
+ */
+void
+riak_timer_wheel_cancel(riak_operation *rop);
+
+/**
+ * @brief Catch up with the clock, firing every expired operation
+ * @param tw Riak Timer Wheel
+ * @param cb Expiry callback
+ * @returns Number of operations expired
+ */
+riak_uint32_t
+riak_timer_wheel_advance(riak_timer_wheel   *tw,
+                         riak_timer_callback cb);
+
+/**
+ * @brief How long an event loop may sleep before the wheel needs advancing
+ * @param tw Riak Timer Wheel
+ * @returns Milliseconds, or -1 if nothing is scheduled
+ */
+int
+riak_timer_wheel_get_timeout(riak_timer_wheel *tw);
+
+/**
+ * @brief Number of operations scheduled
+ * @param tw Riak Timer Wheel
+ * @returns Count
+ */
+riak_uint32_t
+riak_timer_wheel_get_count(riak_timer_wheel *tw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_TIMER_WHEEL_H
@@ -0,0 +1,77 @@
+/*********************************************************************
+ *
+ * riak_trace.h: Tracing hooks around Riak requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_TRACE_H
+#define _RIAK_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Points in a request's life reported to a tracer
+typedef enum {
+    /** the request is first written */    RIAK_TRACE_START,
+    /** its outcome is known */            RIAK_TRACE_FINISH
+} riak_trace_point;
+
+typedef struct _riak_trace_span {
+    riak_trace_point point;
+    riak_uint8_t     msgid;          // Request message id, e.g. MSG_RPBGETREQ
+    riak_binary     *bucket_type;    // NULL when keys are hashed or not part of the request
+    riak_binary     *bucket;
+    riak_binary     *key;
+    riak_uint64_t    key_hash;       // Hash of bucket type, bucket and key when keys are hashed
+    const char      *host;           // Node the request was sent to
+    const char      *port;
+    riak_size_t      bytes_written;  // Framed request bytes, resends included
+    riak_size_t      bytes_read;     // Framed response bytes
+    riak_uint32_t    retries;        // Resends after the first attempt
+    riak_uint64_t    duration_usecs; // Start to finish, 0 at RIAK_TRACE_START
+    riak_error       error;          // Outcome; ERIAK_UNINITIALIZED if freed before finishing
+    void            *span;           // Set by the tracer at RIAK_TRACE_START, handed back at RIAK_TRACE_FINISH
+} riak_trace_span;
+
+typedef void (*riak_trace_fn)(void            *trace_data,
+                              riak_trace_span *span);
+
+/**
+ * @brief Report every request sent on connections built on a configuration
+ * @param cfg Riak Configuration
+ * @param trace_fn Called at RIAK_TRACE_START and RIAK_TRACE_FINISH of each request; NULL stops tracing
+ * @param trace_data Pointer passed to `trace_fn`
+ * @param hash_keys Pass a hash of the bucket type, bucket and key rather than the raw values
+ * @returns Error code
+ * @note Not thread-safe; set tracing before any connection is opened. The
+ *       span and its binaries are only valid until `trace_fn` returns, and
+ *       `trace_fn` runs on whichever thread drives the connection.
+ */
+riak_error
+riak_config_set_tracing(riak_config   *cfg,
+                        riak_trace_fn  trace_fn,
+                        void          *trace_data,
+                        riak_boolean_t hash_keys);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_TRACE_H
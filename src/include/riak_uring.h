@@ -0,0 +1,145 @@
+/*********************************************************************
+ *
+ * riak_uring.h: io_uring reactor with an epoll fallback
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_URING_H
+#define _RIAK_URING_H
+
+#include "riak.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Submission queue entries when none are requested
+#define RIAK_URING_DEFAULT_ENTRIES 256
+
+typedef struct _riak_uring riak_uring;
+typedef struct _riak_uring_connection riak_uring_connection;
+
+/**
+ * @brief Construct an io_uring reactor which drives pipelined connections
+ * @param ur_target Riak io_uring reactor (out)
+ * @param cfg Riak Configuration
+ * @param entries Submission queue entries (0 for RIAK_URING_DEFAULT_ENTRIES)
+ * @returns Error code
+ * @note Kernels without io_uring, provided buffer rings or extended
+ *       waits get a reactor which runs on riak_epoll instead
+ */
+riak_error
+riak_uring_new(riak_uring   **ur_target,
+               riak_config   *cfg,
+               riak_uint32_t  entries);
+
+/**
+ * @brief Release a reactor and every connection still attached to it
+ * @param ur_target Riak io_uring reactor (NULLed on return)
+ */
+void
+riak_uring_free(riak_uring **ur_target);
+
+/**
+ * @brief Whether the reactor runs on io_uring rather than the epoll fallback
+ * @param ur Riak io_uring reactor
+ * @returns True if io_uring is in use
+ */
+riak_boolean_t
+riak_uring_is_native(riak_uring *ur);
+
+/**
+ * @brief Attach a connection's socket to the reactor
+ * @param uconn_target Attached connection (out)
+ * @param ur Riak io_uring reactor
+ * @param cxn Riak Connection
+ * @returns Error code
+ * @note On io_uring, failed requests are not retried, whatever
+ *       riak_config_set_retry_policy() allows: a broken socket fails every
+ *       outstanding operation, which riak_uring_connection_get_error() then
+ *       explains. The epoll fallback retries as riak_epoll does
+ */
+riak_error
+riak_uring_connection_new(riak_uring_connection **uconn_target,
+                          riak_uring             *ur,
+                          riak_connection        *cxn);
+
+/**
+ * @brief Detach a connection, dropping any operations it still has outstanding
+ * @param uconn_target Attached connection (NULLed on return)
+ * @note Waits for the kernel to let go of the socket, so completions of
+ *       other connections may be delivered meanwhile
+ */
+void
+riak_uring_connection_free(riak_uring_connection **uconn_target);
+
+/**
+ * @brief Why the reactor gave up on a connection
+ * @param uconn Attached connection
+ * @returns ERIAK_OK while the connection is usable, otherwise its read or write error
+ */
+riak_error
+riak_uring_connection_get_error(riak_uring_connection *uconn);
+
+/**
+ * @brief Queue an operation on an attached connection
+ * @param rop Riak Operation for the connection behind `uconn`; freed by the reactor once answered
+ * @param uconn Attached connection
+ * @returns Error code
+ * @note The request is submitted on the next riak_uring_run_once(), together with
+ *       every other request queued since the last one
+ */
+riak_error
+riak_uring_send(riak_operation        *rop,
+                riak_uring_connection *uconn);
+
+/**
+ * @brief Submit queued requests, then handle whatever completes
+ * @param ur Riak io_uring reactor
+ * @param timeout_ms Longest wait in milliseconds (-1 waits indefinitely, 0 polls);
+ *        shortened to wake for the nearest operation deadline
+ * @returns Error code; failures of a single connection, including
+ *          ERIAK_TIMEOUT once an operation outlives its deadline, are
+ *          reported through riak_uring_connection_get_error() instead
+ */
+riak_error
+riak_uring_run_once(riak_uring *ur,
+                    int         timeout_ms);
+
+/**
+ * @brief Keep the reactor running until no attached connection awaits a response
+ * @param ur Riak io_uring reactor
+ * @returns Error code
+ */
+riak_error
+riak_uring_run(riak_uring *ur);
+
+/**
+ * @brief Count the operations awaiting responses across attached connections
+ * @param ur Riak io_uring reactor
+ * @returns Outstanding operations
+ */
+riak_uint32_t
+riak_uring_get_pending(riak_uring *ur);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _RIAK_URING_H
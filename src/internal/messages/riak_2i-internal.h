@@ -65,6 +65,9 @@ struct _riak_2i_response
 
     riak_uint32_t  _n_responses;
     RpbIndexResp **_internal;
+    riak_uint32_t  _responses_capacity;
+    riak_uint32_t  _keys_capacity;
+    riak_uint32_t  _results_capacity;
 };
 
 riak_error
@@ -30,6 +30,8 @@ struct _riak_get_response {
     riak_object  **content; // Array of pointers to allow expansion
 
     RpbGetResp    *_internal;
+    riak_uint8_t  *_frame;     // Wire frame viewed into by content (views only)
+    riak_config   *_frame_cfg; // Configuration which owns _frame
 };
 
 // Based on RpbGetReq
@@ -86,3 +88,35 @@ riak_get_response_decode(riak_operation     *rop,
                          riak_pb_message    *pbresp,
                          riak_get_response **resp,
                          riak_boolean_t     *done);
+
+/**
+ * @brief Create a get/fetch Request whose response is decoded as a view
+ * @param rop Riak Operation
+ * @param bucket_type Name of Riak bucket type
+ * @param bucket Name of Riak bucket
+ * @param key Name of Riak key
+ * @param options Get request parameters
+ * @param req Returned PBC request
+ * @return Error if out of memory
+ */
+riak_error
+riak_get_view_request_encode(riak_operation   *rop,
+                             riak_binary      *bucket_type,
+                             riak_binary      *bucket,
+                             riak_binary      *key,
+                             riak_get_options *options,
+                             riak_pb_message **req);
+
+/**
+ * @brief Translate PBC message to a Riak Get message without copying values
+ * @param rop Riak Operation
+ * @param pbresp Protocol Buffer message
+ * @param done Returned flag set to true if finished streaming
+ * @param resp Returned Get message, whose binaries point into the wire frame
+ * @return Error if out of memory or the frame is malformed
+ */
+riak_error
+riak_get_view_response_decode(riak_operation     *rop,
+                              riak_pb_message    *pbresp,
+                              riak_get_response **resp,
+                              riak_boolean_t     *done);
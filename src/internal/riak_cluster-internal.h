@@ -0,0 +1,73 @@
+/*********************************************************************
+ *
+ * riak_cluster-internal.h: Load-balanced access to a ring of Riak nodes
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_CLUSTER_INTERNAL_H
+#define _RIAK_CLUSTER_INTERNAL_H
+
+// GET latencies behind the hedging delay, four buckets per power of two microseconds
+#define RIAK_CLUSTER_LATENCY_BUCKETS 128
+
+typedef struct _riak_cluster_node {
+    riak_connection_pool  *pool;
+    volatile riak_boolean_t up;
+    volatile riak_uint64_t  retry_usecs;   // Earliest time a down node may be probed
+    volatile riak_uint64_t  latency_usecs; // Exponential moving average of request latency
+} riak_cluster_node;
+
+struct _riak_cluster {
+    riak_config         *config;
+    riak_cluster_policy  policy;
+    riak_uint64_t        retry_interval_usecs;
+    riak_uint32_t        n_nodes;
+    riak_uint32_t        capacity;
+    riak_cluster_node  **nodes;
+    volatile riak_uint32_t next_node; // Rotating start of the node scan
+
+    riak_uint32_t          hedge_percentile; // 0 while hedging is off
+    riak_uint64_t          hedge_min_usecs;
+    volatile riak_uint32_t get_samples;
+    volatile riak_uint32_t get_latency[RIAK_CLUSTER_LATENCY_BUCKETS];
+};
+
+/**
+ * @brief Find the node that owns a connection
+ * @param cluster Riak Cluster
+ * @param cxn Riak Connection checked out of the cluster
+ * @returns Matching node or NULL
+ */
+riak_cluster_node*
+riak_cluster_find_node(riak_cluster    *cluster,
+                       riak_connection *cxn);
+
+/**
+ * @brief Borrow a connection to a healthy node other than the one given
+ * @param cluster Riak Cluster
+ * @param exclude Node to pass over (NULL for none)
+ * @param cxn Borrowed Riak Connection (out)
+ * @returns ERIAK_NO_NODES when no other node is up or has a free connection
+ */
+riak_error
+riak_cluster_checkout_excluding(riak_cluster      *cluster,
+                                riak_cluster_node *exclude,
+                                riak_connection  **cxn);
+
+#endif // _RIAK_CLUSTER_INTERNAL_H
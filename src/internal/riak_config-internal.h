@@ -23,17 +23,86 @@
 #ifndef _RIAK_CONFIG_INTERNAL_H
 #define _RIAK_CONFIG_INTERNAL_H
 
+// One contiguous chunk of an arena; memory is carved from data[used, size)
+typedef struct _riak_arena_block {
+    struct _riak_arena_block *next;
+    riak_size_t               size;
+    riak_size_t               used;
+    riak_uint8_t             *data;
+} riak_arena_block;
+
+typedef struct _riak_arena {
+    riak_arena_block   *blocks;      // Most recent block first
+    riak_size_t         block_size;
+    riak_size_t         allocated;   // Bytes handed out since the last reset
+    ProtobufCAllocator  pb_allocator;
+} riak_arena;
+
 struct _riak_config {
     riak_alloc_fn       malloc_fn;
     riak_realloc_fn     realloc_fn;
     riak_free_fn        free_fn;
     ProtobufCAllocator *pb_allocator;
 
+    // Set when every allocation is carved from a bump allocator
+    riak_arena         *arena;
+
     // LOGGING
     void*               log_data;
     riak_log_fn         log_fn;
     riak_log_init_fn    log_init_fn;
     riak_log_cleanup_fn log_cleanup_fn;
+    riak_log_level_t    log_level;       // Least severe level wanted
+    riak_int32_t        log_threshold;   // log_level, or RIAK_LOG_OFF without a log_fn
+
+    // RETRIES
+    riak_uint32_t       retry_attempts;  // Tries per request or connect, including the first
+    riak_uint32_t       retry_base_ms;   // Backoff before the first retry, doubled for each after
+    riak_uint32_t       retry_max_ms;    // Cap on any one backoff
+
+    // Request counters and latencies, NULL unless enabled
+    struct _riak_metrics *metrics;
+
+    // TRACING
+    riak_trace_fn       trace_fn;        // NULL unless tracing
+    void               *trace_data;
+    riak_boolean_t      trace_hash_keys;
 };
 
+// Below every level, so nothing passes
+#define RIAK_LOG_OFF (-1)
+
+// Skip the call to riak_log_is_enabled() inside the library
+#undef riak_log_enabled
+#define riak_log_enabled(cfg,level) ((riak_int32_t)(level) <= (cfg)->log_threshold)
+
+/**
+ * @brief Whether the retry policy allows another try
+ * @param cfg Riak Configuration
+ * @param attempts Tries made so far
+ * @returns True if one more may be made
+ */
+riak_boolean_t
+riak_config_retry_allowed(riak_config  *cfg,
+                          riak_uint32_t attempts);
+
+/**
+ * @brief Pick a random wait up to the exponential backoff, for callers which must not sleep
+ * @param cfg Riak Configuration
+ * @param attempts Tries made so far
+ * @returns Microseconds to wait before the next try
+ */
+riak_uint64_t
+riak_config_retry_backoff_usecs(riak_config  *cfg,
+                                riak_uint32_t attempts);
+
+/**
+ * @brief Sleep before the next try for a random time up to the exponential backoff
+ * @param cfg Riak Configuration
+ * @param attempts Tries made so far
+ */
+void
+riak_config_retry_backoff(riak_config  *cfg,
+                          riak_uint32_t attempts);
+
 #endif // _RIAK_CONFIG_INTERNAL_H
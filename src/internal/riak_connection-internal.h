@@ -24,13 +24,69 @@
 #define _RIAK_CONNECTION_INTERNAL_H
 
 #define RIAK_HOST_MAX_LEN   256
+#define RIAK_RECV_BUFFER_SIZE 65536
+
+// Receive buffers are cached in size classes of 256, 1K, 4K ... 1M bytes
+#define RIAK_BUFFER_MIN_SHIFT   8
+#define RIAK_BUFFER_CLASSES     7
+#define RIAK_BUFFER_CACHE_DEPTH 4
+
+typedef struct _riak_buffer_class {
+    void         *free_list; // Each free buffer starts with a pointer to the next
+    riak_uint32_t count;
+} riak_buffer_class;
 
 struct _riak_connection {
     riak_config   *config;
+    riak_config   *response_config; // Default allocator for decoded responses
     char           hostname[RIAK_HOST_MAX_LEN];
     char           portnum[RIAK_HOST_MAX_LEN]; // Keep as a string for debugging
     riak_addrinfo *addrinfo;
     riak_socket_t  fd;
+    riak_uint32_t  timeout_ms; // Default for new operations, 0 for none
+    riak_boolean_t stale;      // Stream out of step; reopen the socket before reuse
+
+    // Owning connection pool, if any
+    struct _riak_connection_pool *pool;
+    riak_uint32_t                 pool_slot;
+    riak_uint64_t                 checkout_usecs; // When the connection was last lent out
+    riak_uint64_t                 answer_usecs;   // Send to answer, summed over requests since then
+    riak_uint32_t                 answers;        // Requests answered since then
+
+    // Operations written but not yet answered, oldest first
+    struct _riak_operation       *pipeline_head;
+    struct _riak_operation       *pipeline_tail;
+    riak_uint32_t                 pipeline_depth;
+    riak_uint32_t                 pipeline_deadlines; // How many of them have a deadline
+
+    // Bytes received but not yet decoded live in recv_buf[recv_start, recv_end)
+    riak_uint8_t                 *recv_buf;
+    riak_size_t                   recv_start;
+    riak_size_t                   recv_end;
+
+    riak_buffer_class             buffers[RIAK_BUFFER_CLASSES];
+    riak_buffer_stats             buffer_stats;
 };
 
+/**
+ * @brief Borrow a buffer of at least `size` bytes from the connection's cache
+ * @param cxn Riak Connection
+ * @param size Bytes required
+ * @returns Buffer or NULL if out of memory
+ */
+riak_uint8_t*
+riak_connection_buffer_get(riak_connection *cxn,
+                           riak_size_t      size);
+
+/**
+ * @brief Return a buffer from riak_connection_buffer_get() to the cache
+ * @param cxn Riak Connection
+ * @param buf Buffer (NULLed on return)
+ * @param size Size originally requested
+ */
+void
+riak_connection_buffer_put(riak_connection *cxn,
+                           riak_uint8_t   **buf,
+                           riak_size_t      size);
+
 #endif // _RIAK_CONNECTION_INTERNAL_H
@@ -0,0 +1,68 @@
+/*********************************************************************
+ *
+ * riak_connection_pool-internal.h: Pool of Riak Connections to a single node
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_CONNECTION_POOL_INTERNAL_H
+#define _RIAK_CONNECTION_POOL_INTERNAL_H
+
+// Slot life cycle: EMPTY -> BUSY (opening) -> BUSY (lent) <-> IDLE -> BUSY (closing) -> EMPTY
+// Every transition out of EMPTY or IDLE is a compare-and-swap, so the
+// thread that wins a slot owns it exclusively until it publishes a new state
+#define RIAK_POOL_SLOT_EMPTY 0
+#define RIAK_POOL_SLOT_IDLE  1
+#define RIAK_POOL_SLOT_BUSY  2
+
+typedef struct _riak_connection_pool_slot {
+    volatile riak_uint32_t state;
+    riak_connection       *cxn;
+} riak_connection_pool_slot;
+
+struct _riak_connection_pool {
+    riak_config               *config;
+    char                       hostname[RIAK_HOST_MAX_LEN];
+    char                       portnum[RIAK_HOST_MAX_LEN];
+    riak_addr_resolver         resolver;
+    riak_uint32_t              min_connections;
+    riak_uint32_t              max_connections;
+
+    volatile riak_uint32_t     n_open;
+    volatile riak_uint32_t     n_busy;
+    volatile riak_uint32_t     next_slot; // Rotating start of the slot scan
+
+    riak_connection_pool_slot *slots;
+};
+
+/**
+ * @brief Note when a request first goes out on a pooled connection
+ * @param rop Riak Operation just written
+ * @note A cluster weighs its nodes by how long pooled requests take to be answered
+ */
+void
+riak_connection_pool_sent(riak_operation *rop);
+
+/**
+ * @brief Add a request's time to answer to its pooled connection's tally
+ * @param rop Riak Operation whose response, or server error, has arrived
+ */
+void
+riak_connection_pool_answered(riak_operation *rop);
+
+#endif // _RIAK_CONNECTION_POOL_INTERNAL_H
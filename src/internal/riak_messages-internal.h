@@ -25,6 +25,9 @@
 #ifndef _RIAK_INTERNAL_MESSAGES_H
 #define _RIAK_INTERNAL_MESSAGES_H
 
+// Every frame starts with a 32-bit big-endian length and a 1-byte message id
+#define RIAK_FRAME_HEADER_LEN         5
+
 #define MSG_RPBERRORRESP              0
 
 // 0 length
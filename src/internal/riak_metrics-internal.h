@@ -0,0 +1,99 @@
+/*********************************************************************
+ *
+ * riak_metrics-internal.h: Latency histograms and counters of Riak requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_METRICS_INTERNAL_H
+#define _RIAK_METRICS_INTERNAL_H
+
+// Threads are spread over this many copies of every counter
+#define RIAK_METRICS_SHARDS 8
+
+typedef struct _riak_metrics {
+    riak_metrics_snapshot shards[RIAK_METRICS_SHARDS];
+} riak_metrics;
+
+// The operation hooks below also open and close tracing spans
+
+/**
+ * @brief Count a request put on the wire; its first send starts the clock
+ * @param rop Riak Operation
+ * @param bytes Framed length of the request
+ */
+void
+riak_metrics_operation_sent(riak_operation *rop,
+                            riak_size_t     bytes);
+
+/**
+ * @brief Record how a request finished, with its latency if it was answered
+ * @param rop Riak Operation
+ * @param err Outcome
+ */
+void
+riak_metrics_operation_done(riak_operation *rop,
+                            riak_error      err);
+
+/**
+ * @brief Stop counting a request freed before it finished
+ * @param rop Riak Operation
+ */
+void
+riak_metrics_operation_dropped(riak_operation *rop);
+
+/**
+ * @brief Count bytes received on a connection
+ * @param cfg Riak Configuration of the connection
+ * @param bytes Number of bytes
+ */
+void
+riak_metrics_add_read(riak_config *cfg,
+                      riak_size_t  bytes);
+
+#ifdef RIAK_PHASE_TIMING
+/**
+ * @brief Start the clock on a new operation's first phase
+ * @param rop Riak Operation
+ */
+void
+riak_metrics_phase_start(riak_operation *rop);
+
+/**
+ * @brief Charge the time since the last phase ended to `phase`
+ * @param rop Riak Operation
+ * @param phase Phase which just ended
+ */
+void
+riak_metrics_phase_end(riak_operation *rop,
+                       riak_phase      phase);
+
+/**
+ * @brief Add an answered operation's phases to the configuration's histograms
+ * @param rop Riak Operation
+ */
+void
+riak_metrics_phase_record(riak_operation *rop);
+#else
+// Phase timing compiles away entirely unless asked for
+#define riak_metrics_phase_start(rop)
+#define riak_metrics_phase_end(rop, phase)
+#define riak_metrics_phase_record(rop)
+#endif
+
+#endif // _RIAK_METRICS_INTERNAL_H
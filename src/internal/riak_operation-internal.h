@@ -23,6 +23,8 @@
 #ifndef _RIAK_OPERATION_INTERNAL_H
 #define _RIAK_OPERATION_INTERNAL_H
 
+#include "riak_timer_wheel-internal.h"
+
 typedef riak_error (*riak_response_decoder)(struct _riak_operation  *rop,
                                             struct _riak_pb_message *pbresp,
                                             void                   **response,
@@ -31,10 +33,32 @@ typedef riak_error (*riak_response_decoder)(struct _riak_operation  *rop,
 // Essentially the state of the current event
 struct _riak_operation {
     riak_connection         *connection;
+    riak_config             *response_config; // Allocator for the decoded response
     riak_response_decoder    decoder;
     riak_response_callback   response_cb;
     riak_response_callback   error_cb;
+    riak_abandon_callback    abandon_cb;  // Dropped before an answer arrived
     void                    *cb_data;
+    riak_stream_callback     stream_cb;   // Per-chunk delivery instead of accumulation
+    void                    *stream_data;
+    riak_uint32_t            timeout_ms;     // Allowed between sending and the response, 0 for none
+    riak_uint64_t            deadline_usecs; // riak_time_usecs() by which the response is due, 0 for none
+    riak_timer_node          timer;          // Link into a riak_timer_wheel while scheduled
+    riak_uint32_t            attempts;       // Times the request has been sent
+    riak_boolean_t           no_retry;       // Applying the request twice would change the outcome
+    riak_boolean_t           answered;       // Some of the response was decoded, so a resend could repeat it
+    riak_uint64_t            metrics_usecs;  // First send while metrics are on, 0 once finished
+    riak_metrics_type        metrics_type;
+    riak_size_t              bytes_written;  // Framed request bytes, resends included
+    riak_size_t              bytes_read;     // Framed response bytes dispatched
+    riak_uint64_t            trace_usecs;    // First send while tracing, 0 once finished
+    riak_uint64_t            sent_usecs;     // First send on a pooled connection, 0 once finished
+    void                    *trace_span;     // Tracer's handle for the open span
+#ifdef RIAK_PHASE_TIMING
+    riak_uint64_t            phase_mark;     // riak_time_usecs() when the current phase began
+    riak_uint64_t            phase_usecs[RIAK_PHASE_N_PHASES];
+    riak_boolean_t           phase_written;  // RIAK_PHASE_QUEUE is over
+#endif
 
     // Current message being decoded
     riak_uint32_t            position;
@@ -48,9 +72,13 @@ struct _riak_operation {
     struct _riak_pb_message *pb_response;
 
     riak_server_error       *error;
+    riak_error               err;   // Why the operation failed, ERIAK_OK until then
 
     void                    *response;
 
+    // Next operation awaiting a response on the same pipelined connection
+    struct _riak_operation  *next;
+
     // Cache of request data
     struct {
         riak_binary *bucket_type;
@@ -69,5 +97,33 @@ void
 riak_operation_set_response_decoder(riak_operation       *rop,
                                     riak_response_decoder decoder);
 
+/**
+ * @brief Take ownership of the frame currently being decoded
+ * @param rop Riak Operation
+ * @param pbresp Frame handed to the decoder, starting with the message id
+ * @param owner Returned configuration which must be used to free the frame
+ * @returns Frame that outlives the operation or NULL if out of memory
+ */
+riak_uint8_t*
+riak_operation_take_frame(riak_operation   *rop,
+                          riak_pb_message  *pbresp,
+                          riak_config     **owner);
+
+/**
+ * @brief Whether a failed request may be sent again under the retry policy
+ * @param rop Riak Operation
+ * @param err Reason it failed
+ * @returns True for a network failure of a request that is safe to repeat
+ */
+riak_boolean_t
+riak_operation_can_retry(riak_operation *rop,
+                         riak_error      err);
+
+/**
+ * @brief Forget any partly received response before the request is sent again
+ * @param rop Riak Operation
+ */
+void
+riak_operation_rewind(riak_operation *rop);
 
 #endif //_RIAK_OPERATION_INTERNAL_H
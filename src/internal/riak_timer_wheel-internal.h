@@ -0,0 +1,75 @@
+/*********************************************************************
+ *
+ * riak_timer_wheel-internal.h: Internal timer wheel structures
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_TIMER_WHEEL_INTERNAL_H
+#define _RIAK_TIMER_WHEEL_INTERNAL_H
+
+// Four levels of 64 slots cover 2^24 ticks (about 4.6 hours at 1ms);
+// later deadlines park in the top level and are re-filed as it turns
+#define RIAK_TIMER_WHEEL_BITS   6
+#define RIAK_TIMER_WHEEL_SLOTS  (1 << RIAK_TIMER_WHEEL_BITS)
+#define RIAK_TIMER_WHEEL_MASK   (RIAK_TIMER_WHEEL_SLOTS - 1)
+#define RIAK_TIMER_WHEEL_LEVELS 4
+
+// Intrusive list link embedded in each riak_operation; slots hold a sentinel
+typedef struct _riak_timer_node {
+    struct _riak_timer_node  *prev;
+    struct _riak_timer_node  *next;
+    struct _riak_timer_wheel *wheel;   // NULL while not scheduled
+    riak_uint64_t             expires; // Tick at which the deadline has passed
+    void                     *ptr;     // Passed to the expiry callback
+} riak_timer_node;
+
+struct _riak_timer_wheel {
+    riak_config     *config;
+    riak_uint64_t    tick_usecs;
+    riak_uint64_t    now;   // Last tick processed
+    riak_uint32_t    count;
+    riak_timer_node  slots[RIAK_TIMER_WHEEL_LEVELS][RIAK_TIMER_WHEEL_SLOTS];
+};
+
+/**
+ * @brief Schedule an operation to fire at a given time rather than at its deadline
+ * @param tw Riak Timer Wheel
+ * @param rop Riak Operation; its timer is borrowed, e.g. to wake a reactor after a backoff
+ * @param ptr User data passed to the expiry callback
+ * @param expires_usecs Time on the riak_time_usecs() scale
+ */
+void
+riak_timer_wheel_add_at(riak_timer_wheel *tw,
+                        riak_operation   *rop,
+                        void             *ptr,
+                        riak_uint64_t     expires_usecs);
+
+/**
+ * @brief Advance the wheel to a given time rather than the clock's
+ * @param tw Riak Timer Wheel
+ * @param now_usecs Time on the riak_time_usecs() scale
+ * @param cb Expiry callback
+ * @returns Number of operations expired
+ */
+riak_uint32_t
+riak_timer_wheel_advance_to(riak_timer_wheel   *tw,
+                            riak_uint64_t       now_usecs,
+                            riak_timer_callback cb);
+
+#endif // _RIAK_TIMER_WHEEL_INTERNAL_H
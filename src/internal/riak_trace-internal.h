@@ -0,0 +1,42 @@
+/*********************************************************************
+ *
+ * riak_trace-internal.h: Tracing hooks around Riak requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#ifndef _RIAK_TRACE_INTERNAL_H
+#define _RIAK_TRACE_INTERNAL_H
+
+/**
+ * @brief Open a span for a request written for the first time
+ * @param rop Riak Operation
+ */
+void
+riak_trace_operation_start(riak_operation *rop);
+
+/**
+ * @brief Close the span of a request
+ * @param rop Riak Operation
+ * @param err Outcome
+ */
+void
+riak_trace_operation_finish(riak_operation *rop,
+                            riak_error      err);
+
+#endif // _RIAK_TRACE_INTERNAL_H
@@ -25,6 +25,15 @@
 
 #include <glib.h>
 
+// Lock-free primitives (full memory barrier)
+#define riak_atomic_cas(P,O,N)  __sync_bool_compare_and_swap((P),(O),(N))
+#define riak_atomic_add(P,V)    __sync_add_and_fetch((P),(V))
+#define riak_atomic_sub(P,V)    __sync_sub_and_fetch((P),(V))
+#define riak_atomic_load(P)     __sync_add_and_fetch((P),0)
+
+// Smallest array riak_array_reserve will allocate
+#define RIAK_ARRAY_MIN_CAPACITY 16
+
 /**
  * @brief Since strlcpy is not standard everywhere, write our own
  * @param dst Destination
@@ -63,4 +72,37 @@ riak_array_realloc(riak_config *cfg,
                    riak_uint32_t oldnum,
                    riak_uint32_t newnum);
 
+/**
+ * @brief Make room for `needed` units, doubling the array as it fills up
+ * @param cfg Riak Configuration
+ * @param array Location of array pointer to grow (may point to NULL)
+ * @param size Size of one unit
+ * @param used Number of units currently in use
+ * @param capacity Number of units allocated (in/out)
+ * @param needed Number of units required
+ * @return Error if out of memory
+ */
+riak_error
+riak_array_reserve(riak_config   *cfg,
+                   void        ***array,
+                   riak_size_t    size,
+                   riak_uint32_t  used,
+                   riak_uint32_t *capacity,
+                   riak_uint32_t  needed);
+
+/**
+ * @brief Read the monotonic clock
+ * @returns Microseconds since an arbitrary, fixed point in the past
+ */
+riak_uint64_t
+riak_time_usecs();
+
+/**
+ * @brief Time left before a deadline taken from riak_time_usecs()
+ * @param deadline_usecs Deadline, or 0 for none
+ * @returns Milliseconds remaining, rounded up; 0 once passed, -1 if there is no deadline
+ */
+int
+riak_deadline_ms(riak_uint64_t deadline_usecs);
+
 #endif // _RIAK_UTILS_INTERNAL_H
@@ -28,6 +28,7 @@
 #include "riak_utils-internal.h"
 #include "riak_config-internal.h"
 #include "riak_operation-internal.h"
+#include "riak_metrics-internal.h"
 #include "riak_bucketprops-internal.h"
 
 riak_error
@@ -103,13 +104,133 @@ riak_2i_request_encode(riak_operation      *rop,
     return ERIAK_OK;
 }
 
+/**
+ * @brief Keep the latest continuation seen on the stream
+ * @param cfg Riak Configuration of the response
+ * @param response Response being assembled
+ * @param rpbresp Chunk which may carry a continuation
+ * @param copy Deep copy the continuation because the chunk is about to be freed
+ * @returns Error if out of memory
+ */
+static riak_error
+riak_2i_response_set_continuation(riak_config      *cfg,
+                                  riak_2i_response *response,
+                                  RpbIndexResp     *rpbresp,
+                                  riak_boolean_t    copy) {
+    if (!rpbresp->has_continuation) {
+        return ERIAK_OK;
+    }
+    riak_binary_free(cfg, &(response->continuation));
+    if (copy) {
+        response->continuation = riak_binary_new(cfg, rpbresp->continuation.len, rpbresp->continuation.data);
+    } else {
+        response->continuation = riak_binary_copy_from_pb(cfg, &(rpbresp->continuation));
+    }
+    if (response->continuation == NULL) {
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    response->has_continuation = RIAK_TRUE;
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Hand one chunk of keys and results to the stream callback, then drop it
+ * @param rop Riak Operation
+ * @param pbresp PBC response message
+ * @param resp Returned Riak response structure, holding only the continuation
+ * @param done Returned flag set to true if finished streaming
+ * @return Error if out of memory
+ */
+static riak_error
+riak_2i_stream_decode(riak_operation    *rop,
+                      riak_pb_message   *pbresp,
+                      riak_2i_response **resp,
+                      riak_boolean_t    *done) {
+    // Chunks never outlive this call, so keep them out of any response arena
+    riak_config *cfg      = riak_operation_get_config(rop);
+    riak_config *resp_cfg = riak_operation_get_response_config(rop);
+    RpbIndexResp *rpbresp = rpb_index_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
+    if (rpbresp == NULL) {
+        return ERIAK_MESSAGE_FORMAT;
+    }
+    riak_2i_response *response = *resp;
+    if (response == NULL) {
+        response = (riak_2i_response*)riak_config_clean_allocate(resp_cfg, sizeof(riak_2i_response));
+        if (response == NULL) {
+            rpb_index_resp__free_unpacked(rpbresp, cfg->pb_allocator);
+            return ERIAK_OUT_OF_MEMORY;
+        }
+        *resp = response;
+    }
+
+    // Pointers, then the structures they point to, all borrowing from the chunk
+    riak_uint32_t n_keys    = rpbresp->n_keys;
+    riak_uint32_t n_results = rpbresp->n_results;
+    riak_size_t   size      = n_keys * (sizeof(riak_binary*) + sizeof(riak_binary)) +
+                              n_results * (sizeof(riak_pair*) + sizeof(riak_pair) + 2*sizeof(riak_binary));
+    riak_uint8_t *block = NULL;
+    if (size > 0) {
+        block = (riak_uint8_t*)riak_config_clean_allocate(cfg, size);
+        if (block == NULL) {
+            rpb_index_resp__free_unpacked(rpbresp, cfg->pb_allocator);
+            return ERIAK_OUT_OF_MEMORY;
+        }
+    }
+    riak_2i_response chunk;
+    memset((void*)&chunk, '\0', sizeof(chunk));
+    chunk.keys    = (riak_binary**)block;
+    chunk.results = (riak_pair**)(chunk.keys + n_keys);
+    riak_pair   *pairs    = (riak_pair*)(chunk.results + n_results);
+    riak_binary *binaries = (riak_binary*)(pairs + n_results);
+    int i;
+    for(i = 0; i < n_keys; i++, binaries++) {
+        binaries->len  = rpbresp->keys[i].len;
+        binaries->data = rpbresp->keys[i].data;
+        chunk.keys[i]  = binaries;
+    }
+    for(i = 0; i < n_results; i++) {
+        RpbPair *pbpair = rpbresp->results[i];
+        pairs[i].key       = binaries++;
+        pairs[i].key->len  = pbpair->key.len;
+        pairs[i].key->data = pbpair->key.data;
+        if (pbpair->has_value) {
+            pairs[i].has_value   = RIAK_TRUE;
+            pairs[i].value       = binaries++;
+            pairs[i].value->len  = pbpair->value.len;
+            pairs[i].value->data = pbpair->value.data;
+        }
+        chunk.results[i] = &(pairs[i]);
+    }
+    chunk.n_keys           = n_keys;
+    chunk.n_results        = n_results;
+    chunk.has_continuation = rpbresp->has_continuation;
+    chunk.has_done         = rpbresp->has_done;
+    chunk.done             = rpbresp->done;
+    riak_metrics_phase_end(rop, RIAK_PHASE_DECODE);
+    (rop->stream_cb)(&chunk, rop->stream_data);
+    riak_metrics_phase_end(rop, RIAK_PHASE_CALLBACK);
+
+    riak_error err = riak_2i_response_set_continuation(resp_cfg, response, rpbresp, RIAK_TRUE);
+    response->has_done = rpbresp->has_done;
+    response->done     = rpbresp->done;
+    *done = (rpbresp->has_done && rpbresp->done);
+    riak_free(cfg, &block);
+    rpb_index_resp__free_unpacked(rpbresp, cfg->pb_allocator);
+
+    return err;
+}
+
 riak_error
 riak_2i_response_decode(riak_operation        *rop,
                             riak_pb_message       *pbresp,
                             riak_2i_response **resp,
                             riak_boolean_t        *done) {
+    *done = RIAK_FALSE;
+    if (rop->stream_cb) {
+        return riak_2i_stream_decode(rop, pbresp, resp, done);
+    }
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbIndexResp *rpbresp = rpb_index_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -121,91 +242,63 @@ riak_2i_response_decode(riak_operation        *rop,
     if (response == NULL) {
         response = (riak_2i_response*)riak_config_clean_allocate(cfg, sizeof(riak_2i_response));
         if (response == NULL) {
+            rpb_index_resp__free_unpacked(rpbresp, cfg->pb_allocator);
             return ERIAK_OUT_OF_MEMORY;
         }
-    }
-    *done = RIAK_FALSE;
-    if (rpbresp->has_done) {
-        *done = rpbresp->done;
+        *resp = response;
     }
 
-    // Expand the vector of internal RpbListKeysResp links as necessary
-    riak_uint32_t existing_pbs = response->_n_responses;
-    if (existing_pbs > 0) {
-        if (riak_array_realloc(cfg,
-                               (void***)&(response->_internal),
-                               sizeof(RpbIndexResp*),
-                               existing_pbs,
-                               (existing_pbs+1)) == NULL) {
-            return ERIAK_OUT_OF_MEMORY;
-        }
-    } else {
-        response->_internal = (RpbIndexResp **)riak_config_allocate(cfg, sizeof(RpbIndexResp*));
-        if (response->_internal == NULL) {
-            return ERIAK_OUT_OF_MEMORY;
-        }
+    // Each chunk is appended once; arrays double as they fill so a query
+    // returning N keys costs O(log N) reallocations
+    riak_uint32_t existing_pbs     = response->_n_responses;
+    riak_uint32_t existing_keys    = response->n_keys;
+    riak_uint32_t existing_results = response->n_results;
+    if (riak_array_reserve(cfg,
+                           (void***)&(response->_internal),
+                           sizeof(RpbIndexResp*),
+                           existing_pbs,
+                           &(response->_responses_capacity),
+                           existing_pbs+1) != ERIAK_OK ||
+        riak_array_reserve(cfg,
+                           (void***)&(response->keys),
+                           sizeof(riak_binary*),
+                           existing_keys,
+                           &(response->_keys_capacity),
+                           existing_keys+rpbresp->n_keys) != ERIAK_OK ||
+        riak_array_reserve(cfg,
+                           (void***)&(response->results),
+                           sizeof(riak_pair*),
+                           existing_results,
+                           &(response->_results_capacity),
+                           existing_results+rpbresp->n_results) != ERIAK_OK) {
+        rpb_index_resp__free_unpacked(rpbresp, cfg->pb_allocator);
+        return ERIAK_OUT_OF_MEMORY;
     }
+    // The chunk lives as long as the response, so keys and results point into it
     response->_internal[existing_pbs] = rpbresp;
     response->_n_responses++;
 
-    // If we are streaming, i.e., returning partial results or if we
-    // have the complete message, then assemble a user-consumable response
-    if (rop->streaming || *done) {
-        int i, j, chunk;
-        riak_uint32_t total_keys = 0;
-        riak_uint32_t total_results = 0;
-        for(i = 0; i < response->_n_responses; i++) {
-            total_keys    += response->_internal[i]->n_keys;
-            total_results += response->_internal[i]->n_results;
-        }
-        response->keys = (riak_binary**)riak_config_clean_allocate(cfg, sizeof(riak_binary*) * total_keys);
-        if (response->keys == NULL) {
-            return ERIAK_OUT_OF_MEMORY;
-        }
-        response->n_keys = total_keys;
-        response->results = riak_config_clean_allocate(cfg, sizeof(riak_pair*) * total_results);
-        if (response->results == NULL) {
+    int i;
+    for(i = 0; i < rpbresp->n_keys; i++) {
+        response->keys[response->n_keys] = riak_binary_copy_from_pb(cfg, &(rpbresp->keys[i]));
+        if (response->keys[response->n_keys] == NULL) {
             return ERIAK_OUT_OF_MEMORY;
         }
-        response->n_results = total_results;
-
-        for(i = 0, j = 0, chunk = 0; i < response->n_keys; i++) {
-            RpbIndexResp *rpb_response = response->_internal[chunk];
-            response->keys[i] = riak_binary_copy_from_pb(cfg, &(rpb_response->keys[j]));
-            if (response->keys[i] == NULL) {
-                riak_free(cfg, &(response->keys));
-                return ERIAK_OUT_OF_MEMORY;
-            }
-            // If we have run out of keys in the current response,
-            // start working on the next response
-            if (++j >= response->_internal[chunk]->n_keys) {
-                chunk++;
-                j = 0;
-            }
-        }
-        for(i = 0, j = 0, chunk = 0; i < response->n_results; i++) {
-            RpbIndexResp *rpb_response = response->_internal[chunk];
-            riak_error err = riak_pairs_copy_from_pb(cfg, &(response->results[i]), rpb_response->results[j]);
-            if (err == ERIAK_OK) {
-                riak_free(cfg, &(response->results));
-                return ERIAK_OUT_OF_MEMORY;
-            }
-            // If we have run out of results in the current response,
-            // start working on the next response
-            if (++j >= response->_internal[chunk]->n_keys) {
-                chunk++;
-                j = 0;
-            }
+        response->n_keys++;
+    }
+    for(i = 0; i < rpbresp->n_results; i++) {
+        riak_error err = riak_pairs_copy_from_pb(cfg, &(response->results[response->n_results]), rpbresp->results[i]);
+        if (err != ERIAK_OK) {
+            return err;
         }
+        response->n_results++;
     }
-    // Is this correct?  This would only be from the last message
-    RpbIndexResp *rpb_response = response->_internal[response->_n_responses-1];
-    response->has_continuation = rpb_response->has_continuation;
-    response->continuation = riak_binary_copy_from_pb(cfg, &(rpb_response->continuation));
-    response->has_done = rpb_response->has_done;
-    response->done = rpb_response->done;
-
-    *resp = response;
+    if (riak_2i_response_set_continuation(cfg, response, rpbresp, RIAK_FALSE) != ERIAK_OK) {
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    response->has_done = rpbresp->has_done;
+    response->done     = rpbresp->done;
+    *done = (rpbresp->has_done && rpbresp->done);
 
     return ERIAK_OK;
 }
@@ -243,8 +336,10 @@ riak_2i_response_free(riak_config           *cfg,
         riak_binary_free(cfg, &(response->keys[i]));
     }
     riak_free(cfg, &(response->keys));
-    riak_pairs_free(cfg, &(response->results), response->n_results);
-    riak_free(cfg, &(response->results));
+    if (response->results != NULL) {
+        riak_pairs_free(cfg, &(response->results), response->n_results);
+    }
+    riak_binary_free(cfg, &(response->continuation));
     for(i = 0; i < response->_n_responses; i++) {
         rpb_index_resp__free_unpacked(response->_internal[i], cfg->pb_allocator);
     }
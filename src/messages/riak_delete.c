@@ -81,7 +81,7 @@ riak_delete_request_encode(riak_operation      *rop,
     }
 
     riak_uint32_t msglen = rpb_del_req__get_packed_size (&delmsg);
-    riak_uint8_t* msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t* msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -103,8 +103,8 @@ riak_delete_response_decode(riak_operation        *rop,
                             riak_pb_message       *pbresp,
                             riak_delete_response **resp,
                             riak_boolean_t        *done) {
-    riak_config *cfg = riak_operation_get_config(rop);
-    riak_delete_response *response = (riak_delete_response*)(cfg->malloc_fn)(sizeof(riak_delete_response));
+    riak_config *cfg = riak_operation_get_response_config(rop);
+    riak_delete_response *response = (riak_delete_response*)riak_config_allocate(cfg, sizeof(riak_delete_response));
     *done = RIAK_TRUE;
     if (response == NULL) {
         return ERIAK_OUT_OF_MEMORY;
@@ -76,7 +76,7 @@ riak_get_request_encode(riak_operation  *rop,
         getmsg.n_val = get_options->n_val;
     }
     riak_uint32_t msglen = rpb_get_req__get_packed_size (&getmsg);
-    riak_uint8_t* msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t* msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -97,7 +97,7 @@ riak_get_response_decode(riak_operation     *rop,
                          riak_get_response **resp,
                          riak_boolean_t     *done) {
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbGetResp *rpbresp = rpb_get_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -154,6 +154,399 @@ riak_get_response_decode(riak_operation     *rop,
     return ERIAK_OK;
 }
 
+riak_error
+riak_get_view_request_encode(riak_operation   *rop,
+                             riak_binary      *bucket_type,
+                             riak_binary      *bucket,
+                             riak_binary      *key,
+                             riak_get_options *get_options,
+                             riak_pb_message **req) {
+    riak_error err = riak_get_request_encode(rop, bucket_type, bucket, key, get_options, req);
+    if (err == ERIAK_OK) {
+        riak_operation_set_response_decoder(rop, (riak_response_decoder)riak_get_view_response_decode);
+    }
+    return err;
+}
+
+//
+// Minimal protobuf wire reader for get views. protobuf-c's unpacker copies
+// every bytes field, so views walk the frame themselves and leave the
+// ProtobufCBinaryData pointing into it.
+//
+#define RIAK_PB_WIRE_VARINT  0
+#define RIAK_PB_WIRE_FIXED64 1
+#define RIAK_PB_WIRE_BYTES   2
+#define RIAK_PB_WIRE_FIXED32 5
+
+typedef struct _riak_pb_view {
+    riak_uint8_t *pos;
+    riak_uint8_t *end;
+} riak_pb_view;
+
+static riak_boolean_t
+riak_pb_view_varint(riak_pb_view  *view,
+                    riak_uint64_t *value) {
+    riak_uint64_t result = 0;
+    riak_int32_t  shift;
+    for(shift = 0; shift < 64 && view->pos < view->end; shift += 7) {
+        riak_uint8_t byte = *(view->pos)++;
+        result |= (riak_uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return RIAK_TRUE;
+        }
+    }
+    return RIAK_FALSE;
+}
+
+static riak_boolean_t
+riak_pb_view_bytes(riak_pb_view        *view,
+                   ProtobufCBinaryData *bin) {
+    riak_uint64_t len;
+    if (!riak_pb_view_varint(view, &len) || len > (riak_uint64_t)(view->end - view->pos)) {
+        return RIAK_FALSE;
+    }
+    bin->len  = len;
+    bin->data = view->pos;
+    view->pos += len;
+    return RIAK_TRUE;
+}
+
+static riak_boolean_t
+riak_pb_view_field(riak_pb_view  *view,
+                   riak_uint32_t *field,
+                   riak_uint32_t *wire) {
+    riak_uint64_t tag;
+    if (!riak_pb_view_varint(view, &tag)) {
+        return RIAK_FALSE;
+    }
+    *field = (riak_uint32_t)(tag >> 3);
+    *wire  = (riak_uint32_t)(tag & 0x7);
+    return RIAK_TRUE;
+}
+
+static riak_boolean_t
+riak_pb_view_skip(riak_pb_view *view,
+                  riak_uint32_t wire) {
+    riak_uint64_t       ignored;
+    ProtobufCBinaryData skipped;
+    riak_size_t         width = 0;
+    switch (wire) {
+    case RIAK_PB_WIRE_VARINT:
+        return riak_pb_view_varint(view, &ignored);
+    case RIAK_PB_WIRE_BYTES:
+        return riak_pb_view_bytes(view, &skipped);
+    case RIAK_PB_WIRE_FIXED64:
+        width = 8;
+        break;
+    case RIAK_PB_WIRE_FIXED32:
+        width = 4;
+        break;
+    default:
+        return RIAK_FALSE;
+    }
+    if (width > (riak_size_t)(view->end - view->pos)) {
+        return RIAK_FALSE;
+    }
+    view->pos += width;
+    return RIAK_TRUE;
+}
+
+/**
+ * @brief Read an optional bytes field of a nested message into `bin`
+ */
+static riak_boolean_t
+riak_pb_view_optional_bytes(riak_pb_view        *view,
+                            riak_uint32_t        wire,
+                            protobuf_c_boolean  *has,
+                            ProtobufCBinaryData *bin) {
+    if (wire != RIAK_PB_WIRE_BYTES || !riak_pb_view_bytes(view, bin)) {
+        return RIAK_FALSE;
+    }
+    if (has) *has = RIAK_TRUE;
+    return RIAK_TRUE;
+}
+
+static riak_boolean_t
+riak_pb_view_pair(ProtobufCBinaryData *msg,
+                  RpbPair             *pair) {
+    riak_pb_view  view = { msg->data, msg->data + msg->len };
+    riak_uint32_t field, wire;
+    while (view.pos < view.end) {
+        if (!riak_pb_view_field(&view, &field, &wire)) return RIAK_FALSE;
+        riak_boolean_t ok;
+        switch (field) {
+        case 1:  ok = riak_pb_view_optional_bytes(&view, wire, NULL, &(pair->key)); break;
+        case 2:  ok = riak_pb_view_optional_bytes(&view, wire, &(pair->has_value), &(pair->value)); break;
+        default: ok = riak_pb_view_skip(&view, wire); break;
+        }
+        if (!ok) return RIAK_FALSE;
+    }
+    return RIAK_TRUE;
+}
+
+static riak_boolean_t
+riak_pb_view_link(ProtobufCBinaryData *msg,
+                  RpbLink             *link) {
+    riak_pb_view  view = { msg->data, msg->data + msg->len };
+    riak_uint32_t field, wire;
+    while (view.pos < view.end) {
+        if (!riak_pb_view_field(&view, &field, &wire)) return RIAK_FALSE;
+        riak_boolean_t ok;
+        switch (field) {
+        case 1:  ok = riak_pb_view_optional_bytes(&view, wire, &(link->has_bucket), &(link->bucket)); break;
+        case 2:  ok = riak_pb_view_optional_bytes(&view, wire, &(link->has_key), &(link->key)); break;
+        case 3:  ok = riak_pb_view_optional_bytes(&view, wire, &(link->has_tag), &(link->tag)); break;
+        default: ok = riak_pb_view_skip(&view, wire); break;
+        }
+        if (!ok) return RIAK_FALSE;
+    }
+    return RIAK_TRUE;
+}
+
+/**
+ * @brief Release the scratch arrays hung off a view-decoded RpbContent
+ */
+static void
+riak_get_view_content_free(riak_config *cfg,
+                           RpbContent  *content) {
+    riak_free(cfg, &(content->links));
+    riak_free(cfg, &(content->usermeta));
+    riak_free(cfg, &(content->indexes));
+}
+
+/**
+ * @brief Allocate `n` message pointers followed by the messages they point to
+ */
+static void**
+riak_get_view_messages_new(riak_config *cfg,
+                           riak_size_t  n,
+                           riak_size_t  size) {
+    if (n == 0) return NULL;
+    void **ptrs = (void**)riak_config_clean_allocate(cfg, n * (sizeof(void*) + size));
+    if (ptrs == NULL) return NULL;
+    riak_uint8_t *msgs = (riak_uint8_t*)(ptrs + n);
+    riak_size_t i;
+    for(i = 0; i < n; i++) {
+        ptrs[i] = msgs + (i * size);
+    }
+    return ptrs;
+}
+
+/**
+ * @brief Fill an RpbContent whose bytes fields all point into `msg`
+ * @param cfg Configuration for the scratch link and pair arrays
+ * @param msg Encoded RpbContent
+ * @param content Zeroed RpbContent to fill in
+ * @returns Error if the message is malformed or out of memory
+ */
+static riak_error
+riak_get_view_content(riak_config         *cfg,
+                      ProtobufCBinaryData *msg,
+                      RpbContent          *content) {
+    riak_pb_view        view = { msg->data, msg->data + msg->len };
+    riak_uint32_t       field, wire;
+    riak_uint64_t       number;
+    ProtobufCBinaryData nested;
+    riak_size_t         n_links = 0, n_usermeta = 0, n_indexes = 0;
+
+    // Size the repeated fields first so each gets a single allocation
+    while (view.pos < view.end) {
+        if (!riak_pb_view_field(&view, &field, &wire) || !riak_pb_view_skip(&view, wire)) {
+            return ERIAK_MESSAGE_FORMAT;
+        }
+        if (field == 6)  n_links++;
+        if (field == 9)  n_usermeta++;
+        if (field == 10) n_indexes++;
+    }
+    content->links    = (RpbLink**)riak_get_view_messages_new(cfg, n_links, sizeof(RpbLink));
+    content->usermeta = (RpbPair**)riak_get_view_messages_new(cfg, n_usermeta, sizeof(RpbPair));
+    content->indexes  = (RpbPair**)riak_get_view_messages_new(cfg, n_indexes, sizeof(RpbPair));
+    if ((n_links > 0 && content->links == NULL) ||
+        (n_usermeta > 0 && content->usermeta == NULL) ||
+        (n_indexes > 0 && content->indexes == NULL)) {
+        riak_get_view_content_free(cfg, content);
+        return ERIAK_OUT_OF_MEMORY;
+    }
+
+    view.pos = msg->data;
+    while (view.pos < view.end) {
+        riak_boolean_t ok = riak_pb_view_field(&view, &field, &wire);
+        if (!ok) break;
+        switch (field) {
+        case 1:
+            ok = riak_pb_view_optional_bytes(&view, wire, NULL, &(content->value));
+            break;
+        case 2:
+            ok = riak_pb_view_optional_bytes(&view, wire, &(content->has_content_type), &(content->content_type));
+            break;
+        case 3:
+            ok = riak_pb_view_optional_bytes(&view, wire, &(content->has_charset), &(content->charset));
+            break;
+        case 4:
+            ok = riak_pb_view_optional_bytes(&view, wire, &(content->has_content_encoding), &(content->content_encoding));
+            break;
+        case 5:
+            ok = riak_pb_view_optional_bytes(&view, wire, &(content->has_vtag), &(content->vtag));
+            break;
+        case 6:
+            ok = riak_pb_view_optional_bytes(&view, wire, NULL, &nested) &&
+                 riak_pb_view_link(&nested, content->links[content->n_links++]);
+            break;
+        case 7:
+            ok = (wire == RIAK_PB_WIRE_VARINT) && riak_pb_view_varint(&view, &number);
+            content->has_last_mod = ok;
+            content->last_mod     = (riak_uint32_t)number;
+            break;
+        case 8:
+            ok = (wire == RIAK_PB_WIRE_VARINT) && riak_pb_view_varint(&view, &number);
+            content->has_last_mod_usecs = ok;
+            content->last_mod_usecs     = (riak_uint32_t)number;
+            break;
+        case 9:
+            ok = riak_pb_view_optional_bytes(&view, wire, NULL, &nested) &&
+                 riak_pb_view_pair(&nested, content->usermeta[content->n_usermeta++]);
+            break;
+        case 10:
+            ok = riak_pb_view_optional_bytes(&view, wire, NULL, &nested) &&
+                 riak_pb_view_pair(&nested, content->indexes[content->n_indexes++]);
+            break;
+        case 11:
+            ok = (wire == RIAK_PB_WIRE_VARINT) && riak_pb_view_varint(&view, &number);
+            content->has_deleted = ok;
+            content->deleted     = (number != 0);
+            break;
+        default:
+            ok = riak_pb_view_skip(&view, wire);
+            break;
+        }
+        if (!ok) {
+            riak_get_view_content_free(cfg, content);
+            return ERIAK_MESSAGE_FORMAT;
+        }
+    }
+    return ERIAK_OK;
+}
+
+riak_error
+riak_get_view_response_decode(riak_operation     *rop,
+                              riak_pb_message    *pbresp,
+                              riak_get_response **resp,
+                              riak_boolean_t     *done) {
+    riak_config  *cfg       = riak_operation_get_response_config(rop);
+    riak_config  *tmp_cfg   = riak_operation_get_config(rop);
+    riak_config  *frame_cfg = NULL;
+    riak_uint32_t field, wire;
+    riak_uint64_t number;
+    ProtobufCBinaryData bytes;
+    riak_int32_t  n_content = 0;
+    riak_int32_t  i;
+
+    *done = RIAK_TRUE;
+    if (pbresp->len < 1) {
+        return ERIAK_MESSAGE_FORMAT;
+    }
+    riak_uint8_t *frame = riak_operation_take_frame(rop, pbresp, &frame_cfg);
+    if (frame == NULL) {
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    riak_pb_view view = { frame + 1, frame + pbresp->len };
+
+    // Validate the top-level fields and count the siblings
+    while (view.pos < view.end) {
+        if (!riak_pb_view_field(&view, &field, &wire) || !riak_pb_view_skip(&view, wire)) {
+            riak_free(frame_cfg, &frame);
+            return ERIAK_MESSAGE_FORMAT;
+        }
+        if (field == 1) n_content++;
+    }
+
+    riak_get_response *response = riak_config_clean_allocate(cfg, sizeof(riak_get_response));
+    if (response == NULL) {
+        riak_free(frame_cfg, &frame);
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    response->_frame     = frame;
+    response->_frame_cfg = frame_cfg;
+    if (n_content > 0) {
+        riak_error err = riak_object_new_array(cfg, &(response->content), n_content);
+        if (err != ERIAK_OK) {
+            riak_get_response_free(cfg, &response);
+            return err;
+        }
+    }
+
+    view.pos = frame + 1;
+    while (view.pos < view.end) {
+        riak_pb_view_field(&view, &field, &wire);
+        if (field == 1 && wire == RIAK_PB_WIRE_BYTES) {
+            RpbContent content = RPB_CONTENT__INIT;
+            riak_pb_view_bytes(&view, &bytes);
+            riak_error err = riak_get_view_content(tmp_cfg, &bytes, &content);
+            if (err == ERIAK_OK) {
+                i = response->n_content;
+                err = riak_object_new_from_pb(cfg, &(response->content[i]), &content);
+                riak_get_view_content_free(tmp_cfg, &content);
+                // Count partially built objects too so they are freed below
+                if (response->content[i] != NULL) {
+                    response->n_content++;
+                }
+            }
+            if (err != ERIAK_OK) {
+                riak_get_response_free(cfg, &response);
+                return err;
+            }
+        } else if (field == 2 && wire == RIAK_PB_WIRE_BYTES) {
+            riak_pb_view_bytes(&view, &bytes);
+            riak_binary_free(cfg, &(response->vclock));
+            response->vclock = riak_binary_copy_from_pb(cfg, &bytes);
+            if (response->vclock == NULL) {
+                riak_get_response_free(cfg, &response);
+                return ERIAK_OUT_OF_MEMORY;
+            }
+            response->has_vclock = RIAK_TRUE;
+        } else if (field == 3 && wire == RIAK_PB_WIRE_VARINT) {
+            riak_pb_view_varint(&view, &number);
+            response->has_unchanged = RIAK_TRUE;
+            response->unchanged     = (number != 0);
+        } else {
+            riak_pb_view_skip(&view, wire);
+        }
+    }
+
+    // Siblings share the first sibling's copy of the request's names
+    for(i = 0; i < response->n_content; i++) {
+        riak_object *obj   = response->content[i];
+        riak_object *first = response->content[0];
+        riak_binary *bucket_type = riak_operation_get_bucket_type(rop);
+        riak_binary *bucket      = riak_operation_get_bucket(rop);
+        riak_binary *key         = riak_operation_get_key(rop);
+        if (i == 0) {
+            obj->bucket = bucket ? riak_binary_copy(cfg, bucket) : NULL;
+            obj->key    = key ? riak_binary_copy(cfg, key) : NULL;
+            if (riak_operation_has_bucket_type(rop)) {
+                obj->bucket_type = riak_binary_copy(cfg, bucket_type);
+            }
+        } else {
+            obj->bucket = first->bucket ? riak_binary_copy_shallow(cfg, first->bucket) : NULL;
+            obj->key    = first->key ? riak_binary_copy_shallow(cfg, first->key) : NULL;
+            if (first->bucket_type) {
+                obj->bucket_type = riak_binary_copy_shallow(cfg, first->bucket_type);
+            }
+        }
+        obj->has_bucket_type = (obj->bucket_type != NULL);
+        obj->has_key         = (obj->key != NULL);
+        if ((bucket && obj->bucket == NULL) || (key && obj->key == NULL) ||
+            (riak_operation_has_bucket_type(rop) && obj->bucket_type == NULL)) {
+            riak_get_response_free(cfg, &response);
+            return ERIAK_OUT_OF_MEMORY;
+        }
+    }
+    *resp = response;
+
+    return ERIAK_OK;
+}
+
 riak_int32_t
 riak_get_response_print(riak_print_state  *state,
                         riak_get_response *response) {
@@ -174,11 +567,15 @@ riak_get_response_free(riak_config        *cfg,
                        riak_get_response **resp) {
     riak_get_response *response = *resp;
     if (response == NULL) return;
-    if (response->n_content > 0) {
+    if (response->content != NULL) {
         riak_object_free_array(cfg, &(response->content), response->n_content);
     }
     riak_binary_free(cfg, &(response->vclock));
-    rpb_get_resp__free_unpacked(response->_internal, cfg->pb_allocator);
+    if (response->_frame) {
+        riak_free(response->_frame_cfg, &(response->_frame));
+    } else {
+        rpb_get_resp__free_unpacked(response->_internal, cfg->pb_allocator);
+    }
     riak_free(cfg, resp);
 }
 
@@ -44,7 +44,7 @@ riak_get_bucketprops_request_encode(riak_operation   *rop,
     }
     riak_binary_copy_to_pb(&(bucketreq.bucket), bucket);
     riak_size_t msglen = rpb_get_bucket_req__get_packed_size(&bucketreq);
-    riak_uint8_t *msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t *msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return 1;
     }
@@ -67,7 +67,7 @@ riak_get_bucketprops_response_decode(riak_operation                 *rop,
                                      riak_get_bucketprops_response **resp,
                                      riak_boolean_t                 *done) {
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbGetBucketResp *rpbresp = rpb_get_bucket_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -78,7 +78,7 @@ riak_get_bucketprops_response_decode(riak_operation                 *rop,
     if (rpbresp == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
-    riak_get_bucketprops_response *response = (riak_get_bucketprops_response*)(cfg->malloc_fn)(sizeof(riak_get_bucketprops_response));
+    riak_get_bucketprops_response *response = (riak_get_bucketprops_response*)riak_config_allocate(cfg, sizeof(riak_get_bucketprops_response));
     if (response == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
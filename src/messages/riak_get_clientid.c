@@ -50,7 +50,7 @@ riak_get_clientid_response_decode(riak_operation              *rop,
                                   riak_get_clientid_response **resp,
                                   riak_boolean_t              *done) {
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbGetClientIdResp *rpbresp = rpb_get_client_id_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -61,7 +61,7 @@ riak_get_clientid_response_decode(riak_operation              *rop,
     if (rpbresp == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
-    riak_get_clientid_response *response = (riak_get_clientid_response*)(cfg->malloc_fn)(sizeof(riak_get_clientid_response));
+    riak_get_clientid_response *response = (riak_get_clientid_response*)riak_config_allocate(cfg, sizeof(riak_get_clientid_response));
     if (response == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -47,7 +47,7 @@ riak_listbuckets_request_encode(riak_operation   *rop,
         listbucketsreq.timeout = timeout;
     }
     riak_size_t msglen = rpb_list_buckets_req__get_packed_size(&listbucketsreq);
-    riak_uint8_t *msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t *msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -69,7 +69,7 @@ riak_listbuckets_response_decode(riak_operation             *rop,
                                  riak_pb_message            *pbresp,
                                  riak_listbuckets_response **resp,
                                  riak_boolean_t             *done) {
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     riak_connection *cxn = riak_operation_get_connection(rop);
     riak_log_debug(cxn, "%s", "riak_decode_listbuckets_response");
     RpbListBucketsResp *listbucketresp = rpb_list_buckets_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
@@ -82,7 +82,7 @@ riak_listbuckets_response_decode(riak_operation             *rop,
     // If this is NULL, there was no propious message
     if (response == NULL) {
         riak_log_debug(cxn, "%s", "Initializing listbucket response");
-        response = (cfg->malloc_fn)(sizeof(riak_listbuckets_response));
+        response = riak_config_allocate(cfg, sizeof(riak_listbuckets_response));
         if (response == NULL) {
             return ERIAK_OUT_OF_MEMORY;
         }
@@ -102,7 +102,7 @@ riak_listbuckets_response_decode(riak_operation             *rop,
             return ERIAK_OUT_OF_MEMORY;
         }
     } else {
-        response->buckets = (riak_binary**)(cfg->malloc_fn)(sizeof(riak_binary*)*additional_buckets);
+        response->buckets = (riak_binary**)riak_config_allocate(cfg, sizeof(riak_binary*)*additional_buckets);
         if (response->buckets == NULL) {
             return ERIAK_OUT_OF_MEMORY;
         }
@@ -143,7 +143,7 @@ riak_listbuckets_response_decode(riak_operation             *rop,
             return ERIAK_OUT_OF_MEMORY;
         }
     } else {
-        response->_internal = (RpbListBucketsResp **)(cfg->malloc_fn)(sizeof(RpbListBucketsResp*));
+        response->_internal = (RpbListBucketsResp **)riak_config_allocate(cfg, sizeof(RpbListBucketsResp*));
         if (response->_internal == NULL) {
             return ERIAK_OUT_OF_MEMORY;
         }
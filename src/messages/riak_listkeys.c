@@ -28,6 +28,7 @@
 #include "riak_utils-internal.h"
 #include "riak_config-internal.h"
 #include "riak_operation-internal.h"
+#include "riak_metrics-internal.h"
 
 riak_error
 riak_listkeys_request_encode(riak_operation   *rop,
@@ -48,7 +49,7 @@ riak_listkeys_request_encode(riak_operation   *rop,
         listkeysreq.timeout = timeout;
     }
     riak_size_t msglen = rpb_list_keys_req__get_packed_size(&listkeysreq);
-    riak_uint8_t *msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t *msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return 1;
     }
@@ -65,13 +66,79 @@ riak_listkeys_request_encode(riak_operation   *rop,
 
 }
 
+/**
+ * @brief Hand one chunk of keys to the stream callback, then drop it
+ * @param rop Riak Operation
+ * @param pbresp PBC response message
+ * @param resp Returned Riak response structure, only set on the final chunk
+ * @param done Returned flag set to true if finished streaming
+ * @return Error if out of memory
+ */
+static riak_error
+riak_listkeys_stream_decode(riak_operation          *rop,
+                            riak_pb_message         *pbresp,
+                            riak_listkeys_response **resp,
+                            riak_boolean_t          *done) {
+    // Chunks never outlive this call, so keep them out of any response arena
+    riak_config *cfg = riak_operation_get_config(rop);
+    RpbListKeysResp *listkeyresp = rpb_list_keys_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
+    if (listkeyresp == NULL) {
+        return ERIAK_MESSAGE_FORMAT;
+    }
+    riak_listkeys_response chunk;
+    memset((void*)&chunk, '\0', sizeof(chunk));
+    riak_uint32_t n_keys = listkeyresp->n_keys;
+    if (n_keys > 0) {
+        // Key pointers followed by the binaries they point to, all borrowing from the chunk
+        chunk.keys = (riak_binary**)riak_config_allocate(cfg, n_keys * (sizeof(riak_binary*) + sizeof(riak_binary)));
+        if (chunk.keys == NULL) {
+            rpb_list_keys_resp__free_unpacked(listkeyresp, cfg->pb_allocator);
+            return ERIAK_OUT_OF_MEMORY;
+        }
+        riak_binary *keys = (riak_binary*)(chunk.keys + n_keys);
+        int i;
+        for(i = 0; i < n_keys; i++) {
+            keys[i].len     = listkeyresp->keys[i].len;
+            keys[i].data    = listkeyresp->keys[i].data;
+            keys[i].managed = RIAK_FALSE;
+            chunk.keys[i]   = &(keys[i]);
+        }
+        chunk.n_keys = n_keys;
+    }
+    if (listkeyresp->has_done) {
+        chunk.done = listkeyresp->done;
+    }
+    riak_metrics_phase_end(rop, RIAK_PHASE_DECODE);
+    (rop->stream_cb)(&chunk, rop->stream_data);
+    riak_metrics_phase_end(rop, RIAK_PHASE_CALLBACK);
+    riak_free(cfg, &(chunk.keys));
+    rpb_list_keys_resp__free_unpacked(listkeyresp, cfg->pb_allocator);
+
+    *done = chunk.done;
+    if (*done) {
+        // Only the completion status is left for the response callback
+        riak_config *resp_cfg = riak_operation_get_response_config(rop);
+        riak_listkeys_response *response = riak_config_clean_allocate(resp_cfg, sizeof(riak_listkeys_response));
+        if (response == NULL) {
+            return ERIAK_OUT_OF_MEMORY;
+        }
+        response->done = RIAK_TRUE;
+        *resp = response;
+    }
+
+    return ERIAK_OK;
+}
+
 // STREAMING MESSAGE
 riak_error
 riak_listkeys_response_decode(riak_operation          *rop,
                               riak_pb_message         *pbresp,
                               riak_listkeys_response **resp,
                               riak_boolean_t          *done) {
-    riak_config *cfg = riak_operation_get_config(rop);
+    if (rop->stream_cb) {
+        return riak_listkeys_stream_decode(rop, pbresp, resp, done);
+    }
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbListKeysResp *listkeyresp = rpb_list_keys_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (listkeyresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -81,47 +148,48 @@ riak_listkeys_response_decode(riak_operation          *rop,
     riak_listkeys_response *response = *resp;
     // If this is NULL, there was no previous message
     if (response == NULL) {
-        response = (cfg->malloc_fn)(sizeof(riak_listkeys_response));
+        response = riak_config_clean_allocate(cfg, sizeof(riak_listkeys_response));
         if (response == NULL) {
+            rpb_list_keys_resp__free_unpacked(listkeyresp, cfg->pb_allocator);
             return ERIAK_OUT_OF_MEMORY;
         }
-        memset((void*)response, '\0', sizeof(riak_listkeys_response));
+        *resp = response;
     }
-    // Existing keys need some expansion, so copy the pointers
-    // of the old keys to a new, larger array
-    // TODO: Geometric reallocation to minimize extra mallocs, maybe?
+    // Both arrays double as they fill, so N keys cost O(log N) reallocations
     riak_uint32_t existing_keys   = response->n_keys;
     riak_uint32_t additional_keys = listkeyresp->n_keys;
-    if (response->keys != NULL) {
-        if (riak_array_realloc(cfg,
-                               (void***)&(response->keys),
-                               sizeof(riak_binary*),
-                               existing_keys,
-                               (additional_keys+existing_keys)) == NULL) {
-            return ERIAK_OUT_OF_MEMORY;
-        }
-    } else {
-        response->keys = (riak_binary**)(cfg->malloc_fn)(sizeof(riak_binary*)*additional_keys);
-        if (response->keys == NULL) {
-            return ERIAK_OUT_OF_MEMORY;
-        }
+    riak_uint32_t existing_pbs    = response->n_responses;
+    if (riak_array_reserve(cfg,
+                           (void***)&(response->keys),
+                           sizeof(riak_binary*),
+                           existing_keys,
+                           &(response->keys_capacity),
+                           existing_keys+additional_keys) != ERIAK_OK ||
+        riak_array_reserve(cfg,
+                           (void***)&(response->_internal),
+                           sizeof(RpbListKeysResp*),
+                           existing_pbs,
+                           &(response->responses_capacity),
+                           existing_pbs+1) != ERIAK_OK) {
+        rpb_list_keys_resp__free_unpacked(listkeyresp, cfg->pb_allocator);
+        return ERIAK_OUT_OF_MEMORY;
     }
-    response->n_keys += additional_keys;
+    // Keys point into the unpacked chunk, which lives as long as the response
     for(i = 0; i < additional_keys; i++) {
-        ProtobufCBinaryData *binary = &(listkeyresp->keys[i]);
-        response->keys[i+existing_keys] = riak_binary_new(cfg, binary->len, binary->data);
-        if (response->keys[i+existing_keys]->data == NULL) {
+        response->keys[i+existing_keys] = riak_binary_copy_from_pb(cfg, &(listkeyresp->keys[i]));
+        if (response->keys[i+existing_keys] == NULL) {
             int j;
-            rpb_list_keys_resp__free_unpacked(listkeyresp, cfg->pb_allocator);
             for(j = 0; j < i; j++) {
-                riak_free(cfg, &(response->keys[j+existing_keys]));
+                riak_binary_free(cfg, &(response->keys[j+existing_keys]));
             }
-            riak_free(cfg, &(response->keys));
-            riak_free(cfg, resp);
-
+            rpb_list_keys_resp__free_unpacked(listkeyresp, cfg->pb_allocator);
             return ERIAK_OUT_OF_MEMORY;
         }
     }
+    response->n_keys += additional_keys;
+    response->_internal[existing_pbs] = listkeyresp;
+    response->n_responses++;
+
     response->done = RIAK_FALSE;
     if (listkeyresp->has_done) {
         riak_connection *cxn = riak_operation_get_connection(rop);
@@ -130,26 +198,6 @@ riak_listkeys_response_decode(riak_operation          *rop,
     }
     *done = response->done;
 
-    // Expand the vector of internal RpbListKeysResp links as necessary
-    riak_uint32_t existing_pbs = response->n_responses;
-    if (existing_pbs > 0) {
-        if (riak_array_realloc(cfg,
-                               (void***)&(response->_internal),
-                               sizeof(RpbListKeysResp*),
-                               existing_pbs,
-                               (existing_pbs+1)) == NULL) {
-            return ERIAK_OUT_OF_MEMORY;
-        }
-    } else {
-        response->_internal = (RpbListKeysResp **)(cfg->malloc_fn)(sizeof(RpbListKeysResp*));
-        if (response->_internal == NULL) {
-            return ERIAK_OUT_OF_MEMORY;
-        }
-    }
-    response->_internal[existing_pbs] = listkeyresp;
-    response->n_responses++;
-    *resp = response;
-
     return ERIAK_OK;
 }
 
@@ -179,12 +227,10 @@ riak_listkeys_response_free(riak_config             *cfg,
         riak_binary_free(cfg, &(response->keys[i]));
     }
     riak_free(cfg, &(response->keys));
-    if (response->n_responses > 0) {
-        for(i = 0; i < response->n_responses; i++) {
-            rpb_list_keys_resp__free_unpacked(response->_internal[i], cfg->pb_allocator);
-        }
-        riak_free(cfg, &(response->_internal));
+    for(i = 0; i < response->n_responses; i++) {
+        rpb_list_keys_resp__free_unpacked(response->_internal[i], cfg->pb_allocator);
     }
+    riak_free(cfg, &(response->_internal));
     riak_free(cfg, resp);
 }
 
@@ -43,7 +43,7 @@ riak_mapreduce_request_encode(riak_operation   *rop,
     riak_binary_copy_to_pb(&mapmsg.content_type, content_type);
 
     riak_uint32_t msglen = rpb_map_red_req__get_packed_size (&mapmsg);
-    riak_uint8_t* msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t* msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -64,7 +64,7 @@ riak_mapreduce_response_decode(riak_operation           *rop,
                                riak_mapreduce_response **resp,
                                riak_boolean_t           *done) {
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbMapRedResp *rpbresp = rpb_map_red_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
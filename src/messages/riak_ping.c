@@ -49,8 +49,8 @@ riak_ping_response_decode(riak_operation      *rop,
                           riak_pb_message     *pbresp,
                           riak_ping_response **resp,
                           riak_boolean_t      *done) {
-    riak_config *cfg = riak_operation_get_config(rop);
-    riak_ping_response *response = (riak_ping_response*)(cfg->malloc_fn)(sizeof(riak_ping_response));
+    riak_config *cfg = riak_operation_get_response_config(rop);
+    riak_ping_response *response = (riak_ping_response*)riak_config_allocate(cfg, sizeof(riak_ping_response));
     *done = RIAK_TRUE;
     if (response == NULL) {
         return ERIAK_OUT_OF_MEMORY;
@@ -108,7 +108,7 @@ riak_put_request_encode(riak_operation   *rop,
     }
 
     riak_uint32_t msglen = rpb_put_req__get_packed_size (&putmsg);
-    riak_uint8_t* msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t* msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -121,6 +121,8 @@ riak_put_request_encode(riak_operation   *rop,
     }
     *req = request;
     riak_operation_set_response_decoder(rop, (riak_response_decoder)riak_put_response_decode);
+    // Without a vclock a second copy would land as a sibling (or a second object)
+    rop->no_retry = !(options != NULL && options->has_vclock);
 
     return ERIAK_OK;
 }
@@ -142,7 +144,7 @@ riak_put_response_decode(riak_operation     *rop,
                          riak_put_response **resp,
                          riak_boolean_t     *done) {
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbPutResp *rpbresp = rpb_put_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -154,7 +156,7 @@ riak_put_response_decode(riak_operation     *rop,
         return ERIAK_OUT_OF_MEMORY;
     }
     int i = 0;
-    riak_put_response *response = (riak_put_response*)(cfg->malloc_fn)(sizeof(riak_put_response));
+    riak_put_response *response = (riak_put_response*)riak_config_allocate(cfg, sizeof(riak_put_response));
     if (response == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -103,7 +103,7 @@ riak_search_response_decode(riak_operation           *rop,
                                riak_search_response **resp,
                                riak_boolean_t        *done) {
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbSearchQueryResp *rpbresp = rpb_search_query_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -40,9 +40,8 @@ riak_server_error_response_decode(riak_operation              *rop,
     if (errresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
     }
-    riak_server_error_response *response = (riak_server_error_response*)(cfg->malloc_fn)(sizeof(riak_server_error_response));
+    riak_server_error_response *response = (riak_server_error_response*)riak_config_allocate(cfg, sizeof(riak_server_error_response));
     *done = RIAK_TRUE;
-    riak_free(cfg, &pbresp);
     if (response == NULL) {
         rpb_error_resp__free_unpacked(errresp, cfg->pb_allocator);
         return ERIAK_OUT_OF_MEMORY;
@@ -56,11 +55,6 @@ riak_server_error_response_decode(riak_operation              *rop,
         return ERIAK_OUT_OF_MEMORY;
     }
 
-    // Call user's error callback, if present
-    if (rop->error_cb) {
-        riak_response_callback cb = rop->error_cb;
-        (cb)(response, rop->cb_data);
-    }
     *resp = response;
 
     riak_error err = riak_server_error_new(cfg,
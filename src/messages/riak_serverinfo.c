@@ -49,7 +49,7 @@ riak_serverinfo_response_decode(riak_operation            *rop,
                                 riak_serverinfo_response **resp,
                                 riak_boolean_t            *done) {
     // decode the PB response etc
-    riak_config *cfg = riak_operation_get_config(rop);
+    riak_config *cfg = riak_operation_get_response_config(rop);
     RpbGetServerInfoResp *rpbresp = rpb_get_server_info_resp__unpack(cfg->pb_allocator, (pbresp->len)-1, (uint8_t*)((pbresp->data)+1));
     if (rpbresp == NULL) {
         return ERIAK_MESSAGE_FORMAT;
@@ -60,7 +60,7 @@ riak_serverinfo_response_decode(riak_operation            *rop,
     if (rpbresp == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
-    riak_serverinfo_response *response = (riak_serverinfo_response*)(cfg->malloc_fn)(sizeof(riak_serverinfo_response));
+    riak_serverinfo_response *response = (riak_serverinfo_response*)riak_config_allocate(cfg, sizeof(riak_serverinfo_response));
     if (response == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -34,8 +34,8 @@ riak_set_clientid_response_decode(riak_operation              *rop,
                                   riak_pb_message             *pbresp,
                                   riak_set_clientid_response **resp,
                                   riak_boolean_t              *done) {
-    riak_config *cfg = riak_operation_get_config(rop);
-    riak_set_clientid_response *response = (riak_set_clientid_response*)(cfg->malloc_fn)(sizeof(riak_set_clientid_response));
+    riak_config *cfg = riak_operation_get_response_config(rop);
+    riak_set_clientid_response *response = (riak_set_clientid_response*)riak_config_allocate(cfg, sizeof(riak_set_clientid_response));
     *done = RIAK_TRUE;
     if (response == NULL) {
         return ERIAK_OUT_OF_MEMORY;
@@ -55,7 +55,7 @@ riak_set_clientid_request_encode(riak_operation  *rop,
     riak_binary_copy_to_pb(&(clidmsg.client_id), clientid);
 
     riak_uint32_t msglen = rpb_set_client_id_req__get_packed_size(&clidmsg);
-    riak_uint8_t* msgbuf = (riak_uint8_t*)(cfg->malloc_fn)(msglen);
+    riak_uint8_t* msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, msglen);
     if (msgbuf == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -20,12 +20,17 @@
  *
  *********************************************************************/
 
+#include <poll.h>
 #include <errno.h>
 #include "riak.h"
 #include "riak_connection.h"
 #include "riak_messages-internal.h"
 #include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_metrics-internal.h"
 #include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+#include "riak_connection_pool-internal.h"
 
 //
 // SYNCHRONOUS CALLBACKS
@@ -57,6 +62,150 @@ riak_sync_write_cb(void       *ptr,
     return write(fd, data, size);
 }
 
+riak_ssize_t
+riak_sync_writev_cb(void         *ptr,
+                    struct iovec *iov,
+                    int           iovcnt) {
+    riak_operation  *rop = (riak_operation*)ptr;
+    riak_connection *cxn = riak_operation_get_connection(rop);
+    riak_socket_t    fd  = riak_connection_get_fd(cxn);
+    return writev(fd, iov, iovcnt);
+}
+
+// Blocking reads on a connection's socket, remembering when the server hangs up
+typedef struct _riak_sync_reader {
+    riak_connection *cxn;
+    riak_operation  *rop;       // Operation whose deadline applies (NULL for the whole pipeline)
+    riak_boolean_t   closed;
+    riak_boolean_t   timed_out;
+} riak_sync_reader;
+
+/**
+ * @brief Earliest deadline of the operations waiting on a connection
+ * @param cxn Riak Connection
+ * @returns Deadline from riak_time_usecs(), or 0 if none has one
+ */
+static riak_uint64_t
+riak_pipeline_next_deadline(riak_connection *cxn) {
+    riak_uint64_t   deadline = 0;
+    riak_operation *rop;
+    if (cxn->pipeline_deadlines == 0) {
+        return 0;
+    }
+    for(rop = cxn->pipeline_head; rop != NULL; rop = rop->next) {
+        if (rop->deadline_usecs && (deadline == 0 || rop->deadline_usecs < deadline)) {
+            deadline = rop->deadline_usecs;
+        }
+    }
+    return deadline;
+}
+
+/**
+ * @brief Start the clock on an operation whose request is being sent
+ * @param rop Riak Operation
+ */
+static void
+riak_operation_arm_deadline(riak_operation *rop) {
+    rop->deadline_usecs = (rop->timeout_ms) ? riak_time_usecs() + (riak_uint64_t)rop->timeout_ms * 1000 : 0;
+}
+
+static riak_ssize_t
+riak_sync_reader_cb(void       *ptr,
+                    void       *data,
+                    riak_size_t size) {
+    riak_sync_reader *reader = (riak_sync_reader*)ptr;
+    riak_socket_t     fd     = riak_connection_get_fd(reader->cxn);
+    riak_ssize_t      result;
+    riak_uint64_t     deadline = (reader->rop) ? reader->rop->deadline_usecs
+                                               : riak_pipeline_next_deadline(reader->cxn);
+    if (deadline) {
+        struct pollfd pfd;
+        int ready;
+        do {
+            pfd.fd      = fd;
+            pfd.events  = POLLIN;
+            pfd.revents = 0;
+            ready = poll(&pfd, 1, riak_deadline_ms(deadline));
+        } while (ready < 0 && errno == EINTR);
+        if (ready == 0) {
+            reader->timed_out = RIAK_TRUE;
+            return 0;
+        }
+    }
+    do {
+        result = read(fd, data, size);
+    } while (result < 0 && errno == EINTR);
+    if (result <= 0) {
+        if (result < 0) {
+            char message[256];
+            strerror_r(errno, message, sizeof(message));
+            riak_log_error(reader->cxn, "%s", message);
+        }
+        reader->closed = RIAK_TRUE;
+    }
+    return result;
+}
+
+/**
+ * @brief Reopen a connection left out of step before sending on it again
+ * @param cxn Riak Connection
+ * @returns Error code
+ */
+static riak_error
+riak_sync_check_stale(riak_connection *cxn) {
+    if (!cxn->stale) {
+        return ERIAK_OK;
+    }
+    riak_log_notice(cxn, "Reconnecting to %s:%s", cxn->hostname, cxn->portnum);
+    return riak_connection_reconnect(cxn);
+}
+
+/**
+ * @brief Send a request once and block until its response is decoded
+ * @param rop Riak Operation with an encoded request
+ * @returns Error code
+ */
+static riak_error
+riak_sync_attempt(riak_operation *rop) {
+    riak_connection *cxn = riak_operation_get_connection(rop);
+    // A socket which cannot be reopened uses up a try as well
+    rop->attempts++;
+    riak_error err = riak_sync_check_stale(cxn);
+    if (err) {
+        return err;
+    }
+    riak_operation_arm_deadline(rop);
+    err = riak_writev(rop, riak_sync_writev_cb, rop);
+    if (err) {
+        riak_log_critical(cxn, "%s", "Could not send request");
+        cxn->stale = RIAK_TRUE;
+        return err;
+    }
+
+    riak_sync_reader reader = { cxn, rop, RIAK_FALSE, RIAK_FALSE };
+    riak_boolean_t done_streaming = RIAK_FALSE;
+    while (!done_streaming) {
+        err = riak_read_buffered(rop, &done_streaming, riak_sync_reader_cb, &reader);
+        if (err) {
+            break;
+        }
+        if (!done_streaming && reader.timed_out) {
+            // The late response would be taken for the next request's
+            riak_log_error(cxn, "%s", "Timed out waiting for response");
+            cxn->stale = RIAK_TRUE;
+            err = ERIAK_TIMEOUT;
+            break;
+        }
+        if (!done_streaming && reader.closed) {
+            riak_log_error(cxn, "%s", "Connection closed before response completed");
+            cxn->stale = RIAK_TRUE;
+            err = ERIAK_READ;
+            break;
+        }
+    }
+    return err;
+}
+
 static riak_error
 riak_sync_request(riak_operation **rop_target,
                   void           **response) {
@@ -64,15 +213,15 @@ riak_sync_request(riak_operation **rop_target,
     riak_connection *cxn = riak_operation_get_connection(rop);
     riak_operation_set_cb_data(rop, rop);
 
-    riak_error err = riak_write(rop, riak_sync_write_cb, rop);
-    if (err) {
-        riak_log_critical(cxn, "%s", "Could not send request");
-        riak_operation_free(rop_target);
-        return err;
+    riak_error err = riak_sync_attempt(rop);
+    while (err && riak_operation_can_retry(rop, err)) {
+        // The encoded request is kept, so only the socket needs replacing
+        riak_log_warn(cxn, "Retrying request to %s:%s [%s]", cxn->hostname, cxn->portnum, riak_strerror(err));
+        riak_operation_rewind(rop);
+        riak_config_retry_backoff(riak_connection_get_config(cxn), rop->attempts);
+        err = riak_sync_attempt(rop);
     }
-
-    riak_boolean_t done_streaming;
-    err = riak_read(rop, &done_streaming, riak_sync_read_cb, rop);
+    riak_metrics_operation_done(rop, err);
 
     *response = rop->response;
     riak_operation_free(rop_target);
@@ -83,7 +232,6 @@ riak_error
 riak_ping(riak_connection *cxn) {
     riak_operation *rop = NULL;
     riak_error err   = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
-    riak_config *cfg = riak_connection_get_config(cxn);
     if (err) {
         return err;
     }
@@ -92,6 +240,8 @@ riak_ping(riak_connection *cxn) {
     if (err) {
         return err;
     }
+    // The response comes from the response allocator, which may be an arena
+    riak_config *cfg = riak_operation_get_response_config(rop);
     err = riak_sync_request(&rop, (void**)&response);
     if (err) {
         return err;
@@ -147,6 +297,30 @@ riak_get(riak_connection    *cxn,
     return ERIAK_OK;
 }
 
+riak_error
+riak_get_view(riak_connection    *cxn,
+              riak_binary        *bucket_type,
+              riak_binary        *bucket,
+              riak_binary        *key,
+              riak_get_options   *opts,
+              riak_get_response **response) {
+    riak_operation *rop = NULL;
+    riak_error err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    if (err) {
+        return err;
+    }
+    err = riak_get_view_request_encode(rop, bucket_type, bucket, key, opts, &(rop->pb_request));
+    if (err) {
+        return err;
+    }
+    err = riak_sync_request(&rop, (void**)response);
+    if (err) {
+        return err;
+    }
+
+    return ERIAK_OK;
+}
+
 riak_error
 riak_put(riak_connection    *cxn,
          riak_object        *obj,
@@ -176,7 +350,6 @@ riak_delete(riak_connection    *cxn,
             riak_binary         *key,
             riak_delete_options *opts) {
     riak_operation *rop = NULL;
-    riak_config    *cfg = riak_connection_get_config(cxn);
     riak_error err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
     if (err) {
         return err;
@@ -185,6 +358,7 @@ riak_delete(riak_connection    *cxn,
     if (err) {
         return err;
     }
+    riak_config          *cfg      = riak_operation_get_response_config(rop);
     riak_delete_response *response = NULL;
     err = riak_sync_request(&rop, (void**)&response);
     riak_delete_response_free(cfg, &response);
@@ -238,6 +412,30 @@ riak_listkeys(riak_connection         *cxn,
     return ERIAK_OK;
 }
 
+riak_error
+riak_listkeys_stream(riak_connection              *cxn,
+                     riak_binary                  *bucket_type,
+                     riak_binary                  *bucket,
+                     riak_uint32_t                 timeout,
+                     riak_listkeys_stream_callback cb,
+                     void                         *cb_data) {
+    riak_operation *rop = NULL;
+    riak_error err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    if (err) {
+        return err;
+    }
+    riak_operation_set_stream_cb(rop, (riak_stream_callback)cb, cb_data);
+    err = riak_listkeys_request_encode(rop, bucket_type, bucket, timeout, &(rop->pb_request));
+    if (err) {
+        return err;
+    }
+    riak_config            *cfg      = riak_operation_get_response_config(rop);
+    riak_listkeys_response *response = NULL;
+    err = riak_sync_request(&rop, (void**)&response);
+    riak_listkeys_response_free(cfg, &response);
+    return err;
+}
+
 riak_error
 riak_get_clientid(riak_connection             *cxn,
                   riak_get_clientid_response **response) {
@@ -270,9 +468,10 @@ riak_set_clientid(riak_connection *cxn,
     if (err) {
         return err;
     }
+    riak_config                *cfg      = riak_operation_get_response_config(rop);
     riak_set_clientid_response *response = NULL;
     err = riak_sync_request(&rop, (void**)&response);
-    riak_set_clientid_response_free(riak_connection_get_config(cxn), &response);
+    riak_set_clientid_response_free(cfg, &response);
     if (err) {
         return err;
     }
@@ -393,6 +592,36 @@ riak_2i(riak_connection       *cxn,
     return ERIAK_OK;
 }
 
+riak_error
+riak_2i_stream(riak_connection        *cxn,
+               riak_binary            *bucket_type,
+               riak_binary            *bucket,
+               riak_binary            *index,
+               riak_2i_options        *opts,
+               riak_2i_stream_callback cb,
+               void                   *cb_data,
+               riak_2i_response      **response) {
+    riak_operation *rop = NULL;
+    riak_error err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    if (err) {
+        return err;
+    }
+    riak_operation_set_stream_cb(rop, (riak_stream_callback)cb, cb_data);
+    err = riak_2i_request_encode(rop, bucket_type, bucket, index, opts, &(rop->pb_request));
+    if (err) {
+        return err;
+    }
+    riak_config      *cfg    = riak_operation_get_response_config(rop);
+    riak_2i_response *result = NULL;
+    err = riak_sync_request(&rop, (void**)&result);
+    if (response) {
+        *response = result;
+    } else {
+        riak_2i_response_free(cfg, &result);
+    }
+    return err;
+}
+
 riak_error
 riak_search(riak_connection       *cxn,
             riak_binary           *bucket,
@@ -416,13 +645,97 @@ riak_search(riak_connection       *cxn,
     return ERIAK_OK;
 }
 
+/**
+ * @brief Decode one complete response frame and run the operation's callbacks
+ * @param rop Riak Operation
+ * @param msgbuf Frame body, starting with the message id
+ * @param msglen Length of `msgbuf`
+ * @param done_streaming Set when the operation expects no further frames
+ * @returns Error code
+ * @note `msgbuf` still belongs to the caller after return
+ */
+static riak_error
+riak_operation_dispatch(riak_operation *rop,
+                        riak_uint8_t   *msgbuf,
+                        riak_uint32_t   msglen,
+                        riak_boolean_t *done_streaming) {
+    riak_connection *cxn = riak_operation_get_connection(rop);
+    riak_config     *cfg = riak_connection_get_config(cxn);
+    riak_uint8_t   msgid = msgbuf[0];
+    riak_error    result;
+
+    // Assume we are doing a single loop, unless told otherwise
+    *done_streaming = RIAK_TRUE;
+    rop->answered   = RIAK_TRUE;
+    rop->bytes_read += sizeof(riak_uint32_t) + msglen;
+    riak_metrics_phase_end(rop, RIAK_PHASE_WIRE);
+    if (rop->decoder == NULL) {
+        riak_log_debug(cxn, "%d NOT IMPLEMENTED", msgid);
+        return ERIAK_READ;
+    }
+    // Decoders only look at the frame, so it never needs to leave the stack
+    riak_pb_message frame;
+    riak_pb_message *pbresp = &frame;
+    frame.msgid = msgid;
+    frame.len   = msglen;
+    frame.data  = msgbuf;
+    // Response varies by data type
+    if (msgid == MSG_RPBERRORRESP) {
+        riak_server_error_response *err_response = NULL;
+        result = riak_server_error_response_decode(rop, pbresp, &err_response, done_streaming);
+        if (result) {
+            return ERIAK_READ;
+        }
+        // Convert error response to a null-terminated string, unless nobody would see it
+        if (riak_log_enabled(cfg, RIAK_LOG_ERROR)) {
+            char errmsg[2048];
+            riak_binary_print(err_response->errmsg, errmsg, sizeof(errmsg));
+            riak_log_error(cxn, "ERR #%d - %s\n", err_response->errcode, errmsg);
+        }
+        riak_metrics_phase_end(rop, RIAK_PHASE_DECODE);
+        if (rop->error_cb) {
+            (rop->error_cb)(err_response, rop->cb_data);
+        }
+        riak_metrics_phase_end(rop, RIAK_PHASE_CALLBACK);
+        riak_metrics_phase_record(rop);
+        riak_server_error_response_free(cfg, &err_response);
+        rop->response = NULL;
+        rop->err      = ERIAK_SERVER_ERROR;
+        riak_connection_pool_answered(rop);
+        riak_metrics_operation_done(rop, ERIAK_SERVER_ERROR);
+        return ERIAK_SERVER_ERROR;
+    }
+    // Decode the message from Protocol Buffers
+    result = (rop->decoder)(rop, pbresp, &(rop->response), done_streaming);
+    riak_metrics_phase_end(rop, RIAK_PHASE_DECODE);
+
+    // Something is amiss
+    if (result) {
+        riak_metrics_operation_done(rop, ERIAK_READ);
+        return ERIAK_READ;
+    }
+    if (*done_streaming) {
+        riak_connection_pool_answered(rop);
+        riak_metrics_operation_done(rop, ERIAK_OK);
+    }
+
+    // Call the user-defined callback for this message, when finished
+    if (*done_streaming && rop->response_cb) {
+        (rop->response_cb)(rop->response, rop->cb_data);
+    }
+    if (*done_streaming) {
+        riak_metrics_phase_end(rop, RIAK_PHASE_CALLBACK);
+        riak_metrics_phase_record(rop);
+    }
+    return ERIAK_OK;
+}
+
 riak_error
 riak_read(riak_operation *rop,
           riak_boolean_t *done_streaming,
           riak_io_cb      read_cb,
           void           *read_cb_data) {
     riak_connection *cxn = riak_operation_get_connection(rop);
-    riak_config     *cfg = riak_connection_get_config(cxn);
     riak_size_t      buflen;
     *done_streaming = RIAK_FALSE;
 
@@ -451,12 +764,17 @@ riak_read(riak_operation *rop,
                 return ERIAK_READ;  // Something is hosed here
             }
 
+            riak_metrics_add_read(cxn->config, buflen);
             rop->msglen_complete = RIAK_TRUE;
             rop->msglen = ntohl(inmsglen);
+            rop->position = 0;  // Now counts body bytes, not size bytes
             riak_log_debug(cxn, "Read msglen = %d", rop->msglen);
+            if (rop->msglen == 0) {
+                riak_log_error(cxn, "%s", "Received empty frame");
+                return ERIAK_READ;
+            }
 
-            // TODO: Need to malloc new buffer each time?
-            rop->msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, rop->msglen);
+            rop->msgbuf = riak_connection_buffer_get(cxn, rop->msglen);
             if (rop->msgbuf == NULL) {
                 riak_log_debug(cxn, "%s", "Could not allocate read buffer");
                 return ERIAK_READ;
@@ -469,6 +787,9 @@ riak_read(riak_operation *rop,
         current_position += rop->position;
         buflen = (read_cb)(read_cb_data, (void*)current_position, rop->msglen - rop->position);
         riak_log_debug(cxn, "read %d bytes at position %d, msglen = %d", buflen, rop->position, rop->msglen);
+        if ((riak_ssize_t)buflen > 0) {
+            riak_metrics_add_read(cxn->config, buflen);
+        }
         rop->position += buflen;
         // Are we done yet? If not, break out and wait for the next callback
         if (rop->position < rop->msglen) {
@@ -477,56 +798,190 @@ riak_read(riak_operation *rop,
         }
         assert(rop->position == rop->msglen);
 
-        riak_uint8_t msgid = (rop->msgbuf)[0];
-        riak_pb_message *pbresp = riak_pb_message_new(cfg, msgid, rop->msglen, rop->msgbuf);
-        riak_error result;
+        riak_error result = riak_operation_dispatch(rop, rop->msgbuf, rop->msglen, done_streaming);
+        riak_connection_buffer_put(cxn, &rop->msgbuf, rop->msglen);
         rop->position = 0;  // Reset on success
         rop->msglen = 0;
         rop->msglen_complete = RIAK_FALSE;
-
-        // Response varies by data type
-        riak_server_error_response *err_response = NULL;
-        // Assume we are doing a single loop, unless told otherwise
-        *done_streaming = RIAK_TRUE;
-        if (rop->decoder == NULL) {
-            riak_log_debug(cxn, "%d NOT IMPLEMENTED", msgid);
-            return ERIAK_READ;
+        if (result) {
+            return result;
         }
-        if (msgid == MSG_RPBERRORRESP) {
-            result = riak_server_error_response_decode(rop, pbresp, &err_response, done_streaming);
-            // Convert error response to a null-terminated string
-            char errmsg[2048];
-            riak_binary_print(err_response->errmsg, errmsg, sizeof(errmsg));
-            riak_log_error(cxn, "ERR #%d - %s\n", err_response->errcode, errmsg);
-            if (rop->error_cb) {
-                (rop->error_cb)(err_response, rop->cb_data);
-            }
-            riak_server_error_response_free(cfg, &err_response);
-            rop->response = NULL;
-            return ERIAK_SERVER_ERROR;
+        if (*done_streaming) {
+            break;  // Done with current message
         }
-        // Decode the message from Protocol Buffers
-        result = (rop->decoder)(rop, pbresp, &(rop->response), done_streaming);
+    }
 
-        riak_free(cfg, &pbresp);
-        riak_free(cfg, &rop->msgbuf);
+    return ERIAK_OK;
+}
 
-        // Something is amiss
-        if (result)
-            return ERIAK_READ;
+riak_error
+riak_read_buffered(riak_operation *rop,
+                   riak_boolean_t *done_streaming,
+                   riak_io_cb      read_cb,
+                   void           *read_cb_data) {
+    riak_connection *cxn = riak_operation_get_connection(rop);
+    *done_streaming = RIAK_FALSE;
 
-        // Call the user-defined callback for this message, when finished
-        if (*done_streaming) {
-            if (rop->response_cb) {
-                (rop->response_cb)(rop->response, rop->cb_data);
+    // Finish a frame already being assembled inside the operation
+    if (rop->msglen_complete || rop->position > 0) {
+        return riak_read(rop, done_streaming, read_cb, read_cb_data);
+    }
+    if (cxn->recv_buf == NULL) {
+        cxn->recv_buf = riak_connection_buffer_get(cxn, RIAK_RECV_BUFFER_SIZE);
+        if (cxn->recv_buf == NULL) {
+            riak_log_critical(cxn, "%s", "Could not allocate receive buffer");
+            return ERIAK_OUT_OF_MEMORY;
+        }
+    }
+
+    while(RIAK_TRUE) {
+        // Hand every complete frame already buffered to the operation
+        while (cxn->recv_end - cxn->recv_start >= sizeof(riak_uint32_t)) {
+            riak_uint8_t *frame = cxn->recv_buf + cxn->recv_start;
+            riak_uint32_t msglen;
+            memcpy(&msglen, frame, sizeof(msglen));
+            msglen = ntohl(msglen);
+            if (msglen == 0) {
+                riak_log_error(cxn, "%s", "Received empty frame");
+                return ERIAK_READ;
             }
-            break;  // Done with current message
+            riak_size_t available = cxn->recv_end - cxn->recv_start - sizeof(msglen);
+            if (msglen > available) {
+                if (msglen + sizeof(msglen) <= RIAK_RECV_BUFFER_SIZE) {
+                    break;
+                }
+                // Frame can never fit, so move it into the operation and read the rest in place
+                rop->msgbuf = riak_connection_buffer_get(cxn, msglen);
+                if (rop->msgbuf == NULL) {
+                    riak_log_debug(cxn, "%s", "Could not allocate read buffer");
+                    return ERIAK_READ;
+                }
+                memcpy(rop->msgbuf, frame + sizeof(msglen), available);
+                rop->msglen          = msglen;
+                rop->position        = available;
+                rop->msglen_complete = RIAK_TRUE;
+                cxn->recv_start = cxn->recv_end = 0;
+                return riak_read(rop, done_streaming, read_cb, read_cb_data);
+            }
+            cxn->recv_start += sizeof(msglen) + msglen;
+            riak_error err = riak_operation_dispatch(rop, frame + sizeof(msglen), msglen, done_streaming);
+            if (err) {
+                return err;
+            }
+            // Leave any later frames for the next operation in the pipeline
+            if (*done_streaming) {
+                return ERIAK_OK;
+            }
+        }
+
+        // Slide a partial frame to the front, then top the buffer up
+        if (cxn->recv_start > 0) {
+            memmove(cxn->recv_buf, cxn->recv_buf + cxn->recv_start, cxn->recv_end - cxn->recv_start);
+            cxn->recv_end  -= cxn->recv_start;
+            cxn->recv_start = 0;
         }
+        riak_ssize_t got = (read_cb)(read_cb_data,
+                                     cxn->recv_buf + cxn->recv_end,
+                                     RIAK_RECV_BUFFER_SIZE - cxn->recv_end);
+        if (got <= 0) {
+            return ERIAK_OK;  // Wait for the next callback
+        }
+        riak_metrics_add_read(cxn->config, got);
+        cxn->recv_end += got;
     }
 
     return ERIAK_OK;
 }
 
+/**
+ * @brief Fill in the wire header of a request: 32-bit length then message id
+ * @param msg Encoded request
+ * @param header Buffer of RIAK_FRAME_HEADER_LEN bytes (out)
+ */
+static void
+riak_frame_header(riak_pb_message *msg,
+                  riak_uint8_t    *header) {
+    // Convert len to network byte order
+    riak_uint32_t msglen = htonl(msg->len+1);
+    memcpy(header, &msglen, sizeof(msglen));
+    header[sizeof(msglen)] = msg->msgid;
+}
+
+/**
+ * @brief Keep calling a gathered write until every buffer has been sent
+ * @param iov Buffers to send; consumed in place
+ * @param iovcnt Number of entries in `iov`
+ * @param writev_cb Function used to put buffers on the wire
+ * @param writev_cb_data User data passed to `writev_cb`
+ * @returns Error code
+ */
+static riak_error
+riak_writev_all(struct iovec *iov,
+                int           iovcnt,
+                riak_iov_cb   writev_cb,
+                void         *writev_cb_data) {
+    while (iovcnt > 0) {
+        riak_ssize_t wrote = (writev_cb)(writev_cb_data, iov, iovcnt);
+        if (wrote <= 0) {
+            return ERIAK_WRITE;
+        }
+        // Skip what was fully written and trim a partly written buffer
+        while (iovcnt > 0 && (riak_size_t)wrote >= iov->iov_len) {
+            wrote -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (riak_uint8_t*)iov->iov_base + wrote;
+            iov->iov_len -= wrote;
+        }
+    }
+    return ERIAK_OK;
+}
+
+riak_error
+riak_writev(riak_operation *rop,
+            riak_iov_cb     writev_cb,
+            void           *writev_cb_data) {
+    return riak_writev_batch(&rop, 1, writev_cb, writev_cb_data);
+}
+
+riak_error
+riak_writev_batch(riak_operation **rops,
+                  riak_uint32_t    n_rops,
+                  riak_iov_cb      writev_cb,
+                  void            *writev_cb_data) {
+    riak_uint8_t headers[RIAK_WRITEV_MAX_OPS][RIAK_FRAME_HEADER_LEN];
+    struct iovec iov[RIAK_WRITEV_MAX_OPS*2];
+    riak_uint32_t done = 0;
+    riak_uint32_t sent = 0;
+
+    while (done < n_rops) {
+        int iovcnt = 0;
+        riak_uint32_t i;
+        for(i = 0; i < RIAK_WRITEV_MAX_OPS && done < n_rops; i++, done++) {
+            riak_pb_message *msg = rops[done]->pb_request;
+            riak_frame_header(msg, headers[i]);
+            iov[iovcnt].iov_base = headers[i];
+            iov[iovcnt].iov_len  = RIAK_FRAME_HEADER_LEN;
+            iovcnt++;
+            if (msg->len > 0) {
+                iov[iovcnt].iov_base = msg->data;
+                iov[iovcnt].iov_len  = msg->len;
+                iovcnt++;
+            }
+        }
+        riak_error err = riak_writev_all(iov, iovcnt, writev_cb, writev_cb_data);
+        if (err) {
+            return err;
+        }
+        for(; sent < done; sent++) {
+            riak_metrics_operation_sent(rops[sent], RIAK_FRAME_HEADER_LEN + rops[sent]->pb_request->len);
+            riak_connection_pool_sent(rops[sent]);
+        }
+    }
+    return ERIAK_OK;
+}
 
 // TODO: NOT CHARSET SAFE, need iconv
 riak_error
@@ -534,20 +989,21 @@ riak_write(riak_operation *rop,
            riak_io_cb      write_cb,
            void           *write_cb_data) {
     riak_pb_message *msg = rop->pb_request;
-    riak_uint8_t  reqid  = msg->msgid;
     riak_uint8_t *msgbuf = msg->data;
     riak_size_t   len    = msg->len;
 
-    // Convert len to network byte order
-    riak_uint32_t msglen = htonl(len+1);
-    riak_int32_t wrote = (write_cb)(write_cb_data, (void*)&msglen, sizeof(msglen));
-    if (wrote == 0) return ERIAK_WRITE;
-    wrote = (write_cb)(write_cb_data, (void*)&reqid, sizeof(reqid));
+    // Length and message id go out together
+    riak_uint8_t header[RIAK_FRAME_HEADER_LEN];
+    riak_frame_header(msg, header);
+    riak_int32_t wrote = (write_cb)(write_cb_data, (void*)header, sizeof(header));
     if (wrote == 0) return ERIAK_WRITE;
     if (len > 0) {
         wrote = (write_cb)(write_cb_data, (void*)msgbuf, len);
         if (wrote == 0) return ERIAK_WRITE;
     }
+    riak_metrics_operation_sent(rop, sizeof(header) + len);
+    riak_connection_pool_sent(rop);
+    riak_operation_arm_deadline(rop);
 #ifdef _RIAK_DEBUG
     riak_connection *cxn = riak_operation_get_connection(rop);
     riak_log_debug(cxn, "Wrote %d bytes", (int)len);
@@ -575,3 +1031,372 @@ riak_write(riak_operation *rop,
 #endif
     return ERIAK_OK;
 }
+
+//
+// PIPELINING
+//
+
+/**
+ * @brief Blocking gathered write on the connection's socket
+ * @param ptr Riak Connection
+ */
+static riak_ssize_t
+riak_pipeline_sync_writev_cb(void         *ptr,
+                             struct iovec *iov,
+                             int           iovcnt) {
+    riak_connection *cxn = (riak_connection*)ptr;
+    return writev(riak_connection_get_fd(cxn), iov, iovcnt);
+}
+
+/**
+ * @brief Add an operation to the end of the pipeline as it is
+ * @param cxn Riak Connection
+ * @param rop Riak Operation
+ */
+static void
+riak_pipeline_append(riak_connection *cxn,
+                     riak_operation  *rop) {
+    rop->next = NULL;
+    if (cxn->pipeline_tail) {
+        cxn->pipeline_tail->next = rop;
+    } else {
+        cxn->pipeline_head = rop;
+    }
+    cxn->pipeline_tail = rop;
+    cxn->pipeline_depth++;
+    if (rop->deadline_usecs) {
+        cxn->pipeline_deadlines++;
+    }
+}
+
+/**
+ * @brief Queue an operation whose request is already on the wire
+ * @param cxn Riak Connection
+ * @param rop Riak Operation
+ */
+static void
+riak_pipeline_push(riak_connection *cxn,
+                   riak_operation  *rop) {
+    riak_operation_arm_deadline(rop);
+    rop->attempts++;
+    riak_pipeline_append(cxn, rop);
+}
+
+/**
+ * @brief Remove the oldest outstanding operation from the pipeline
+ * @param cxn Riak Connection
+ * @returns Former head of the pipeline
+ */
+static riak_operation*
+riak_pipeline_pop(riak_connection *cxn) {
+    riak_operation *rop = cxn->pipeline_head;
+    cxn->pipeline_head = rop->next;
+    if (cxn->pipeline_head == NULL) {
+        cxn->pipeline_tail = NULL;
+    }
+    cxn->pipeline_depth--;
+    if (rop->deadline_usecs) {
+        cxn->pipeline_deadlines--;
+    }
+    rop->next = NULL;
+    return rop;
+}
+
+riak_error
+riak_pipeline_send(riak_operation *rop,
+                   riak_io_cb      write_cb,
+                   void           *write_cb_data) {
+    riak_error err = riak_write(rop, write_cb, write_cb_data);
+    if (err) {
+        return err;
+    }
+    riak_pipeline_push(riak_operation_get_connection(rop), rop);
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_pipeline_send_batch(riak_operation **rops,
+                         riak_uint32_t    n_rops,
+                         riak_iov_cb      writev_cb,
+                         void            *writev_cb_data) {
+    riak_error err = riak_writev_batch(rops, n_rops, writev_cb, writev_cb_data);
+    if (err) {
+        // Earlier frames, or part of one, may be on the wire and would be answered
+        riak_operation_get_connection(rops[0])->stale = RIAK_TRUE;
+        return err;
+    }
+    riak_uint32_t i;
+    for(i = 0; i < n_rops; i++) {
+        riak_pipeline_push(riak_operation_get_connection(rops[i]), rops[i]);
+    }
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_pipeline_read(riak_connection *cxn,
+                   riak_io_cb       read_cb,
+                   void            *read_cb_data) {
+    while (cxn->pipeline_head) {
+        riak_operation *rop  = cxn->pipeline_head;
+        riak_boolean_t  done = RIAK_FALSE;
+        riak_error err = riak_read_buffered(rop, &done, read_cb, read_cb_data);
+        // A server error still answers exactly one request, so the stream stays in step
+        if (err && err != ERIAK_SERVER_ERROR) {
+            return err;
+        }
+        if (!done) {
+            return ERIAK_OK;  // Wait for the rest of the frame
+        }
+        rop = riak_pipeline_pop(cxn);
+        riak_operation_free(&rop);
+    }
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_pipeline_sync_send(riak_operation *rop) {
+    riak_connection *cxn = riak_operation_get_connection(rop);
+    if (cxn->pipeline_head == NULL) {
+        riak_error err = riak_sync_check_stale(cxn);
+        if (err) {
+            return err;
+        }
+    }
+    return riak_pipeline_send_batch(&rop, 1, riak_pipeline_sync_writev_cb, cxn);
+}
+
+riak_error
+riak_pipeline_sync_send_batch(riak_operation **rops,
+                              riak_uint32_t    n_rops) {
+    if (n_rops == 0) {
+        return ERIAK_OK;
+    }
+    riak_connection *cxn = riak_operation_get_connection(rops[0]);
+    if (cxn->pipeline_head == NULL) {
+        riak_error err = riak_sync_check_stale(cxn);
+        if (err) {
+            return err;
+        }
+    }
+    return riak_pipeline_send_batch(rops, n_rops, riak_pipeline_sync_writev_cb, cxn);
+}
+
+riak_error
+riak_pipeline_sync_wait(riak_connection *cxn) {
+    riak_sync_reader reader = { cxn, NULL, RIAK_FALSE, RIAK_FALSE };
+    while (cxn->pipeline_head) {
+        riak_error err = riak_pipeline_read(cxn, riak_sync_reader_cb, &reader);
+        if (err) {
+            return err;
+        }
+        if (cxn->pipeline_head && reader.timed_out) {
+            riak_log_error(cxn, "Timed out with %d responses outstanding", cxn->pipeline_depth);
+            riak_pipeline_fail(cxn, ERIAK_TIMEOUT);
+            return ERIAK_TIMEOUT;
+        }
+        if (cxn->pipeline_head && reader.closed) {
+            riak_log_error(cxn, "Connection closed with %d responses outstanding", cxn->pipeline_depth);
+            if (!riak_config_retry_allowed(riak_connection_get_config(cxn), 1)) {
+                riak_pipeline_fail(cxn, ERIAK_READ);
+                return ERIAK_READ;
+            }
+            err = riak_pipeline_retry(cxn, ERIAK_READ);
+            if (err) {
+                return err;
+            }
+            reader.closed = RIAK_FALSE;
+        }
+    }
+
+    return ERIAK_OK;
+}
+
+riak_uint32_t
+riak_pipeline_get_depth(riak_connection *cxn) {
+    return cxn->pipeline_depth;
+}
+
+int
+riak_pipeline_get_timeout(riak_connection *cxn) {
+    return riak_deadline_ms(riak_pipeline_next_deadline(cxn));
+}
+
+riak_uint32_t
+riak_pipeline_reset(riak_connection *cxn) {
+    riak_uint32_t dropped = 0;
+    while (cxn->pipeline_head) {
+        riak_operation *rop = riak_pipeline_pop(cxn);
+        riak_operation_free(&rop);
+        dropped++;
+    }
+    return dropped;
+}
+
+/**
+ * @brief Give up on an operation taken off the pipeline, telling its abandon callback why
+ * @param rop Riak Operation (freed)
+ * @param err Reason
+ */
+static void
+riak_pipeline_abandon(riak_operation *rop,
+                      riak_error      err) {
+    riak_metrics_operation_done(rop, err);
+    if (rop->abandon_cb) {
+        (rop->abandon_cb)(err, rop->cb_data);
+    }
+    riak_operation_free(&rop);
+}
+
+riak_uint32_t
+riak_pipeline_fail(riak_connection *cxn,
+                   riak_error       err) {
+    riak_uint32_t dropped = 0;
+    if (cxn->pipeline_head) {
+        cxn->stale = RIAK_TRUE; // Any answers still to come belong to nobody
+    }
+    while (cxn->pipeline_head) {
+        riak_pipeline_abandon(riak_pipeline_pop(cxn), err);
+        dropped++;
+    }
+    return dropped;
+}
+
+riak_uint32_t
+riak_pipeline_drop(riak_connection *cxn,
+                   riak_error       err) {
+    if (cxn->pipeline_head == NULL) {
+        return 0;
+    }
+    riak_log_error(cxn, "Dropping %d pipelined operations [%s]",
+                   cxn->pipeline_depth, riak_strerror(err));
+    return riak_pipeline_fail(cxn, err);
+}
+
+riak_error
+riak_pipeline_queue(riak_operation *rop,
+                    riak_io_cb      write_cb,
+                    void           *write_cb_data,
+                    riak_size_t    *buffered) {
+    riak_size_t before = *buffered;
+    riak_error  err    = riak_pipeline_send(rop, write_cb, write_cb_data);
+    if (err) {
+        *buffered = before;
+    }
+    return err;
+}
+
+riak_error
+riak_pipeline_retry(riak_connection *cxn,
+                    riak_error       err) {
+    riak_operation *head     = NULL;
+    riak_operation *tail     = NULL;
+    riak_uint32_t   attempts = 0;
+    riak_uint32_t   kept     = 0;
+
+    // Keep, in order, whatever may safely be sent again and give up on the rest
+    while (cxn->pipeline_head) {
+        riak_operation *rop = riak_pipeline_pop(cxn);
+        if (!riak_operation_can_retry(rop, err)) {
+            riak_pipeline_abandon(rop, err);
+            continue;
+        }
+        riak_operation_rewind(rop);
+        if (rop->attempts > attempts) {
+            attempts = rop->attempts;
+        }
+        if (tail) {
+            tail->next = rop;
+        } else {
+            head = rop;
+        }
+        tail = rop;
+        kept++;
+    }
+    cxn->stale = RIAK_TRUE;
+    if (head == NULL) {
+        return err;
+    }
+
+    riak_log_warn(cxn, "Retrying %d pipelined requests to %s:%s [%s]",
+                  kept, cxn->hostname, cxn->portnum, riak_strerror(err));
+    riak_config_retry_backoff(riak_connection_get_config(cxn), attempts);
+    riak_error result = riak_connection_reconnect(cxn);
+    while (head) {
+        riak_operation *rops[RIAK_WRITEV_MAX_OPS];
+        riak_uint32_t   n_rops = 0;
+        while (head && n_rops < RIAK_WRITEV_MAX_OPS) {
+            rops[n_rops] = head;
+            head = head->next;
+            rops[n_rops++]->next = NULL;
+        }
+        if (result == ERIAK_OK) {
+            result = riak_pipeline_send_batch(rops, n_rops, riak_pipeline_sync_writev_cb, cxn);
+        }
+        if (result) {
+            riak_uint32_t i;
+            for(i = 0; i < n_rops; i++) {
+                riak_pipeline_abandon(rops[i], result);
+            }
+        }
+    }
+    if (result) {
+        riak_pipeline_fail(cxn, result);
+    }
+
+    return result;
+}
+
+riak_uint32_t
+riak_pipeline_rewind(riak_connection *cxn,
+                     riak_error       err,
+                     riak_uint64_t   *backoff_usecs) {
+    riak_uint32_t remaining = cxn->pipeline_depth;
+    riak_uint32_t attempts  = 0;
+    riak_uint32_t kept      = 0;
+
+    // Go round the queue once, keeping in order whatever may safely be sent again
+    while (remaining-- > 0) {
+        riak_operation *rop = riak_pipeline_pop(cxn);
+        if (!riak_operation_can_retry(rop, err)) {
+            riak_pipeline_abandon(rop, err);
+            continue;
+        }
+        riak_operation_rewind(rop);
+        if (rop->attempts > attempts) {
+            attempts = rop->attempts;
+        }
+        // A socket which cannot be reopened uses up a try as well
+        rop->attempts++;
+        riak_pipeline_append(cxn, rop);
+        kept++;
+    }
+    cxn->stale = RIAK_TRUE;
+    *backoff_usecs = 0;
+    if (kept > 0) {
+        riak_log_warn(cxn, "Retrying %d pipelined requests to %s:%s [%s]",
+                      kept, cxn->hostname, cxn->portnum, riak_strerror(err));
+        *backoff_usecs = riak_config_retry_backoff_usecs(riak_connection_get_config(cxn), attempts);
+    }
+
+    return kept;
+}
+
+riak_error
+riak_pipeline_resend(riak_connection *cxn,
+                     riak_io_cb       write_cb,
+                     void            *write_cb_data) {
+    riak_operation *rop;
+    for(rop = cxn->pipeline_head; rop != NULL; rop = rop->next) {
+        // Requests queued since the rewind are framed again too, so the new stream starts clean
+        riak_operation_rewind(rop);
+        riak_error err = riak_write(rop, write_cb, write_cb_data);
+        if (err) {
+            return err;
+        }
+    }
+
+    return ERIAK_OK;
+}
@@ -52,6 +52,18 @@ riak_async_register_get(riak_operation        *rop,
     return riak_get_request_encode(rop, bucket_type, bucket, key, get_options, &(rop->pb_request));
 }
 
+riak_error
+riak_async_register_get_view(riak_operation        *rop,
+                             riak_binary           *bucket_type,
+                             riak_binary           *bucket,
+                             riak_binary           *key,
+                             riak_get_options      *get_options,
+                             riak_response_callback cb) {
+
+    riak_operation_set_response_cb(rop, cb);
+    return riak_get_view_request_encode(rop, bucket_type, bucket, key, get_options, &(rop->pb_request));
+}
+
 riak_error
 riak_async_register_put(riak_operation        *rop,
                         riak_object           *riak_obj,
@@ -91,6 +103,19 @@ riak_async_register_listkeys(riak_operation        *rop,
     return riak_listkeys_request_encode(rop, bucket_type, bucket, timeout, &(rop->pb_request));
 }
 
+riak_error
+riak_async_register_listkeys_stream(riak_operation               *rop,
+                                    riak_binary                  *bucket_type,
+                                    riak_binary                  *bucket,
+                                    riak_uint32_t                 timeout,
+                                    riak_listkeys_stream_callback stream_cb,
+                                    void                         *stream_data,
+                                    riak_response_callback        cb) {
+    riak_operation_set_response_cb(rop, cb);
+    riak_operation_set_stream_cb(rop, (riak_stream_callback)stream_cb, stream_data);
+    return riak_listkeys_request_encode(rop, bucket_type, bucket, timeout, &(rop->pb_request));
+}
+
 riak_error
 riak_async_register_get_clientid(riak_operation       *rop,
                                  riak_response_callback cb) {
@@ -155,6 +180,20 @@ riak_async_register_2i(riak_operation        *rop,
     return riak_2i_request_encode(rop, bucket_type, bucket, index, index_options, &(rop->pb_request));
 }
 
+riak_error
+riak_async_register_2i_stream(riak_operation         *rop,
+                              riak_binary            *bucket_type,
+                              riak_binary            *bucket,
+                              riak_binary            *index,
+                              riak_2i_options        *index_options,
+                              riak_2i_stream_callback stream_cb,
+                              void                   *stream_data,
+                              riak_response_callback  cb) {
+    riak_operation_set_response_cb(rop, cb);
+    riak_operation_set_stream_cb(rop, (riak_stream_callback)stream_cb, stream_data);
+    return riak_2i_request_encode(rop, bucket_type, bucket, index, index_options, &(rop->pb_request));
+}
+
 riak_error
 riak_async_register_search(riak_operation      *rop,
                            riak_binary         *bucket,
@@ -0,0 +1,506 @@
+/*********************************************************************
+ *
+ * riak_batch.c: Pipelined fan-out of many requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <poll.h>
+#include <errno.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+#include "riak_connection_pool-internal.h"
+
+struct _riak_batch;
+
+/**
+ * @brief Encode the request for one item of a batch
+ * @param batch Batch being run
+ * @param rop Riak Operation to encode into
+ * @param index Position of the item in the caller's array
+ * @returns Error code
+ */
+typedef riak_error (*riak_batch_encoder)(struct _riak_batch *batch,
+                                         riak_operation     *rop,
+                                         riak_uint32_t       index);
+
+/**
+ * @brief Record the outcome of one item and tell the caller
+ * @param batch Batch being run
+ * @param index Position of the item in the caller's array
+ * @param err Outcome of the item
+ * @param response Decoded response, or NULL on error
+ */
+typedef void (*riak_batch_completer)(struct _riak_batch *batch,
+                                     riak_uint32_t       index,
+                                     riak_error          err,
+                                     void               *response);
+
+// Callback data of each operation, so responses find their item
+typedef struct _riak_batch_slot {
+    struct _riak_batch *batch;
+    riak_uint32_t       index;
+} riak_batch_slot;
+
+typedef struct _riak_batch {
+    riak_config         *cfg;
+    riak_uint32_t        n_items;
+    riak_uint32_t        next;      // First item not yet sent
+    riak_uint32_t        completed; // Items with an outcome
+    riak_uint32_t        window;    // Most requests in flight per connection
+    riak_batch_slot     *slots;
+    riak_batch_encoder   encode;
+    riak_batch_completer complete;
+    void                *items;
+    void                *options;
+    void                *cb;
+    void                *cb_data;
+} riak_batch;
+
+// One connection the batch is spread over
+typedef struct _riak_batch_lane {
+    riak_connection *cxn;
+    riak_error       err; // First connection-level failure, which retires the lane
+} riak_batch_lane;
+
+// Reads only what has already arrived, so one slow connection never stalls the rest
+typedef struct _riak_batch_reader {
+    riak_connection *cxn;
+    riak_boolean_t   closed;
+} riak_batch_reader;
+
+static riak_ssize_t
+riak_batch_reader_cb(void       *ptr,
+                     void       *data,
+                     riak_size_t size) {
+    riak_batch_reader *reader = (riak_batch_reader*)ptr;
+    riak_socket_t      fd     = riak_connection_get_fd(reader->cxn);
+    riak_ssize_t       result;
+    do {
+        result = recv(fd, data, size, MSG_DONTWAIT);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            char message[256];
+            strerror_r(errno, message, sizeof(message));
+            riak_log_error(reader->cxn, "%s", message);
+            reader->closed = RIAK_TRUE;
+        }
+        return 0;
+    }
+    if (result == 0) {
+        reader->closed = RIAK_TRUE;
+    }
+    return result;
+}
+
+static void
+riak_batch_response_cb(void *response,
+                       void *ptr) {
+    riak_batch_slot *slot = (riak_batch_slot*)ptr;
+    (slot->batch->complete)(slot->batch, slot->index, ERIAK_OK, response);
+}
+
+static void
+riak_batch_error_cb(void *response,
+                    void *ptr) {
+    riak_batch_slot *slot = (riak_batch_slot*)ptr;
+    (slot->batch->complete)(slot->batch, slot->index, ERIAK_SERVER_ERROR, NULL);
+}
+
+static void
+riak_batch_abandon_cb(riak_error err,
+                      void      *ptr) {
+    riak_batch_slot *slot = (riak_batch_slot*)ptr;
+    (slot->batch->complete)(slot->batch, slot->index, err, NULL);
+}
+
+/**
+ * @brief Retry, or else fail, every request still waiting on a broken connection
+ * @param batch Batch being run
+ * @param lane Failed connection
+ * @param err Connection-level error
+ */
+static void
+riak_batch_lane_fail(riak_batch      *batch,
+                     riak_batch_lane *lane,
+                     riak_error       err) {
+    riak_uint32_t depth = riak_pipeline_get_depth(lane->cxn);
+    // Requests which may be retried carry on over a new socket
+    if (depth > 0 &&
+        riak_config_retry_allowed(riak_connection_get_config(lane->cxn), 1) &&
+        riak_pipeline_retry(lane->cxn, err) == ERIAK_OK) {
+        return;
+    }
+    riak_log_error(lane->cxn, "Batch lost %d requests: %s", depth, riak_strerror(err));
+    riak_pipeline_fail(lane->cxn, err);
+    lane->cxn->stale = RIAK_TRUE;
+    lane->err = err;
+}
+
+/**
+ * @brief Send unsent items on a connection until its window is full
+ * @param batch Batch being run
+ * @param lane Connection to send on
+ * @returns Connection-level error, if any
+ */
+static riak_error
+riak_batch_lane_fill(riak_batch      *batch,
+                     riak_batch_lane *lane) {
+    riak_operation *rops[RIAK_WRITEV_MAX_OPS];
+    while (batch->next < batch->n_items) {
+        riak_uint32_t depth = riak_pipeline_get_depth(lane->cxn);
+        riak_uint32_t n_rops = 0;
+        while (depth + n_rops < batch->window &&
+               n_rops < RIAK_WRITEV_MAX_OPS &&
+               batch->next < batch->n_items) {
+            riak_uint32_t   index = batch->next++;
+            riak_operation *rop   = NULL;
+            riak_error err = riak_operation_new(lane->cxn, &rop, riak_batch_response_cb, riak_batch_error_cb, &(batch->slots[index]));
+            if (err == ERIAK_OK) {
+                riak_operation_set_abandon_cb(rop, riak_batch_abandon_cb);
+                err = (batch->encode)(batch, rop, index);
+                if (err) {
+                    riak_operation_free(&rop);
+                }
+            }
+            if (err) {
+                (batch->complete)(batch, index, err, NULL);
+                continue;
+            }
+            rops[n_rops++] = rop;
+        }
+        if (n_rops == 0) {
+            break;
+        }
+        riak_error err = riak_pipeline_sync_send_batch(rops, n_rops);
+        if (err) {
+            // Nothing was queued, so these are still ours to fail
+            riak_uint32_t i;
+            for(i = 0; i < n_rops; i++) {
+                riak_batch_slot *slot = (riak_batch_slot*)rops[i]->cb_data;
+                (batch->complete)(batch, slot->index, err, NULL);
+                riak_operation_free(&(rops[i]));
+            }
+            return err;
+        }
+    }
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Decode whatever responses have arrived on a connection
+ * @param lane Readable connection
+ * @returns Connection-level error, if any
+ */
+static riak_error
+riak_batch_lane_read(riak_batch_lane *lane) {
+    riak_batch_reader reader = { lane->cxn, RIAK_FALSE };
+    riak_error err = riak_pipeline_read(lane->cxn, riak_batch_reader_cb, &reader);
+    if (err) {
+        return err;
+    }
+    if (reader.closed && riak_pipeline_get_depth(lane->cxn) > 0) {
+        riak_log_error(lane->cxn, "%s", "Connection closed with batch requests outstanding");
+        return ERIAK_READ;
+    }
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Keep every connection's window full until each item has an outcome
+ * @param batch Batch to run
+ * @param lanes Connections to spread the batch over
+ * @param n_lanes Number of connections
+ * @returns First connection-level error if any item was left unanswered
+ */
+static riak_error
+riak_batch_run(riak_batch      *batch,
+               riak_batch_lane *lanes,
+               riak_uint32_t    n_lanes) {
+    riak_error     result = ERIAK_OK;
+    riak_uint32_t  i;
+    struct pollfd *fds = (struct pollfd*)riak_config_allocate(batch->cfg, n_lanes * sizeof(struct pollfd));
+    if (fds == NULL) {
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    // Which lane each entry in fds belongs to
+    riak_uint32_t *lanes_polled = (riak_uint32_t*)riak_config_allocate(batch->cfg, n_lanes * sizeof(riak_uint32_t));
+    if (lanes_polled == NULL) {
+        riak_free(batch->cfg, &fds);
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    batch->slots = (riak_batch_slot*)riak_config_allocate(batch->cfg, batch->n_items * sizeof(riak_batch_slot));
+    if (batch->slots == NULL && batch->n_items > 0) {
+        riak_free(batch->cfg, &lanes_polled);
+        riak_free(batch->cfg, &fds);
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    for(i = 0; i < batch->n_items; i++) {
+        batch->slots[i].batch = batch;
+        batch->slots[i].index = i;
+    }
+
+    while (batch->completed < batch->n_items) {
+        // Top up every healthy connection, then wait for any of them to answer
+        nfds_t nfds    = 0;
+        int    wait_ms = -1;
+        for(i = 0; i < n_lanes; i++) {
+            riak_batch_lane *lane = &(lanes[i]);
+            if (lane->err) continue;
+            riak_error err = riak_batch_lane_fill(batch, lane);
+            if (err) {
+                // A successful retry leaves the lane healthy with its requests resent
+                riak_batch_lane_fail(batch, lane, err);
+                if (lane->err) continue;
+            }
+            if (riak_pipeline_get_depth(lane->cxn) > 0) {
+                int lane_ms = riak_pipeline_get_timeout(lane->cxn);
+                if (lane_ms >= 0 && (wait_ms < 0 || lane_ms < wait_ms)) {
+                    wait_ms = lane_ms;
+                }
+                fds[nfds].fd      = riak_connection_get_fd(lane->cxn);
+                fds[nfds].events  = POLLIN;
+                fds[nfds].revents = 0;
+                lanes_polled[nfds++] = i;
+            }
+        }
+        if (nfds == 0) {
+            break; // Every connection has failed
+        }
+        if (poll(fds, nfds, wait_ms) < 0) {
+            if (errno == EINTR) continue;
+            result = ERIAK_READ;
+            break;
+        }
+        nfds_t p;
+        for(p = 0; p < nfds; p++) {
+            riak_batch_lane *lane = &(lanes[lanes_polled[p]]);
+            riak_error err = ERIAK_OK;
+            if (fds[p].revents) {
+                err = riak_batch_lane_read(lane);
+            }
+            if (err == ERIAK_OK && riak_pipeline_get_timeout(lane->cxn) == 0) {
+                err = ERIAK_TIMEOUT;
+            }
+            if (err) {
+                riak_batch_lane_fail(batch, lane, err);
+            }
+        }
+    }
+
+    // Anything still outstanding has no connection left to go to
+    for(i = 0; i < n_lanes && result == ERIAK_OK; i++) {
+        result = lanes[i].err;
+    }
+    for(i = 0; i < n_lanes; i++) {
+        if (!lanes[i].err && riak_pipeline_get_depth(lanes[i].cxn) > 0) {
+            riak_batch_lane_fail(batch, &(lanes[i]), result);
+        }
+    }
+    while (batch->next < batch->n_items) {
+        (batch->complete)(batch, batch->next++, result, NULL);
+    }
+    riak_free(batch->cfg, &(batch->slots));
+    riak_free(batch->cfg, &lanes_polled);
+    riak_free(batch->cfg, &fds);
+
+    return result;
+}
+
+/**
+ * @brief Spread a batch over connections borrowed from a pool
+ * @param batch Batch to run
+ * @param pool Riak Connection Pool
+ * @param max_connections Most connections to borrow
+ * @returns As riak_batch_run()
+ */
+static riak_error
+riak_batch_run_pool(riak_batch           *batch,
+                    riak_connection_pool *pool,
+                    riak_uint32_t         max_connections) {
+    if (max_connections == 0) {
+        max_connections = 1;
+    }
+    riak_batch_lane *lanes = (riak_batch_lane*)riak_config_clean_allocate(batch->cfg, max_connections * sizeof(riak_batch_lane));
+    if (lanes == NULL) {
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    // No point borrowing more connections than there are windows to fill
+    riak_uint32_t wanted  = (batch->n_items + batch->window - 1) / batch->window;
+    riak_uint32_t n_lanes = 0;
+    riak_error    err     = ERIAK_OK;
+    while (n_lanes < max_connections && (n_lanes < wanted || n_lanes == 0)) {
+        err = riak_connection_pool_checkout(pool, &(lanes[n_lanes].cxn));
+        if (err) break;
+        n_lanes++;
+    }
+    if (n_lanes > 0) {
+        err = riak_batch_run(batch, lanes, n_lanes);
+    }
+    riak_uint32_t i;
+    for(i = 0; i < n_lanes; i++) {
+        riak_connection_pool_checkin(pool, &(lanes[i].cxn), lanes[i].err);
+    }
+    riak_free(batch->cfg, &lanes);
+
+    return err;
+}
+
+/**
+ * @brief Set up a batch of `n_items` requests
+ */
+static void
+riak_batch_init(riak_batch          *batch,
+                riak_config         *cfg,
+                riak_batch_encoder   encode,
+                riak_batch_completer complete,
+                void                *items,
+                riak_uint32_t        n_items,
+                void                *options,
+                riak_uint32_t        window,
+                void                *cb,
+                void                *cb_data) {
+    memset((void*)batch, '\0', sizeof(riak_batch));
+    batch->cfg      = cfg;
+    batch->n_items  = n_items;
+    batch->window   = (window > 0) ? window : RIAK_BATCH_DEFAULT_WINDOW;
+    batch->encode   = encode;
+    batch->complete = complete;
+    batch->items    = items;
+    batch->options  = options;
+    batch->cb       = cb;
+    batch->cb_data  = cb_data;
+}
+
+//
+// Multi-Get
+//
+
+static riak_error
+riak_multiget_encode(riak_batch     *batch,
+                     riak_operation *rop,
+                     riak_uint32_t   index) {
+    riak_multiget_item *item = &(((riak_multiget_item*)batch->items)[index]);
+    return riak_get_request_encode(rop, item->bucket_type, item->bucket, item->key,
+                                   (riak_get_options*)batch->options, &(rop->pb_request));
+}
+
+static void
+riak_multiget_complete(riak_batch   *batch,
+                       riak_uint32_t index,
+                       riak_error    err,
+                       void         *response) {
+    riak_multiget_item *item = &(((riak_multiget_item*)batch->items)[index]);
+    item->err      = err;
+    item->response = (riak_get_response*)response;
+    batch->completed++;
+    if (batch->cb) {
+        ((riak_multiget_callback)batch->cb)(item, index, batch->cb_data);
+    }
+}
+
+riak_error
+riak_multiget(riak_connection       *cxn,
+              riak_multiget_item    *items,
+              riak_uint32_t          n_items,
+              riak_get_options      *opts,
+              riak_uint32_t          window,
+              riak_multiget_callback cb,
+              void                  *cb_data) {
+    riak_batch batch;
+    riak_batch_init(&batch, riak_connection_get_config(cxn), riak_multiget_encode, riak_multiget_complete,
+                    items, n_items, opts, window, (void*)cb, cb_data);
+    riak_batch_lane lane = { cxn, ERIAK_OK };
+    return riak_batch_run(&batch, &lane, 1);
+}
+
+riak_error
+riak_multiget_pool(riak_connection_pool  *pool,
+                   riak_uint32_t          max_connections,
+                   riak_multiget_item    *items,
+                   riak_uint32_t          n_items,
+                   riak_get_options      *opts,
+                   riak_uint32_t          window,
+                   riak_multiget_callback cb,
+                   void                  *cb_data) {
+    riak_batch batch;
+    riak_batch_init(&batch, pool->config, riak_multiget_encode, riak_multiget_complete,
+                    items, n_items, opts, window, (void*)cb, cb_data);
+    return riak_batch_run_pool(&batch, pool, max_connections);
+}
+
+//
+// Multi-Put
+//
+
+static riak_error
+riak_multiput_encode(riak_batch     *batch,
+                     riak_operation *rop,
+                     riak_uint32_t   index) {
+    riak_multiput_item *item = &(((riak_multiput_item*)batch->items)[index]);
+    return riak_put_request_encode(rop, item->object, (riak_put_options*)batch->options, &(rop->pb_request));
+}
+
+static void
+riak_multiput_complete(riak_batch   *batch,
+                       riak_uint32_t index,
+                       riak_error    err,
+                       void         *response) {
+    riak_multiput_item *item = &(((riak_multiput_item*)batch->items)[index]);
+    item->err      = err;
+    item->response = (riak_put_response*)response;
+    batch->completed++;
+    if (batch->cb) {
+        ((riak_multiput_callback)batch->cb)(item, index, batch->cb_data);
+    }
+}
+
+riak_error
+riak_multiput(riak_connection       *cxn,
+              riak_multiput_item    *items,
+              riak_uint32_t          n_items,
+              riak_put_options      *opts,
+              riak_uint32_t          window,
+              riak_multiput_callback cb,
+              void                  *cb_data) {
+    riak_batch batch;
+    riak_batch_init(&batch, riak_connection_get_config(cxn), riak_multiput_encode, riak_multiput_complete,
+                    items, n_items, opts, window, (void*)cb, cb_data);
+    riak_batch_lane lane = { cxn, ERIAK_OK };
+    return riak_batch_run(&batch, &lane, 1);
+}
+
+riak_error
+riak_multiput_pool(riak_connection_pool  *pool,
+                   riak_uint32_t          max_connections,
+                   riak_multiput_item    *items,
+                   riak_uint32_t          n_items,
+                   riak_put_options      *opts,
+                   riak_uint32_t          window,
+                   riak_multiput_callback cb,
+                   void                  *cb_data) {
+    riak_batch batch;
+    riak_batch_init(&batch, pool->config, riak_multiput_encode, riak_multiput_complete,
+                    items, n_items, opts, window, (void*)cb, cb_data);
+    return riak_batch_run_pool(&batch, pool, max_connections);
+}
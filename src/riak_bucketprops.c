@@ -40,7 +40,7 @@ static const char* riak_bucketprops_repl[] = {
 
 riak_modfun*
 riak_modfun_new(riak_config *cfg) {
-    riak_modfun *fun = (riak_modfun*)(cfg->malloc_fn)(sizeof(riak_modfun));
+    riak_modfun *fun = (riak_modfun*)riak_config_allocate(cfg, sizeof(riak_modfun));
     if (fun) memset(fun, '\0', sizeof(riak_modfun));
     return fun;
 }
@@ -74,7 +74,7 @@ riak_modfun_copy_to_pb(riak_config   *cfg,
     if (mod_fun == NULL) {
         return ERIAK_OK;
     }
-    RpbModFun *pbmod_fun = (RpbModFun*)(cfg->malloc_fn)(sizeof(RpbModFun));
+    RpbModFun *pbmod_fun = (RpbModFun*)riak_config_allocate(cfg, sizeof(RpbModFun));
     if (pbmod_fun == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -90,7 +90,7 @@ static riak_error
 riak_modfun_copy_from_pb(riak_config   *cfg,
                          riak_modfun **mod_fun_target,
                          RpbModFun     *pbmod_fun) {
-    riak_modfun *mod_fun = (riak_modfun*)(cfg->malloc_fn)(sizeof(riak_modfun));
+    riak_modfun *mod_fun = (riak_modfun*)riak_config_allocate(cfg, sizeof(riak_modfun));
     if (pbmod_fun == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -181,7 +181,7 @@ riak_modfun_set_function(riak_config  *cfg,
 
 riak_commit_hook*
 riak_commit_hook_new(riak_config *cfg) {
-    riak_commit_hook *hook = (riak_commit_hook*)(cfg->malloc_fn)(sizeof(riak_commit_hook));
+    riak_commit_hook *hook = (riak_commit_hook*)riak_config_allocate(cfg, sizeof(riak_commit_hook));
     if (hook) memset(hook, '\0', sizeof(riak_commit_hook));
     return hook;
 }
@@ -190,7 +190,7 @@ riak_error
 riak_commit_hook_new_array(riak_config        *cfg,
                            riak_commit_hook ***array,
                            riak_size_t         len) {
-    riak_commit_hook **result = (riak_commit_hook**)(cfg->malloc_fn)(sizeof(riak_commit_hook)*len);
+    riak_commit_hook **result = (riak_commit_hook**)riak_config_allocate(cfg, sizeof(riak_commit_hook)*len);
     if (result == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
@@ -208,13 +208,13 @@ riak_commit_hooks_copy_to_pb(riak_config       *cfg,
     if (hook == NULL) {
         return ERIAK_OK;
     }
-    RpbCommitHook **pbhook = (RpbCommitHook**)(cfg->malloc_fn)(sizeof(RpbCommitHook*) * num_hooks);
+    RpbCommitHook **pbhook = (RpbCommitHook**)riak_config_allocate(cfg, sizeof(RpbCommitHook*) * num_hooks);
     if (pbhook == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
     int i;
     for(i = 0; i < num_hooks; i++) {
-        pbhook[i] = (RpbCommitHook*)(cfg->malloc_fn)(sizeof(RpbCommitHook));
+        pbhook[i] = (RpbCommitHook*)riak_config_allocate(cfg, sizeof(RpbCommitHook));
         if (pbhook[i] == NULL) {
             return ERIAK_OUT_OF_MEMORY;
         }
@@ -239,13 +239,13 @@ riak_commit_hooks_copy_from_pb(riak_config         *cfg,
                                 riak_commit_hook ***hook_target,
                                 RpbCommitHook     **pbhook,
                                 riak_uint32_t       num_hooks) {
-    riak_commit_hook **hook = (riak_commit_hook**)(cfg->malloc_fn)(sizeof(riak_commit_hook*) * num_hooks);
+    riak_commit_hook **hook = (riak_commit_hook**)riak_config_allocate(cfg, sizeof(riak_commit_hook*) * num_hooks);
     if (hook == NULL) {
         return ERIAK_OUT_OF_MEMORY;
     }
     int i;
     for(i = 0; i < num_hooks; i++) {
-        hook[i] = (riak_commit_hook*)(cfg->malloc_fn)(sizeof(riak_commit_hook));
+        hook[i] = (riak_commit_hook*)riak_config_allocate(cfg, sizeof(riak_commit_hook));
         if (hook[i] == NULL) {
             return ERIAK_OUT_OF_MEMORY;
         }
@@ -357,7 +357,7 @@ riak_commit_hook_set_name(riak_config      *cfg,
 //
 riak_bucketprops*
 riak_bucketprops_new(riak_config *cfg) {
-    riak_bucketprops *pty = (riak_bucketprops*)(cfg->malloc_fn)(sizeof(riak_bucketprops));
+    riak_bucketprops *pty = (riak_bucketprops*)riak_config_allocate(cfg, sizeof(riak_bucketprops));
     if (pty) memset(pty, '\0', sizeof(riak_bucketprops));
     return pty;
 }
@@ -0,0 +1,296 @@
+/*********************************************************************
+ *
+ * riak_cluster.c: Load-balanced access to a ring of Riak nodes
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_connection-internal.h"
+#include "riak_connection_pool-internal.h"
+#include "riak_cluster-internal.h"
+
+// Weight of a new sample in the latency moving average is 1/2^RIAK_CLUSTER_EWMA_SHIFT
+#define RIAK_CLUSTER_EWMA_SHIFT 3
+#define RIAK_CLUSTER_INITIAL_NODES 4
+
+/**
+ * @brief Take a node out of rotation until its retry interval has passed
+ * @param cluster Riak Cluster
+ * @param node Failed node
+ * @param err Reason for failure
+ */
+static void
+riak_cluster_mark_down(riak_cluster      *cluster,
+                       riak_cluster_node *node,
+                       riak_error         err) {
+    node->retry_usecs = riak_time_usecs() + cluster->retry_interval_usecs;
+    if (riak_atomic_cas(&(node->up), RIAK_TRUE, RIAK_FALSE)) {
+        riak_log_warn_config(cluster->config, "Marking node %s:%s down [%s]",
+                             node->pool->hostname, node->pool->portnum, riak_strerror(err));
+    }
+}
+
+/**
+ * @brief Cost of sending the next operation to a node under the cluster's policy
+ * @param cluster Riak Cluster
+ * @param node Candidate node
+ * @returns Relative cost; lower is better
+ */
+static riak_uint64_t
+riak_cluster_node_cost(riak_cluster      *cluster,
+                       riak_cluster_node *node) {
+    riak_uint64_t busy = riak_connection_pool_get_n_busy(node->pool);
+    switch (cluster->policy) {
+    case RIAK_CLUSTER_LEAST_OUTSTANDING:
+        return busy;
+    case RIAK_CLUSTER_LATENCY_WEIGHTED:
+        // Unmeasured nodes count as 1usec so they are tried early
+        return (node->latency_usecs + 1) * (busy + 1);
+    default:
+        return 0;
+    }
+}
+
+riak_error
+riak_cluster_new(riak_config         *cfg,
+                 riak_cluster       **cluster_target,
+                 riak_cluster_policy  policy) {
+    riak_cluster *cluster = (riak_cluster*)riak_config_clean_allocate(cfg, sizeof(riak_cluster));
+    if (cluster == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_cluster");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    cluster->nodes = (riak_cluster_node**)riak_config_clean_allocate(cfg, sizeof(riak_cluster_node*) * RIAK_CLUSTER_INITIAL_NODES);
+    if (cluster->nodes == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate cluster nodes");
+        riak_free(cfg, &cluster);
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    cluster->config   = cfg;
+    cluster->policy   = policy;
+    cluster->capacity = RIAK_CLUSTER_INITIAL_NODES;
+    cluster->retry_interval_usecs = (riak_uint64_t)RIAK_CLUSTER_DEFAULT_RETRY_MSECS * 1000;
+    *cluster_target = cluster;
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_cluster_add_node(riak_cluster      *cluster,
+                      const char        *hostname,
+                      const char        *portnum,
+                      riak_addr_resolver resolver,
+                      riak_uint32_t      min_connections,
+                      riak_uint32_t      max_connections) {
+    riak_config *cfg = cluster->config;
+    if (cluster->n_nodes == cluster->capacity) {
+        riak_uint32_t capacity = cluster->capacity * 2;
+        riak_cluster_node **nodes = (riak_cluster_node**)riak_array_realloc(cfg,
+                                                                            (void***)&(cluster->nodes),
+                                                                            sizeof(riak_cluster_node*),
+                                                                            cluster->capacity,
+                                                                            capacity);
+        if (nodes == NULL) {
+            riak_log_critical_config(cfg, "%s", "Could not grow cluster nodes");
+            return ERIAK_OUT_OF_MEMORY;
+        }
+        cluster->capacity = capacity;
+    }
+    riak_cluster_node *node = (riak_cluster_node*)riak_config_clean_allocate(cfg, sizeof(riak_cluster_node));
+    if (node == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_cluster_node");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    riak_error err = riak_connection_pool_new(cfg, &(node->pool), hostname, portnum, resolver,
+                                              min_connections, max_connections);
+    if (node->pool == NULL) {
+        riak_free(cfg, &node);
+        return err;
+    }
+    node->up = RIAK_TRUE;
+    if (err) {
+        // Keep the node; it will be probed back into rotation later
+        riak_cluster_mark_down(cluster, node, err);
+    }
+    cluster->nodes[cluster->n_nodes++] = node;
+
+    return ERIAK_OK;
+}
+
+void
+riak_cluster_free(riak_cluster **cluster_target) {
+    if (cluster_target == NULL || *cluster_target == NULL) return;
+    riak_cluster *cluster = *cluster_target;
+    riak_config  *cfg     = cluster->config;
+
+    riak_uint32_t i;
+    for(i = 0; i < cluster->n_nodes; i++) {
+        riak_connection_pool_free(&(cluster->nodes[i]->pool));
+        riak_free(cfg, &(cluster->nodes[i]));
+    }
+    riak_free(cfg, &(cluster->nodes));
+    riak_free(cfg, cluster_target);
+}
+
+/**
+ * @brief Borrow a connection from one node, taking the node down if it is unreachable
+ * @param cluster Riak Cluster
+ * @param node Candidate node
+ * @param cxn Borrowed Riak Connection (out)
+ * @returns Error code
+ */
+static riak_error
+riak_cluster_node_checkout(riak_cluster      *cluster,
+                           riak_cluster_node *node,
+                           riak_connection  **cxn) {
+    riak_error err = riak_connection_pool_checkout(node->pool, cxn);
+    if (err && err != ERIAK_POOL_EXHAUSTED) {
+        riak_cluster_mark_down(cluster, node, err);
+    }
+    return err;
+}
+
+riak_error
+riak_cluster_checkout(riak_cluster     *cluster,
+                      riak_connection **cxn) {
+    return riak_cluster_checkout_excluding(cluster, NULL, cxn);
+}
+
+riak_error
+riak_cluster_checkout_excluding(riak_cluster      *cluster,
+                                riak_cluster_node *exclude,
+                                riak_connection  **cxn) {
+    riak_uint32_t n_nodes = cluster->n_nodes;
+    if (n_nodes == 0) {
+        return ERIAK_NO_NODES;
+    }
+    riak_uint32_t start = riak_atomic_add(&(cluster->next_node), 1);
+    riak_cluster_node *best = NULL;
+    riak_uint64_t best_cost = 0;
+    riak_uint32_t i;
+
+    // Scanning from a rotating start breaks ties (and implements round-robin)
+    for(i = 0; i < n_nodes; i++) {
+        riak_cluster_node *node = cluster->nodes[(start + i) % n_nodes];
+        if (node == exclude || !node->up) continue;
+        riak_uint64_t cost = riak_cluster_node_cost(cluster, node);
+        if (best == NULL || cost < best_cost) {
+            best      = node;
+            best_cost = cost;
+        }
+        if (cluster->policy == RIAK_CLUSTER_ROUND_ROBIN) break;
+    }
+    if (best && riak_cluster_node_checkout(cluster, best, cxn) == ERIAK_OK) {
+        return ERIAK_OK;
+    }
+
+    // Fail over to any other healthy node with a free connection
+    for(i = 0; i < n_nodes; i++) {
+        riak_cluster_node *node = cluster->nodes[(start + i) % n_nodes];
+        if (node == best || node == exclude || !node->up) continue;
+        if (riak_cluster_node_checkout(cluster, node, cxn) == ERIAK_OK) {
+            return ERIAK_OK;
+        }
+    }
+
+    return ERIAK_NO_NODES;
+}
+
+riak_cluster_node*
+riak_cluster_find_node(riak_cluster    *cluster,
+                       riak_connection *cxn) {
+    riak_uint32_t i;
+    for(i = 0; i < cluster->n_nodes; i++) {
+        if (cluster->nodes[i]->pool == cxn->pool) {
+            return cluster->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+void
+riak_cluster_checkin(riak_cluster     *cluster,
+                     riak_connection **cxn_target,
+                     riak_error        err) {
+    if (cxn_target == NULL || *cxn_target == NULL) return;
+    riak_connection   *cxn  = *cxn_target;
+    riak_cluster_node *node = riak_cluster_find_node(cluster, cxn);
+    assert(node != NULL);
+
+    if (err == ERIAK_CONNECT || err == ERIAK_READ || err == ERIAK_WRITE) {
+        riak_cluster_mark_down(cluster, node, err);
+    } else if (cxn->answers > 0) {
+        // Lock-free EWMA of how long the node took to answer, not how long the caller held on
+        riak_int64_t  sample = (riak_int64_t)(cxn->answer_usecs / cxn->answers);
+        riak_uint64_t old    = node->latency_usecs;
+        riak_int64_t  delta  = (sample - (riak_int64_t)old) / (1 << RIAK_CLUSTER_EWMA_SHIFT);
+        riak_atomic_cas(&(node->latency_usecs), old, (riak_uint64_t)((riak_int64_t)old + delta));
+    }
+    riak_connection_pool_checkin(node->pool, cxn_target, err);
+}
+
+riak_uint32_t
+riak_cluster_probe(riak_cluster *cluster) {
+    riak_uint64_t now = riak_time_usecs();
+    riak_uint32_t revived = 0;
+    riak_uint32_t i;
+    for(i = 0; i < cluster->n_nodes; i++) {
+        riak_cluster_node *node = cluster->nodes[i];
+        if (node->up || now < node->retry_usecs) continue;
+        // Push the next attempt out first so concurrent probes do not pile on
+        node->retry_usecs = now + cluster->retry_interval_usecs;
+
+        riak_connection *cxn = NULL;
+        riak_error err = riak_connection_pool_checkout(node->pool, &cxn);
+        if (err == ERIAK_OK) {
+            err = riak_ping(cxn);
+            riak_connection_pool_checkin(node->pool, &cxn, err);
+        }
+        if (err == ERIAK_OK && riak_atomic_cas(&(node->up), RIAK_FALSE, RIAK_TRUE)) {
+            riak_log_notice_config(cluster->config, "Node %s:%s is back up",
+                                   node->pool->hostname, node->pool->portnum);
+            revived++;
+        }
+    }
+    return revived;
+}
+
+void
+riak_cluster_set_retry_interval(riak_cluster *cluster,
+                                riak_uint32_t msecs) {
+    cluster->retry_interval_usecs = (riak_uint64_t)msecs * 1000;
+}
+
+riak_uint32_t
+riak_cluster_get_n_nodes(riak_cluster *cluster) {
+    return cluster->n_nodes;
+}
+
+riak_uint32_t
+riak_cluster_get_n_up(riak_cluster *cluster) {
+    riak_uint32_t n_up = 0;
+    riak_uint32_t i;
+    for(i = 0; i < cluster->n_nodes; i++) {
+        if (cluster->nodes[i]->up) n_up++;
+    }
+    return n_up;
+}
@@ -0,0 +1,359 @@
+/*********************************************************************
+ *
+ * riak_completion_queue.c: Submit operations from any thread and harvest their results
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_operation-internal.h"
+
+// A submitted operation; linked first on the submission queue, then on a completion list
+typedef struct _riak_completion_entry {
+    struct _riak_completion_entry *next;
+    struct _riak_completion_queue *cq;
+    riak_operation                *rop;   // Until sent
+    riak_completion                completion;
+} riak_completion_entry;
+
+struct _riak_completion_queue {
+    riak_config           *config;
+
+    // Lock-free multi-producer, single-consumer submission queue: producers swing
+    // `head`, the I/O thread follows `tail`, and `stub` keeps the queue non-empty
+    riak_completion_entry *head;
+    riak_completion_entry *tail;
+    riak_completion_entry  stub;
+    riak_uint32_t          signalled; // A wakeup byte is already in the pipe
+    int                    wakeup[2]; // Read end readable while submissions wait
+
+    // Completions gathered by the I/O thread since the last publish
+    riak_completion_entry *staged_head;
+    riak_completion_entry *staged_tail;
+
+    // Published completions, oldest first
+    pthread_mutex_t        lock;
+    pthread_cond_t         ready;
+    riak_completion_entry *done_head;
+    riak_completion_entry *done_tail;
+};
+
+/**
+ * @brief Add an entry to the submission queue; any thread
+ * @param cq Riak Completion Queue
+ * @param entry Entry to add
+ */
+static void
+riak_completion_queue_push(riak_completion_queue *cq,
+                           riak_completion_entry *entry) {
+    entry->next = NULL;
+    riak_completion_entry *prev;
+    do {
+        prev = riak_atomic_load(&(cq->head));
+    } while (!riak_atomic_cas(&(cq->head), prev, entry));
+    // Until this link lands the consumer sees the queue end at `prev`
+    riak_atomic_cas(&(prev->next), NULL, entry);
+}
+
+/**
+ * @brief Remove the oldest entry from the submission queue; I/O thread only
+ * @param cq Riak Completion Queue
+ * @returns Entry or NULL if none is ready
+ */
+static riak_completion_entry*
+riak_completion_queue_pop(riak_completion_queue *cq) {
+    riak_completion_entry *tail = cq->tail;
+    riak_completion_entry *next = riak_atomic_load(&(tail->next));
+    if (tail == &(cq->stub)) {
+        if (next == NULL) {
+            return NULL;
+        }
+        cq->tail = next;
+        tail     = next;
+        next     = riak_atomic_load(&(next->next));
+    }
+    if (next) {
+        cq->tail = next;
+        return tail;
+    }
+    // A producer is between swinging head and linking its entry
+    if (tail != riak_atomic_load(&(cq->head))) {
+        return NULL;
+    }
+    riak_completion_queue_push(cq, &(cq->stub));
+    next = riak_atomic_load(&(tail->next));
+    if (next) {
+        cq->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Record the outcome of an entry for the next publish; I/O thread only
+ * @param entry Finished entry
+ * @param err Outcome
+ * @param response Decoded response or NULL
+ */
+static void
+riak_completion_queue_stage(riak_completion_entry *entry,
+                            riak_error             err,
+                            void                  *response) {
+    riak_completion_queue *cq = entry->cq;
+    entry->rop                 = NULL;
+    entry->completion.err      = err;
+    entry->completion.response = response;
+    entry->next                = NULL;
+    if (cq->staged_tail) {
+        cq->staged_tail->next = entry;
+    } else {
+        cq->staged_head = entry;
+    }
+    cq->staged_tail = entry;
+}
+
+static void
+riak_completion_queue_response_cb(void *response,
+                                  void *ptr) {
+    riak_completion_queue_stage((riak_completion_entry*)ptr, ERIAK_OK, response);
+}
+
+static void
+riak_completion_queue_error_cb(void *response,
+                               void *ptr) {
+    riak_completion_entry      *entry        = (riak_completion_entry*)ptr;
+    riak_server_error_response *err_response = (riak_server_error_response*)response;
+    // The error response is freed once this returns, so the consumer gets a copy
+    riak_server_error *error = NULL;
+    if (riak_server_error_new(entry->cq->config, &error, err_response->errcode, err_response->errmsg)) {
+        riak_log_critical_config(entry->cq->config, "%s", "Could not copy a server error");
+        error = NULL;
+    }
+    riak_completion_queue_stage(entry, ERIAK_SERVER_ERROR, error);
+}
+
+static void
+riak_completion_queue_abandon_cb(riak_error err,
+                                 void      *ptr) {
+    riak_completion_queue_stage((riak_completion_entry*)ptr, err, NULL);
+}
+
+/**
+ * @brief Move staged completions where consumers can see them, waking them once
+ * @param cq Riak Completion Queue
+ */
+static void
+riak_completion_queue_publish(riak_completion_queue *cq) {
+    if (cq->staged_head == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&(cq->lock));
+    if (cq->done_tail) {
+        cq->done_tail->next = cq->staged_head;
+    } else {
+        cq->done_head = cq->staged_head;
+    }
+    cq->done_tail = cq->staged_tail;
+    pthread_cond_broadcast(&(cq->ready));
+    pthread_mutex_unlock(&(cq->lock));
+    cq->staged_head = cq->staged_tail = NULL;
+}
+
+/**
+ * @brief Copy up to `max` published completions out; caller holds the lock
+ * @returns Number of completions harvested
+ */
+static riak_uint32_t
+riak_completion_queue_harvest(riak_completion_queue *cq,
+                              riak_completion       *completions,
+                              riak_uint32_t          max) {
+    riak_uint32_t count = 0;
+    riak_completion_entry *freed = NULL;
+    while (count < max && cq->done_head) {
+        riak_completion_entry *entry = cq->done_head;
+        cq->done_head = entry->next;
+        completions[count++] = entry->completion;
+        entry->next = freed;
+        freed       = entry;
+    }
+    if (cq->done_head == NULL) {
+        cq->done_tail = NULL;
+    }
+    pthread_mutex_unlock(&(cq->lock));
+    while (freed) {
+        riak_completion_entry *entry = freed;
+        freed = entry->next;
+        riak_free(cq->config, &entry);
+    }
+    return count;
+}
+
+riak_error
+riak_completion_queue_new(riak_completion_queue **cq_target,
+                          riak_config            *cfg) {
+    riak_completion_queue *cq = (riak_completion_queue*)riak_config_clean_allocate(cfg, sizeof(riak_completion_queue));
+    if (cq == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_completion_queue");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    cq->config = cfg;
+    cq->head   = &(cq->stub);
+    cq->tail   = &(cq->stub);
+    if (pipe(cq->wakeup) != 0) {
+        riak_log_critical_config(cfg, "Could not create wakeup pipe [%s]", strerror(errno));
+        riak_free(cfg, &cq);
+        return ERIAK_EVENT;
+    }
+    // Neither a producer nor the I/O thread may ever block on the pipe
+    fcntl(cq->wakeup[0], F_SETFL, fcntl(cq->wakeup[0], F_GETFL, 0)|O_NONBLOCK);
+    fcntl(cq->wakeup[1], F_SETFL, fcntl(cq->wakeup[1], F_GETFL, 0)|O_NONBLOCK);
+    if (pthread_mutex_init(&(cq->lock), NULL) != 0 ||
+        pthread_cond_init(&(cq->ready), NULL) != 0) {
+        riak_log_critical_config(cfg, "%s", "Could not initialize completion queue lock");
+        close(cq->wakeup[0]);
+        close(cq->wakeup[1]);
+        riak_free(cfg, &cq);
+        return ERIAK_THREAD;
+    }
+    *cq_target = cq;
+
+    return ERIAK_OK;
+}
+
+void
+riak_completion_queue_free(riak_completion_queue **cq_target) {
+    if (cq_target == NULL || *cq_target == NULL) {
+        return;
+    }
+    riak_completion_queue *cq  = *cq_target;
+    riak_config           *cfg = cq->config;
+    riak_completion_entry *entry;
+    while ((entry = riak_completion_queue_pop(cq)) != NULL) {
+        riak_operation_free(&(entry->rop));
+        riak_free(cfg, &entry);
+    }
+    riak_completion_queue_publish(cq);
+    while (cq->done_head) {
+        entry = cq->done_head;
+        cq->done_head = entry->next;
+        riak_free(cfg, &entry);
+    }
+    pthread_cond_destroy(&(cq->ready));
+    pthread_mutex_destroy(&(cq->lock));
+    close(cq->wakeup[0]);
+    close(cq->wakeup[1]);
+    riak_free(cfg, cq_target);
+}
+
+riak_error
+riak_completion_queue_submit(riak_completion_queue *cq,
+                             riak_operation        *rop,
+                             void                  *tag) {
+    riak_completion_entry *entry = (riak_completion_entry*)riak_config_clean_allocate(cq->config, sizeof(riak_completion_entry));
+    if (entry == NULL) {
+        riak_log_critical_config(cq->config, "%s", "Could not allocate a completion");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    entry->cq             = cq;
+    entry->rop            = rop;
+    entry->completion.tag = tag;
+    riak_operation_set_cb_data(rop, entry);
+    riak_operation_set_response_cb(rop, riak_completion_queue_response_cb);
+    riak_operation_set_error_cb(rop, riak_completion_queue_error_cb);
+    riak_operation_set_abandon_cb(rop, riak_completion_queue_abandon_cb);
+    riak_completion_queue_push(cq, entry);
+
+    // Only the first submission after the I/O thread drained the queue wakes it
+    if (riak_atomic_cas(&(cq->signalled), 0, 1)) {
+        char byte = 1;
+        if (write(cq->wakeup[1], &byte, sizeof(byte)) < 0 && errno != EAGAIN) {
+            riak_log_error_config(cq->config, "Could not wake I/O thread [%s]", strerror(errno));
+        }
+    }
+
+    return ERIAK_OK;
+}
+
+riak_uint32_t
+riak_completion_queue_process(riak_completion_queue  *cq,
+                              riak_completion_send_fn send,
+                              void                   *send_data) {
+    // Clear the flag before draining, so a later submission signals again
+    if (riak_atomic_cas(&(cq->signalled), 1, 0)) {
+        char bytes[64];
+        while (read(cq->wakeup[0], bytes, sizeof(bytes)) > 0) {
+        }
+    }
+    riak_uint32_t sent = 0;
+    riak_completion_entry *entry;
+    while ((entry = riak_completion_queue_pop(cq)) != NULL) {
+        riak_error err = (send)(entry->rop, send_data);
+        if (err) {
+            riak_operation_free(&(entry->rop));
+            riak_completion_queue_stage(entry, err, NULL);
+            continue;
+        }
+        sent++;
+    }
+    riak_completion_queue_publish(cq);
+
+    return sent;
+}
+
+int
+riak_completion_queue_get_fd(riak_completion_queue *cq) {
+    return cq->wakeup[0];
+}
+
+riak_uint32_t
+riak_completion_queue_poll(riak_completion_queue *cq,
+                           riak_completion       *completions,
+                           riak_uint32_t          max) {
+    pthread_mutex_lock(&(cq->lock));
+    return riak_completion_queue_harvest(cq, completions, max);
+}
+
+riak_uint32_t
+riak_completion_queue_wait(riak_completion_queue *cq,
+                           riak_completion       *completions,
+                           riak_uint32_t          max,
+                           int                    timeout_ms) {
+    struct timespec deadline;
+    if (timeout_ms >= 0) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        riak_uint64_t nsecs = (riak_uint64_t)now.tv_usec * 1000 + (riak_uint64_t)timeout_ms * 1000000;
+        deadline.tv_sec  = now.tv_sec + nsecs / 1000000000;
+        deadline.tv_nsec = nsecs % 1000000000;
+    }
+    pthread_mutex_lock(&(cq->lock));
+    while (cq->done_head == NULL) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&(cq->ready), &(cq->lock));
+        } else if (pthread_cond_timedwait(&(cq->ready), &(cq->lock), &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    return riak_completion_queue_harvest(cq, completions, max);
+}
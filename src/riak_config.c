@@ -20,6 +20,8 @@
  *
  *********************************************************************/
 
+#include <time.h>
+#include <errno.h>
 #include "riak.h"
 #include "riak_messages-internal.h"
 #include "riak_utils-internal.h"
@@ -68,6 +70,11 @@ riak_config_new(riak_config      **config,
     cfg->log_fn          = NULL;
     cfg->log_init_fn     = NULL;
     cfg->log_cleanup_fn  = NULL;
+    cfg->log_level       = RIAK_LOG_DEBUG;
+    cfg->log_threshold   = RIAK_LOG_OFF;
+    cfg->retry_attempts  = 1;
+    cfg->retry_base_ms   = RIAK_RETRY_DEFAULT_BASE_MSECS;
+    cfg->retry_max_ms    = RIAK_RETRY_DEFAULT_MAX_MSECS;
 
     *config = cfg;
     return ERIAK_OK;
@@ -87,6 +94,7 @@ riak_config_set_logging(riak_config        *cfg,
     cfg->log_fn = log_fn;
     cfg->log_init_fn = log_init;
     cfg->log_cleanup_fn = log_cleanup;
+    cfg->log_threshold = (log_fn) ? (riak_int32_t)cfg->log_level : RIAK_LOG_OFF;
 
     if (cfg->log_init_fn) {
         int result = (cfg->log_init_fn)(cfg->log_data);
@@ -97,11 +105,124 @@ riak_config_set_logging(riak_config        *cfg,
     return ERIAK_OK;
 }
 
+riak_error
+riak_config_set_log_level(riak_config     *cfg,
+                          riak_log_level_t level) {
+    if (level < RIAK_LOG_EMERG || level > RIAK_LOG_DEBUG) {
+        return ERIAK_OUT_OF_RANGE;
+    }
+    cfg->log_level     = level;
+    cfg->log_threshold = (cfg->log_fn) ? (riak_int32_t)level : RIAK_LOG_OFF;
+    return ERIAK_OK;
+}
+
+riak_error
+riak_config_set_retry_policy(riak_config  *cfg,
+                             riak_uint32_t max_attempts,
+                             riak_uint32_t base_delay_ms,
+                             riak_uint32_t max_delay_ms) {
+    if (max_attempts == 0) {
+        return ERIAK_OUT_OF_RANGE;
+    }
+    cfg->retry_attempts = max_attempts;
+    cfg->retry_base_ms  = (base_delay_ms) ? base_delay_ms : RIAK_RETRY_DEFAULT_BASE_MSECS;
+    cfg->retry_max_ms   = (max_delay_ms) ? max_delay_ms : RIAK_RETRY_DEFAULT_MAX_MSECS;
+    return ERIAK_OK;
+}
+
+riak_boolean_t
+riak_config_retry_allowed(riak_config  *cfg,
+                          riak_uint32_t attempts) {
+    return (attempts < cfg->retry_attempts);
+}
+
+riak_uint64_t
+riak_config_retry_backoff_usecs(riak_config  *cfg,
+                                riak_uint32_t attempts) {
+    riak_uint64_t backoff = cfg->retry_base_ms;
+    riak_uint32_t i;
+    for(i = 1; i < attempts && backoff < cfg->retry_max_ms; i++) {
+        backoff *= 2;
+    }
+    if (backoff > cfg->retry_max_ms) {
+        backoff = cfg->retry_max_ms;
+    }
+    // Full jitter; the seed differs per caller and per moment
+    unsigned int seed = (unsigned int)(riak_time_usecs() ^ (riak_uint64_t)(size_t)&seed);
+    return ((riak_uint64_t)rand_r(&seed) % (backoff * 1000 + 1));
+}
+
+void
+riak_config_retry_backoff(riak_config  *cfg,
+                          riak_uint32_t attempts) {
+    riak_uint64_t usecs = riak_config_retry_backoff_usecs(cfg, attempts);
+    struct timespec pause;
+    pause.tv_sec  = usecs / 1000000;
+    pause.tv_nsec = (usecs % 1000000) * 1000;
+    while (nanosleep(&pause, &pause) < 0 && errno == EINTR);
+}
+
+// Arena allocations keep the alignment malloc would give
+#define RIAK_ARENA_ALIGN 16
+
+/**
+ * @brief Bump-allocate from an arena, claiming a new block when the current one is full
+ * @param cfg Arena Configuration
+ * @param bytes Number of bytes to allocate
+ * @returns Pointer to allocated memory (or NULL)
+ */
+static void*
+riak_arena_allocate(riak_config *cfg,
+                    riak_size_t  bytes) {
+    riak_arena       *arena = cfg->arena;
+    riak_arena_block *block = arena->blocks;
+    riak_size_t       need  = (bytes + RIAK_ARENA_ALIGN - 1) & ~((riak_size_t)RIAK_ARENA_ALIGN - 1);
+
+    if (block == NULL || block->size - block->used < need) {
+        // Oversized requests get a block of their own so the current one keeps its space
+        riak_size_t size = (need > arena->block_size) ? need : arena->block_size;
+        riak_size_t head = (sizeof(riak_arena_block) + RIAK_ARENA_ALIGN - 1) & ~((riak_size_t)RIAK_ARENA_ALIGN - 1);
+        riak_arena_block *fresh = (riak_arena_block*)(cfg->malloc_fn)(head + size);
+        if (fresh == NULL) {
+            return NULL;
+        }
+        fresh->size = size;
+        fresh->used = 0;
+        fresh->data = (riak_uint8_t*)fresh + head;
+        if (block != NULL && need > arena->block_size) {
+            fresh->next = block->next;
+            block->next = fresh;
+        } else {
+            fresh->next    = block;
+            arena->blocks  = fresh;
+        }
+        block = fresh;
+    }
+    void *memory = block->data + block->used;
+    block->used      += need;
+    arena->allocated += need;
+    return memory;
+}
+
+static void*
+riak_arena_pb_alloc(void       *allocator_data,
+                    size_t      size) {
+    return riak_arena_allocate((riak_config*)allocator_data, size);
+}
+
+static void
+riak_arena_pb_free(void *allocator_data,
+                   void *pointer) {
+    // Released with the arena
+}
+
 void*
 riak_config_allocate(riak_config *cfg,
                      riak_size_t  bytes) {
     void *memory = NULL;
-    if (cfg && cfg->malloc_fn) {
+    if (cfg && cfg->arena) {
+        memory = riak_arena_allocate(cfg, bytes);
+    } else if (cfg && cfg->malloc_fn) {
         memory = (cfg->malloc_fn)(bytes);
     }
     return memory;
@@ -110,26 +231,94 @@ riak_config_allocate(riak_config *cfg,
 void*
 riak_config_clean_allocate(riak_config *cfg,
                            riak_size_t  bytes) {
-    void *memory = NULL;
-    if (cfg && cfg->malloc_fn) {
-        memory = (cfg->malloc_fn)(bytes);
-        if (memory) {
-            memset(memory, '\0', bytes);
-        }
+    void *memory = riak_config_allocate(cfg, bytes);
+    if (memory) {
+        memset(memory, '\0', bytes);
     }
     return memory;
 }
 
+riak_error
+riak_config_new_arena(riak_config  *parent,
+                      riak_config **config,
+                      riak_size_t   block_size) {
+    *config = NULL;
+    // Straight from the allocator, as riak_config_free() hands it back there even if the parent is an arena
+    riak_config *cfg = (riak_config*)(parent->malloc_fn)(sizeof(riak_config) + sizeof(riak_arena));
+    if (cfg == NULL) {
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    memset(cfg, '\0', sizeof(riak_config) + sizeof(riak_arena));
+    // Blocks come from the parent's allocator; logging is shared but owned by the parent
+    cfg->malloc_fn  = parent->malloc_fn;
+    cfg->realloc_fn = parent->realloc_fn;
+    cfg->free_fn    = parent->free_fn;
+    cfg->log_data   = parent->log_data;
+    cfg->log_fn     = parent->log_fn;
+    cfg->log_level     = parent->log_level;
+    cfg->log_threshold = parent->log_threshold;
+    cfg->retry_attempts = parent->retry_attempts;
+    cfg->retry_base_ms  = parent->retry_base_ms;
+    cfg->retry_max_ms   = parent->retry_max_ms;
+    cfg->trace_fn        = parent->trace_fn;
+    cfg->trace_data      = parent->trace_data;
+    cfg->trace_hash_keys = parent->trace_hash_keys;
+
+    cfg->arena = (riak_arena*)(cfg + 1);
+    cfg->arena->block_size = (block_size > 0) ? block_size : RIAK_ARENA_DEFAULT_BLOCK_SIZE;
+    cfg->arena->pb_allocator.alloc          = riak_arena_pb_alloc;
+    cfg->arena->pb_allocator.tmp_alloc      = riak_arena_pb_alloc;
+    cfg->arena->pb_allocator.free           = riak_arena_pb_free;
+    cfg->arena->pb_allocator.allocator_data = cfg;
+    cfg->pb_allocator = &(cfg->arena->pb_allocator);
+
+    *config = cfg;
+    return ERIAK_OK;
+}
+
+void
+riak_config_arena_reset(riak_config *cfg) {
+    riak_arena *arena = cfg->arena;
+    if (arena == NULL || arena->blocks == NULL) return;
+    // Keep the most recent block, which is usually the only one
+    riak_arena_block *keep  = arena->blocks;
+    riak_arena_block *block = keep->next;
+    while (block) {
+        riak_arena_block *next = block->next;
+        (cfg->free_fn)(block);
+        block = next;
+    }
+    keep->next = NULL;
+    keep->used = 0;
+    arena->allocated = 0;
+}
+
+riak_size_t
+riak_config_arena_get_allocated(riak_config *cfg) {
+    return (cfg->arena) ? cfg->arena->allocated : 0;
+}
+
 
 void
 riak_config_free(riak_config **config) {
     riak_config *cfg = *config;
     riak_free_fn freer = cfg->free_fn;
 
+    if (cfg->arena) {
+        riak_arena_block *block = cfg->arena->blocks;
+        while (block) {
+            riak_arena_block *next = block->next;
+            (freer)(block);
+            block = next;
+        }
+    }
     // Since we will only clean up one config, let's shut down non-threadsafe logging here, too
     if (cfg->log_cleanup_fn) {
         (cfg->log_cleanup_fn)(cfg->log_data);
     }
+    if (cfg->metrics) {
+        (freer)(cfg->metrics);
+    }
     (freer)(cfg);
     *config = NULL;
 }
@@ -28,6 +28,26 @@
 #include "riak_connection-internal.h"
 #include "riak_network.h"
 
+/**
+ * @brief Open the connection's socket, backing off between tries as the retry policy allows
+ * @param cxn Riak Connection with a resolved address
+ * @returns Socket, or -1 if every try failed
+ */
+static riak_socket_t
+riak_connection_open(riak_connection *cxn) {
+    riak_config  *cfg      = riak_connection_get_config(cxn);
+    riak_uint32_t attempts = 0;
+    while (RIAK_TRUE) {
+        riak_socket_t fd = riak_just_open_a_socket(cfg, cxn->addrinfo);
+        attempts++;
+        if (fd >= 0 || !riak_config_retry_allowed(cfg, attempts)) {
+            return fd;
+        }
+        riak_log_warn_config(cfg, "Could not connect to %s:%s, retrying", cxn->hostname, cxn->portnum);
+        riak_config_retry_backoff(cfg, attempts);
+    }
+}
+
 riak_error
 riak_connection_new(riak_config       *cfg,
                     riak_connection  **cxn_target,
@@ -55,8 +75,7 @@ riak_connection_new(riak_config       *cfg,
         return ERIAK_DNS_RESOLUTION;
     }
 
-    // TODO: Implement retry logic
-    cxn->fd = riak_just_open_a_socket(cfg, cxn->addrinfo);
+    cxn->fd = riak_connection_open(cxn);
     if (cxn->fd < 0) {
         riak_log_critical_config(cfg, "%s", "Could not just open a socket");
         return ERIAK_CONNECT;
@@ -69,16 +88,164 @@ riak_socket_t
 riak_connection_get_fd(riak_connection *cxn) {
     return cxn->fd;
 }
+
+void
+riak_connection_set_timeout(riak_connection *cxn,
+                            riak_uint32_t    timeout_ms) {
+    cxn->timeout_ms = timeout_ms;
+}
+
+riak_boolean_t
+riak_connection_is_stale(riak_connection *cxn) {
+    return cxn->stale;
+}
+
+riak_error
+riak_connection_reconnect(riak_connection *cxn) {
+    riak_config *cfg = riak_connection_get_config(cxn);
+    riak_pipeline_fail(cxn, ERIAK_CONNECT);
+    // Whatever was buffered belongs to the old stream
+    cxn->recv_start = 0;
+    cxn->recv_end   = 0;
+    cxn->stale      = RIAK_TRUE;
+    if (cxn->fd >= 0) {
+        close(cxn->fd);
+    }
+    cxn->fd = riak_just_open_a_socket(cfg, cxn->addrinfo);
+    if (cxn->fd < 0) {
+        riak_log_error(cxn, "Could not reconnect to %s:%s", cxn->hostname, cxn->portnum);
+        return ERIAK_CONNECT;
+    }
+    cxn->stale = RIAK_FALSE;
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_connection_reopen(riak_connection *cxn) {
+    riak_config *cfg = riak_connection_get_config(cxn);
+    // Whatever was buffered belongs to the old stream
+    cxn->recv_start = 0;
+    cxn->recv_end   = 0;
+    cxn->stale      = RIAK_TRUE;
+    if (cxn->fd >= 0) {
+        close(cxn->fd);
+    }
+    cxn->fd = riak_just_start_a_socket(cfg, cxn->addrinfo);
+    if (cxn->fd < 0) {
+        riak_log_error(cxn, "Could not reconnect to %s:%s", cxn->hostname, cxn->portnum);
+        return ERIAK_CONNECT;
+    }
+    cxn->stale = RIAK_FALSE;
+
+    return ERIAK_OK;
+}
+
 riak_config*
 riak_connection_get_config(riak_connection *cxn) {
     return cxn->config;
 }
 
+void
+riak_connection_set_response_config(riak_connection *cxn,
+                                    riak_config     *cfg) {
+    cxn->response_config = cfg;
+}
+
+riak_config*
+riak_connection_get_response_config(riak_connection *cxn) {
+    return (cxn->response_config) ? cxn->response_config : cxn->config;
+}
+
+/**
+ * @brief Size class able to hold `size` bytes
+ * @param size Bytes required
+ * @returns Class index, or -1 when too large to cache
+ */
+static int
+riak_connection_buffer_class(riak_size_t size) {
+    int i;
+    for(i = 0; i < RIAK_BUFFER_CLASSES; i++) {
+        if (size <= ((riak_size_t)1 << (RIAK_BUFFER_MIN_SHIFT + 2*i))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Release every cached buffer back to the allocator
+ * @param cxn Riak Connection
+ */
+static void
+riak_connection_buffer_flush(riak_connection *cxn) {
+    riak_config *cfg = riak_connection_get_config(cxn);
+    int i;
+    for(i = 0; i < RIAK_BUFFER_CLASSES; i++) {
+        while (cxn->buffers[i].free_list) {
+            void *buf = cxn->buffers[i].free_list;
+            cxn->buffers[i].free_list = *(void**)buf;
+            riak_free(cfg, &buf);
+            cxn->buffer_stats.heap_frees++;
+        }
+        cxn->buffers[i].count = 0;
+    }
+}
+
+riak_uint8_t*
+riak_connection_buffer_get(riak_connection *cxn,
+                           riak_size_t      size) {
+    riak_config *cfg = riak_connection_get_config(cxn);
+    int index = riak_connection_buffer_class(size);
+    if (index < 0) {
+        cxn->buffer_stats.heap_allocs++;
+        return (riak_uint8_t*)riak_config_allocate(cfg, size);
+    }
+    riak_buffer_class *class = &(cxn->buffers[index]);
+    if (class->free_list) {
+        void *buf = class->free_list;
+        class->free_list = *(void**)buf;
+        class->count--;
+        cxn->buffer_stats.reuses++;
+        return (riak_uint8_t*)buf;
+    }
+    cxn->buffer_stats.heap_allocs++;
+    return (riak_uint8_t*)riak_config_allocate(cfg, (riak_size_t)1 << (RIAK_BUFFER_MIN_SHIFT + 2*index));
+}
+
+void
+riak_connection_buffer_put(riak_connection *cxn,
+                           riak_uint8_t   **buf,
+                           riak_size_t      size) {
+    if (buf == NULL || *buf == NULL) return;
+    riak_config *cfg = riak_connection_get_config(cxn);
+    int index = riak_connection_buffer_class(size);
+    if (index < 0 || cxn->buffers[index].count >= RIAK_BUFFER_CACHE_DEPTH) {
+        riak_free(cfg, buf);
+        cxn->buffer_stats.heap_frees++;
+        return;
+    }
+    riak_buffer_class *class = &(cxn->buffers[index]);
+    *(void**)(*buf) = class->free_list;
+    class->free_list = *buf;
+    class->count++;
+    *buf = NULL;
+}
+
+void
+riak_connection_get_buffer_stats(riak_connection   *cxn,
+                                 riak_buffer_stats *stats) {
+    *stats = cxn->buffer_stats;
+}
+
 void riak_connection_free(riak_connection** cxn_target) {
     if (cxn_target == NULL || *cxn_target == NULL) return;
     riak_connection *cxn = *cxn_target;
     riak_config *cfg = riak_connection_get_config(cxn);
 
+    riak_pipeline_reset(cxn);
+    riak_connection_buffer_put(cxn, &(cxn->recv_buf), RIAK_RECV_BUFFER_SIZE);
+    riak_connection_buffer_flush(cxn);
     if (cxn->fd) {
         close(cxn->fd);
 
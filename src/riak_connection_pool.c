@@ -0,0 +1,281 @@
+/*********************************************************************
+ *
+ * riak_connection_pool.c: Pool of Riak Connections to a single node
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+#include "riak_connection_pool-internal.h"
+
+/**
+ * @brief Open a new connection into a slot the caller already owns
+ * @param pool Riak Connection Pool
+ * @param slot Index of slot in BUSY state
+ * @returns Error code
+ */
+static riak_error
+riak_connection_pool_open_slot(riak_connection_pool *pool,
+                               riak_uint32_t         slot) {
+    riak_connection *cxn = NULL;
+    riak_error err = riak_connection_new(pool->config,
+                                         &cxn,
+                                         pool->hostname,
+                                         pool->portnum,
+                                         pool->resolver);
+    if (err) {
+        riak_connection_free(&cxn);
+        return err;
+    }
+    cxn->pool      = pool;
+    cxn->pool_slot = slot;
+    pool->slots[slot].cxn = cxn;
+    riak_atomic_add(&(pool->n_open), 1);
+
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Free the connection in a slot the caller already owns and mark it EMPTY
+ * @param pool Riak Connection Pool
+ * @param slot Index of slot in BUSY state, already taken off `n_open`
+ */
+static void
+riak_connection_pool_empty_slot(riak_connection_pool *pool,
+                                riak_uint32_t         slot) {
+    riak_connection_free(&(pool->slots[slot].cxn));
+    riak_atomic_cas(&(pool->slots[slot].state), RIAK_POOL_SLOT_BUSY, RIAK_POOL_SLOT_EMPTY);
+}
+
+/**
+ * @brief Close the connection in a slot the caller already owns and mark it EMPTY
+ * @param pool Riak Connection Pool
+ * @param slot Index of slot in BUSY state
+ */
+static void
+riak_connection_pool_close_slot(riak_connection_pool *pool,
+                                riak_uint32_t         slot) {
+    riak_atomic_sub(&(pool->n_open), 1);
+    riak_connection_pool_empty_slot(pool, slot);
+}
+
+/**
+ * @brief Take one connection off `n_open`, unless that would leave fewer than the minimum
+ * @param pool Riak Connection Pool
+ * @returns True if the caller may close a connection
+ */
+static riak_boolean_t
+riak_connection_pool_claim_surplus(riak_connection_pool *pool) {
+    riak_uint32_t open = riak_atomic_load(&(pool->n_open));
+    while (open > pool->min_connections) {
+        if (riak_atomic_cas(&(pool->n_open), open, open - 1)) {
+            return RIAK_TRUE;
+        }
+        open = riak_atomic_load(&(pool->n_open));
+    }
+    return RIAK_FALSE;
+}
+
+riak_error
+riak_connection_pool_new(riak_config           *cfg,
+                         riak_connection_pool **pool_target,
+                         const char            *hostname,
+                         const char            *portnum,
+                         riak_addr_resolver     resolver,
+                         riak_uint32_t          min_connections,
+                         riak_uint32_t          max_connections) {
+    if (max_connections == 0 || min_connections > max_connections) {
+        riak_log_critical_config(cfg, "Invalid pool bounds [min %u, max %u]", min_connections, max_connections);
+        return ERIAK_INVALID;
+    }
+    riak_connection_pool *pool = (riak_connection_pool*)riak_config_clean_allocate(cfg, sizeof(riak_connection_pool));
+    if (pool == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_connection_pool");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    pool->slots = (riak_connection_pool_slot*)riak_config_clean_allocate(cfg, sizeof(riak_connection_pool_slot) * max_connections);
+    if (pool->slots == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate connection pool slots");
+        riak_free(cfg, &pool);
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    *pool_target = pool;
+    pool->config          = cfg;
+    pool->resolver        = resolver;
+    pool->min_connections = min_connections;
+    pool->max_connections = max_connections;
+    riak_strlcpy(pool->hostname, hostname, sizeof(pool->hostname));
+    riak_strlcpy(pool->portnum, portnum, sizeof(pool->portnum));
+
+    // Pre-open the minimum number of sockets so the first callers do not pay for connect()
+    riak_uint32_t i;
+    for(i = 0; i < min_connections; i++) {
+        pool->slots[i].state = RIAK_POOL_SLOT_BUSY;
+        riak_error err = riak_connection_pool_open_slot(pool, i);
+        if (err) {
+            pool->slots[i].state = RIAK_POOL_SLOT_EMPTY;
+            return err;
+        }
+        pool->slots[i].state = RIAK_POOL_SLOT_IDLE;
+    }
+
+    return ERIAK_OK;
+}
+
+void
+riak_connection_pool_free(riak_connection_pool **pool_target) {
+    if (pool_target == NULL || *pool_target == NULL) return;
+    riak_connection_pool *pool = *pool_target;
+    riak_config *cfg = pool->config;
+
+    riak_uint32_t i;
+    for(i = 0; i < pool->max_connections; i++) {
+        if (pool->slots[i].state == RIAK_POOL_SLOT_BUSY) {
+            riak_log_warn_config(cfg, "Freeing pool with connection %u still checked out", i);
+        }
+        riak_connection_free(&(pool->slots[i].cxn));
+    }
+    riak_free(cfg, &(pool->slots));
+    riak_free(cfg, pool_target);
+}
+
+riak_error
+riak_connection_pool_checkout(riak_connection_pool *pool,
+                              riak_connection     **cxn) {
+    riak_uint32_t max   = pool->max_connections;
+    riak_uint32_t start = riak_atomic_add(&(pool->next_slot), 1);
+    riak_uint32_t i;
+
+    // Prefer an already open connection
+    for(i = 0; i < max; i++) {
+        riak_uint32_t slot = (start + i) % max;
+        if (pool->slots[slot].state == RIAK_POOL_SLOT_IDLE &&
+            riak_atomic_cas(&(pool->slots[slot].state), RIAK_POOL_SLOT_IDLE, RIAK_POOL_SLOT_BUSY)) {
+            riak_atomic_add(&(pool->n_busy), 1);
+            *cxn = pool->slots[slot].cxn;
+            (*cxn)->checkout_usecs = riak_time_usecs();
+            (*cxn)->answer_usecs   = 0;
+            (*cxn)->answers        = 0;
+            return ERIAK_OK;
+        }
+    }
+
+    // Otherwise grow into the first free slot
+    for(i = 0; i < max; i++) {
+        riak_uint32_t slot = (start + i) % max;
+        if (pool->slots[slot].state == RIAK_POOL_SLOT_EMPTY &&
+            riak_atomic_cas(&(pool->slots[slot].state), RIAK_POOL_SLOT_EMPTY, RIAK_POOL_SLOT_BUSY)) {
+            riak_error err = riak_connection_pool_open_slot(pool, slot);
+            if (err) {
+                riak_atomic_cas(&(pool->slots[slot].state), RIAK_POOL_SLOT_BUSY, RIAK_POOL_SLOT_EMPTY);
+                return err;
+            }
+            riak_atomic_add(&(pool->n_busy), 1);
+            *cxn = pool->slots[slot].cxn;
+            (*cxn)->checkout_usecs = riak_time_usecs();
+            (*cxn)->answer_usecs   = 0;
+            (*cxn)->answers        = 0;
+            return ERIAK_OK;
+        }
+    }
+
+    return ERIAK_POOL_EXHAUSTED;
+}
+
+void
+riak_connection_pool_checkin(riak_connection_pool *pool,
+                             riak_connection     **cxn_target,
+                             riak_error            err) {
+    if (cxn_target == NULL || *cxn_target == NULL) return;
+    riak_connection *cxn  = *cxn_target;
+    riak_uint32_t    slot = cxn->pool_slot;
+    *cxn_target = NULL;
+
+    assert(cxn->pool == pool);
+    riak_atomic_sub(&(pool->n_busy), 1);
+    // A socket that failed or timed out mid-conversation may hold half a frame; never reuse it
+    if (err == ERIAK_CONNECT || err == ERIAK_READ || err == ERIAK_WRITE ||
+        err == ERIAK_TIMEOUT || cxn->stale) {
+        riak_log_notice_config(pool->config, "Evicting broken connection to %s:%s [%s]",
+                               pool->hostname, pool->portnum, riak_strerror(err));
+        riak_connection_pool_close_slot(pool, slot);
+        return;
+    }
+    riak_atomic_cas(&(pool->slots[slot].state), RIAK_POOL_SLOT_BUSY, RIAK_POOL_SLOT_IDLE);
+}
+
+riak_uint32_t
+riak_connection_pool_shrink(riak_connection_pool *pool) {
+    riak_uint32_t closed = 0;
+    riak_uint32_t i;
+    for(i = 0; i < pool->max_connections; i++) {
+        if (riak_atomic_load(&(pool->n_open)) <= pool->min_connections) {
+            break;
+        }
+        if (pool->slots[i].state != RIAK_POOL_SLOT_IDLE ||
+            !riak_atomic_cas(&(pool->slots[i].state), RIAK_POOL_SLOT_IDLE, RIAK_POOL_SLOT_BUSY)) {
+            continue;
+        }
+        // Another shrink may have taken the surplus since the check above
+        if (!riak_connection_pool_claim_surplus(pool)) {
+            riak_atomic_cas(&(pool->slots[i].state), RIAK_POOL_SLOT_BUSY, RIAK_POOL_SLOT_IDLE);
+            break;
+        }
+        riak_connection_pool_empty_slot(pool, i);
+        closed++;
+    }
+    return closed;
+}
+
+riak_uint32_t
+riak_connection_pool_get_n_open(riak_connection_pool *pool) {
+    return riak_atomic_load(&(pool->n_open));
+}
+
+riak_uint32_t
+riak_connection_pool_get_n_busy(riak_connection_pool *pool) {
+    return riak_atomic_load(&(pool->n_busy));
+}
+
+riak_connection_pool*
+riak_connection_get_pool(riak_connection *cxn) {
+    return cxn->pool;
+}
+
+void
+riak_connection_pool_sent(riak_operation *rop) {
+    // Retries and hedges are timed from the first send
+    if (rop->connection->pool && rop->sent_usecs == 0) {
+        rop->sent_usecs = riak_time_usecs();
+    }
+}
+
+void
+riak_connection_pool_answered(riak_operation *rop) {
+    if (rop->sent_usecs == 0) {
+        return;
+    }
+    rop->connection->answer_usecs += riak_time_usecs() - rop->sent_usecs;
+    rop->connection->answers++;
+    rop->sent_usecs = 0;
+}
@@ -0,0 +1,569 @@
+/*********************************************************************
+ *
+ * riak_epoll.c: Native Linux epoll reactor
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "riak.h"
+#include "riak_epoll.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+#include "riak_timer_wheel-internal.h"
+
+// Ready sockets collected by one epoll_wait()
+#define RIAK_EPOLL_MAX_EVENTS 64
+
+struct _riak_epoll_connection {
+    struct _riak_epoll            *epoll;
+    riak_connection               *cxn;
+    int                            fd_flags;  // Restored when detached
+    riak_error                     err;       // First failure; the connection is unusable after one
+    riak_boolean_t                 closed;    // Server hung up or the socket failed
+
+    // While a retry waits out its backoff and then its connect, the oldest
+    // operation's timer is borrowed to wake the reactor
+    riak_operation                *retry_rop;
+    riak_boolean_t                 connecting;
+
+    // Framed requests not yet taken by the kernel live in out_buf[out_start, out_end)
+    riak_uint8_t                  *out_buf;
+    riak_size_t                    out_start;
+    riak_size_t                    out_end;
+    riak_uint32_t                  out_capacity;
+
+    riak_boolean_t                 queued;    // On the reactor's flush list
+    struct _riak_epoll_connection *next_flush;
+    struct _riak_epoll_connection *prev;
+    struct _riak_epoll_connection *next;
+};
+
+struct _riak_epoll {
+    riak_config           *config;
+    int                    epfd;
+    riak_epoll_connection *connections;
+    riak_epoll_connection *flush_head;    // Connections with requests queued since the last pass
+    riak_timer_wheel      *timers;        // Deadlines of operations in flight
+};
+
+/**
+ * @brief Append part of a framed request to the connection's output buffer
+ * @param ptr Attached connection
+ * @param data Bytes to queue
+ * @param size Number of bytes
+ * @returns `size`, or 0 if out of memory
+ */
+static riak_ssize_t
+riak_epoll_buffer_cb(void       *ptr,
+                     void       *data,
+                     riak_size_t size) {
+    riak_epoll_connection *econn = (riak_epoll_connection*)ptr;
+    riak_config           *cfg   = riak_connection_get_config(econn->cxn);
+
+    // Slide unsent bytes to the front before growing
+    if (econn->out_start > 0) {
+        memmove(econn->out_buf, econn->out_buf + econn->out_start, econn->out_end - econn->out_start);
+        econn->out_end  -= econn->out_start;
+        econn->out_start = 0;
+    }
+    riak_error err = riak_array_reserve(cfg,
+                                        (void***)&(econn->out_buf),
+                                        sizeof(riak_uint8_t),
+                                        econn->out_end,
+                                        &(econn->out_capacity),
+                                        econn->out_end + size);
+    if (err) {
+        return 0;
+    }
+    memcpy(econn->out_buf + econn->out_end, data, size);
+    econn->out_end += size;
+    return size;
+}
+
+/**
+ * @brief Non-blocking read which reports an empty socket as 0 bytes
+ * @param ptr Attached connection
+ * @param data Buffer to fill
+ * @param size Space in `data`
+ * @returns Bytes read; 0 means nothing more for now and `closed` tells whether any will follow
+ */
+static riak_ssize_t
+riak_epoll_read_cb(void       *ptr,
+                   void       *data,
+                   riak_size_t size) {
+    riak_epoll_connection *econn = (riak_epoll_connection*)ptr;
+    riak_socket_t          fd    = riak_connection_get_fd(econn->cxn);
+    riak_ssize_t           result;
+    do {
+        result = recv(fd, data, size, 0);
+    } while (result < 0 && errno == EINTR);
+    if (result > 0) {
+        return result;
+    }
+    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (result < 0) {
+        char message[256];
+        strerror_r(errno, message, sizeof(message));
+        riak_log_error(econn->cxn, "%s", message);
+    }
+    econn->closed = RIAK_TRUE;
+    return 0;
+}
+
+/**
+ * @brief Rewind what may be retried and wait out the backoff on the timer wheel
+ * @param econn Attached connection, no longer watched
+ * @param err Reason it broke
+ * @returns Error code; anything but ERIAK_OK means nothing was kept for a retry
+ */
+static riak_error
+riak_epoll_retry(riak_epoll_connection *econn,
+                 riak_error             err) {
+    riak_connection *cxn = econn->cxn;
+    riak_uint64_t    backoff_usecs;
+    if (riak_pipeline_rewind(cxn, err, &backoff_usecs) == 0) {
+        return err;
+    }
+    // No deadline runs until the requests are back on the wire
+    riak_operation *rop;
+    for(rop = cxn->pipeline_head; rop != NULL; rop = rop->next) {
+        riak_timer_wheel_cancel(rop);
+    }
+    econn->connecting = RIAK_FALSE;
+    econn->retry_rop  = cxn->pipeline_head;
+    riak_timer_wheel_add_at(econn->epoll->timers, econn->retry_rop, econn, riak_time_usecs() + backoff_usecs);
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Stop watching a connection and retry or drop its outstanding operations
+ * @param econn Attached connection
+ * @param err Reason
+ */
+static void
+riak_epoll_fail(riak_epoll_connection *econn,
+                riak_error             err) {
+    riak_connection *cxn = econn->cxn;
+    if (econn->err) {
+        return;
+    }
+    econn->err = err;
+    if (econn->retry_rop == NULL || econn->connecting) {
+        epoll_ctl(econn->epoll->epfd, EPOLL_CTL_DEL, riak_connection_get_fd(cxn), NULL);
+    }
+    econn->out_start = econn->out_end = 0;
+    if (riak_pipeline_get_depth(cxn) > 0 && err != ERIAK_EVENT &&
+        riak_config_retry_allowed(riak_connection_get_config(cxn), 1) &&
+        riak_epoll_retry(econn, err) == ERIAK_OK) {
+        econn->err = ERIAK_OK;
+        return;
+    }
+    econn->retry_rop  = NULL;
+    econn->connecting = RIAK_FALSE;
+    riak_pipeline_drop(cxn, err);
+}
+
+/**
+ * @brief Once the backoff is over, start connecting a new socket and watch it
+ * @param econn Attached connection waiting to retry
+ */
+static void
+riak_epoll_reconnect(riak_epoll_connection *econn) {
+    riak_connection *cxn = econn->cxn;
+    riak_error       err = riak_connection_reopen(cxn);
+    if (err) {
+        // Counts as another try, so a node which stays down is given up on
+        riak_epoll_fail(econn, err);
+        return;
+    }
+    riak_socket_t fd = riak_connection_get_fd(cxn);
+    struct epoll_event event;
+    memset(&event, '\0', sizeof(event));
+    event.events   = EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
+    event.data.ptr = econn;
+    if (epoll_ctl(econn->epoll->epfd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        riak_log_error(cxn, "Could not watch socket [fd %d, %s]", fd, strerror(errno));
+        riak_epoll_fail(econn, ERIAK_EVENT);
+        return;
+    }
+    econn->connecting = RIAK_TRUE;
+    econn->closed     = RIAK_FALSE;
+    // A connect may take no longer than the request it carries
+    if (econn->retry_rop->timeout_ms) {
+        riak_timer_wheel_add_at(econn->epoll->timers, econn->retry_rop, econn,
+                                riak_time_usecs() + (riak_uint64_t)econn->retry_rop->timeout_ms * 1000);
+    }
+}
+
+/**
+ * @brief Finish a retry once the new socket is writable by queueing every request again
+ * @param econn Attached connection whose new socket is connecting
+ * @returns Error code
+ */
+static riak_error
+riak_epoll_connected(riak_epoll_connection *econn) {
+    riak_connection *cxn   = econn->cxn;
+    int              error = 0;
+    socklen_t        len   = sizeof(error);
+    if (getsockopt(riak_connection_get_fd(cxn), SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+        riak_log_error(cxn, "Could not reconnect to %s:%s [%s]", cxn->hostname, cxn->portnum, strerror(error));
+        return ERIAK_CONNECT;
+    }
+    riak_timer_wheel_cancel(econn->retry_rop);
+    econn->retry_rop  = NULL;
+    econn->connecting = RIAK_FALSE;
+    // Anything queued during the backoff was meant for the old socket; frame it all again
+    econn->out_start = econn->out_end = 0;
+    riak_error err = riak_pipeline_resend(cxn, riak_epoll_buffer_cb, econn);
+    if (err) {
+        return err;
+    }
+    riak_operation *rop;
+    for(rop = cxn->pipeline_head; rop != NULL; rop = rop->next) {
+        riak_timer_wheel_add(econn->epoll->timers, rop, econn);
+    }
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Hand queued requests to the kernel until they are gone or the socket is full
+ * @param econn Attached connection
+ * @returns Error code
+ */
+static riak_error
+riak_epoll_flush(riak_epoll_connection *econn) {
+    // A retry frames everything again once its new socket connects
+    if (econn->retry_rop) {
+        return ERIAK_OK;
+    }
+    riak_socket_t fd = riak_connection_get_fd(econn->cxn);
+    while (econn->out_start < econn->out_end) {
+        riak_ssize_t wrote = send(fd,
+                                  econn->out_buf + econn->out_start,
+                                  econn->out_end - econn->out_start,
+                                  MSG_NOSIGNAL);
+        if (wrote < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // The next EPOLLOUT edge resumes from here
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return ERIAK_OK;
+            }
+            char message[256];
+            strerror_r(errno, message, sizeof(message));
+            riak_log_error(econn->cxn, "%s", message);
+            return ERIAK_WRITE;
+        }
+        econn->out_start += wrote;
+    }
+    econn->out_start = econn->out_end = 0;
+    return ERIAK_OK;
+}
+
+/**
+ * @brief React to readiness of one socket
+ * @param econn Attached connection
+ * @param events Bitvector of epoll events
+ */
+static void
+riak_epoll_handle(riak_epoll_connection *econn,
+                  riak_uint32_t          events) {
+    riak_connection *cxn = econn->cxn;
+    riak_error       err = ERIAK_OK;
+
+    if (econn->err) {
+        return;
+    }
+    if (econn->connecting) {
+        // Writable or failed, either way the connect is over
+        if ((events & (EPOLLOUT|EPOLLERR|EPOLLHUP)) == 0) {
+            return;
+        }
+        err = riak_epoll_connected(econn);
+        if (err) {
+            riak_epoll_fail(econn, err);
+            return;
+        }
+    }
+    if (events & EPOLLOUT) {
+        err = riak_epoll_flush(econn);
+    }
+    // Edge-triggered, so read until the socket is empty; riak_pipeline_read stops on a 0-byte read
+    if (err == ERIAK_OK && (events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR))) {
+        // Nothing is read while idle, so a hang-up must be noticed here
+        if (riak_pipeline_get_depth(cxn) == 0 && (events & (EPOLLRDHUP|EPOLLHUP|EPOLLERR))) {
+            econn->closed = RIAK_TRUE;
+        }
+        err = riak_pipeline_read(cxn, riak_epoll_read_cb, econn);
+        if (err == ERIAK_OK && econn->closed) {
+            err = ERIAK_READ;
+        }
+    }
+    if (err) {
+        riak_epoll_fail(econn, err);
+    }
+}
+
+/**
+ * @brief Called by the timer wheel when an operation outlives its deadline, or a retry's backoff or connect is up
+ * @param rop Expired operation
+ * @param ptr Attached connection
+ */
+static void
+riak_epoll_timeout_cb(riak_operation *rop,
+                      void           *ptr) {
+    riak_epoll_connection *econn = (riak_epoll_connection*)ptr;
+    if (rop == econn->retry_rop) {
+        if (econn->connecting) {
+            riak_epoll_fail(econn, ERIAK_CONNECT);
+        } else {
+            riak_epoll_reconnect(econn);
+        }
+        return;
+    }
+    riak_epoll_fail(econn, ERIAK_TIMEOUT);
+}
+
+riak_error
+riak_epoll_new(riak_epoll  **ep_target,
+               riak_config  *cfg) {
+    riak_epoll *ep = (riak_epoll*)riak_config_clean_allocate(cfg, sizeof(riak_epoll));
+    if (ep == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_epoll");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    riak_error err = riak_timer_wheel_new(&(ep->timers), cfg, RIAK_TIMER_WHEEL_DEFAULT_TICK_MS);
+    if (err) {
+        riak_free(cfg, &ep);
+        return err;
+    }
+    ep->config = cfg;
+    ep->epfd   = epoll_create1(EPOLL_CLOEXEC);
+    if (ep->epfd < 0) {
+        riak_log_critical_config(cfg, "Could not create epoll instance [%s]", strerror(errno));
+        riak_timer_wheel_free(&(ep->timers));
+        riak_free(cfg, &ep);
+        return ERIAK_EVENT;
+    }
+    *ep_target = ep;
+
+    return ERIAK_OK;
+}
+
+void
+riak_epoll_free(riak_epoll **ep_target) {
+    if (ep_target == NULL || *ep_target == NULL) {
+        return;
+    }
+    riak_epoll  *ep  = *ep_target;
+    riak_config *cfg = ep->config;
+    while (ep->connections) {
+        riak_epoll_connection *econn = ep->connections;
+        riak_epoll_connection_free(&econn);
+    }
+    close(ep->epfd);
+    riak_timer_wheel_free(&(ep->timers));
+    riak_free(cfg, ep_target);
+}
+
+riak_error
+riak_epoll_connection_new(riak_epoll_connection **econn_target,
+                          riak_epoll             *ep,
+                          riak_connection        *cxn) {
+    riak_config  *cfg = riak_connection_get_config(cxn);
+    riak_socket_t fd  = riak_connection_get_fd(cxn);
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        riak_log_critical(cxn, "Could not read socket flags [fd %d]", fd);
+        return ERIAK_EVENT;
+    }
+    riak_epoll_connection *econn = (riak_epoll_connection*)riak_config_clean_allocate(cfg, sizeof(riak_epoll_connection));
+    if (econn == NULL) {
+        riak_log_critical(cxn, "%s", "Could not allocate a riak_epoll_connection");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    econn->epoll    = ep;
+    econn->cxn      = cxn;
+    econn->fd_flags = flags;
+    if (fcntl(fd, F_SETFL, flags|O_NONBLOCK) != 0) {
+        riak_log_critical(cxn, "Could not make socket non-blocking [fd %d]", fd);
+        riak_free(cfg, &econn);
+        return ERIAK_EVENT;
+    }
+
+    // Registered once for both directions; edges need no re-arming per request
+    struct epoll_event event;
+    memset(&event, '\0', sizeof(event));
+    event.events   = EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
+    event.data.ptr = econn;
+    if (epoll_ctl(ep->epfd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        riak_log_critical(cxn, "Could not watch socket [fd %d, %s]", fd, strerror(errno));
+        fcntl(fd, F_SETFL, flags);
+        riak_free(cfg, &econn);
+        return ERIAK_EVENT;
+    }
+
+    econn->next = ep->connections;
+    if (ep->connections) {
+        ep->connections->prev = econn;
+    }
+    ep->connections = econn;
+    *econn_target   = econn;
+
+    return ERIAK_OK;
+}
+
+void
+riak_epoll_connection_free(riak_epoll_connection **econn_target) {
+    if (econn_target == NULL || *econn_target == NULL) {
+        return;
+    }
+    riak_epoll_connection *econn = *econn_target;
+    riak_epoll            *ep    = econn->epoll;
+    riak_connection       *cxn   = econn->cxn;
+    riak_config           *cfg   = riak_connection_get_config(cxn);
+
+    // Unsent requests can never be answered
+    riak_epoll_fail(econn, ERIAK_EVENT);
+    fcntl(riak_connection_get_fd(cxn), F_SETFL, econn->fd_flags);
+
+    if (econn->queued) {
+        riak_epoll_connection **link = &(ep->flush_head);
+        while (*link != econn) {
+            link = &((*link)->next_flush);
+        }
+        *link = econn->next_flush;
+    }
+    if (econn->prev) {
+        econn->prev->next = econn->next;
+    } else {
+        ep->connections = econn->next;
+    }
+    if (econn->next) {
+        econn->next->prev = econn->prev;
+    }
+    riak_free(cfg, &(econn->out_buf));
+    riak_free(cfg, econn_target);
+}
+
+riak_error
+riak_epoll_connection_get_error(riak_epoll_connection *econn) {
+    return econn->err;
+}
+
+riak_error
+riak_epoll_send(riak_operation        *rop,
+                riak_epoll_connection *econn) {
+    if (econn->err) {
+        return econn->err;
+    }
+    if (riak_operation_get_connection(rop) != econn->cxn) {
+        riak_log_error(econn->cxn, "%s", "Operation belongs to another connection");
+        return ERIAK_INVALID;
+    }
+    riak_error err = riak_pipeline_queue(rop, riak_epoll_buffer_cb, econn, &(econn->out_end));
+    if (err) {
+        return err;
+    }
+    // During a retry the deadline starts once the new socket takes the request
+    if (econn->retry_rop == NULL) {
+        riak_timer_wheel_add(econn->epoll->timers, rop, econn);
+    }
+    if (!econn->queued) {
+        econn->queued            = RIAK_TRUE;
+        econn->next_flush        = econn->epoll->flush_head;
+        econn->epoll->flush_head = econn;
+    }
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_epoll_run_once(riak_epoll *ep,
+                    int         timeout_ms) {
+    // One write per connection carries every request queued since the last pass
+    while (ep->flush_head) {
+        riak_epoll_connection *econn = ep->flush_head;
+        ep->flush_head    = econn->next_flush;
+        econn->next_flush = NULL;
+        econn->queued     = RIAK_FALSE;
+        if (econn->err == ERIAK_OK) {
+            riak_error err = riak_epoll_flush(econn);
+            if (err) {
+                riak_epoll_fail(econn, err);
+            }
+        }
+    }
+
+    // Wake in time to enforce the nearest deadline
+    int deadline_ms = riak_timer_wheel_get_timeout(ep->timers);
+    if (deadline_ms >= 0 && (timeout_ms < 0 || deadline_ms < timeout_ms)) {
+        timeout_ms = deadline_ms;
+    }
+    struct epoll_event events[RIAK_EPOLL_MAX_EVENTS];
+    int n_events = epoll_wait(ep->epfd, events, RIAK_EPOLL_MAX_EVENTS, timeout_ms);
+    if (n_events < 0) {
+        if (errno == EINTR) {
+            return ERIAK_OK;
+        }
+        riak_log_critical_config(ep->config, "epoll_wait failed [%s]", strerror(errno));
+        return ERIAK_EVENT;
+    }
+    int i;
+    for(i = 0; i < n_events; i++) {
+        riak_epoll_handle((riak_epoll_connection*)events[i].data.ptr, events[i].events);
+    }
+    riak_timer_wheel_advance(ep->timers, riak_epoll_timeout_cb);
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_epoll_run(riak_epoll *ep) {
+    while (riak_epoll_get_pending(ep) > 0) {
+        riak_error err = riak_epoll_run_once(ep, -1);
+        if (err) {
+            return err;
+        }
+    }
+
+    return ERIAK_OK;
+}
+
+riak_uint32_t
+riak_epoll_get_pending(riak_epoll *ep) {
+    riak_uint32_t pending = 0;
+    riak_epoll_connection *econn;
+    for(econn = ep->connections; econn != NULL; econn = econn->next) {
+        if (econn->err == ERIAK_OK) {
+            pending += riak_pipeline_get_depth(econn->cxn);
+        }
+    }
+    return pending;
+}
@@ -0,0 +1,356 @@
+/*********************************************************************
+ *
+ * riak_hedge.c: Hedged requests across the nodes of a Riak cluster
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <poll.h>
+#include <limits.h>
+#include <errno.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_metrics-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+#include "riak_cluster-internal.h"
+
+// Once this many GETs are timed the histogram is halved, so old samples fade
+#define RIAK_CLUSTER_HEDGE_WINDOW 10000
+#define RIAK_HEDGE_MAX_LEGS 2
+
+// One copy of the request in flight on one node
+typedef struct _riak_hedge_leg {
+    riak_connection *cxn;
+    riak_operation  *rop;
+    riak_uint64_t    sent_usecs;
+    riak_error       err;       // Connection-level failure, which retires the leg
+    riak_boolean_t   closed;
+} riak_hedge_leg;
+
+/**
+ * @brief Histogram bucket of a latency: exact below 4usecs, then 4 per power of two
+ * @param usecs Latency in microseconds
+ * @returns Index into the cluster's latency histogram
+ */
+static riak_uint32_t
+riak_hedge_bucket(riak_uint64_t usecs) {
+    if (usecs < 4) {
+        return (riak_uint32_t)usecs;
+    }
+    riak_uint32_t msb = 2;
+    while ((usecs >> (msb + 1)) != 0) {
+        msb++;
+    }
+    riak_uint32_t index = 4 * (msb - 1) + (riak_uint32_t)((usecs >> (msb - 2)) & 3);
+    return (index < RIAK_CLUSTER_LATENCY_BUCKETS) ? index : RIAK_CLUSTER_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @brief Largest latency counted in a histogram bucket
+ * @param index Histogram bucket
+ * @returns Upper bound in microseconds
+ */
+static riak_uint64_t
+riak_hedge_bucket_limit(riak_uint32_t index) {
+    if (index < 4) {
+        return index;
+    }
+    riak_uint32_t msb = index / 4 + 1;
+    return (((riak_uint64_t)(5 + index % 4)) << (msb - 2)) - 1;
+}
+
+/**
+ * @brief Count one GET's latency towards the hedging delay
+ * @param cluster Riak Cluster
+ * @param usecs Time from sending the request to its response
+ */
+static void
+riak_hedge_record(riak_cluster *cluster,
+                  riak_uint64_t usecs) {
+    riak_atomic_add(&(cluster->get_latency[riak_hedge_bucket(usecs)]), 1);
+    if (riak_atomic_add(&(cluster->get_samples), 1) == RIAK_CLUSTER_HEDGE_WINDOW) {
+        // Only one caller sees the window fill; racing increments may be lost
+        riak_uint32_t i;
+        for(i = 0; i < RIAK_CLUSTER_LATENCY_BUCKETS; i++) {
+            cluster->get_latency[i] /= 2;
+        }
+        riak_atomic_sub(&(cluster->get_samples), RIAK_CLUSTER_HEDGE_WINDOW / 2);
+    }
+}
+
+riak_error
+riak_cluster_set_hedge_policy(riak_cluster *cluster,
+                              riak_uint32_t percentile,
+                              riak_uint32_t min_delay_ms) {
+    if (percentile > 100) {
+        return ERIAK_OUT_OF_RANGE;
+    }
+    cluster->hedge_percentile = percentile;
+    cluster->hedge_min_usecs  = (riak_uint64_t)min_delay_ms * 1000;
+    return ERIAK_OK;
+}
+
+int
+riak_cluster_get_hedge_delay(riak_cluster *cluster) {
+    if (cluster->hedge_percentile == 0) {
+        return -1;
+    }
+    riak_uint64_t delay = cluster->hedge_min_usecs;
+    if (cluster->get_samples >= RIAK_CLUSTER_HEDGE_MIN_SAMPLES) {
+        riak_uint64_t total = 0;
+        riak_uint32_t i;
+        for(i = 0; i < RIAK_CLUSTER_LATENCY_BUCKETS; i++) {
+            total += cluster->get_latency[i];
+        }
+        riak_uint64_t target = (total * cluster->hedge_percentile + 99) / 100;
+        riak_uint64_t seen   = 0;
+        for(i = 0; i < RIAK_CLUSTER_LATENCY_BUCKETS; i++) {
+            seen += cluster->get_latency[i];
+            if (seen >= target) {
+                break;
+            }
+        }
+        if (i < RIAK_CLUSTER_LATENCY_BUCKETS && riak_hedge_bucket_limit(i) > delay) {
+            delay = riak_hedge_bucket_limit(i);
+        }
+    }
+    delay = (delay + 999) / 1000;
+    return (delay > INT_MAX) ? INT_MAX : (int)delay;
+}
+
+static riak_ssize_t
+riak_hedge_writev_cb(void         *ptr,
+                     struct iovec *iov,
+                     int           iovcnt) {
+    riak_hedge_leg *leg = (riak_hedge_leg*)ptr;
+    return writev(riak_connection_get_fd(leg->cxn), iov, iovcnt);
+}
+
+// Reads only what has already arrived, so the slower node never holds up the faster
+static riak_ssize_t
+riak_hedge_reader_cb(void       *ptr,
+                     void       *data,
+                     riak_size_t size) {
+    riak_hedge_leg *leg = (riak_hedge_leg*)ptr;
+    riak_ssize_t    result;
+    do {
+        result = recv(riak_connection_get_fd(leg->cxn), data, size, MSG_DONTWAIT);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            char message[256];
+            strerror_r(errno, message, sizeof(message));
+            riak_log_error(leg->cxn, "%s", message);
+            leg->closed = RIAK_TRUE;
+        }
+        return 0;
+    }
+    if (result == 0) {
+        leg->closed = RIAK_TRUE;
+    }
+    return result;
+}
+
+/**
+ * @brief Put a leg's request on the wire
+ * @param leg Hedge leg with a connection and an encoded request
+ * @returns Error code
+ */
+static riak_error
+riak_hedge_leg_send(riak_hedge_leg *leg) {
+    leg->sent_usecs = riak_time_usecs();
+    riak_error err = riak_writev(leg->rop, riak_hedge_writev_cb, leg);
+    if (err) {
+        riak_log_error(leg->cxn, "%s", "Could not send request");
+    }
+    return err;
+}
+
+/**
+ * @brief Send the primary's request to another node without encoding it again
+ * @param cluster Riak Cluster
+ * @param hedge Leg to start (out)
+ * @param primary Leg already sent
+ * @returns Error code
+ */
+static riak_error
+riak_hedge_leg_start(riak_cluster   *cluster,
+                     riak_hedge_leg *hedge,
+                     riak_hedge_leg *primary) {
+    riak_cluster_node *node = riak_cluster_find_node(cluster, primary->cxn);
+    riak_error err = riak_cluster_checkout_excluding(cluster, node, &(hedge->cxn));
+    if (err) {
+        return err;
+    }
+    err = riak_operation_new(hedge->cxn, &(hedge->rop), NULL, NULL, NULL);
+    if (err) {
+        riak_cluster_checkin(cluster, &(hedge->cxn), ERIAK_OK);
+        return err;
+    }
+    riak_operation *rop = hedge->rop;
+    riak_operation_set_bucket_type(rop, riak_operation_get_bucket_type(primary->rop));
+    riak_operation_set_bucket(rop, riak_operation_get_bucket(primary->rop));
+    riak_operation_set_key(rop, riak_operation_get_key(primary->rop));
+    riak_operation_set_response_decoder(rop, primary->rop->decoder);
+    rop->response_config = primary->rop->response_config;
+    // Borrowed; handed back before the operation is freed
+    rop->pb_request = primary->rop->pb_request;
+
+    riak_log_debug(primary->cxn, "Hedging request to %s:%s", hedge->cxn->hostname, hedge->cxn->portnum);
+    hedge->err = riak_hedge_leg_send(hedge);
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Take whatever has arrived for a leg
+ * @param leg Hedge leg still waiting for its answer
+ * @param done Set once the response is complete (out)
+ * @returns ERIAK_OK, ERIAK_SERVER_ERROR on a complete error answer, else the leg's failure
+ */
+static riak_error
+riak_hedge_leg_read(riak_hedge_leg *leg,
+                    riak_boolean_t *done) {
+    riak_error err = riak_read_buffered(leg->rop, done, riak_hedge_reader_cb, leg);
+    if (err == ERIAK_SERVER_ERROR) {
+        *done = RIAK_TRUE;
+        return err;
+    }
+    if (err == ERIAK_OK && !(*done) && leg->closed) {
+        riak_log_error(leg->cxn, "%s", "Connection closed before response completed");
+        err = ERIAK_READ;
+    }
+    return err;
+}
+
+riak_error
+riak_cluster_get(riak_cluster       *cluster,
+                 riak_binary        *bucket_type,
+                 riak_binary        *bucket,
+                 riak_binary        *key,
+                 riak_get_options   *opts,
+                 riak_get_response **response) {
+    riak_hedge_leg legs[RIAK_HEDGE_MAX_LEGS];
+    riak_uint32_t  n_legs = 1;
+    riak_int32_t   winner = -1;
+    riak_uint32_t  i;
+    memset(legs, 0, sizeof(legs));
+
+    riak_error err = riak_cluster_checkout(cluster, &(legs[0].cxn));
+    if (err) {
+        return err;
+    }
+    err = riak_operation_new(legs[0].cxn, &(legs[0].rop), NULL, NULL, NULL);
+    if (err) {
+        riak_cluster_checkin(cluster, &(legs[0].cxn), ERIAK_OK);
+        return err;
+    }
+    err = riak_get_request_encode(legs[0].rop, bucket_type, bucket, key, opts, &(legs[0].rop->pb_request));
+    if (err) {
+        riak_operation_free(&(legs[0].rop));
+        riak_cluster_checkin(cluster, &(legs[0].cxn), ERIAK_OK);
+        return err;
+    }
+    legs[0].err = riak_hedge_leg_send(&legs[0]);
+
+    riak_uint64_t start    = legs[0].sent_usecs;
+    riak_uint64_t deadline = (legs[0].rop->timeout_ms) ? start + (riak_uint64_t)legs[0].rop->timeout_ms * 1000 : 0;
+    int           delay    = riak_cluster_get_hedge_delay(cluster);
+    riak_uint64_t hedge_at = (delay >= 0 && cluster->n_nodes > 1) ? start + (riak_uint64_t)delay * 1000 : 0;
+
+    while (err == ERIAK_OK && winner < 0) {
+        riak_uint64_t now = riak_time_usecs();
+        // Hedge once, when the delay is up or as soon as the first node fails
+        if (hedge_at && (now >= hedge_at || legs[0].err)) {
+            hedge_at = 0;
+            if (riak_hedge_leg_start(cluster, &legs[1], &legs[0]) == ERIAK_OK) {
+                n_legs = 2;
+            }
+        }
+        struct pollfd pfds[RIAK_HEDGE_MAX_LEGS];
+        riak_uint32_t legs_polled[RIAK_HEDGE_MAX_LEGS];
+        int n_pfds = 0;
+        for(i = 0; i < n_legs; i++) {
+            if (legs[i].err) continue;
+            pfds[n_pfds].fd      = riak_connection_get_fd(legs[i].cxn);
+            pfds[n_pfds].events  = POLLIN;
+            pfds[n_pfds].revents = 0;
+            legs_polled[n_pfds++] = i;
+        }
+        if (n_pfds == 0) {
+            err = legs[n_legs-1].err;
+            break;
+        }
+        if (deadline && now >= deadline) {
+            riak_log_error(legs[0].cxn, "%s", "Timed out waiting for response");
+            err = ERIAK_TIMEOUT;
+            break;
+        }
+        riak_uint64_t wake = hedge_at;
+        if (deadline && (wake == 0 || deadline < wake)) {
+            wake = deadline;
+        }
+        int ready = poll(pfds, n_pfds, (wake) ? riak_deadline_ms(wake) : -1);
+        if (ready < 0 && errno != EINTR) {
+            err = ERIAK_READ;
+            break;
+        }
+        int p;
+        for(p = 0; p < n_pfds && ready > 0; p++) {
+            if (pfds[p].revents == 0) continue;
+            riak_hedge_leg *leg  = &legs[legs_polled[p]];
+            riak_boolean_t  done = RIAK_FALSE;
+            riak_error   outcome = riak_hedge_leg_read(leg, &done);
+            if (done) {
+                winner = legs_polled[p];
+                err    = outcome;
+                if (outcome == ERIAK_OK) {
+                    riak_hedge_record(cluster, riak_time_usecs() - leg->sent_usecs);
+                }
+                break;
+            }
+            leg->err = outcome;
+        }
+    }
+
+    if (winner >= 0) {
+        *response = legs[winner].rop->response;
+    }
+    // Hand the borrowed request back before anything is freed
+    if (n_legs > 1) {
+        legs[1].rop->pb_request = NULL;
+    }
+    for(i = RIAK_HEDGE_MAX_LEGS; i-- > 0; ) {
+        riak_hedge_leg *leg = &legs[i];
+        if (leg->cxn == NULL) continue;
+        riak_error outcome = leg->err;
+        if ((riak_int32_t)i == winner) {
+            outcome = err;
+        } else if (outcome == ERIAK_OK) {
+            // The slower node's answer would be taken for the next request's
+            leg->cxn->stale = RIAK_TRUE;
+            outcome = ERIAK_TIMEOUT;
+        }
+        riak_metrics_operation_done(leg->rop, outcome);
+        riak_operation_free(&(leg->rop));
+        riak_cluster_checkin(cluster, &(leg->cxn), outcome);
+    }
+    return err;
+}
@@ -41,6 +41,12 @@ riak_log_default(void            *ptr,
 
 }
 
+riak_boolean_t
+riak_log_is_enabled(riak_config      *cfg,
+                    riak_log_level_t  level) {
+    return riak_log_enabled(cfg, level);
+}
+
 void
 riak_log_internal(riak_config         *cfg,
                   riak_log_level_t     level,
@@ -0,0 +1,575 @@
+/*********************************************************************
+ *
+ * riak_log_buffer.c: In-memory log ring buffers drained by a background thread
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <pthread.h>
+#include <time.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+
+// Room in each record for the arguments of one message
+#define RIAK_LOG_BUFFER_ARGS 8
+#define RIAK_LOG_BUFFER_TEXT 160
+// Longest line written out
+#define RIAK_LOG_BUFFER_LINE 1024
+// Text offset standing in for a NULL string
+#define RIAK_LOG_BUFFER_NULL 0xFFFFFFFF
+
+typedef union _riak_log_arg {
+    riak_int64_t  i;
+    riak_uint64_t u;
+    double        d;
+    const void   *p;
+} riak_log_arg;
+
+// One message with its arguments captured but not yet formatted
+typedef struct _riak_log_record {
+    riak_uint64_t    usecs;     // Wall clock time of the message
+    riak_log_level_t level;
+    const char      *file;      // Format, file and function are string literals
+    riak_uint32_t    filelen;
+    riak_uint32_t    line;
+    const char      *format;
+    riak_uint32_t    n_args;
+    riak_log_arg     args[RIAK_LOG_BUFFER_ARGS];
+    char             text[RIAK_LOG_BUFFER_TEXT]; // Copies of string arguments, args hold their offsets
+} riak_log_record;
+
+// Single-producer, single-consumer ring owned by one logging thread
+typedef struct _riak_log_ring {
+    riak_log_record       *records;
+    riak_uint32_t          mask;
+    riak_uint64_t          head;  // Next record the owning thread fills
+    riak_uint64_t          tail;  // Next record the drain formats
+    riak_uint32_t          orphaned; // Set once the owning thread has exited
+    struct _riak_log_ring *next;  // Every ring of the buffer
+} riak_log_ring;
+
+struct _riak_log_buffer {
+    riak_alloc_fn   malloc_fn;
+    riak_free_fn    free_fn;
+    FILE           *out;
+    riak_uint32_t   records;  // Per ring, a power of two
+    pthread_key_t   key;      // The calling thread's ring
+    riak_log_ring  *rings;
+    riak_uint64_t   dropped;
+
+    // Held while draining or adding a ring; logging never takes it
+    pthread_mutex_t lock;
+    pthread_t       drain;
+    riak_boolean_t  running;
+    riak_uint32_t   stopping;
+};
+
+// One conversion of a printf-like format
+typedef struct _riak_log_spec {
+    const char    *start;    // The '%'
+    const char    *length;   // First length modifier, or the conversion if none
+    const char    *end;      // Just past the conversion
+    riak_uint32_t  stars;          // Width and precision taken from arguments
+    riak_boolean_t star_precision; // The last of them is the precision
+    int            precision;      // -1 for none
+    char           modifier; // 0, 'h', 'l', 'q' (long long), 'L', 'z', 'j' or 't'
+    char           conv;
+} riak_log_spec;
+
+/**
+ * @brief Pick apart the conversion starting at a '%'
+ * @param p The '%'
+ * @param spec Conversion (out)
+ */
+static void
+riak_log_spec_parse(const char    *p,
+                    riak_log_spec *spec) {
+    memset(spec, '\0', sizeof(riak_log_spec));
+    spec->start     = p++;
+    spec->precision = -1;
+    while (*p && strchr("-+ #0'", *p)) {
+        p++;
+    }
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            spec->star_precision = RIAK_TRUE;
+            p++;
+        } else {
+            spec->precision = 0;
+            while (*p >= '0' && *p <= '9') {
+                spec->precision = spec->precision * 10 + (*p++ - '0');
+            }
+        }
+    }
+    spec->length = p;
+    while (*p && strchr("hlLqzjt", *p)) {
+        if (*p == 'l' && spec->modifier == 'l') {
+            spec->modifier = 'q';
+        } else if (spec->modifier != 'h') {
+            spec->modifier = *p;
+        }
+        p++;
+    }
+    spec->conv = *p;
+    spec->end  = (*p) ? p + 1 : p;
+}
+
+/**
+ * @brief Copy the arguments of a message into a record; formatting comes later
+ * @param record Record to fill
+ * @param format Printf-like format
+ * @param args Arguments to `format`
+ */
+static void
+riak_log_record_capture(riak_log_record *record,
+                        const char      *format,
+                        va_list          args) {
+    riak_uint32_t text = 0;
+    riak_log_spec spec;
+    const char   *p = format;
+    record->n_args = 0;
+    while ((p = strchr(p, '%')) != NULL) {
+        if (p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        riak_log_spec_parse(p, &spec);
+        p = spec.end;
+        // Stop at whatever cannot be kept; the rest of the line is cut short
+        if (record->n_args + spec.stars + 1 > RIAK_LOG_BUFFER_ARGS) {
+            return;
+        }
+        riak_uint32_t i;
+        for(i = 0; i < spec.stars; i++) {
+            int star = va_arg(args, int);
+            record->args[record->n_args++].i = star;
+            if (spec.star_precision && i + 1 == spec.stars) {
+                spec.precision = (star >= 0) ? star : -1;
+            }
+        }
+        riak_log_arg *arg = &(record->args[record->n_args]);
+        switch (spec.conv) {
+        case 'd':
+        case 'i':
+            switch (spec.modifier) {
+            case 'l': arg->i = va_arg(args, long);          break;
+            case 'q': arg->i = va_arg(args, long long);     break;
+            case 'z': arg->i = va_arg(args, ssize_t);       break;
+            case 'j': arg->i = va_arg(args, intmax_t);      break;
+            case 't': arg->i = va_arg(args, ptrdiff_t);     break;
+            default:  arg->i = va_arg(args, int);           break;
+            }
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            switch (spec.modifier) {
+            case 'l': arg->u = va_arg(args, unsigned long);      break;
+            case 'q': arg->u = va_arg(args, unsigned long long); break;
+            case 'z': arg->u = va_arg(args, size_t);             break;
+            case 'j': arg->u = va_arg(args, uintmax_t);          break;
+            case 't': arg->u = va_arg(args, ptrdiff_t);          break;
+            default:  arg->u = va_arg(args, unsigned int);       break;
+            }
+            break;
+        case 'c':
+            arg->i = va_arg(args, int);
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            arg->d = (spec.modifier == 'L') ? (double)va_arg(args, long double) : va_arg(args, double);
+            break;
+        case 'p':
+            arg->p = va_arg(args, void*);
+            break;
+        case 's': {
+            const char *str = va_arg(args, const char*);
+            if (str == NULL) {
+                arg->u = RIAK_LOG_BUFFER_NULL;
+                break;
+            }
+            // Strings often live on the caller's stack, so keep what fits
+            riak_size_t room = RIAK_LOG_BUFFER_TEXT - text;
+            if (room == 0) {
+                // The terminator of the last copy reads as an empty string
+                arg->u = RIAK_LOG_BUFFER_TEXT - 1;
+                break;
+            }
+            riak_size_t len = strnlen(str, (spec.precision >= 0 && (riak_size_t)spec.precision < room) ? (riak_size_t)spec.precision : room - 1);
+            memcpy(record->text + text, str, len);
+            record->text[text + len] = '\0';
+            arg->u = text;
+            text  += len + 1;
+            break;
+        }
+        default:
+            // %n or something unknown: the type of what follows is anyone's guess
+            return;
+        }
+        record->n_args++;
+    }
+}
+
+// Print one captured value, passing along any width and precision arguments
+#define RIAK_LOG_BUFFER_PRINT(V) \
+        n = (spec.stars == 0) ? snprintf(out, room, conversion, (V)) : \
+            (spec.stars == 1) ? snprintf(out, room, conversion, stars[0], (V)) : \
+                                snprintf(out, room, conversion, stars[0], stars[1], (V))
+
+/**
+ * @brief Format a record into one line of text
+ * @param record Captured message
+ * @param line Output buffer
+ * @param size Size of `line`
+ * @returns Length of the line
+ */
+static riak_size_t
+riak_log_record_format(riak_log_record *record,
+                       char            *line,
+                       riak_size_t      size) {
+    time_t    secs = (time_t)(record->usecs / 1000000);
+    struct tm when;
+    localtime_r(&secs, &when);
+    riak_size_t wrote = strftime(line, size, "%F %T", &when);
+    wrote += snprintf(line + wrote, size - wrote, ".%06u %s %.*s:%u ",
+                      (unsigned)(record->usecs % 1000000), riak_log_level_description(record->level),
+                      (int)record->filelen, record->file, record->line);
+
+    riak_uint32_t arg = 0;
+    riak_log_spec spec;
+    const char   *p = record->format;
+    while (*p && wrote < size - 1) {
+        const char *next = strchr(p, '%');
+        riak_size_t len  = (next) ? (riak_size_t)(next - p) : strlen(p);
+        if (len > size - 1 - wrote) {
+            len = size - 1 - wrote;
+        }
+        memcpy(line + wrote, p, len);
+        wrote += len;
+        if (next == NULL || wrote >= size - 1) {
+            break;
+        }
+        if (next[1] == '%') {
+            line[wrote++] = '%';
+            p = next + 2;
+            continue;
+        }
+        riak_log_spec_parse(next, &spec);
+        p = spec.end;
+        if (arg + spec.stars + 1 > record->n_args) {
+            wrote += snprintf(line + wrote, size - wrote, "...");
+            break;
+        }
+        // Rebuild the conversion around the widened type it was captured as
+        char conversion[32];
+        snprintf(conversion, sizeof(conversion), "%.*s%s%c", (int)(spec.length - spec.start), spec.start,
+                 strchr("diuoxX", spec.conv) ? "ll" : "", spec.conv);
+
+        int stars[2];
+        riak_uint32_t i;
+        for(i = 0; i < spec.stars; i++) {
+            stars[i] = (int)record->args[arg++].i;
+        }
+        riak_log_arg *value = &(record->args[arg++]);
+        char         *out   = line + wrote;
+        riak_size_t   room  = size - wrote;
+        int           n     = 0;
+        switch (spec.conv) {
+        case 'd':
+        case 'i':
+            RIAK_LOG_BUFFER_PRINT((long long)value->i);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            RIAK_LOG_BUFFER_PRINT((unsigned long long)value->u);
+            break;
+        case 'c':
+            RIAK_LOG_BUFFER_PRINT((int)value->i);
+            break;
+        case 'p':
+            RIAK_LOG_BUFFER_PRINT(value->p);
+            break;
+        case 's':
+            RIAK_LOG_BUFFER_PRINT((value->u == RIAK_LOG_BUFFER_NULL) ? "(null)" : record->text + value->u);
+            break;
+        default:
+            RIAK_LOG_BUFFER_PRINT(value->d);
+            break;
+        }
+        if (n > 0) {
+            wrote += ((riak_size_t)n < room) ? (riak_size_t)n : room - 1;
+        }
+    }
+    if (wrote > size - 2) {
+        wrote = size - 2;
+    }
+    line[wrote++] = '\n';
+    line[wrote]   = '\0';
+    return wrote;
+}
+
+/**
+ * @brief Called as a logging thread exits, so the drain can free its ring once empty
+ * @param ptr The thread's ring
+ */
+static void
+riak_log_buffer_orphan(void *ptr) {
+    riak_log_ring *ring = (riak_log_ring*)ptr;
+    riak_atomic_add(&(ring->orphaned), 1);
+}
+
+/**
+ * @brief The calling thread's ring, made on its first message
+ * @param buffer Riak Log Buffer
+ * @returns Ring or NULL if out of memory
+ */
+static riak_log_ring*
+riak_log_buffer_ring(riak_log_buffer *buffer) {
+    riak_log_ring *ring = (riak_log_ring*)pthread_getspecific(buffer->key);
+    if (ring) {
+        return ring;
+    }
+    ring = (riak_log_ring*)(buffer->malloc_fn)(sizeof(riak_log_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    memset(ring, '\0', sizeof(riak_log_ring));
+    ring->records = (riak_log_record*)(buffer->malloc_fn)(buffer->records * sizeof(riak_log_record));
+    if (ring->records == NULL) {
+        (buffer->free_fn)(ring);
+        return NULL;
+    }
+    ring->mask = buffer->records - 1;
+    pthread_mutex_lock(&(buffer->lock));
+    ring->next    = buffer->rings;
+    buffer->rings = ring;
+    pthread_mutex_unlock(&(buffer->lock));
+    // Rings outlive their threads so nothing logged is lost; the drain frees them later
+    pthread_setspecific(buffer->key, ring);
+    return ring;
+}
+
+/**
+ * @brief Format and write out every record queued in one ring
+ * @param buffer Riak Log Buffer, locked
+ * @param ring Ring to empty
+ * @returns Number of records written
+ */
+static riak_uint32_t
+riak_log_buffer_drain_ring(riak_log_buffer *buffer,
+                           riak_log_ring   *ring) {
+    char          line[RIAK_LOG_BUFFER_LINE];
+    riak_uint32_t count = 0;
+    riak_uint64_t tail  = ring->tail;
+    riak_uint64_t head  = riak_atomic_load(&(ring->head));
+    for(; tail < head; tail++, count++) {
+        riak_size_t len = riak_log_record_format(&(ring->records[tail & ring->mask]), line, sizeof(line));
+        fwrite(line, 1, len, buffer->out);
+    }
+    // Hand the slots back only once they have been read
+    __sync_synchronize();
+    ring->tail = tail;
+    return count;
+}
+
+static void*
+riak_log_buffer_drain(void *ptr) {
+    riak_log_buffer *buffer = (riak_log_buffer*)ptr;
+    struct timespec  pause;
+    pause.tv_sec  = 0;
+    pause.tv_nsec = RIAK_LOG_BUFFER_DRAIN_MSECS * 1000000L;
+    while (!riak_atomic_load(&(buffer->stopping))) {
+        riak_log_buffer_flush(buffer);
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+riak_error
+riak_log_buffer_new(riak_log_buffer **buffer_target,
+                    riak_config      *cfg,
+                    FILE             *out,
+                    riak_uint32_t     records) {
+    // Straight from the allocator, so an arena reset never takes it away
+    riak_log_buffer *buffer = (riak_log_buffer*)(cfg->malloc_fn)(sizeof(riak_log_buffer));
+    if (buffer == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_log_buffer");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    memset(buffer, '\0', sizeof(riak_log_buffer));
+    buffer->malloc_fn = cfg->malloc_fn;
+    buffer->free_fn   = cfg->free_fn;
+    buffer->out       = out;
+    buffer->records   = 1;
+    if (records == 0) {
+        records = RIAK_LOG_BUFFER_DEFAULT_RECORDS;
+    }
+    if (records > RIAK_LOG_BUFFER_MAX_RECORDS) {
+        riak_log_error_config(cfg, "Log buffer of %u records is over the limit of %u",
+                              records, RIAK_LOG_BUFFER_MAX_RECORDS);
+        (cfg->free_fn)(buffer);
+        return ERIAK_OUT_OF_RANGE;
+    }
+    while (buffer->records < records) {
+        buffer->records <<= 1;
+    }
+    if (pthread_key_create(&(buffer->key), riak_log_buffer_orphan) != 0) {
+        (cfg->free_fn)(buffer);
+        return ERIAK_THREAD;
+    }
+    if (pthread_mutex_init(&(buffer->lock), NULL) != 0) {
+        pthread_key_delete(buffer->key);
+        (cfg->free_fn)(buffer);
+        return ERIAK_THREAD;
+    }
+    *buffer_target = buffer;
+
+    return ERIAK_OK;
+}
+
+void
+riak_log_buffer_free(riak_log_buffer **buffer_target) {
+    if (buffer_target == NULL || *buffer_target == NULL) {
+        return;
+    }
+    riak_log_buffer *buffer = *buffer_target;
+    riak_log_buffer_flush(buffer);
+    while (buffer->rings) {
+        riak_log_ring *ring = buffer->rings;
+        buffer->rings = ring->next;
+        (buffer->free_fn)(ring->records);
+        (buffer->free_fn)(ring);
+    }
+    pthread_key_delete(buffer->key);
+    pthread_mutex_destroy(&(buffer->lock));
+    (buffer->free_fn)(buffer);
+    *buffer_target = NULL;
+}
+
+void
+riak_log_buffer_log(void            *ptr,
+                    riak_log_level_t level,
+                    const char      *file,
+                    riak_size_t      filelen,
+                    const char      *func,
+                    riak_size_t      funclen,
+                    riak_uint32_t    line,
+                    const char      *format,
+                    va_list          args) {
+    riak_log_buffer *buffer = (riak_log_buffer*)ptr;
+    riak_log_ring   *ring   = riak_log_buffer_ring(buffer);
+    if (ring == NULL) {
+        riak_atomic_add(&(buffer->dropped), 1);
+        return;
+    }
+    // Only this thread moves head, so only the drain's progress needs a fresh look
+    riak_uint64_t head = ring->head;
+    if (head - riak_atomic_load(&(ring->tail)) > ring->mask) {
+        riak_atomic_add(&(buffer->dropped), 1);
+        return;
+    }
+    riak_log_record *record = &(ring->records[head & ring->mask]);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->usecs   = (riak_uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    record->level   = level;
+    record->file    = file;
+    record->filelen = (riak_uint32_t)filelen;
+    record->line    = line;
+    record->format  = format;
+    riak_log_record_capture(record, format, args);
+    // Publish the record only once it is complete
+    __sync_synchronize();
+    ring->head = head + 1;
+}
+
+riak_int32_t
+riak_log_buffer_start(void *ptr) {
+    riak_log_buffer *buffer = (riak_log_buffer*)ptr;
+    if (buffer->running) {
+        return 0;
+    }
+    buffer->stopping = 0;
+    if (pthread_create(&(buffer->drain), NULL, riak_log_buffer_drain, buffer) != 0) {
+        return -1;
+    }
+    buffer->running = RIAK_TRUE;
+    return 0;
+}
+
+void
+riak_log_buffer_stop(void *ptr) {
+    riak_log_buffer *buffer = (riak_log_buffer*)ptr;
+    if (!buffer->running) {
+        return;
+    }
+    riak_atomic_add(&(buffer->stopping), 1);
+    pthread_join(buffer->drain, NULL);
+    buffer->running = RIAK_FALSE;
+    riak_log_buffer_flush(buffer);
+}
+
+riak_uint32_t
+riak_log_buffer_flush(riak_log_buffer *buffer) {
+    riak_uint32_t count = 0;
+    pthread_mutex_lock(&(buffer->lock));
+    riak_log_ring **link = &(buffer->rings);
+    while (*link) {
+        riak_log_ring *ring = *link;
+        // Checked first: a thread which has exited has published its last message
+        riak_uint32_t orphaned = riak_atomic_load(&(ring->orphaned));
+        count += riak_log_buffer_drain_ring(buffer, ring);
+        if (orphaned) {
+            *link = ring->next;
+            (buffer->free_fn)(ring->records);
+            (buffer->free_fn)(ring);
+            continue;
+        }
+        link = &(ring->next);
+    }
+    if (count > 0) {
+        fflush(buffer->out);
+    }
+    pthread_mutex_unlock(&(buffer->lock));
+    return count;
+}
+
+riak_uint64_t
+riak_log_buffer_get_dropped(riak_log_buffer *buffer) {
+    return riak_atomic_load(&(buffer->dropped));
+}
@@ -0,0 +1,309 @@
+/*********************************************************************
+ *
+ * riak_metrics.c: Latency histograms and counters of Riak requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <pthread.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_metrics-internal.h"
+#include "riak_trace-internal.h"
+
+#define RIAK_METRICS_SUB_BUCKETS (1 << RIAK_METRICS_SUB_BITS)
+
+/**
+ * @brief This thread's copy of the counters
+ * @param metrics Metrics of a configuration
+ * @returns Shard picked by hashing the thread id
+ */
+static riak_metrics_snapshot*
+riak_metrics_shard(riak_metrics *metrics) {
+    riak_uint64_t hash = (riak_uint64_t)(size_t)pthread_self();
+    hash ^= hash >> 17;
+    hash *= 0x9E3779B97F4A7C15ULL;
+    return &(metrics->shards[(hash >> 32) % RIAK_METRICS_SHARDS]);
+}
+
+/**
+ * @brief Histogram bucket of a latency: exact below 2^RIAK_METRICS_SUB_BITS, then log-linear
+ * @param usecs Latency in microseconds
+ * @returns Bucket index
+ */
+static riak_uint32_t
+riak_metrics_bucket(riak_uint64_t usecs) {
+    if (usecs < RIAK_METRICS_SUB_BUCKETS) {
+        return (riak_uint32_t)usecs;
+    }
+    riak_uint32_t msb = RIAK_METRICS_SUB_BITS;
+    while ((usecs >> (msb + 1)) != 0) {
+        msb++;
+    }
+    riak_uint32_t shift = msb - RIAK_METRICS_SUB_BITS;
+    riak_uint32_t index = RIAK_METRICS_SUB_BUCKETS * (shift + 1) + (riak_uint32_t)((usecs >> shift) & (RIAK_METRICS_SUB_BUCKETS - 1));
+    return (index < RIAK_METRICS_BUCKETS) ? index : RIAK_METRICS_BUCKETS - 1;
+}
+
+/**
+ * @brief Largest latency counted in a histogram bucket
+ * @param index Bucket index
+ * @returns Upper bound in microseconds
+ */
+static riak_uint64_t
+riak_metrics_bucket_limit(riak_uint32_t index) {
+    if (index < RIAK_METRICS_SUB_BUCKETS) {
+        return index;
+    }
+    riak_uint32_t shift = index / RIAK_METRICS_SUB_BUCKETS - 1;
+    riak_uint64_t sub   = index % RIAK_METRICS_SUB_BUCKETS;
+    return ((RIAK_METRICS_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief Count one latency in a shard's histogram
+ * @param histogram Histogram to update
+ * @param usecs Latency in microseconds
+ */
+static void
+riak_metrics_histogram_add(riak_metrics_histogram *histogram,
+                           riak_uint64_t           usecs) {
+    riak_atomic_add(&(histogram->buckets[riak_metrics_bucket(usecs)]), 1);
+    riak_atomic_add(&(histogram->count), 1);
+    riak_atomic_add(&(histogram->sum_usecs), usecs);
+    riak_uint64_t max = histogram->max_usecs;
+    while (usecs > max && !riak_atomic_cas(&(histogram->max_usecs), max, usecs)) {
+        max = histogram->max_usecs;
+    }
+}
+
+/**
+ * @brief Fold one shard's histogram into a snapshot's
+ * @param to Snapshot histogram
+ * @param from Shard histogram
+ */
+static void
+riak_metrics_histogram_merge(riak_metrics_histogram *to,
+                             riak_metrics_histogram *from) {
+    to->count     += from->count;
+    to->sum_usecs += from->sum_usecs;
+    if (from->max_usecs > to->max_usecs) {
+        to->max_usecs = from->max_usecs;
+    }
+    riak_uint32_t i;
+    for(i = 0; i < RIAK_METRICS_BUCKETS; i++) {
+        to->buckets[i] += from->buckets[i];
+    }
+}
+
+/**
+ * @brief Kind of request being sent
+ * @param rop Riak Operation with an encoded request
+ * @returns Metrics type
+ */
+static riak_metrics_type
+riak_metrics_classify(riak_operation *rop) {
+    switch (rop->pb_request->msgid) {
+    case MSG_RPBGETREQ:         return RIAK_METRICS_GET;
+    case MSG_RPBPUTREQ:         return RIAK_METRICS_PUT;
+    case MSG_RPBDELREQ:         return RIAK_METRICS_DELETE;
+    case MSG_RPBINDEXREQ:       return RIAK_METRICS_2I;
+    case MSG_RPBMAPREDREQ:      return RIAK_METRICS_MAPREDUCE;
+    case MSG_RPBSEARCHQUERYREQ: return RIAK_METRICS_SEARCH;
+    default:                    return RIAK_METRICS_OTHER;
+    }
+}
+
+riak_error
+riak_config_enable_metrics(riak_config *cfg) {
+    if (cfg->metrics) {
+        return ERIAK_OK;
+    }
+    // Straight from the allocator, so an arena reset never takes it away
+    cfg->metrics = (riak_metrics*)(cfg->malloc_fn)(sizeof(riak_metrics));
+    if (cfg->metrics == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate riak_metrics");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    memset(cfg->metrics, '\0', sizeof(riak_metrics));
+    return ERIAK_OK;
+}
+
+riak_error
+riak_config_get_metrics(riak_config           *cfg,
+                        riak_metrics_snapshot *snapshot) {
+    riak_metrics *metrics = cfg->metrics;
+    if (metrics == NULL) {
+        return ERIAK_UNINITIALIZED;
+    }
+    memset(snapshot, '\0', sizeof(riak_metrics_snapshot));
+    // Shards keep changing while they are summed, so totals may be a few requests apart
+    riak_uint32_t s, t, i;
+    for(s = 0; s < RIAK_METRICS_SHARDS; s++) {
+        riak_metrics_snapshot *shard = &(metrics->shards[s]);
+        for(t = 0; t < RIAK_METRICS_N_TYPES; t++) {
+            snapshot->requests[t] += shard->requests[t];
+            riak_metrics_histogram_merge(&(snapshot->latency[t]), &(shard->latency[t]));
+        }
+        for(i = 0; i < RIAK_PHASE_N_PHASES; i++) {
+            riak_metrics_histogram_merge(&(snapshot->phases[i]), &(shard->phases[i]));
+        }
+        for(i = 0; i < ERIAK_LAST_ERRORNUM; i++) {
+            snapshot->outcomes[i] += shard->outcomes[i];
+        }
+        snapshot->bytes_written += shard->bytes_written;
+        snapshot->bytes_read    += shard->bytes_read;
+        snapshot->in_flight     += shard->in_flight;
+    }
+    return ERIAK_OK;
+}
+
+riak_uint64_t
+riak_metrics_get_percentile(riak_metrics_histogram *histogram,
+                            double                  percentile) {
+    riak_uint64_t total = 0;
+    riak_uint32_t i;
+    for(i = 0; i < RIAK_METRICS_BUCKETS; i++) {
+        total += histogram->buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    riak_uint64_t target = (riak_uint64_t)(total * percentile / 100.0 + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    riak_uint64_t seen = 0;
+    for(i = 0; i < RIAK_METRICS_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= target) {
+            break;
+        }
+    }
+    if (i == RIAK_METRICS_BUCKETS) {
+        i--;
+    }
+    riak_uint64_t limit = riak_metrics_bucket_limit(i);
+    return (histogram->max_usecs && histogram->max_usecs < limit) ? histogram->max_usecs : limit;
+}
+
+void
+riak_metrics_operation_sent(riak_operation *rop,
+                            riak_size_t     bytes) {
+#ifdef RIAK_PHASE_TIMING
+    if (!rop->phase_written) {
+        riak_metrics_phase_end(rop, RIAK_PHASE_QUEUE);
+        rop->phase_written = RIAK_TRUE;
+    }
+#endif
+    riak_config *cfg = riak_operation_get_config(rop);
+    rop->bytes_written += bytes;
+    if (cfg->trace_fn) {
+        riak_trace_operation_start(rop);
+    }
+    riak_metrics *metrics = cfg->metrics;
+    if (metrics == NULL) {
+        return;
+    }
+    riak_metrics_snapshot *shard = riak_metrics_shard(metrics);
+    riak_atomic_add(&(shard->bytes_written), bytes);
+    // Retries and hedges resend the same operation, which is timed from its first send
+    if (rop->metrics_usecs) {
+        return;
+    }
+    rop->metrics_type  = riak_metrics_classify(rop);
+    rop->metrics_usecs = riak_time_usecs();
+    riak_atomic_add(&(shard->requests[rop->metrics_type]), 1);
+    riak_atomic_add(&(shard->in_flight), 1);
+}
+
+void
+riak_metrics_operation_done(riak_operation *rop,
+                            riak_error      err) {
+    riak_config *cfg = riak_operation_get_config(rop);
+    if (cfg->trace_fn) {
+        riak_trace_operation_finish(rop, err);
+    }
+    riak_metrics *metrics = cfg->metrics;
+    if (metrics == NULL || rop->metrics_usecs == 0) {
+        return;
+    }
+    riak_metrics_snapshot *shard = riak_metrics_shard(metrics);
+    if (err == ERIAK_OK || err == ERIAK_SERVER_ERROR) {
+        riak_metrics_histogram_add(&(shard->latency[rop->metrics_type]), riak_time_usecs() - rop->metrics_usecs);
+    }
+    if (err < ERIAK_LAST_ERRORNUM) {
+        riak_atomic_add(&(shard->outcomes[err]), 1);
+    }
+    riak_atomic_sub(&(shard->in_flight), 1);
+    rop->metrics_usecs = 0;
+}
+
+void
+riak_metrics_operation_dropped(riak_operation *rop) {
+    riak_config *cfg = riak_operation_get_config(rop);
+    if (cfg->trace_fn) {
+        riak_trace_operation_finish(rop, ERIAK_UNINITIALIZED);
+    }
+    riak_metrics *metrics = cfg->metrics;
+    if (metrics == NULL || rop->metrics_usecs == 0) {
+        return;
+    }
+    riak_atomic_sub(&(riak_metrics_shard(metrics)->in_flight), 1);
+    rop->metrics_usecs = 0;
+}
+
+void
+riak_metrics_add_read(riak_config *cfg,
+                      riak_size_t  bytes) {
+    if (cfg->metrics == NULL) {
+        return;
+    }
+    riak_atomic_add(&(riak_metrics_shard(cfg->metrics)->bytes_read), bytes);
+}
+
+#ifdef RIAK_PHASE_TIMING
+void
+riak_metrics_phase_start(riak_operation *rop) {
+    rop->phase_mark = riak_time_usecs();
+}
+
+void
+riak_metrics_phase_end(riak_operation *rop,
+                       riak_phase      phase) {
+    riak_uint64_t now = riak_time_usecs();
+    rop->phase_usecs[phase] += now - rop->phase_mark;
+    rop->phase_mark = now;
+}
+
+void
+riak_metrics_phase_record(riak_operation *rop) {
+    riak_metrics *metrics = riak_operation_get_config(rop)->metrics;
+    if (metrics == NULL) {
+        return;
+    }
+    riak_metrics_snapshot *shard = riak_metrics_shard(metrics);
+    riak_uint32_t i;
+    for(i = 0; i < RIAK_PHASE_N_PHASES; i++) {
+        riak_metrics_histogram_add(&(shard->phases[i]), rop->phase_usecs[i]);
+    }
+}
+#endif
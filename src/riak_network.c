@@ -79,9 +79,17 @@ riak_print_host(riak_addrinfo *addrinfo,
     }
 }
 
-riak_socket_t
-riak_just_open_a_socket(riak_config   *cfg,
-                        riak_addrinfo *addrinfo) {
+/**
+ * @brief Opens a socket and connects it, optionally without waiting for the connect
+ * @param cfg Riak Configuration
+ * @param addrinfo Address of machine to connect to
+ * @param blocking Whether the socket blocks
+ * @returns A socket file descriptor (or -1)
+ */
+static riak_socket_t
+riak_open_a_socket(riak_config    *cfg,
+                   riak_addrinfo  *addrinfo,
+                   riak_boolean_t  blocking) {
 
     riak_socket_t sock = socket(addrinfo->ai_family,
                                 addrinfo->ai_socktype,
@@ -91,15 +99,13 @@ riak_just_open_a_socket(riak_config   *cfg,
         return -1;
     }
 
-#ifdef _RIAK_NON_BLOCKING
-    riak_boolean_t blocking = RIAK_FALSE;
-    int flags = fcntl(sock, F_GETFL, 0);
-    if (flags < 0) return -1;
-    flags = blocking ? (flags&~O_NONBLOCK) : (flags|O_NONBLOCK);
-    if (fcntl(sock, F_SETFL, flags) != 0) {
-       return -1;
+    if (!blocking) {
+        int flags = fcntl(sock, F_GETFL, 0);
+        if (flags < 0 || fcntl(sock, F_SETFL, flags|O_NONBLOCK) != 0) {
+            close(sock);
+            return -1;
+        }
     }
-#endif
 
     int err = connect(sock, addrinfo->ai_addr, addrinfo->ai_addrlen);
     if (err) {
@@ -117,4 +123,20 @@ riak_just_open_a_socket(riak_config   *cfg,
     return sock;
 }
 
+riak_socket_t
+riak_just_open_a_socket(riak_config   *cfg,
+                        riak_addrinfo *addrinfo) {
+#ifdef _RIAK_NON_BLOCKING
+    return riak_open_a_socket(cfg, addrinfo, RIAK_FALSE);
+#else
+    return riak_open_a_socket(cfg, addrinfo, RIAK_TRUE);
+#endif
+}
+
+riak_socket_t
+riak_just_start_a_socket(riak_config   *cfg,
+                         riak_addrinfo *addrinfo) {
+    return riak_open_a_socket(cfg, addrinfo, RIAK_FALSE);
+}
+
 
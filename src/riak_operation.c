@@ -22,7 +22,11 @@
 
 #include "riak.h"
 #include "riak_messages-internal.h"
+#include "riak_config-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_metrics-internal.h"
 #include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
 
 riak_error
 riak_operation_new(riak_connection        *cxn,
@@ -42,6 +46,8 @@ riak_operation_new(riak_connection        *cxn,
     rop->response_cb = response_cb;
     rop->error_cb    = error_cb;
     rop->cb_data     = cb_data;
+    rop->timeout_ms  = cxn->timeout_ms;
+    riak_metrics_phase_start(rop);
 
     return ERIAK_OK;
 }
@@ -50,6 +56,8 @@ void
 riak_operation_free(riak_operation **rop_target) {
     riak_operation *rop = *rop_target;
     riak_config *cfg = riak_operation_get_config(rop);
+    riak_timer_wheel_cancel(rop);
+    riak_metrics_operation_dropped(rop);
     if (rop->pb_request) {
         riak_pb_message_free(cfg, &(rop->pb_request));
     }
@@ -57,7 +65,7 @@ riak_operation_free(riak_operation **rop_target) {
     riak_binary_free(cfg, &(rop->request.bucket));
     riak_binary_free(cfg, &(rop->request.key));
     riak_binary_free(cfg, &(rop->request.index));
-    riak_free(cfg, &(rop->msgbuf));
+    riak_connection_buffer_put(rop->connection, &(rop->msgbuf), rop->msglen);
     riak_server_error_free(cfg, &(rop->error));
     riak_free(cfg, rop_target);
 }
@@ -72,11 +80,86 @@ riak_operation_get_connection(riak_operation *rop) {
     return rop->connection;
 }
 
+void
+riak_operation_set_response_config(riak_operation *rop,
+                                   riak_config    *cfg) {
+    rop->response_config = cfg;
+}
+
+riak_config*
+riak_operation_get_response_config(riak_operation *rop) {
+    if (rop->response_config) {
+        return rop->response_config;
+    }
+    return riak_connection_get_response_config(rop->connection);
+}
+
+riak_uint8_t*
+riak_operation_take_frame(riak_operation   *rop,
+                          riak_pb_message  *pbresp,
+                          riak_config     **owner) {
+    // Large frames were read straight into the operation, so keep that buffer
+    if (pbresp->data == rop->msgbuf) {
+        rop->msgbuf = NULL;
+        *owner = riak_operation_get_config(rop);
+        return pbresp->data;
+    }
+    // Anything else sits in the connection's receive buffer, which is about to be reused
+    riak_config  *cfg   = riak_operation_get_response_config(rop);
+    riak_uint8_t *frame = (riak_uint8_t*)riak_config_allocate(cfg, pbresp->len);
+    if (frame == NULL) {
+        return NULL;
+    }
+    memcpy(frame, pbresp->data, pbresp->len);
+    *owner = cfg;
+    return frame;
+}
+
+riak_boolean_t
+riak_operation_can_retry(riak_operation *rop,
+                         riak_error      err) {
+    if (err != ERIAK_CONNECT && err != ERIAK_READ && err != ERIAK_WRITE) {
+        return RIAK_FALSE;
+    }
+    if (rop->no_retry || rop->answered || rop->pb_request == NULL) {
+        return RIAK_FALSE;
+    }
+    return riak_config_retry_allowed(riak_operation_get_config(rop), rop->attempts);
+}
+
+void
+riak_operation_rewind(riak_operation *rop) {
+    riak_connection_buffer_put(rop->connection, &(rop->msgbuf), rop->msglen);
+    rop->position        = 0;
+    rop->msglen          = 0;
+    rop->msglen_complete = RIAK_FALSE;
+}
+
 riak_server_error*
 riak_operation_get_server_error(riak_operation *rop) {
     return rop->error;
 }
 
+riak_error
+riak_operation_get_error(riak_operation *rop) {
+    return rop->err;
+}
+
+int
+riak_operation_get_timeout(riak_operation *rop) {
+    return riak_deadline_ms(rop->deadline_usecs);
+}
+
+void
+riak_operation_fail(riak_operation *rop,
+                    riak_error      err) {
+    rop->err = err;
+    riak_metrics_operation_done(rop, err);
+    if (rop->error_cb) {
+        (rop->error_cb)(NULL, rop->cb_data);
+    }
+}
+
 void
 riak_operation_set_response_cb(riak_operation          *rop,
                                riak_response_callback  cb) {
@@ -89,6 +172,37 @@ riak_operation_set_error_cb(riak_operation         *rop,
     rop->error_cb = cb;
 }
 
+void
+riak_operation_set_abandon_cb(riak_operation        *rop,
+                              riak_abandon_callback  cb) {
+    rop->abandon_cb = cb;
+}
+
+void
+riak_operation_set_timeout(riak_operation *rop,
+                           riak_uint32_t   timeout_ms) {
+    rop->timeout_ms = timeout_ms;
+}
+
+void
+riak_operation_set_stream_cb(riak_operation       *rop,
+                             riak_stream_callback  cb,
+                             void                 *stream_data) {
+    rop->stream_cb   = cb;
+    rop->stream_data = stream_data;
+}
+
+riak_uint64_t
+riak_operation_get_phase_usecs(riak_operation *rop,
+                               riak_phase      phase) {
+#ifdef RIAK_PHASE_TIMING
+    if (phase < RIAK_PHASE_N_PHASES) {
+        return rop->phase_usecs[phase];
+    }
+#endif
+    return 0;
+}
+
 void
 riak_operation_set_cb_data(riak_operation     *rop,
                            void               *cb_data) {
@@ -98,6 +212,8 @@ void
 riak_operation_set_response_decoder(riak_operation       *rop,
                                     riak_response_decoder decoder) {
     rop->decoder = decoder;
+    // Every encoder finishes by choosing the decoder for its response
+    riak_metrics_phase_end(rop, RIAK_PHASE_ENCODE);
 }
 
 void
@@ -0,0 +1,273 @@
+/*********************************************************************
+ *
+ * riak_timer_wheel.c: Hierarchical timer wheel for operation deadlines
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stddef.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_operation-internal.h"
+
+// Ticks the wheel can hold without re-filing
+#define RIAK_TIMER_WHEEL_SPAN ((riak_uint64_t)1 << (RIAK_TIMER_WHEEL_BITS * RIAK_TIMER_WHEEL_LEVELS))
+
+static void
+riak_timer_list_init(riak_timer_node *head) {
+    head->prev = head;
+    head->next = head;
+}
+
+static void
+riak_timer_list_append(riak_timer_node *head,
+                       riak_timer_node *node) {
+    node->prev       = head->prev;
+    node->next       = head;
+    head->prev->next = node;
+    head->prev       = node;
+}
+
+static void
+riak_timer_list_unlink(riak_timer_node *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev       = NULL;
+    node->next       = NULL;
+}
+
+/**
+ * @brief Move every node from one list onto an empty one
+ * @param from List to empty
+ * @param to Uninitialized list head
+ */
+static void
+riak_timer_list_take(riak_timer_node *from,
+                     riak_timer_node *to) {
+    if (from->next == from) {
+        riak_timer_list_init(to);
+        return;
+    }
+    to->next       = from->next;
+    to->prev       = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    riak_timer_list_init(from);
+}
+
+/**
+ * @brief File a node in the slot matching its distance from the current tick
+ * @param tw Riak Timer Wheel
+ * @param node Node expiring no earlier than the current tick
+ */
+static void
+riak_timer_wheel_file(riak_timer_wheel *tw,
+                      riak_timer_node  *node) {
+    riak_uint64_t expires = node->expires;
+    if (expires - tw->now >= RIAK_TIMER_WHEEL_SPAN) {
+        expires = tw->now + RIAK_TIMER_WHEEL_SPAN - 1;
+    }
+    riak_uint64_t delta = expires - tw->now;
+    int level = 0;
+    while (level < RIAK_TIMER_WHEEL_LEVELS - 1 &&
+           delta >= ((riak_uint64_t)1 << (RIAK_TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    riak_uint32_t slot = (expires >> (RIAK_TIMER_WHEEL_BITS * level)) & RIAK_TIMER_WHEEL_MASK;
+    riak_timer_list_append(&(tw->slots[level][slot]), node);
+}
+
+/**
+ * @brief Spread one slot of an upper level over the levels below it
+ * @param tw Riak Timer Wheel
+ * @param level Level that has come round
+ * @param slot Slot within that level
+ */
+static void
+riak_timer_wheel_cascade(riak_timer_wheel *tw,
+                         int               level,
+                         riak_uint32_t     slot) {
+    riak_timer_node pending;
+    riak_timer_list_take(&(tw->slots[level][slot]), &pending);
+    while (pending.next != &pending) {
+        riak_timer_node *node = pending.next;
+        riak_timer_list_unlink(node);
+        riak_timer_wheel_file(tw, node);
+    }
+}
+
+riak_error
+riak_timer_wheel_new(riak_timer_wheel **tw_target,
+                     riak_config       *cfg,
+                     riak_uint32_t      tick_ms) {
+    riak_timer_wheel *tw = (riak_timer_wheel*)riak_config_clean_allocate(cfg, sizeof(riak_timer_wheel));
+    if (tw == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_timer_wheel");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    if (tick_ms == 0) {
+        tick_ms = 1;
+    }
+    tw->config     = cfg;
+    tw->tick_usecs = (riak_uint64_t)tick_ms * 1000;
+    tw->now        = riak_time_usecs() / tw->tick_usecs;
+    int level;
+    riak_uint32_t slot;
+    for(level = 0; level < RIAK_TIMER_WHEEL_LEVELS; level++) {
+        for(slot = 0; slot < RIAK_TIMER_WHEEL_SLOTS; slot++) {
+            riak_timer_list_init(&(tw->slots[level][slot]));
+        }
+    }
+    *tw_target = tw;
+
+    return ERIAK_OK;
+}
+
+void
+riak_timer_wheel_free(riak_timer_wheel **tw_target) {
+    if (tw_target == NULL || *tw_target == NULL) {
+        return;
+    }
+    riak_timer_wheel *tw = *tw_target;
+    // Detach anything left, so freeing those operations later is harmless
+    int level;
+    riak_uint32_t slot;
+    for(level = 0; level < RIAK_TIMER_WHEEL_LEVELS; level++) {
+        for(slot = 0; slot < RIAK_TIMER_WHEEL_SLOTS; slot++) {
+            riak_timer_node *head = &(tw->slots[level][slot]);
+            while (head->next != head) {
+                riak_timer_node *node = head->next;
+                riak_timer_list_unlink(node);
+                node->wheel = NULL;
+            }
+        }
+    }
+    riak_free(tw->config, tw_target);
+}
+
+void
+riak_timer_wheel_add(riak_timer_wheel *tw,
+                     riak_operation   *rop,
+                     void             *ptr) {
+    riak_timer_wheel_cancel(rop);
+    if (rop->deadline_usecs == 0) {
+        return;
+    }
+    riak_timer_wheel_add_at(tw, rop, ptr, rop->deadline_usecs);
+}
+
+void
+riak_timer_wheel_add_at(riak_timer_wheel *tw,
+                        riak_operation   *rop,
+                        void             *ptr,
+                        riak_uint64_t     expires_usecs) {
+    riak_timer_wheel_cancel(rop);
+    riak_timer_node *node = &(rop->timer);
+    // Round up, so a deadline never fires early
+    node->expires = (expires_usecs + tw->tick_usecs - 1) / tw->tick_usecs;
+    if (node->expires <= tw->now) {
+        node->expires = tw->now + 1;
+    }
+    node->ptr   = ptr;
+    node->wheel = tw;
+    riak_timer_wheel_file(tw, node);
+    tw->count++;
+}
+
+void
+riak_timer_wheel_cancel(riak_operation *rop) {
+    riak_timer_node *node = &(rop->timer);
+    if (node->wheel == NULL) {
+        return;
+    }
+    node->wheel->count--;
+    node->wheel = NULL;
+    riak_timer_list_unlink(node);
+}
+
+riak_uint32_t
+riak_timer_wheel_advance_to(riak_timer_wheel   *tw,
+                            riak_uint64_t       now_usecs,
+                            riak_timer_callback cb) {
+    riak_uint64_t target = now_usecs / tw->tick_usecs;
+    riak_uint32_t fired  = 0;
+    while (tw->now < target) {
+        if (tw->count == 0) {
+            tw->now = target;
+            break;
+        }
+        riak_uint64_t now = ++(tw->now);
+        // Each time a level comes round, the matching slot of the one above is spread out below
+        int level;
+        for(level = 1; level < RIAK_TIMER_WHEEL_LEVELS; level++) {
+            if ((now & (((riak_uint64_t)1 << (RIAK_TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            riak_timer_wheel_cascade(tw, level, (now >> (RIAK_TIMER_WHEEL_BITS * level)) & RIAK_TIMER_WHEEL_MASK);
+        }
+
+        // Taken off the wheel first, since a callback may cancel others due on this tick
+        riak_timer_node due;
+        riak_timer_list_take(&(tw->slots[0][now & RIAK_TIMER_WHEEL_MASK]), &due);
+        while (due.next != &due) {
+            riak_timer_node *node = due.next;
+            riak_timer_list_unlink(node);
+            if (node->expires > now) {
+                riak_timer_wheel_file(tw, node);
+                continue;
+            }
+            node->wheel = NULL;
+            tw->count--;
+            riak_operation *rop = (riak_operation*)((char*)node - offsetof(riak_operation, timer));
+            (cb)(rop, node->ptr);
+            fired++;
+        }
+    }
+    return fired;
+}
+
+riak_uint32_t
+riak_timer_wheel_advance(riak_timer_wheel   *tw,
+                         riak_timer_callback cb) {
+    return riak_timer_wheel_advance_to(tw, riak_time_usecs(), cb);
+}
+
+int
+riak_timer_wheel_get_timeout(riak_timer_wheel *tw) {
+    if (tw->count == 0) {
+        return -1;
+    }
+    // Never sleep past the next cascade, which may bring timers down to the first level
+    riak_uint64_t ticks = RIAK_TIMER_WHEEL_SLOTS - (tw->now & RIAK_TIMER_WHEEL_MASK);
+    riak_uint64_t i;
+    for(i = 1; i < ticks; i++) {
+        riak_timer_node *head = &(tw->slots[0][(tw->now + i) & RIAK_TIMER_WHEEL_MASK]);
+        if (head->next != head) {
+            ticks = i;
+            break;
+        }
+    }
+    return riak_deadline_ms((tw->now + ticks) * tw->tick_usecs);
+}
+
+riak_uint32_t
+riak_timer_wheel_get_count(riak_timer_wheel *tw) {
+    return tw->count;
+}
@@ -0,0 +1,123 @@
+/*********************************************************************
+ *
+ * riak_trace.c: Tracing hooks around Riak requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_config-internal.h"
+#include "riak_connection-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_trace-internal.h"
+
+/**
+ * @brief Fold a binary into a running FNV-1a hash
+ * @param hash Hash so far
+ * @param bin Binary to add, or NULL
+ * @returns Updated hash
+ */
+static riak_uint64_t
+riak_trace_hash(riak_uint64_t hash,
+                riak_binary  *bin) {
+    if (bin) {
+        riak_size_t i;
+        for(i = 0; i < bin->len; i++) {
+            hash ^= bin->data[i];
+            hash *= 0x100000001B3ULL;
+        }
+    }
+    // Separator, so "ab"/"c" and "a"/"bc" differ
+    hash ^= 0xFF;
+    hash *= 0x100000001B3ULL;
+    return hash;
+}
+
+/**
+ * @brief Describe a request to the tracer
+ * @param rop Riak Operation
+ * @param point Start or finish
+ * @param err Outcome
+ */
+static void
+riak_trace_report(riak_operation  *rop,
+                  riak_trace_point point,
+                  riak_error       err) {
+    riak_config     *cfg = riak_operation_get_config(rop);
+    riak_connection *cxn = rop->connection;
+    riak_trace_span  span;
+    memset(&span, '\0', sizeof(span));
+    span.point         = point;
+    span.msgid         = rop->pb_request ? rop->pb_request->msgid : 0;
+    span.host          = cxn->hostname;
+    span.port          = cxn->portnum;
+    span.bytes_written = rop->bytes_written;
+    span.bytes_read    = rop->bytes_read;
+    span.retries       = (rop->attempts > 0) ? rop->attempts - 1 : 0;
+    span.error         = err;
+    span.span          = rop->trace_span;
+    if (point == RIAK_TRACE_FINISH) {
+        span.duration_usecs = riak_time_usecs() - rop->trace_usecs;
+    }
+    if (cfg->trace_hash_keys) {
+        riak_uint64_t hash = 0xCBF29CE484222325ULL;
+        hash = riak_trace_hash(hash, rop->request.bucket_type);
+        hash = riak_trace_hash(hash, rop->request.bucket);
+        span.key_hash = riak_trace_hash(hash, rop->request.key);
+    } else {
+        span.bucket_type = rop->request.bucket_type;
+        span.bucket      = rop->request.bucket;
+        span.key         = rop->request.key;
+    }
+    (cfg->trace_fn)(cfg->trace_data, &span);
+    rop->trace_span = span.span;
+}
+
+riak_error
+riak_config_set_tracing(riak_config   *cfg,
+                        riak_trace_fn  trace_fn,
+                        void          *trace_data,
+                        riak_boolean_t hash_keys) {
+    cfg->trace_fn        = trace_fn;
+    cfg->trace_data      = trace_data;
+    cfg->trace_hash_keys = hash_keys;
+    return ERIAK_OK;
+}
+
+void
+riak_trace_operation_start(riak_operation *rop) {
+    // Retries and hedges resend the same operation inside one span
+    if (rop->trace_usecs) {
+        return;
+    }
+    rop->trace_usecs = riak_time_usecs();
+    riak_trace_report(rop, RIAK_TRACE_START, ERIAK_OK);
+}
+
+void
+riak_trace_operation_finish(riak_operation *rop,
+                            riak_error      err) {
+    if (rop->trace_usecs == 0) {
+        return;
+    }
+    riak_trace_report(rop, RIAK_TRACE_FINISH, err);
+    rop->trace_usecs = 0;
+    rop->trace_span  = NULL;
+}
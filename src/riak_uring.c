@@ -0,0 +1,839 @@
+/*********************************************************************
+ *
+ * riak_uring.c: io_uring reactor with an epoll fallback
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <errno.h>
+#include "riak.h"
+#include "riak_epoll.h"
+#include "riak_uring.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+
+// Receive buffers shared by every connection through one provided buffer ring
+#define RIAK_URING_BUFFERS      64
+#define RIAK_URING_BUFFER_SIZE  16384
+#define RIAK_URING_BUFFER_GROUP 0
+
+// Low bits of each request's user_data say what it was
+#define RIAK_URING_RECV   0
+#define RIAK_URING_SEND   1
+#define RIAK_URING_CANCEL 2
+#define RIAK_URING_TAG_MASK ((riak_uint64_t)3)
+
+struct _riak_uring_connection {
+    struct _riak_uring            *uring;
+    riak_connection               *cxn;
+    riak_epoll_connection         *fallback;
+    riak_error                     err;        // First failure; the connection is unusable after one
+
+    // Bytes of the receive being handed to riak_pipeline_read
+    riak_uint8_t                  *in_data;
+    riak_size_t                    in_len;
+
+    // Requests queued since the last send; the kernel never sees this buffer
+    riak_uint8_t                  *out_buf;
+    riak_size_t                    out_len;
+    riak_uint32_t                  out_capacity;
+
+    // Requests the kernel is sending from send_buf[send_start, send_end)
+    riak_uint8_t                  *send_buf;
+    riak_size_t                    send_start;
+    riak_size_t                    send_end;
+    riak_uint32_t                  send_capacity;
+
+    riak_boolean_t                 receiving;  // A receive is armed
+    riak_boolean_t                 sending;    // A send is in flight
+    riak_boolean_t                 queued;     // On the reactor's flush list
+    struct _riak_uring_connection *next_flush;
+    struct _riak_uring_connection *prev;
+    struct _riak_uring_connection *next;
+};
+
+struct _riak_uring {
+    riak_config              *config;
+    riak_epoll               *fallback;     // Set when the kernel cannot run io_uring for us
+    int                       fd;
+    riak_boolean_t            multishot;    // Cleared on kernels which refuse multishot receives
+
+    // Submission queue
+    void                     *sq_map;
+    riak_size_t               sq_map_len;
+    riak_uint32_t            *sq_khead;
+    riak_uint32_t            *sq_ktail;
+    riak_uint32_t             sq_mask;
+    riak_uint32_t             sq_entries;
+    riak_uint32_t            *sq_array;
+    struct io_uring_sqe      *sqes;
+    riak_size_t               sqes_len;
+    riak_uint32_t             sq_tail;      // Next entry to fill
+    riak_uint32_t             sq_submitted; // Entries handed to the kernel
+
+    // Completion queue, sharing the submission queue's mapping
+    riak_uint32_t            *cq_khead;
+    riak_uint32_t            *cq_ktail;
+    riak_uint32_t             cq_mask;
+    struct io_uring_cqe      *cqes;
+
+    // Provided buffer ring and the buffers it hands out
+    struct io_uring_buf_ring *buf_ring;
+    riak_uint8_t             *buffers;
+    riak_size_t               buffers_len;
+    riak_uint16_t             buf_tail;
+
+    riak_uring_connection    *connections;
+    riak_uring_connection    *flush_head;   // Connections with requests queued since the last pass
+    riak_timer_wheel         *timers;       // Deadlines of operations in flight
+};
+
+static int
+riak_uring_setup(riak_uint32_t           entries,
+                 struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int
+riak_uring_enter(int           fd,
+                 riak_uint32_t to_submit,
+                 riak_uint32_t min_complete,
+                 riak_uint32_t flags,
+                 void         *arg,
+                 riak_size_t   argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int
+riak_uring_register(int           fd,
+                    riak_uint32_t opcode,
+                    void         *arg,
+                    riak_uint32_t nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Hand a receive buffer back to the kernel
+ * @param ur Riak io_uring reactor
+ * @param bid Buffer id
+ */
+static void
+riak_uring_buffer_recycle(riak_uring   *ur,
+                          riak_uint16_t bid) {
+    struct io_uring_buf *buf = &(ur->buf_ring->bufs[ur->buf_tail & (RIAK_URING_BUFFERS - 1)]);
+    buf->addr = (riak_uint64_t)(uintptr_t)(ur->buffers + (riak_size_t)bid * RIAK_URING_BUFFER_SIZE);
+    buf->len  = RIAK_URING_BUFFER_SIZE;
+    buf->bid  = bid;
+    ur->buf_tail++;
+    __sync_synchronize();
+    ur->buf_ring->tail = ur->buf_tail;
+}
+
+/**
+ * @brief Pass filled submission entries to the kernel and optionally wait for completions
+ * @param ur Riak io_uring reactor
+ * @param timeout_ms Longest wait in milliseconds (-1 waits indefinitely, 0 does not wait)
+ * @returns Error code
+ */
+static riak_error
+riak_uring_submit(riak_uring *ur,
+                  int         timeout_ms) {
+    riak_uint32_t to_submit = ur->sq_tail - ur->sq_submitted;
+    __sync_synchronize();
+    *(ur->sq_ktail) = ur->sq_tail;
+    __sync_synchronize();
+    if (to_submit == 0 && timeout_ms == 0) {
+        return ERIAK_OK;
+    }
+
+    struct __kernel_timespec      ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, '\0', sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeout_ms > 0) {
+        ts.tv_sec  = timeout_ms / 1000;
+        ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+        arg.ts     = (riak_uint64_t)(uintptr_t)&ts;
+    }
+    riak_uint32_t flags        = IORING_ENTER_EXT_ARG;
+    riak_uint32_t min_complete = 0;
+    if (timeout_ms != 0) {
+        flags       |= IORING_ENTER_GETEVENTS;
+        min_complete = 1;
+    }
+    int result = riak_uring_enter(ur->fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+    if (result < 0) {
+        // Out of time, interrupted or the completion queue is backed up: all fine to reap
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) {
+            return ERIAK_OK;
+        }
+        riak_log_critical_config(ur->config, "io_uring_enter failed [%s]", strerror(errno));
+        return ERIAK_EVENT;
+    }
+    ur->sq_submitted += result;
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Claim the next submission entry, submitting what is queued if the ring is full
+ * @param ur Riak io_uring reactor
+ * @param uconn Connection the request is for
+ * @param tag What the request is (RIAK_URING_RECV, ...)
+ * @returns Zeroed entry or NULL
+ */
+static struct io_uring_sqe*
+riak_uring_get_sqe(riak_uring            *ur,
+                   riak_uring_connection *uconn,
+                   riak_uint64_t          tag) {
+    riak_uint32_t head = *(ur->sq_khead);
+    __sync_synchronize();
+    if (ur->sq_tail - head >= ur->sq_entries) {
+        if (riak_uring_submit(ur, 0)) {
+            return NULL;
+        }
+        head = *(ur->sq_khead);
+        __sync_synchronize();
+        if (ur->sq_tail - head >= ur->sq_entries) {
+            riak_log_critical_config(ur->config, "%s", "io_uring submission queue is full");
+            return NULL;
+        }
+    }
+    riak_uint32_t index = ur->sq_tail & ur->sq_mask;
+    struct io_uring_sqe *sqe = &(ur->sqes[index]);
+    memset(sqe, '\0', sizeof(*sqe));
+    sqe->user_data = (riak_uint64_t)(uintptr_t)uconn | tag;
+    ur->sq_array[index] = index;
+    ur->sq_tail++;
+    return sqe;
+}
+
+/**
+ * @brief Arm a receive into the provided buffer ring
+ * @param uconn Attached connection
+ * @returns Error code
+ */
+static riak_error
+riak_uring_arm_recv(riak_uring_connection *uconn) {
+    riak_uring *ur = uconn->uring;
+    struct io_uring_sqe *sqe = riak_uring_get_sqe(ur, uconn, RIAK_URING_RECV);
+    if (sqe == NULL) {
+        return ERIAK_EVENT;
+    }
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = riak_connection_get_fd(uconn->cxn);
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RIAK_URING_BUFFER_GROUP;
+    if (ur->multishot) {
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+    }
+    uconn->receiving = RIAK_TRUE;
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Send what remains of the in-flight buffer
+ * @param uconn Attached connection
+ * @returns Error code
+ */
+static riak_error
+riak_uring_arm_send(riak_uring_connection *uconn) {
+    struct io_uring_sqe *sqe = riak_uring_get_sqe(uconn->uring, uconn, RIAK_URING_SEND);
+    if (sqe == NULL) {
+        return ERIAK_EVENT;
+    }
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = riak_connection_get_fd(uconn->cxn);
+    sqe->addr      = (riak_uint64_t)(uintptr_t)(uconn->send_buf + uconn->send_start);
+    sqe->len       = uconn->send_end - uconn->send_start;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    uconn->sending = RIAK_TRUE;
+    return ERIAK_OK;
+}
+
+/**
+ * @brief Start sending the queued requests, unless a send is already in flight
+ * @param uconn Attached connection
+ * @returns Error code
+ */
+static riak_error
+riak_uring_start_send(riak_uring_connection *uconn) {
+    if (uconn->sending || uconn->out_len == 0) {
+        return ERIAK_OK;
+    }
+    // Swap buffers so new requests never move memory the kernel is reading
+    riak_uint8_t *buf      = uconn->send_buf;
+    riak_uint32_t capacity = uconn->send_capacity;
+    uconn->send_buf      = uconn->out_buf;
+    uconn->send_capacity = uconn->out_capacity;
+    uconn->send_start    = 0;
+    uconn->send_end      = uconn->out_len;
+    uconn->out_buf       = buf;
+    uconn->out_capacity  = capacity;
+    uconn->out_len       = 0;
+    return riak_uring_arm_send(uconn);
+}
+
+/**
+ * @brief Give up on a connection and drop its outstanding operations
+ * @param uconn Attached connection
+ * @param err Reason
+ */
+static void
+riak_uring_fail(riak_uring_connection *uconn,
+                riak_error             err) {
+    riak_connection *cxn = uconn->cxn;
+    if (uconn->err) {
+        return;
+    }
+    uconn->err     = err;
+    uconn->out_len = 0;
+    riak_pipeline_drop(cxn, err);
+}
+
+/**
+ * @brief Append part of a framed request to the connection's output buffer
+ * @param ptr Attached connection
+ * @param data Bytes to queue
+ * @param size Number of bytes
+ * @returns `size`, or 0 if out of memory
+ */
+static riak_ssize_t
+riak_uring_buffer_cb(void       *ptr,
+                     void       *data,
+                     riak_size_t size) {
+    riak_uring_connection *uconn = (riak_uring_connection*)ptr;
+    riak_config           *cfg   = riak_connection_get_config(uconn->cxn);
+    riak_error err = riak_array_reserve(cfg,
+                                        (void***)&(uconn->out_buf),
+                                        sizeof(riak_uint8_t),
+                                        uconn->out_len,
+                                        &(uconn->out_capacity),
+                                        uconn->out_len + size);
+    if (err) {
+        return 0;
+    }
+    memcpy(uconn->out_buf + uconn->out_len, data, size);
+    uconn->out_len += size;
+    return size;
+}
+
+/**
+ * @brief Copy out of the receive being processed; 0 bytes once it is used up
+ * @param ptr Attached connection
+ * @param data Buffer to fill
+ * @param size Space in `data`
+ * @returns Bytes copied
+ */
+static riak_ssize_t
+riak_uring_read_cb(void       *ptr,
+                   void       *data,
+                   riak_size_t size) {
+    riak_uring_connection *uconn = (riak_uring_connection*)ptr;
+    if (size > uconn->in_len) {
+        size = uconn->in_len;
+    }
+    memcpy(data, uconn->in_data, size);
+    uconn->in_data += size;
+    uconn->in_len  -= size;
+    return size;
+}
+
+/**
+ * @brief Deliver a receive completion to the connection's pipeline
+ * @param ur Riak io_uring reactor
+ * @param uconn Attached connection
+ * @param result Bytes received or negative errno
+ * @param flags Completion flags
+ */
+static void
+riak_uring_handle_recv(riak_uring            *ur,
+                       riak_uring_connection *uconn,
+                       riak_int32_t           result,
+                       riak_uint32_t          flags) {
+    riak_error err = ERIAK_OK;
+    if (!(flags & IORING_CQE_F_MORE)) {
+        uconn->receiving = RIAK_FALSE;
+    }
+    if (flags & IORING_CQE_F_BUFFER) {
+        riak_uint16_t bid = (riak_uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (result > 0 && uconn->err == ERIAK_OK) {
+            uconn->in_data = ur->buffers + (riak_size_t)bid * RIAK_URING_BUFFER_SIZE;
+            uconn->in_len  = result;
+            err = riak_pipeline_read(uconn->cxn, riak_uring_read_cb, uconn);
+            if (err == ERIAK_OK && uconn->in_len > 0) {
+                riak_log_error(uconn->cxn, "Received %d bytes nobody asked for", (int)uconn->in_len);
+                err = ERIAK_READ;
+            }
+            uconn->in_len = 0;
+        }
+        riak_uring_buffer_recycle(ur, bid);
+    }
+    if (uconn->err) {
+        return;
+    }
+    if (result == -EINVAL && ur->multishot) {
+        riak_log_notice_config(ur->config, "%s", "Multishot receives unsupported, using single receives");
+        ur->multishot = RIAK_FALSE;
+    } else if (result == 0) {
+        err = ERIAK_READ;  // Server hung up
+    } else if (result < 0 && result != -ENOBUFS && result != -EINTR) {
+        riak_log_error(uconn->cxn, "%s", strerror(-result));
+        err = ERIAK_READ;
+    }
+    if (err == ERIAK_OK && !uconn->receiving) {
+        err = riak_uring_arm_recv(uconn);
+    }
+    if (err) {
+        riak_uring_fail(uconn, err);
+    }
+}
+
+/**
+ * @brief Account for a send completion and keep the connection's output moving
+ * @param uconn Attached connection
+ * @param result Bytes sent or negative errno
+ */
+static void
+riak_uring_handle_send(riak_uring_connection *uconn,
+                       riak_int32_t           result) {
+    riak_error err = ERIAK_OK;
+    uconn->sending = RIAK_FALSE;
+    if (uconn->err) {
+        return;
+    }
+    if (result < 0 && result != -EINTR && result != -EAGAIN) {
+        riak_log_error(uconn->cxn, "%s", strerror(-result));
+        err = ERIAK_WRITE;
+    } else {
+        if (result > 0) {
+            uconn->send_start += result;
+        }
+        if (uconn->send_start < uconn->send_end) {
+            err = riak_uring_arm_send(uconn);
+        } else {
+            err = riak_uring_start_send(uconn);
+        }
+    }
+    if (err) {
+        riak_uring_fail(uconn, err);
+    }
+}
+
+/**
+ * @brief Handle every completion the kernel has posted
+ * @param ur Riak io_uring reactor
+ */
+static void
+riak_uring_reap(riak_uring *ur) {
+    riak_uint32_t head = *(ur->cq_khead);
+    while (RIAK_TRUE) {
+        __sync_synchronize();
+        if (head == *(ur->cq_ktail)) {
+            break;
+        }
+        struct io_uring_cqe *cqe = &(ur->cqes[head & ur->cq_mask]);
+        riak_uint64_t user_data = cqe->user_data;
+        riak_int32_t  result    = cqe->res;
+        riak_uint32_t flags     = cqe->flags;
+        head++;
+        __sync_synchronize();
+        *(ur->cq_khead) = head;
+
+        riak_uint64_t tag = user_data & RIAK_URING_TAG_MASK;
+        riak_uring_connection *uconn = (riak_uring_connection*)(uintptr_t)(user_data & ~RIAK_URING_TAG_MASK);
+        if (tag == RIAK_URING_RECV) {
+            riak_uring_handle_recv(ur, uconn, result, flags);
+        } else if (tag == RIAK_URING_SEND) {
+            riak_uring_handle_send(uconn, result);
+        }
+        head = *(ur->cq_khead);
+    }
+}
+
+/**
+ * @brief Called by the timer wheel when an operation outlives its deadline
+ * @param rop Expired operation
+ * @param ptr Attached connection
+ */
+static void
+riak_uring_timeout_cb(riak_operation *rop,
+                      void           *ptr) {
+    riak_uring_fail((riak_uring_connection*)ptr, ERIAK_TIMEOUT);
+}
+
+/**
+ * @brief Release the rings and buffers of a native reactor
+ * @param ur Riak io_uring reactor
+ */
+static void
+riak_uring_unmap(riak_uring *ur) {
+    if (ur->buf_ring) {
+        munmap(ur->buf_ring, RIAK_URING_BUFFERS * sizeof(struct io_uring_buf));
+        ur->buf_ring = NULL;
+    }
+    if (ur->buffers) {
+        munmap(ur->buffers, ur->buffers_len);
+        ur->buffers = NULL;
+    }
+    if (ur->sqes) {
+        munmap(ur->sqes, ur->sqes_len);
+        ur->sqes = NULL;
+    }
+    if (ur->sq_map) {
+        munmap(ur->sq_map, ur->sq_map_len);
+        ur->sq_map = NULL;
+    }
+    if (ur->fd >= 0) {
+        close(ur->fd);
+        ur->fd = -1;
+    }
+}
+
+/**
+ * @brief Create the rings and register the receive buffers
+ * @param ur Riak io_uring reactor
+ * @param entries Submission queue entries
+ * @returns Error code; any failure means the kernel cannot serve this reactor
+ */
+static riak_error
+riak_uring_map(riak_uring   *ur,
+               riak_uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, '\0', sizeof(params));
+    ur->fd = riak_uring_setup(entries, &params);
+    if (ur->fd < 0) {
+        riak_log_notice_config(ur->config, "io_uring unavailable [%s]", strerror(errno));
+        return ERIAK_EVENT;
+    }
+    riak_uint32_t needed = IORING_FEAT_SINGLE_MMAP|IORING_FEAT_NODROP|IORING_FEAT_EXT_ARG;
+    if ((params.features & needed) != needed) {
+        riak_log_notice_config(ur->config, "io_uring lacks features [0x%x]", params.features);
+        return ERIAK_EVENT;
+    }
+
+    riak_size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(riak_uint32_t);
+    riak_size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ur->sq_map_len = (sq_len > cq_len) ? sq_len : cq_len;
+    ur->sq_map = mmap(NULL, ur->sq_map_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+    if (ur->sq_map == MAP_FAILED) {
+        ur->sq_map = NULL;
+        return ERIAK_EVENT;
+    }
+    ur->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ur->sqes = (struct io_uring_sqe*)mmap(NULL, ur->sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+    if (ur->sqes == MAP_FAILED) {
+        ur->sqes = NULL;
+        return ERIAK_EVENT;
+    }
+    riak_uint8_t *base = (riak_uint8_t*)ur->sq_map;
+    ur->sq_khead   = (riak_uint32_t*)(base + params.sq_off.head);
+    ur->sq_ktail   = (riak_uint32_t*)(base + params.sq_off.tail);
+    ur->sq_mask    = *(riak_uint32_t*)(base + params.sq_off.ring_mask);
+    ur->sq_entries = params.sq_entries;
+    ur->sq_array   = (riak_uint32_t*)(base + params.sq_off.array);
+    ur->sq_tail    = ur->sq_submitted = *(ur->sq_ktail);
+    ur->cq_khead   = (riak_uint32_t*)(base + params.cq_off.head);
+    ur->cq_ktail   = (riak_uint32_t*)(base + params.cq_off.tail);
+    ur->cq_mask    = *(riak_uint32_t*)(base + params.cq_off.ring_mask);
+    ur->cqes       = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+
+    // Page-aligned, as the kernel requires of a buffer ring
+    ur->buf_ring = (struct io_uring_buf_ring*)mmap(NULL, RIAK_URING_BUFFERS * sizeof(struct io_uring_buf),
+                                                   PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (ur->buf_ring == MAP_FAILED) {
+        ur->buf_ring = NULL;
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    ur->buffers_len = (riak_size_t)RIAK_URING_BUFFERS * RIAK_URING_BUFFER_SIZE;
+    ur->buffers = (riak_uint8_t*)mmap(NULL, ur->buffers_len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (ur->buffers == MAP_FAILED) {
+        ur->buffers = NULL;
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, '\0', sizeof(reg));
+    reg.ring_addr    = (riak_uint64_t)(uintptr_t)ur->buf_ring;
+    reg.ring_entries = RIAK_URING_BUFFERS;
+    reg.bgid         = RIAK_URING_BUFFER_GROUP;
+    if (riak_uring_register(ur->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        riak_log_notice_config(ur->config, "io_uring buffer rings unavailable [%s]", strerror(errno));
+        return ERIAK_EVENT;
+    }
+    riak_uint16_t bid;
+    for(bid = 0; bid < RIAK_URING_BUFFERS; bid++) {
+        riak_uring_buffer_recycle(ur, bid);
+    }
+    ur->multishot = RIAK_TRUE;
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_uring_new(riak_uring   **ur_target,
+               riak_config   *cfg,
+               riak_uint32_t  entries) {
+    riak_uring *ur = (riak_uring*)riak_config_clean_allocate(cfg, sizeof(riak_uring));
+    if (ur == NULL) {
+        riak_log_critical_config(cfg, "%s", "Could not allocate a riak_uring");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    ur->config = cfg;
+    ur->fd     = -1;
+    if (entries == 0) {
+        entries = RIAK_URING_DEFAULT_ENTRIES;
+    }
+    riak_error err = riak_uring_map(ur, entries);
+    if (err) {
+        riak_uring_unmap(ur);
+        riak_log_notice_config(cfg, "%s", "Falling back to epoll");
+        err = riak_epoll_new(&(ur->fallback), cfg);
+    } else {
+        err = riak_timer_wheel_new(&(ur->timers), cfg, RIAK_TIMER_WHEEL_DEFAULT_TICK_MS);
+        if (err) {
+            riak_uring_unmap(ur);
+        }
+    }
+    if (err) {
+        riak_free(cfg, &ur);
+        return err;
+    }
+    *ur_target = ur;
+
+    return ERIAK_OK;
+}
+
+void
+riak_uring_free(riak_uring **ur_target) {
+    if (ur_target == NULL || *ur_target == NULL) {
+        return;
+    }
+    riak_uring  *ur  = *ur_target;
+    riak_config *cfg = ur->config;
+    while (ur->connections) {
+        riak_uring_connection *uconn = ur->connections;
+        riak_uring_connection_free(&uconn);
+    }
+    riak_epoll_free(&(ur->fallback));
+    riak_uring_unmap(ur);
+    riak_timer_wheel_free(&(ur->timers));
+    riak_free(cfg, ur_target);
+}
+
+riak_boolean_t
+riak_uring_is_native(riak_uring *ur) {
+    return (ur->fallback == NULL);
+}
+
+riak_error
+riak_uring_connection_new(riak_uring_connection **uconn_target,
+                          riak_uring             *ur,
+                          riak_connection        *cxn) {
+    riak_config *cfg = riak_connection_get_config(cxn);
+    riak_uring_connection *uconn = (riak_uring_connection*)riak_config_clean_allocate(cfg, sizeof(riak_uring_connection));
+    if (uconn == NULL) {
+        riak_log_critical(cxn, "%s", "Could not allocate a riak_uring_connection");
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    uconn->uring = ur;
+    uconn->cxn   = cxn;
+    riak_error err;
+    if (ur->fallback) {
+        err = riak_epoll_connection_new(&(uconn->fallback), ur->fallback, cxn);
+    } else {
+        err = riak_uring_arm_recv(uconn);
+    }
+    if (err) {
+        riak_free(cfg, &uconn);
+        return err;
+    }
+
+    uconn->next = ur->connections;
+    if (ur->connections) {
+        ur->connections->prev = uconn;
+    }
+    ur->connections = uconn;
+    *uconn_target   = uconn;
+
+    return ERIAK_OK;
+}
+
+void
+riak_uring_connection_free(riak_uring_connection **uconn_target) {
+    if (uconn_target == NULL || *uconn_target == NULL) {
+        return;
+    }
+    riak_uring_connection *uconn = *uconn_target;
+    riak_uring            *ur    = uconn->uring;
+    riak_config           *cfg   = riak_connection_get_config(uconn->cxn);
+
+    if (uconn->queued) {
+        riak_uring_connection **link = &(ur->flush_head);
+        while (*link != uconn) {
+            link = &((*link)->next_flush);
+        }
+        *link = uconn->next_flush;
+    }
+    if (uconn->prev) {
+        uconn->prev->next = uconn->next;
+    } else {
+        ur->connections = uconn->next;
+    }
+    if (uconn->next) {
+        uconn->next->prev = uconn->prev;
+    }
+
+    if (uconn->fallback) {
+        riak_epoll_connection_free(&(uconn->fallback));
+    } else {
+        riak_uring_fail(uconn, ERIAK_EVENT);
+        // The kernel may still write into or read from this connection's memory
+        riak_boolean_t uncancelled = RIAK_FALSE;
+        riak_uint64_t  tag;
+        for(tag = RIAK_URING_RECV; tag <= RIAK_URING_SEND; tag++) {
+            riak_boolean_t armed = (tag == RIAK_URING_RECV) ? uconn->receiving : uconn->sending;
+            if (!armed) {
+                continue;
+            }
+            struct io_uring_sqe *sqe = riak_uring_get_sqe(ur, uconn, RIAK_URING_CANCEL);
+            if (sqe == NULL) {
+                uncancelled = RIAK_TRUE;
+                continue;
+            }
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr   = (riak_uint64_t)(uintptr_t)uconn | tag;
+        }
+        // Without a cancel, a receive from a quiet server would never complete; a shut down socket ends it
+        if (uncancelled) {
+            riak_log_warn_config(cfg, "%s", "Could not cancel io_uring requests; shutting down the socket");
+            shutdown(riak_connection_get_fd(uconn->cxn), SHUT_RDWR);
+            uconn->cxn->stale = RIAK_TRUE;
+        }
+        while (uconn->receiving || uconn->sending) {
+            if (riak_uring_submit(ur, -1)) {
+                break;
+            }
+            riak_uring_reap(ur);
+        }
+    }
+    riak_free(cfg, &(uconn->out_buf));
+    riak_free(cfg, &(uconn->send_buf));
+    riak_free(cfg, uconn_target);
+}
+
+riak_error
+riak_uring_connection_get_error(riak_uring_connection *uconn) {
+    if (uconn->fallback) {
+        return riak_epoll_connection_get_error(uconn->fallback);
+    }
+    return uconn->err;
+}
+
+riak_error
+riak_uring_send(riak_operation        *rop,
+                riak_uring_connection *uconn) {
+    if (uconn->fallback) {
+        return riak_epoll_send(rop, uconn->fallback);
+    }
+    if (uconn->err) {
+        return uconn->err;
+    }
+    if (riak_operation_get_connection(rop) != uconn->cxn) {
+        riak_log_error(uconn->cxn, "%s", "Operation belongs to another connection");
+        return ERIAK_INVALID;
+    }
+    riak_error err = riak_pipeline_queue(rop, riak_uring_buffer_cb, uconn, &(uconn->out_len));
+    if (err) {
+        return err;
+    }
+    riak_timer_wheel_add(uconn->uring->timers, rop, uconn);
+    if (!uconn->queued) {
+        uconn->queued            = RIAK_TRUE;
+        uconn->next_flush        = uconn->uring->flush_head;
+        uconn->uring->flush_head = uconn;
+    }
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_uring_run_once(riak_uring *ur,
+                    int         timeout_ms) {
+    if (ur->fallback) {
+        return riak_epoll_run_once(ur->fallback, timeout_ms);
+    }
+    // One submission carries the sends of every connection with queued requests
+    while (ur->flush_head) {
+        riak_uring_connection *uconn = ur->flush_head;
+        ur->flush_head    = uconn->next_flush;
+        uconn->next_flush = NULL;
+        uconn->queued     = RIAK_FALSE;
+        if (uconn->err == ERIAK_OK) {
+            riak_error err = riak_uring_start_send(uconn);
+            if (err) {
+                riak_uring_fail(uconn, err);
+            }
+        }
+    }
+    // Wake in time to enforce the nearest deadline
+    int deadline_ms = riak_timer_wheel_get_timeout(ur->timers);
+    if (deadline_ms >= 0 && (timeout_ms < 0 || deadline_ms < timeout_ms)) {
+        timeout_ms = deadline_ms;
+    }
+    riak_error err = riak_uring_submit(ur, timeout_ms);
+    if (err) {
+        return err;
+    }
+    riak_uring_reap(ur);
+    riak_timer_wheel_advance(ur->timers, riak_uring_timeout_cb);
+
+    return ERIAK_OK;
+}
+
+riak_error
+riak_uring_run(riak_uring *ur) {
+    while (riak_uring_get_pending(ur) > 0) {
+        riak_error err = riak_uring_run_once(ur, -1);
+        if (err) {
+            return err;
+        }
+    }
+
+    return ERIAK_OK;
+}
+
+riak_uint32_t
+riak_uring_get_pending(riak_uring *ur) {
+    if (ur->fallback) {
+        return riak_epoll_get_pending(ur->fallback);
+    }
+    riak_uint32_t pending = 0;
+    riak_uring_connection *uconn;
+    for(uconn = ur->connections; uconn != NULL; uconn = uconn->next) {
+        if (uconn->err == ERIAK_OK) {
+            pending += riak_pipeline_get_depth(uconn->cxn);
+        }
+    }
+    return pending;
+}
@@ -20,6 +20,9 @@
  *
  *********************************************************************/
 
+#include <limits.h>
+#include <time.h>
+#include <sys/time.h>
 #include "riak.h"
 #include "riak_binary-internal.h"
 #include "riak_messages-internal.h"
@@ -75,12 +78,67 @@ riak_array_realloc(riak_config  *cfg,
     return (*from);
 }
 
+riak_error
+riak_array_reserve(riak_config   *cfg,
+                   void        ***array,
+                   riak_size_t    size,
+                   riak_uint32_t  used,
+                   riak_uint32_t *capacity,
+                   riak_uint32_t  needed) {
+    if (needed <= *capacity && *array != NULL) {
+        return ERIAK_OK;
+    }
+    riak_uint32_t grown = (*capacity > 0) ? *capacity : RIAK_ARRAY_MIN_CAPACITY;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    if (*array == NULL) {
+        *array = (void**)riak_config_allocate(cfg, grown*size);
+        if (*array == NULL) {
+            return ERIAK_OUT_OF_MEMORY;
+        }
+    } else if (riak_array_realloc(cfg, array, size, used, grown) == NULL) {
+        return ERIAK_OUT_OF_MEMORY;
+    }
+    *capacity = grown;
+    return ERIAK_OK;
+}
+
+riak_uint64_t
+riak_time_usecs() {
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((riak_uint64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return ((riak_uint64_t)now.tv_sec * 1000000) + now.tv_usec;
+#endif
+}
+
+int
+riak_deadline_ms(riak_uint64_t deadline_usecs) {
+    if (deadline_usecs == 0) {
+        return -1;
+    }
+    riak_uint64_t now = riak_time_usecs();
+    if (deadline_usecs <= now) {
+        return 0;
+    }
+    // Round up so a wait never ends just short of the deadline
+    riak_uint64_t remaining = (deadline_usecs - now + 999) / 1000;
+    return (remaining > INT_MAX) ? INT_MAX : (int)remaining;
+}
 
 void
 riak_free_internal(riak_config *cfg,
                    void       **pp) {
     if(pp != NULL && *pp != NULL) {
-        (cfg->free_fn)(*pp);
+        // Arena memory is only released all at once
+        if (cfg->arena == NULL) {
+            (cfg->free_fn)(*pp);
+        }
         *pp = NULL;
     }
 }
@@ -229,4 +229,54 @@ test_load_db(riak_config            *cfg,
 riak_error
 test_cleanup_db(riak_connection* cxn);
 
+// Stand-in Riak node run on its own thread, answering request frames in order
+typedef struct _test_node {
+    riak_socket_t  listener;    // Loopback listener, or -1 when serving one socketpair
+    riak_socket_t  fd;          // Connection being served
+    char           portnum[16]; // Port of `listener`
+    pthread_t      thread;
+    riak_uint32_t  connections; // Connections to serve before stopping (0 is one)
+    riak_uint8_t   msgid;       // Message id of each answer (0: the one after the request's)
+    riak_uint8_t  *body;        // Body of each answer
+    riak_uint32_t  body_len;
+    riak_uint32_t  error_every; // Every Nth request gets an RpbErrorResp instead
+    riak_uint32_t  hangups;     // Bit N set: hang up on request N+1 instead of answering
+    riak_boolean_t silent;      // Read requests without ever answering
+    volatile riak_uint32_t requests; // Requests read so far
+} test_node;
+
+/**
+ * @brief Listen on an ephemeral loopback port without accepting, so connect() succeeds
+ * @param node Test node; `portnum` is filled in
+ * @returns Error Code
+ */
+riak_error
+test_node_listen(test_node *node);
+
+/**
+ * @brief Listen on a loopback port and serve connections on a new thread
+ * @param node Test node, zeroed apart from how it should answer
+ * @returns Error Code
+ */
+riak_error
+test_node_start(test_node *node);
+
+/**
+ * @brief Serve one end of a socketpair on a new thread
+ * @param node Test node, zeroed apart from how it should answer
+ * @param fd Other end, for the client (out)
+ * @returns Error Code
+ */
+riak_error
+test_node_start_pair(test_node     *node,
+                     riak_socket_t *fd);
+
+/**
+ * @brief Wait for a node to finish serving, then close its listener
+ * @param node Test node
+ * @note The client must hang up first, unless the node gives up by itself
+ */
+void
+test_node_stop(test_node *node);
+
 #endif // _RIAK_C_TEST_H
@@ -0,0 +1,36 @@
+/*********************************************************************
+ *
+ * test_cluster.h: Riak C Unit testing for riak_cluster
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+void
+test_cluster_no_nodes();
+
+void
+test_cluster_failover();
+
+void
+test_cluster_checkin_marks_down();
+
+void
+test_cluster_hedged_get();
+
+void
+test_cluster_latency_sample();
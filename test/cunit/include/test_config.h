@@ -26,6 +26,9 @@ test_build_config();
 void
 test_config_with_logging();
 
+void
+test_config_log_level();
+
 void
 test_config_allocate();
 
@@ -34,3 +37,9 @@ test_config_allocate_clean();
 
 void
 test_config_free();
+
+void
+test_config_arena();
+
+void
+test_config_arena_nested();
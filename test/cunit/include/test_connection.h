@@ -26,3 +26,12 @@ test_connection_with_good_resolver();
 void
 test_connection_with_bad_resolver();
 
+
+void
+test_connection_buffer_cache();
+
+void
+test_connection_retry();
+
+void
+test_connection_arena_responses();
@@ -0,0 +1,33 @@
+/*********************************************************************
+ *
+ * test_connection_pool.h: Riak C Unit testing for riak_connection_pool
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+void
+test_connection_pool_bad_bounds();
+
+void
+test_connection_pool_unreachable();
+
+void
+test_connection_pool_checkout_checkin();
+
+void
+test_connection_pool_shrink_race();
@@ -23,6 +23,9 @@
 void
 test_listkeys_response_decode();
 
+void
+test_listkeys_stream_decode();
+
 void
 test_integration_listkeys();
 
@@ -31,23 +31,39 @@
 #include "test.h"
 #include "test_2i.h"
 #include "test_array.h"
+#include "test_batch.h"
 #include "test_binary.h"
 #include "test_bucketprops.h"
 #include "test_clientid.h"
+#include "test_completion_queue.h"
+#include "test_cluster.h"
 #include "test_config.h"
 #include "test_connection.h"
+#include "test_connection_pool.h"
 #include "test_delete.h"
+#ifdef HAVE_SYS_EPOLL_H
+#include "test_epoll.h"
+#endif
+#ifdef HAVE_IO_URING
+#include "test_uring.h"
+#endif
 #include "test_get.h"
+#include "test_libevent.h"
 #include "test_listbuckets.h"
 #include "test_listkeys.h"
+#include "test_log_buffer.h"
 #include "test_mapreduce.h"
+#include "test_metrics.h"
 #include "test_object.h"
 #include "test_operation.h"
 #include "test_ping.h"
+#include "test_pipeline.h"
 #include "test_put.h"
 #include "test_search.h"
 #include "test_server_error.h"
 #include "test_serverinfo.h"
+#include "test_timer_wheel.h"
+#include "test_trace.h"
 
 int
 main(int   argc,
@@ -99,12 +115,56 @@ main(int   argc,
     CU_ADD_TEST(config_suite, test_build_config);
     CU_ADD_TEST(connection_suite, test_connection_with_bad_resolver);
     CU_ADD_TEST(connection_suite, test_connection_with_good_resolver);
+    CU_ADD_TEST(connection_suite, test_connection_buffer_cache);
+    CU_ADD_TEST(connection_suite, test_connection_retry);
+    CU_ADD_TEST(connection_suite, test_connection_arena_responses);
+    CU_ADD_TEST(connection_suite, test_connection_pool_bad_bounds);
+    CU_ADD_TEST(connection_suite, test_connection_pool_unreachable);
+    CU_ADD_TEST(connection_suite, test_connection_pool_checkout_checkin);
+    CU_ADD_TEST(connection_suite, test_connection_pool_shrink_race);
+    CU_ADD_TEST(connection_suite, test_cluster_no_nodes);
+    CU_ADD_TEST(connection_suite, test_cluster_failover);
+    CU_ADD_TEST(connection_suite, test_cluster_checkin_marks_down);
+    CU_ADD_TEST(connection_suite, test_cluster_hedged_get);
+    CU_ADD_TEST(connection_suite, test_cluster_latency_sample);
     CU_ADD_TEST(config_suite, test_config_with_logging);
+    CU_ADD_TEST(config_suite, test_config_log_level);
+    CU_ADD_TEST(config_suite, test_log_buffer_format);
+    CU_ADD_TEST(config_suite, test_log_buffer_overflow);
+    CU_ADD_TEST(config_suite, test_log_buffer_thread_exit);
     CU_ADD_TEST(config_suite, test_config_allocate);
     CU_ADD_TEST(config_suite, test_config_allocate_clean);
     CU_ADD_TEST(config_suite, test_config_free);
+    CU_ADD_TEST(config_suite, test_config_arena);
+    CU_ADD_TEST(config_suite, test_config_arena_nested);
+    CU_ADD_TEST(config_suite, test_metrics_counters);
+    CU_ADD_TEST(config_suite, test_metrics_phases);
+    CU_ADD_TEST(config_suite, test_metrics_percentile);
+    CU_ADD_TEST(config_suite, test_trace_spans);
     CU_ADD_TEST(operation_suite, test_operation_new);
     CU_ADD_TEST(operation_suite, test_operation_callbacks);
+    CU_ADD_TEST(operation_suite, test_pipeline_in_order);
+    CU_ADD_TEST(operation_suite, test_pipeline_send_batch);
+    CU_ADD_TEST(operation_suite, test_pipeline_buffered_reads);
+    CU_ADD_TEST(operation_suite, test_pipeline_timeout);
+    CU_ADD_TEST(operation_suite, test_pipeline_hangup);
+    CU_ADD_TEST(operation_suite, test_libevent_pipeline_hangup);
+    CU_ADD_TEST(operation_suite, test_libevent_pipeline_desync);
+    CU_ADD_TEST(operation_suite, test_libevent_pipeline_retry);
+    CU_ADD_TEST(operation_suite, test_libevent_send_timeout);
+    CU_ADD_TEST(operation_suite, test_libevent_send_read_error);
+    CU_ADD_TEST(operation_suite, test_batch_multiget);
+    CU_ADD_TEST(operation_suite, test_batch_multiput);
+    CU_ADD_TEST(operation_suite, test_completion_queue_submit_and_harvest);
+    CU_ADD_TEST(operation_suite, test_timer_wheel_deadlines);
+#ifdef HAVE_SYS_EPOLL_H
+    CU_ADD_TEST(operation_suite, test_epoll_pipeline);
+    CU_ADD_TEST(operation_suite, test_epoll_timeout);
+    CU_ADD_TEST(operation_suite, test_epoll_retry);
+#endif
+#ifdef HAVE_IO_URING
+    CU_ADD_TEST(operation_suite, test_uring_pipeline);
+#endif
     CU_ADD_TEST(messages_suite, test_server_info_encode_request);
     CU_ADD_TEST(messages_suite, test_server_info_decode_good_response);
     CU_ADD_TEST(messages_suite, test_server_info_decode_bad_response);
@@ -122,6 +182,7 @@ main(int   argc,
     CU_ADD_TEST(messages_suite, test_get_options_sloppy_quorum);
     CU_ADD_TEST(messages_suite, test_get_options_n_val);
     CU_ADD_TEST(messages_suite, test_get_decode_response);
+    CU_ADD_TEST(messages_suite, test_get_view_decode_response);
     CU_ADD_TEST(messages_suite, test_put_options_vclock);
     CU_ADD_TEST(messages_suite, test_put_options_w);
     CU_ADD_TEST(messages_suite, test_put_options_dw);
@@ -137,6 +198,7 @@ main(int   argc,
     CU_ADD_TEST(messages_suite, test_put_decode_response);
     CU_ADD_TEST(messages_suite, test_listbuckets_response_decode);
     CU_ADD_TEST(messages_suite, test_listkeys_response_decode);
+    CU_ADD_TEST(messages_suite, test_listkeys_stream_decode);
     CU_ADD_TEST(messages_suite, test_bucketprops);
     CU_ADD_TEST(messages_suite, test_mapreduce_response_decode);
     CU_ADD_TEST(messages_suite, test_2i_options_qtype);
@@ -151,6 +213,8 @@ main(int   argc,
     CU_ADD_TEST(messages_suite, test_2i_options_term_regex);
     CU_ADD_TEST(messages_suite, test_2i_options_pagination_sort);
     CU_ADD_TEST(messages_suite, test_2i_response_decode);
+    CU_ADD_TEST(messages_suite, test_2i_response_decode_results);
+    CU_ADD_TEST(messages_suite, test_2i_stream_decode);
     CU_ADD_TEST(messages_suite, test_search_options_rows);
     CU_ADD_TEST(messages_suite, test_search_options_start);
     CU_ADD_TEST(messages_suite, test_search_options_sort);
@@ -27,7 +27,10 @@
 #include <event2/event.h>
 #include <event2/thread.h>
 #include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include "test.h"
+#include "riak_messages-internal.h"
 #include "riak_async.h"
 #include "../../src/adapters/riak_libevent.h"
 
@@ -523,4 +526,129 @@ test_async_send_message(test_async_connection *conn) {
     return err;
 }
 
+/**
+ * @brief Read exactly `len` bytes
+ * @returns False once the peer hangs up
+ */
+static riak_boolean_t
+test_node_read_fully(riak_socket_t fd,
+                     riak_uint8_t *buf,
+                     riak_size_t   len) {
+    while (len > 0) {
+        riak_ssize_t got = read(fd, buf, len);
+        if (got <= 0) return RIAK_FALSE;
+        buf += got;
+        len -= got;
+    }
+    return RIAK_TRUE;
+}
+
+static void
+test_node_write_frame(riak_socket_t fd,
+                      riak_uint8_t  msgid,
+                      riak_uint8_t *body,
+                      riak_uint32_t body_len) {
+    riak_uint8_t  frame[256];
+    riak_uint32_t len = htonl(body_len + 1);
+    memcpy(frame, &len, sizeof(len));
+    frame[sizeof(len)] = msgid;
+    memcpy(frame + sizeof(len) + 1, body, body_len);
+    write(fd, frame, sizeof(len) + 1 + body_len);
+}
+
+static void*
+test_node_serve(void *ptr) {
+    test_node *node = (test_node*)ptr;
+    // errmsg "oops", errcode 1
+    riak_uint8_t  error_body[] = { 0x0a,0x04,0x6f,0x6f,0x70,0x73,0x10,0x01 };
+    riak_uint8_t  request[1024];
+    riak_uint32_t served = 0;
+    riak_uint32_t connections = (node->connections) ? node->connections : 1;
+    while (served++ < connections) {
+        if (node->listener >= 0) {
+            node->fd = accept(node->listener, NULL, NULL);
+            if (node->fd < 0) {
+                return NULL;
+            }
+        }
+        riak_uint32_t len;
+        while (test_node_read_fully(node->fd, (riak_uint8_t*)&len, sizeof(len))) {
+            len = ntohl(len);
+            if (len == 0 || len > sizeof(request) || !test_node_read_fully(node->fd, request, len)) break;
+            riak_uint32_t n = node->requests++;
+            if (n < 32 && (node->hangups & (1u << n))) {
+                break;
+            }
+            if (node->silent) {
+                continue;
+            }
+            if (node->error_every && (node->requests % node->error_every) == 0) {
+                test_node_write_frame(node->fd, MSG_RPBERRORRESP, error_body, sizeof(error_body));
+            } else {
+                riak_uint8_t msgid = (node->msgid) ? node->msgid : request[0] + 1;
+                test_node_write_frame(node->fd, msgid, node->body, node->body_len);
+            }
+        }
+        close(node->fd);
+    }
+    return NULL;
+}
 
+riak_error
+test_node_listen(test_node *node) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    memset(&addr, '\0', sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    node->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (node->listener < 0) {
+        return ERIAK_CONNECT;
+    }
+    if (bind(node->listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(node->listener, 16) != 0 ||
+        getsockname(node->listener, (struct sockaddr*)&addr, &addrlen) != 0) {
+        close(node->listener);
+        node->listener = -1;
+        return ERIAK_CONNECT;
+    }
+    snprintf(node->portnum, sizeof(node->portnum), "%d", ntohs(addr.sin_port));
+    return ERIAK_OK;
+}
+
+riak_error
+test_node_start(test_node *node) {
+    riak_error err = test_node_listen(node);
+    if (err) {
+        return err;
+    }
+    if (pthread_create(&(node->thread), NULL, test_node_serve, node) != 0) {
+        return ERIAK_THREAD;
+    }
+    return ERIAK_OK;
+}
+
+riak_error
+test_node_start_pair(test_node     *node,
+                     riak_socket_t *fd) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        return ERIAK_CONNECT;
+    }
+    node->listener = -1;
+    node->fd       = sv[1];
+    *fd            = sv[0];
+    if (pthread_create(&(node->thread), NULL, test_node_serve, node) != 0) {
+        return ERIAK_THREAD;
+    }
+    return ERIAK_OK;
+}
+
+void
+test_node_stop(test_node *node) {
+    pthread_join(node->thread, NULL);
+    if (node->listener >= 0) {
+        close(node->listener);
+        node->listener = -1;
+    }
+}
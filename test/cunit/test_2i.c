@@ -319,3 +319,109 @@ test_2i_response_decode() {
     riak_config_free(&cfg);
     CU_PASS("test_2i_response_decode passed")
 }
+
+// Two chunks of term/key results, a continuation, then done
+static riak_uint8_t test_2i_results0[] = { 0x1a,0x12,0x06,0x0a,0x01,0x61,0x12,0x01,0x6b,0x12,0x06,0x0a,0x01,0x62,0x12,0x01,0x6c };
+static riak_uint8_t test_2i_results1[] = { 0x1a,0x12,0x06,0x0a,0x01,0x63,0x12,0x01,0x6d,0x1a,0x02,0x63,0x31 };
+static riak_uint8_t test_2i_results2[] = { 0x1a,0x20,0x01 };
+
+void
+test_2i_response_decode_results() {
+    riak_config     *cfg;
+    riak_operation  *rop = NULL;
+    riak_connection *cxn = NULL;
+
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    riak_uint8_t *bytes[] = { test_2i_results0, test_2i_results1, test_2i_results2 };
+    riak_int32_t len[]    = { sizeof(test_2i_results0), sizeof(test_2i_results1), sizeof(test_2i_results2) };
+
+    riak_pb_message   pb_response;
+    riak_2i_response *response = NULL;
+    riak_boolean_t    done = RIAK_FALSE;
+    for(int i = 0; i < 3; i++) {
+        pb_response.data = bytes[i];
+        pb_response.len  = len[i];
+        err = riak_2i_response_decode(rop, &pb_response, &response, &done);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        CU_ASSERT_EQUAL(done, (i == 2))
+    }
+    CU_ASSERT_EQUAL(riak_2i_get_n_keys(response), 0)
+    CU_ASSERT_EQUAL_FATAL(riak_2i_get_n_results(response), 3)
+    riak_pair **results = riak_2i_get_results(response);
+    CU_ASSERT_EQUAL(memcmp(riak_binary_data(riak_pair_get_key(results[0])), "a", 1), 0)
+    CU_ASSERT_EQUAL(memcmp(riak_binary_data(riak_pair_get_value(results[2])), "m", 1), 0)
+    CU_ASSERT_EQUAL(riak_2i_get_has_continuation(response), RIAK_TRUE)
+    CU_ASSERT_EQUAL(memcmp(riak_binary_data(riak_2i_get_continuation(response)), "c1", 2), 0)
+    CU_ASSERT_EQUAL(riak_2i_get_done(response), RIAK_TRUE)
+
+    riak_operation_free(&rop);
+    riak_connection_free(&cxn);
+    riak_2i_response_free(cfg, &response);
+    riak_config_free(&cfg);
+    CU_PASS("test_2i_response_decode_results passed")
+}
+
+void
+test_2i_stream_cb(riak_2i_response *chunk,
+                  void             *ptr) {
+    riak_int32_t *counts = (riak_int32_t*)ptr;
+    riak_pair   **results = riak_2i_get_results(chunk);
+    riak_uint32_t i;
+    for(i = 0; i < riak_2i_get_n_results(chunk); i++) {
+        // Terms arrive in order: a, b, c
+        if (riak_binary_data(riak_pair_get_key(results[i]))[0] == 'a' + counts[1]) {
+            counts[1]++;
+        }
+    }
+    counts[0]++;
+}
+
+void
+test_2i_stream_decode() {
+    riak_config     *cfg;
+    riak_operation  *rop = NULL;
+    riak_connection *cxn = NULL;
+
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_int32_t counts[2] = { 0, 0 }; // chunks, matching results
+    riak_operation_set_stream_cb(rop, (riak_stream_callback)test_2i_stream_cb, counts);
+
+    riak_uint8_t *bytes[] = { test_2i_results0, test_2i_results1, test_2i_results2 };
+    riak_int32_t len[]    = { sizeof(test_2i_results0), sizeof(test_2i_results1), sizeof(test_2i_results2) };
+
+    riak_pb_message   pb_response;
+    riak_2i_response *response = NULL;
+    riak_boolean_t    done = RIAK_FALSE;
+    for(int i = 0; i < 3; i++) {
+        pb_response.data = bytes[i];
+        pb_response.len  = len[i];
+        err = riak_2i_response_decode(rop, &pb_response, &response, &done);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    CU_ASSERT_EQUAL(done, RIAK_TRUE)
+    CU_ASSERT_EQUAL(counts[0], 3)
+    CU_ASSERT_EQUAL(counts[1], 3)
+    // Nothing is accumulated, but the continuation survives the chunks
+    CU_ASSERT_EQUAL(riak_2i_get_n_results(response), 0)
+    CU_ASSERT_EQUAL(riak_2i_get_has_continuation(response), RIAK_TRUE)
+    CU_ASSERT_EQUAL(memcmp(riak_binary_data(riak_2i_get_continuation(response)), "c1", 2), 0)
+
+    riak_operation_free(&rop);
+    riak_connection_free(&cxn);
+    riak_2i_response_free(cfg, &response);
+    riak_config_free(&cfg);
+    CU_PASS("test_2i_stream_decode passed")
+}
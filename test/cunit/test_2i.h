@@ -58,3 +58,9 @@ test_2i_options_pagination_sort();
 
 void
 test_2i_response_decode();
+
+void
+test_2i_response_decode_results();
+
+void
+test_2i_stream_decode();
@@ -0,0 +1,208 @@
+/*********************************************************************
+ *
+ * test_batch.c: Riak C Unit testing for batched requests
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+#include "test.h"
+
+/**
+ * @brief Point a connection at a new stand-in node on the far end of a socketpair
+ */
+static void
+test_batch_server_start(riak_connection *cxn,
+                        test_node       *server) {
+    CU_ASSERT_FATAL(test_node_start_pair(server, &(cxn->fd)) == ERIAK_OK)
+}
+
+#define TEST_BATCH_ITEMS  100
+#define TEST_BATCH_WINDOW 8
+
+typedef struct _test_multiget_state {
+    riak_connection *cxn;
+    riak_uint32_t    calls;
+    riak_boolean_t   in_order;
+    riak_boolean_t   within_window;
+} test_multiget_state;
+
+static void
+test_multiget_cb(riak_multiget_item *item,
+                 riak_uint32_t       index,
+                 void               *ptr) {
+    test_multiget_state *state = (test_multiget_state*)ptr;
+    if (index != state->calls++) {
+        state->in_order = RIAK_FALSE;
+    }
+    if (riak_pipeline_get_depth(state->cxn) > TEST_BATCH_WINDOW) {
+        state->within_window = RIAK_FALSE;
+    }
+}
+
+void
+test_batch_multiget() {
+    riak_config     *cfg;
+    riak_connection *cxn = NULL;
+
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    // Not found for most keys, a server error for every fifth
+    test_node server;
+    memset(&server, 0, sizeof(server));
+    server.msgid       = MSG_RPBGETRESP;
+    server.error_every = 5;
+    test_batch_server_start(cxn, &server);
+
+    riak_binary *bucket = riak_binary_copy_from_string(cfg, "bucket");
+    riak_binary *keys[TEST_BATCH_ITEMS];
+    riak_multiget_item items[TEST_BATCH_ITEMS];
+    memset(items, 0, sizeof(items));
+    int i;
+    for(i = 0; i < TEST_BATCH_ITEMS; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        keys[i] = riak_binary_copy_from_string(cfg, key);
+        items[i].bucket = bucket;
+        items[i].key    = keys[i];
+        items[i].err    = ERIAK_OUT_OF_RANGE;
+    }
+
+    test_multiget_state state = { cxn, 0, RIAK_TRUE, RIAK_TRUE };
+    err = riak_multiget(cxn, items, TEST_BATCH_ITEMS, NULL, TEST_BATCH_WINDOW, test_multiget_cb, &state);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(state.calls, TEST_BATCH_ITEMS)
+    CU_ASSERT_EQUAL(state.in_order, RIAK_TRUE)
+    CU_ASSERT_EQUAL(state.within_window, RIAK_TRUE)
+    CU_ASSERT_EQUAL(server.requests, TEST_BATCH_ITEMS)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+    for(i = 0; i < TEST_BATCH_ITEMS; i++) {
+        if (((i + 1) % 5) == 0) {
+            CU_ASSERT_EQUAL(items[i].err, ERIAK_SERVER_ERROR)
+            CU_ASSERT(items[i].response == NULL)
+        } else {
+            CU_ASSERT_EQUAL(items[i].err, ERIAK_OK)
+            CU_ASSERT_FATAL(items[i].response != NULL)
+            CU_ASSERT_EQUAL(riak_get_is_found(items[i].response), RIAK_FALSE)
+            riak_get_response_free(cfg, &(items[i].response));
+        }
+        riak_binary_free(cfg, &(keys[i]));
+    }
+    riak_binary_free(cfg, &bucket);
+
+    riak_connection_free(&cxn);
+    test_node_stop(&server);
+    riak_config_free(&cfg);
+    CU_PASS("test_batch_multiget passed")
+}
+
+typedef struct _test_multiput_state {
+    riak_connection *cxn;
+    riak_uint32_t    calls;
+    riak_boolean_t   within_window;
+} test_multiput_state;
+
+static void
+test_multiput_cb(riak_multiput_item *item,
+                 riak_uint32_t       index,
+                 void               *ptr) {
+    test_multiput_state *state = (test_multiput_state*)ptr;
+    state->calls++;
+    if (riak_pipeline_get_depth(state->cxn) > TEST_BATCH_WINDOW) {
+        state->within_window = RIAK_FALSE;
+    }
+}
+
+void
+test_batch_multiput() {
+    riak_config     *cfg;
+    riak_connection *cxn = NULL;
+
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    // Every store returns vclock "vc1", except every fourth which fails
+    riak_uint8_t put_body[] = { 0x12,0x03,0x76,0x63,0x31 };
+    test_node server;
+    memset(&server, 0, sizeof(server));
+    server.msgid       = MSG_RPBPUTRESP;
+    server.body        = put_body;
+    server.body_len    = sizeof(put_body);
+    server.error_every = 4;
+    test_batch_server_start(cxn, &server);
+
+    riak_binary *bucket = riak_binary_copy_from_string(cfg, "bucket");
+    riak_binary *value  = riak_binary_copy_from_string(cfg, "value");
+    riak_multiput_item items[TEST_BATCH_ITEMS];
+    memset(items, 0, sizeof(items));
+    int i;
+    for(i = 0; i < TEST_BATCH_ITEMS; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        riak_binary *key_bin = riak_binary_copy_from_string(cfg, key);
+        items[i].object = riak_object_new(cfg);
+        CU_ASSERT_FATAL(items[i].object != NULL)
+        riak_object_set_bucket(cfg, items[i].object, bucket);
+        riak_object_set_key(cfg, items[i].object, key_bin);
+        riak_object_set_value(cfg, items[i].object, value);
+        riak_binary_free(cfg, &key_bin);
+    }
+
+    test_multiput_state state = { cxn, 0, RIAK_TRUE };
+    err = riak_multiput(cxn, items, TEST_BATCH_ITEMS, NULL, TEST_BATCH_WINDOW, test_multiput_cb, &state);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(state.calls, TEST_BATCH_ITEMS)
+    CU_ASSERT_EQUAL(state.within_window, RIAK_TRUE)
+    CU_ASSERT_EQUAL(server.requests, TEST_BATCH_ITEMS)
+    for(i = 0; i < TEST_BATCH_ITEMS; i++) {
+        if (((i + 1) % 4) == 0) {
+            CU_ASSERT_EQUAL(items[i].err, ERIAK_SERVER_ERROR)
+            CU_ASSERT(items[i].response == NULL)
+        } else {
+            CU_ASSERT_EQUAL(items[i].err, ERIAK_OK)
+            CU_ASSERT_FATAL(items[i].response != NULL)
+            CU_ASSERT_EQUAL(riak_put_get_has_vclock(items[i].response), RIAK_TRUE)
+            CU_ASSERT_EQUAL(memcmp(riak_binary_data(riak_put_get_vclock(items[i].response)), "vc1", 3), 0)
+            riak_put_response_free(cfg, &(items[i].response));
+        }
+        riak_object_free(cfg, &(items[i].object));
+    }
+    riak_binary_free(cfg, &bucket);
+    riak_binary_free(cfg, &value);
+
+    riak_connection_free(&cxn);
+    test_node_stop(&server);
+    riak_config_free(&cfg);
+    CU_PASS("test_batch_multiput passed")
+}
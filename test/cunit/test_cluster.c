@@ -0,0 +1,239 @@
+/*********************************************************************
+ *
+ * test_cluster.c: Riak C Unit testing for riak_cluster
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_cluster-internal.h"
+#include "test.h"
+
+void
+test_cluster_no_nodes() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster *cluster = NULL;
+    err = riak_cluster_new(cfg, &cluster, RIAK_CLUSTER_ROUND_ROBIN);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_cluster_checkout(cluster, &cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_NO_NODES)
+
+    err = riak_cluster_add_node(cluster, "localhost", "1", NULL, 0, 2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_cluster_add_node(cluster, "localhost", "2", NULL, 0, 2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_cluster_get_n_nodes(cluster), 2)
+    CU_ASSERT_EQUAL(riak_cluster_get_n_up(cluster), 2)
+    err = riak_cluster_checkout(cluster, &cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_NO_NODES)
+    CU_ASSERT_PTR_NULL(cxn)
+    CU_ASSERT_EQUAL(riak_cluster_get_n_up(cluster), 0)
+    // Neither node has waited out its retry interval
+    CU_ASSERT_EQUAL(riak_cluster_probe(cluster), 0)
+
+    riak_cluster_free(&cluster);
+    riak_config_free(&cfg);
+    CU_PASS("test_cluster_no_nodes passed")
+}
+
+void
+test_cluster_failover() {
+    test_node node;
+    memset(&node, '\0', sizeof(node));
+    CU_ASSERT_FATAL(test_node_listen(&node) == ERIAK_OK)
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster *cluster = NULL;
+    err = riak_cluster_new(cfg, &cluster, RIAK_CLUSTER_LATENCY_WEIGHTED);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_cluster_add_node(cluster, "localhost", "1", NULL, 1, 2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_cluster_add_node(cluster, "127.0.0.1", node.portnum, NULL, 0, 2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    // The unreachable node could not pre-open its connection
+    CU_ASSERT_EQUAL(riak_cluster_get_n_up(cluster), 1)
+
+    riak_connection *cxn1 = NULL;
+    riak_connection *cxn2 = NULL;
+    riak_connection *cxn3 = NULL;
+    err = riak_cluster_checkout(cluster, &cxn1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_cluster_checkout(cluster, &cxn2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_PTR_EQUAL(riak_connection_get_pool(cxn1), riak_connection_get_pool(cxn2))
+    err = riak_cluster_checkout(cluster, &cxn3);
+    CU_ASSERT_EQUAL(err, ERIAK_NO_NODES)
+    riak_cluster_checkin(cluster, &cxn1, ERIAK_OK);
+    riak_cluster_checkin(cluster, &cxn2, ERIAK_OK);
+    CU_ASSERT_PTR_NULL(cxn1)
+    CU_ASSERT_PTR_NULL(cxn2)
+    CU_ASSERT_EQUAL(riak_cluster_get_n_up(cluster), 1)
+
+    riak_cluster_free(&cluster);
+    riak_config_free(&cfg);
+    close(node.listener);
+    CU_PASS("test_cluster_failover passed")
+}
+
+void
+test_cluster_checkin_marks_down() {
+    test_node node;
+    memset(&node, '\0', sizeof(node));
+    CU_ASSERT_FATAL(test_node_listen(&node) == ERIAK_OK)
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster *cluster = NULL;
+    err = riak_cluster_new(cfg, &cluster, RIAK_CLUSTER_LEAST_OUTSTANDING);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster_set_retry_interval(cluster, 0);
+    err = riak_cluster_add_node(cluster, "127.0.0.1", node.portnum, NULL, 1, 1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    riak_connection *cxn = NULL;
+    err = riak_cluster_checkout(cluster, &cxn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster_checkin(cluster, &cxn, ERIAK_READ);
+    CU_ASSERT_EQUAL(riak_cluster_get_n_up(cluster), 0)
+    err = riak_cluster_checkout(cluster, &cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_NO_NODES)
+
+    riak_cluster_free(&cluster);
+    riak_config_free(&cfg);
+    close(node.listener);
+    CU_PASS("test_cluster_checkin_marks_down passed")
+}
+
+void
+test_cluster_hedged_get() {
+    // One node answers GETs at once, the other reads them and stays silent
+    test_node slow;
+    test_node fast;
+    memset(&slow, '\0', sizeof(slow));
+    memset(&fast, '\0', sizeof(fast));
+    slow.silent = RIAK_TRUE;
+    fast.msgid  = MSG_RPBGETRESP;
+    CU_ASSERT_FATAL(test_node_start(&slow) == ERIAK_OK)
+    CU_ASSERT_FATAL(test_node_start(&fast) == ERIAK_OK)
+
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster *cluster = NULL;
+    err = riak_cluster_new(cfg, &cluster, RIAK_CLUSTER_ROUND_ROBIN);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_cluster_add_node(cluster, "127.0.0.1", fast.portnum, NULL, 0, 1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_cluster_add_node(cluster, "127.0.0.1", slow.portnum, NULL, 0, 1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    CU_ASSERT_EQUAL(riak_cluster_get_hedge_delay(cluster), -1)
+    CU_ASSERT_EQUAL(riak_cluster_set_hedge_policy(cluster, 101, 20), ERIAK_OUT_OF_RANGE)
+    err = riak_cluster_set_hedge_policy(cluster, 95, 20);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    // Too few GETs have been timed for the percentile to count
+    CU_ASSERT_EQUAL(riak_cluster_get_hedge_delay(cluster), 20)
+
+    riak_binary *bucket = riak_binary_copy_from_string(cfg, "bucket");
+    riak_binary *key    = riak_binary_copy_from_string(cfg, "key");
+    riak_get_response *response = NULL;
+    // Round-robin starts with the second node, which never answers
+    riak_uint64_t start = riak_time_usecs();
+    err = riak_cluster_get(cluster, NULL, bucket, key, NULL, &response);
+    riak_uint64_t elapsed = riak_time_usecs() - start;
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_PTR_NOT_NULL(response)
+    CU_ASSERT(elapsed >= 20000 && elapsed < 5000000)
+    CU_ASSERT(slow.requests > 0)
+    CU_ASSERT(fast.requests > 0)
+    // The silent node's connection was closed, not returned to its pool
+    CU_ASSERT_EQUAL(riak_cluster_get_n_up(cluster), 2)
+    test_node_stop(&slow);
+
+    riak_get_response_free(cfg, &response);
+    riak_binary_free(cfg, &bucket);
+    riak_binary_free(cfg, &key);
+    riak_cluster_free(&cluster);
+    test_node_stop(&fast);
+    riak_config_free(&cfg);
+    CU_PASS("test_cluster_hedged_get passed")
+}
+
+void
+test_cluster_latency_sample() {
+    test_node server;
+    memset(&server, '\0', sizeof(server));
+    server.msgid = MSG_RPBGETRESP;
+    CU_ASSERT_FATAL(test_node_start(&server) == ERIAK_OK)
+
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster *cluster = NULL;
+    err = riak_cluster_new(cfg, &cluster, RIAK_CLUSTER_LATENCY_WEIGHTED);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_cluster_add_node(cluster, "127.0.0.1", server.portnum, NULL, 1, 1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    riak_connection *cxn = NULL;
+    err = riak_cluster_checkout(cluster, &cxn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_cluster_node *node = riak_cluster_find_node(cluster, cxn);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(node)
+    // Holding a connection without using it is not a sample
+    usleep(50000);
+    riak_cluster_checkin(cluster, &cxn, ERIAK_OK);
+    CU_ASSERT_EQUAL(node->latency_usecs, 0)
+
+    riak_binary *bucket = riak_binary_copy_from_string(cfg, "bucket");
+    riak_binary *key    = riak_binary_copy_from_string(cfg, "key");
+    riak_get_response *response = NULL;
+    err = riak_cluster_checkout(cluster, &cxn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    usleep(50000);
+    err = riak_get(cxn, NULL, bucket, key, NULL, &response);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    usleep(50000);
+    riak_cluster_checkin(cluster, &cxn, ERIAK_OK);
+    // The 1/8 weighted sample is the prompt loopback answer, not the 100ms the connection was held
+    CU_ASSERT(node->latency_usecs < 100000 / 8)
+    CU_ASSERT(server.requests > 0)
+
+    riak_get_response_free(cfg, &response);
+    riak_binary_free(cfg, &bucket);
+    riak_binary_free(cfg, &key);
+    riak_cluster_free(&cluster);
+    test_node_stop(&server);
+    riak_config_free(&cfg);
+    CU_PASS("test_cluster_latency_sample passed")
+}
@@ -0,0 +1,227 @@
+/*********************************************************************
+ *
+ * test_completion_queue.c: Riak C Unit testing for the completion queue
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_operation-internal.h"
+
+#define TEST_CQ_THREADS     4
+#define TEST_CQ_PER_THREAD 25
+#define TEST_CQ_OPS        (TEST_CQ_THREADS*TEST_CQ_PER_THREAD)
+
+// In-memory stand-in for a socket
+typedef struct _test_cq_wire {
+    riak_uint8_t buf[4096];
+    riak_size_t  len;
+    riak_size_t  pos;
+} test_cq_wire;
+
+static riak_ssize_t
+test_cq_write_cb(void       *ptr,
+                 void       *data,
+                 riak_size_t size) {
+    test_cq_wire *wire = (test_cq_wire*)ptr;
+    if (wire->len + size > sizeof(wire->buf)) {
+        return 0;
+    }
+    memcpy(wire->buf + wire->len, data, size);
+    wire->len += size;
+    return size;
+}
+
+static riak_ssize_t
+test_cq_read_cb(void       *ptr,
+                void       *data,
+                riak_size_t size) {
+    test_cq_wire *wire = (test_cq_wire*)ptr;
+    riak_size_t remaining = wire->len - wire->pos;
+    if (size > remaining) {
+        size = remaining;
+    }
+    memcpy(data, wire->buf + wire->pos, size);
+    wire->pos += size;
+    return size;
+}
+
+static riak_error
+test_cq_send(riak_operation *rop,
+             void           *ptr) {
+    return riak_pipeline_send(rop, test_cq_write_cb, ptr);
+}
+
+static riak_error
+test_cq_refuse(riak_operation *rop,
+               void           *ptr) {
+    return ERIAK_WRITE;
+}
+
+typedef struct _test_cq_producer {
+    riak_completion_queue *cq;
+    riak_connection       *cxn;
+    int                    first_tag;
+} test_cq_producer;
+
+static void
+test_cq_submit(riak_completion_queue *cq,
+               riak_connection       *cxn,
+               int                    tag) {
+    riak_operation *rop = NULL;
+    riak_error err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_completion_queue_submit(cq, rop, (void*)(intptr_t)tag);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+}
+
+static void*
+test_cq_producer_thread(void *ptr) {
+    test_cq_producer *producer = (test_cq_producer*)ptr;
+    int i;
+    for(i = 0; i < TEST_CQ_PER_THREAD; i++) {
+        test_cq_submit(producer->cq, producer->cxn, producer->first_tag + i);
+    }
+    return NULL;
+}
+
+void
+test_completion_queue_submit_and_harvest() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    riak_completion_queue *cq = NULL;
+    err = riak_completion_queue_new(&cq, cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // Several threads submit at once
+    pthread_t        threads[TEST_CQ_THREADS];
+    test_cq_producer producers[TEST_CQ_THREADS];
+    int i;
+    for(i = 0; i < TEST_CQ_THREADS; i++) {
+        producers[i].cq        = cq;
+        producers[i].cxn       = cxn;
+        producers[i].first_tag = i * TEST_CQ_PER_THREAD;
+        CU_ASSERT_FATAL(pthread_create(&(threads[i]), NULL, test_cq_producer_thread, &(producers[i])) == 0)
+    }
+    for(i = 0; i < TEST_CQ_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // The wakeup descriptor stays readable until the I/O thread takes the submissions
+    struct pollfd pfd = { riak_completion_queue_get_fd(cq), POLLIN, 0 };
+    CU_ASSERT_EQUAL(poll(&pfd, 1, 0), 1)
+    test_cq_wire wire;
+    memset(&wire, '\0', sizeof(wire));
+    CU_ASSERT_EQUAL(riak_completion_queue_process(cq, test_cq_send, &wire), TEST_CQ_OPS)
+    CU_ASSERT_EQUAL(poll(&pfd, 1, 0), 0)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), TEST_CQ_OPS)
+    CU_ASSERT_EQUAL(wire.len, TEST_CQ_OPS * 5)
+
+    // Answer everything, with a server error in tenth place
+    riak_uint8_t pong[]  = { 0, 0, 0, 1, MSG_RPBPINGRESP };
+    riak_uint8_t error[] = { 0, 0, 0, 6, MSG_RPBERRORRESP, 0x0a, 0x01, 'x', 0x10, 0x01 };
+    wire.len = 0;
+    for(i = 0; i < TEST_CQ_OPS; i++) {
+        if (i == 9) {
+            test_cq_write_cb(&wire, error, sizeof(error));
+        } else {
+            test_cq_write_cb(&wire, pong, sizeof(pong));
+        }
+    }
+    err = riak_pipeline_read(cxn, test_cq_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+
+    // Nothing is visible until the I/O thread publishes
+    riak_completion completions[TEST_CQ_OPS];
+    CU_ASSERT_EQUAL(riak_completion_queue_poll(cq, completions, TEST_CQ_OPS), 0)
+    CU_ASSERT_EQUAL(riak_completion_queue_process(cq, test_cq_send, &wire), 0)
+    riak_uint32_t harvested = riak_completion_queue_wait(cq, completions, 64, 1000);
+    CU_ASSERT_EQUAL(harvested, 64)
+    harvested += riak_completion_queue_poll(cq, completions + harvested, TEST_CQ_OPS);
+    CU_ASSERT_EQUAL(harvested, TEST_CQ_OPS)
+
+    int seen[TEST_CQ_OPS];
+    int errors = 0;
+    memset(seen, '\0', sizeof(seen));
+    for(i = 0; i < TEST_CQ_OPS; i++) {
+        int tag = (int)(intptr_t)completions[i].tag;
+        CU_ASSERT_FATAL(tag >= 0 && tag < TEST_CQ_OPS)
+        seen[tag]++;
+        if (completions[i].err == ERIAK_SERVER_ERROR) {
+            // The server's code and message outlive the operation
+            riak_server_error *error = (riak_server_error*)completions[i].response;
+            CU_ASSERT_FATAL(error != NULL)
+            CU_ASSERT_EQUAL(riak_server_error_get_errcode(error), 1)
+            riak_binary *errmsg = riak_server_error_get_errmsg(error);
+            CU_ASSERT(riak_binary_len(errmsg) == 1 && riak_binary_data(errmsg)[0] == 'x')
+            riak_server_error_free(cfg, &error);
+            errors++;
+        } else {
+            CU_ASSERT_EQUAL(completions[i].err, ERIAK_OK)
+            CU_ASSERT(completions[i].response != NULL)
+            riak_ping_response *pong_response = (riak_ping_response*)completions[i].response;
+            riak_ping_response_free(cfg, &pong_response);
+        }
+    }
+    CU_ASSERT_EQUAL(errors, 1)
+    for(i = 0; i < TEST_CQ_OPS; i++) {
+        CU_ASSERT_EQUAL(seen[i], 1)
+    }
+
+    // Operations dropped with their connection still complete
+    test_cq_submit(cq, cxn, 1);
+    test_cq_submit(cq, cxn, 2);
+    CU_ASSERT_EQUAL(riak_completion_queue_process(cq, test_cq_send, &wire), 2)
+    CU_ASSERT_EQUAL(riak_pipeline_fail(cxn, ERIAK_READ), 2)
+    CU_ASSERT_EQUAL(riak_completion_queue_process(cq, test_cq_send, &wire), 0)
+    CU_ASSERT_EQUAL(riak_completion_queue_poll(cq, completions, TEST_CQ_OPS), 2)
+    CU_ASSERT_EQUAL(completions[0].err, ERIAK_READ)
+    CU_ASSERT_EQUAL(completions[1].err, ERIAK_READ)
+
+    // So do operations which could not be sent
+    test_cq_submit(cq, cxn, 3);
+    CU_ASSERT_EQUAL(riak_completion_queue_process(cq, test_cq_refuse, NULL), 0)
+    CU_ASSERT_EQUAL(riak_completion_queue_poll(cq, completions, TEST_CQ_OPS), 1)
+    CU_ASSERT_EQUAL(completions[0].err, ERIAK_WRITE)
+    CU_ASSERT_EQUAL((int)(intptr_t)completions[0].tag, 3)
+
+    CU_ASSERT_EQUAL(riak_completion_queue_wait(cq, completions, TEST_CQ_OPS, 10), 0)
+
+    riak_completion_queue_free(&cq);
+    CU_ASSERT(cq == NULL)
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_completion_queue_submit_and_harvest passed")
+}
@@ -91,6 +91,53 @@ test_config_with_logging() {
     CU_PASS("test_config_with_logging passed")
 }
 
+static void
+test_counting_logger(void            *ptr,
+                     riak_log_level_t level,
+                     const char      *file,
+                     riak_size_t      filelen,
+                     const char      *func,
+                     riak_size_t      funclen,
+                     riak_uint32_t    line,
+                     const char      *format,
+                     va_list          args) {
+    int *logged = (int*)ptr;
+    (*logged)++;
+}
+
+void
+test_config_log_level() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    // Nothing is formatted, or even evaluated, without a log function
+    int evaluated = 0;
+    CU_ASSERT_FALSE(riak_log_is_enabled(cfg, RIAK_LOG_EMERG))
+    riak_log_error_config(cfg, "%d", evaluated++);
+    CU_ASSERT_EQUAL(evaluated, 0)
+
+    int logged = 0;
+    err = riak_config_set_logging(cfg, &logged, test_counting_logger, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT(riak_log_is_enabled(cfg, RIAK_LOG_DEBUG))
+    err = riak_config_set_log_level(cfg, RIAK_LOG_UNKNOWN);
+    CU_ASSERT_EQUAL(err, ERIAK_OUT_OF_RANGE)
+    err = riak_config_set_log_level(cfg, RIAK_LOG_WARN);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT(riak_log_is_enabled(cfg, RIAK_LOG_WARN))
+    CU_ASSERT_FALSE(riak_log_is_enabled(cfg, RIAK_LOG_NOTICE))
+
+    riak_log_notice_config(cfg, "%d", evaluated++);
+    CU_ASSERT_EQUAL(evaluated, 0)
+    CU_ASSERT_EQUAL(logged, 0)
+    riak_log_error_config(cfg, "%d", evaluated++);
+    CU_ASSERT_EQUAL(evaluated, 1)
+    CU_ASSERT_EQUAL(logged, 1)
+
+    riak_config_free(&cfg);
+    CU_PASS("test_config_log_level passed")
+}
+
 //
 // Internally riak_config_new() uses this allocator
 // to bootstrap itself
@@ -148,3 +195,65 @@ test_config_free() {
     CU_ASSERT_FATAL(passes == RIAK_TRUE)
     CU_PASS("test_config_free passed")
 }
+
+void
+test_config_arena() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_config *arena;
+    err = riak_config_new_arena(cfg, &arena, 256);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_PTR_NOT_NULL(arena->pb_allocator)
+
+    // Consecutive small allocations share a block and stay aligned
+    riak_uint8_t *first  = (riak_uint8_t*)riak_config_allocate(arena, 10);
+    riak_uint8_t *second = (riak_uint8_t*)riak_config_clean_allocate(arena, 20);
+    CU_ASSERT_FATAL(first != NULL && second != NULL)
+    CU_ASSERT_EQUAL(second - first, 16)
+    CU_ASSERT_EQUAL(second[19], 0)
+    // Oversized requests get their own block
+    void *big = riak_config_allocate(arena, 1000);
+    CU_ASSERT_PTR_NOT_NULL(big)
+    void *third = riak_config_allocate(arena, 8);
+    CU_ASSERT_EQUAL((riak_uint8_t*)third - first, 48)
+    CU_ASSERT_EQUAL(riak_config_arena_get_allocated(arena), 16 + 32 + 1008 + 16)
+
+    // Individual frees are no-ops that only NULL the pointer
+    riak_free(arena, &first);
+    CU_ASSERT_PTR_NULL(first)
+    riak_config_arena_reset(arena);
+    CU_ASSERT_EQUAL(riak_config_arena_get_allocated(arena), 0)
+    CU_ASSERT_EQUAL(riak_config_arena_get_allocated(cfg), 0)
+
+    riak_config_free(&arena);
+    CU_ASSERT_PTR_NULL(arena)
+    riak_config_free(&cfg);
+    CU_PASS("test_config_arena passed")
+}
+
+void
+test_config_arena_nested() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_config *parent;
+    err = riak_config_new_arena(cfg, &parent, 256);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_config *child;
+    err = riak_config_new_arena(parent, &child, 256);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // The child draws on the real allocator, not on its parent's blocks
+    void *ptr = riak_config_allocate(child, 10);
+    CU_ASSERT_PTR_NOT_NULL(ptr)
+    CU_ASSERT_EQUAL(riak_config_arena_get_allocated(child), 16)
+    CU_ASSERT_EQUAL(riak_config_arena_get_allocated(parent), 0)
+
+    // Either may go first
+    riak_config_free(&parent);
+    riak_config_free(&child);
+    CU_ASSERT_PTR_NULL(child)
+    riak_config_free(&cfg);
+    CU_PASS("test_config_arena_nested passed")
+}
@@ -24,13 +24,16 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <string.h>
+#include <pthread.h>
 #include <netinet/in.h>
 #include <CUnit/CUnit.h>
 #include <CUnit/Automated.h>
 #include <CUnit/Basic.h>
 #include "riak.h"
 #include "riak.pb-c.h"
+#include "riak_messages-internal.h"
 #include "riak_connection-internal.h"
+#include "test.h"
 
 static int
 test_connection_bad_resolver(const char          *nodename,
@@ -104,3 +107,133 @@ test_connection_with_good_resolver() {
     riak_config_free(&cfg);
     CU_PASS("test_config_with_connection passed")
 }
+
+void
+test_connection_buffer_cache() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    riak_buffer_stats stats;
+    riak_uint8_t *small = riak_connection_buffer_get(cxn, 100);
+    CU_ASSERT_FATAL(small != NULL)
+    riak_connection_buffer_put(cxn, &small, 100);
+    CU_ASSERT_PTR_NULL(small)
+    // Same size class, so the first buffer comes back
+    small = riak_connection_buffer_get(cxn, 200);
+    riak_uint8_t *medium = riak_connection_buffer_get(cxn, 2000);
+    riak_uint8_t *huge   = riak_connection_buffer_get(cxn, 2*1024*1024);
+    CU_ASSERT_FATAL(medium != NULL && huge != NULL)
+    riak_connection_get_buffer_stats(cxn, &stats);
+    CU_ASSERT_EQUAL(stats.heap_allocs, 3)
+    CU_ASSERT_EQUAL(stats.reuses, 1)
+    CU_ASSERT_EQUAL(stats.heap_frees, 0)
+
+    // Oversized buffers are never cached
+    riak_connection_buffer_put(cxn, &small, 200);
+    riak_connection_buffer_put(cxn, &medium, 2000);
+    riak_connection_buffer_put(cxn, &huge, 2*1024*1024);
+    riak_connection_get_buffer_stats(cxn, &stats);
+    CU_ASSERT_EQUAL(stats.heap_frees, 1)
+
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_connection_buffer_cache passed")
+}
+
+void
+test_connection_retry() {
+    // A node which hangs up on the first request, answers the resent GET, then hangs up on the PUT
+    test_node server;
+    memset(&server, '\0', sizeof(server));
+    server.connections = 2;
+    server.msgid       = MSG_RPBGETRESP;
+    server.hangups     = (1 << 0)|(1 << 2);
+
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_config_set_retry_policy(cfg, 0, 1, 5), ERIAK_OUT_OF_RANGE)
+    err = riak_config_set_retry_policy(cfg, 3, 1, 5);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    // Every connect is refused, each after a short backoff
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "127.0.0.1", "1", NULL);
+    CU_ASSERT_EQUAL(err, ERIAK_CONNECT)
+    riak_connection_free(&cxn);
+
+    CU_ASSERT_FATAL(test_node_start(&server) == ERIAK_OK)
+    err = riak_connection_new(cfg, &cxn, "127.0.0.1", server.portnum, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // The GET is resent on a new socket after the hang-up
+    riak_binary *bucket = riak_binary_copy_from_string(cfg, "bucket");
+    riak_binary *key    = riak_binary_copy_from_string(cfg, "key");
+    riak_get_response *get_response = NULL;
+    err = riak_get(cxn, NULL, bucket, key, NULL, &get_response);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_PTR_NOT_NULL(get_response)
+    CU_ASSERT_EQUAL(server.requests, 2)
+
+    // A PUT without a vclock could be applied twice, so it is not
+    riak_object *obj = riak_object_new(cfg);
+    CU_ASSERT_FATAL(obj != NULL)
+    riak_object_set_bucket(cfg, obj, bucket);
+    riak_object_set_key(cfg, obj, key);
+    riak_object_set_value(cfg, obj, key);
+    riak_put_response *put_response = NULL;
+    err = riak_put(cxn, obj, NULL, &put_response);
+    CU_ASSERT_EQUAL(err, ERIAK_READ)
+    test_node_stop(&server);
+    CU_ASSERT_EQUAL(server.requests, 3)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+
+    riak_object_free(cfg, &obj);
+    riak_get_response_free(cfg, &get_response);
+    riak_binary_free(cfg, &bucket);
+    riak_binary_free(cfg, &key);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_connection_retry passed")
+}
+
+void
+test_connection_arena_responses() {
+    // Every request is answered with an empty response of the matching type
+    test_node server;
+    memset(&server, '\0', sizeof(server));
+    CU_ASSERT_FATAL(test_node_start(&server) == ERIAK_OK)
+
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_config *arena;
+    err = riak_config_new_arena(cfg, &arena, 0);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "127.0.0.1", server.portnum, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection_set_response_config(cxn, arena);
+
+    // Responses decoded into the arena must be released through it, not the parent
+    err = riak_ping(cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    riak_binary *bucket = riak_binary_copy_from_string(cfg, "bucket");
+    riak_binary *key    = riak_binary_copy_from_string(cfg, "key");
+    err = riak_delete(cxn, NULL, bucket, key, NULL);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    err = riak_set_clientid(cxn, key);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(server.requests, 3)
+
+    riak_binary_free(cfg, &bucket);
+    riak_binary_free(cfg, &key);
+    riak_connection_free(&cxn);
+    test_node_stop(&server);
+    riak_config_free(&arena);
+    riak_config_free(&cfg);
+    CU_PASS("test_connection_arena_responses passed")
+}
@@ -0,0 +1,206 @@
+/*********************************************************************
+ *
+ * test_connection_pool.c: Riak C Unit testing for riak_connection_pool
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+
+/**
+ * @brief Listen on an ephemeral loopback port so connect() succeeds without a Riak node
+ * @param portnum Returned port number as a string
+ * @param len Size of `portnum`
+ * @returns Listening socket or -1
+ */
+static riak_socket_t
+test_connection_pool_listen(char *portnum,
+                            int   len) {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    memset(&addr, '\0', sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    riak_socket_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(sock, 16) != 0 ||
+        getsockname(sock, (struct sockaddr*)&addr, &addrlen) != 0) {
+        close(sock);
+        return -1;
+    }
+    snprintf(portnum, len, "%d", ntohs(addr.sin_port));
+    return sock;
+}
+
+void
+test_connection_pool_bad_bounds() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection_pool *pool = NULL;
+    err = riak_connection_pool_new(cfg, &pool, "localhost", "1", NULL, 2, 1);
+    CU_ASSERT_EQUAL(err, ERIAK_INVALID)
+    CU_ASSERT_PTR_NULL(pool)
+    err = riak_connection_pool_new(cfg, &pool, "localhost", "1", NULL, 0, 0);
+    CU_ASSERT_EQUAL(err, ERIAK_INVALID)
+    CU_ASSERT_PTR_NULL(pool)
+    riak_config_free(&cfg);
+    CU_PASS("test_connection_pool_bad_bounds passed")
+}
+
+void
+test_connection_pool_unreachable() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection_pool *pool = NULL;
+    err = riak_connection_pool_new(cfg, &pool, "localhost", "1", NULL, 0, 4);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_pool_checkout(pool, &cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_CONNECT)
+    CU_ASSERT_PTR_NULL(cxn)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 0)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_busy(pool), 0)
+    riak_connection_pool_free(&pool);
+    riak_config_free(&cfg);
+    CU_PASS("test_connection_pool_unreachable passed")
+}
+
+void
+test_connection_pool_checkout_checkin() {
+    char portnum[16];
+    riak_socket_t listener = test_connection_pool_listen(portnum, sizeof(portnum));
+    CU_ASSERT_FATAL(listener >= 0)
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection_pool *pool = NULL;
+    err = riak_connection_pool_new(cfg, &pool, "127.0.0.1", portnum, NULL, 1, 2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 1)
+
+    riak_connection *cxn1 = NULL;
+    riak_connection *cxn2 = NULL;
+    riak_connection *cxn3 = NULL;
+    err = riak_connection_pool_checkout(pool, &cxn1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_PTR_EQUAL(riak_connection_get_pool(cxn1), pool)
+    err = riak_connection_pool_checkout(pool, &cxn2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_PTR_NOT_EQUAL(cxn1, cxn2)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 2)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_busy(pool), 2)
+    err = riak_connection_pool_checkout(pool, &cxn3);
+    CU_ASSERT_EQUAL(err, ERIAK_POOL_EXHAUSTED)
+
+    // Healthy connections are recycled, broken ones are evicted
+    riak_connection_pool_checkin(pool, &cxn1, ERIAK_OK);
+    CU_ASSERT_PTR_NULL(cxn1)
+    riak_connection_pool_checkin(pool, &cxn2, ERIAK_READ);
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 1)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_busy(pool), 0)
+
+    // Grow again past the minimum, then shrink back down
+    err = riak_connection_pool_checkout(pool, &cxn1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_connection_pool_checkout(pool, &cxn2);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 2)
+    riak_connection_pool_checkin(pool, &cxn1, ERIAK_OK);
+    riak_connection_pool_checkin(pool, &cxn2, ERIAK_OK);
+    CU_ASSERT_EQUAL(riak_connection_pool_shrink(pool), 1)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 1)
+
+    riak_connection_pool_free(&pool);
+    riak_config_free(&cfg);
+    close(listener);
+    CU_PASS("test_connection_pool_checkout_checkin passed")
+}
+
+// Connections closed by one test_connection_pool_shrinker thread
+typedef struct _test_connection_pool_shrinker {
+    riak_connection_pool *pool;
+    riak_uint32_t         closed;
+} test_connection_pool_shrinker;
+
+static void*
+test_connection_pool_shrink_thread(void *ptr) {
+    test_connection_pool_shrinker *shrinker = (test_connection_pool_shrinker*)ptr;
+    shrinker->closed = riak_connection_pool_shrink(shrinker->pool);
+    return NULL;
+}
+
+void
+test_connection_pool_shrink_race() {
+    char portnum[16];
+    riak_socket_t listener = test_connection_pool_listen(portnum, sizeof(portnum));
+    CU_ASSERT_FATAL(listener >= 0)
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection_pool *pool = NULL;
+    err = riak_connection_pool_new(cfg, &pool, "127.0.0.1", portnum, NULL, 2, 12);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // Open every slot, then hand them all back idle
+    riak_connection *cxns[12];
+    int i;
+    for(i = 0; i < 12; i++) {
+        err = riak_connection_pool_checkout(pool, &(cxns[i]));
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    for(i = 0; i < 12; i++) {
+        riak_connection_pool_checkin(pool, &(cxns[i]), ERIAK_OK);
+    }
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 12)
+
+    // Shrinking at once from several threads never goes below the minimum
+    test_connection_pool_shrinker shrinkers[4];
+    pthread_t threads[4];
+    for(i = 0; i < 4; i++) {
+        shrinkers[i].pool   = pool;
+        shrinkers[i].closed = 0;
+        CU_ASSERT_FATAL(pthread_create(&(threads[i]), NULL, test_connection_pool_shrink_thread, &(shrinkers[i])) == 0)
+    }
+    riak_uint32_t closed = 0;
+    for(i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        closed += shrinkers[i].closed;
+    }
+    CU_ASSERT_EQUAL(closed, 10)
+    CU_ASSERT_EQUAL(riak_connection_pool_get_n_open(pool), 2)
+
+    riak_connection_pool_free(&pool);
+    riak_config_free(&cfg);
+    close(listener);
+    CU_PASS("test_connection_pool_shrink_race passed")
+}
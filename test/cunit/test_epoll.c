@@ -0,0 +1,250 @@
+/*********************************************************************
+ *
+ * test_epoll.c: Riak C Unit testing for the epoll reactor
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_epoll.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+#include "test.h"
+
+typedef struct _test_epoll_state {
+    riak_config *cfg;
+    int          delivered;
+} test_epoll_state;
+
+static void
+test_epoll_response_cb(void *response,
+                       void *ptr) {
+    test_epoll_state   *state = (test_epoll_state*)ptr;
+    riak_ping_response *pong  = (riak_ping_response*)response;
+    state->delivered++;
+    riak_ping_response_free(state->cfg, &pong);
+}
+
+void
+test_epoll_pipeline() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    cxn->fd = sv[0];
+
+    riak_epoll            *ep    = NULL;
+    riak_epoll_connection *econn = NULL;
+    err = riak_epoll_new(&ep, cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_epoll_connection_new(&econn, ep, cxn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    test_epoll_state state = { cfg, 0 };
+    int i;
+    for(i = 0; i < 3; i++) {
+        riak_operation *rop = NULL;
+        err = riak_operation_new(cxn, &rop, NULL, NULL, &state);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_async_register_ping(rop, test_epoll_response_cb);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_epoll_send(rop, econn);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    CU_ASSERT_EQUAL(riak_epoll_get_pending(ep), 3)
+
+    // Nothing reaches the socket until the reactor runs, then all three go out together
+    riak_uint8_t wire[64];
+    CU_ASSERT_EQUAL(recv(sv[1], wire, sizeof(wire), MSG_DONTWAIT), -1)
+    err = riak_epoll_run_once(ep, 0);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(recv(sv[1], wire, sizeof(wire), MSG_DONTWAIT), 15)
+
+    // Answer with the second pong cut short
+    riak_uint8_t pongs[] = { 0, 0, 0, 1, MSG_RPBPINGRESP,
+                             0, 0, 0, 1, MSG_RPBPINGRESP,
+                             0, 0, 0, 1, MSG_RPBPINGRESP };
+    CU_ASSERT_EQUAL(write(sv[1], pongs, 7), 7)
+    err = riak_epoll_run_once(ep, 1000);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(state.delivered, 1)
+    CU_ASSERT_EQUAL(riak_epoll_get_pending(ep), 2)
+
+    CU_ASSERT_EQUAL(write(sv[1], pongs + 7, sizeof(pongs) - 7), sizeof(pongs) - 7)
+    err = riak_epoll_run(ep);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(state.delivered, 3)
+    CU_ASSERT_EQUAL(riak_epoll_get_pending(ep), 0)
+    CU_ASSERT_EQUAL(riak_epoll_connection_get_error(econn), ERIAK_OK)
+
+    // A hang-up while idle is noticed and refuses further requests
+    close(sv[1]);
+    err = riak_epoll_run_once(ep, 1000);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_epoll_connection_get_error(econn), ERIAK_READ)
+    riak_operation *rop = NULL;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, &state);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_epoll_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_epoll_send(rop, econn);
+    CU_ASSERT_EQUAL(err, ERIAK_READ)
+    riak_operation_free(&rop);
+
+    // Detaching hands back a blocking socket
+    riak_epoll_connection_free(&econn);
+    CU_ASSERT(econn == NULL)
+    CU_ASSERT_EQUAL(fcntl(sv[0], F_GETFL, 0) & O_NONBLOCK, 0)
+    riak_epoll_free(&ep);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_epoll_pipeline passed")
+}
+
+static void
+test_epoll_abandon_cb(riak_error err,
+                      void      *ptr) {
+    *((riak_error*)ptr) = err;
+}
+
+void
+test_epoll_timeout() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    cxn->fd = sv[0];
+
+    riak_epoll            *ep    = NULL;
+    riak_epoll_connection *econn = NULL;
+    err = riak_epoll_new(&ep, cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_epoll_connection_new(&econn, ep, cxn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // Nobody answers, so the reactor wakes itself at the deadline rather than waiting forever
+    riak_error abandoned = ERIAK_OK;
+    riak_operation *rop = NULL;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, &abandoned);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_epoll_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_operation_set_abandon_cb(rop, test_epoll_abandon_cb);
+    riak_operation_set_timeout(rop, 20);
+    err = riak_epoll_send(rop, econn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_epoll_run(ep);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(abandoned, ERIAK_TIMEOUT)
+    CU_ASSERT_EQUAL(riak_epoll_get_pending(ep), 0)
+    CU_ASSERT_EQUAL(riak_epoll_connection_get_error(econn), ERIAK_TIMEOUT)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+
+    riak_epoll_connection_free(&econn);
+    riak_epoll_free(&ep);
+    close(sv[1]);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_epoll_timeout passed")
+}
+
+void
+test_epoll_retry() {
+    // A node which restarts while the first ping is in flight
+    test_node server;
+    memset(&server, '\0', sizeof(server));
+    server.connections = 2;
+    server.msgid       = MSG_RPBPINGRESP;
+    server.hangups     = (1 << 0);
+    CU_ASSERT_FATAL(test_node_start(&server) == ERIAK_OK)
+
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_config_set_retry_policy(cfg, 3, 500, 500);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "127.0.0.1", server.portnum, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    riak_epoll            *ep    = NULL;
+    riak_epoll_connection *econn = NULL;
+    err = riak_epoll_new(&ep, cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_epoll_connection_new(&econn, ep, cxn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    test_epoll_state state = { cfg, 0 };
+    riak_operation *rop = NULL;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, &state);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_epoll_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_epoll_send(rop, econn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_epoll_run_once(ep, 0);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+
+    // The hang-up schedules a retry rather than sleeping through the backoff
+    riak_uint64_t started = riak_time_usecs();
+    int i;
+    for(i = 0; i < 10 && !riak_connection_is_stale(cxn); i++) {
+        err = riak_epoll_run_once(ep, 100);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    CU_ASSERT(riak_connection_is_stale(cxn))
+    CU_ASSERT(riak_time_usecs() - started < 400000)
+    CU_ASSERT_EQUAL(riak_epoll_get_pending(ep), 1)
+    CU_ASSERT_EQUAL(riak_epoll_connection_get_error(econn), ERIAK_OK)
+
+    // The ping goes out again on a new socket and is answered
+    err = riak_epoll_run(ep);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(state.delivered, 1)
+    CU_ASSERT_EQUAL(server.requests, 2)
+    CU_ASSERT_EQUAL(riak_epoll_get_pending(ep), 0)
+    CU_ASSERT_EQUAL(riak_epoll_connection_get_error(econn), ERIAK_OK)
+
+    riak_epoll_connection_free(&econn);
+    riak_epoll_free(&ep);
+    riak_connection_free(&cxn);
+    test_node_stop(&server);
+    riak_config_free(&cfg);
+    CU_PASS("test_epoll_retry passed")
+}
@@ -32,6 +32,26 @@
 #include "riak_operation-internal.h"
 #include "test.h"
 
+// Captured RpbGetResp frame (message id first) holding three siblings
+static riak_uint8_t test_get_response_frame[] = {
+    0x0a,0x0a,0x43,0x0a,0x0d,0x7b,0x22,0x62,0x61,0x72,0x22,0x3a,0x22,0x62,0x61,0x7a,
+    0x22,0x7d,0x12,0x10,0x61,0x70,0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,
+    0x6a,0x73,0x6f,0x6e,0x2a,0x16,0x31,0x70,0x66,0x49,0x76,0x38,0x51,0x52,0x74,0x6c,
+    0x31,0x36,0x65,0x64,0x4c,0x42,0x51,0x6b,0x68,0x54,0x7a,0x63,0x38,0xc2,0x86,0x9f,
+    0x95,0x05,0x40,0xec,0xf5,0x31,0x0a,0x43,0x0a,0x0d,0x7b,0x22,0x62,0x61,0x72,0x22,
+    0x3a,0x22,0x62,0x61,0x7a,0x22,0x7d,0x12,0x10,0x61,0x70,0x70,0x6c,0x69,0x63,0x61,
+    0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x2a,0x16,0x33,0x4b,0x5a,0x57,0x77,
+    0x6a,0x31,0x69,0x54,0x63,0x51,0x70,0x6f,0x58,0x37,0x74,0x36,0x50,0x6c,0x72,0x54,
+    0x53,0x38,0xbf,0x86,0x9f,0x95,0x05,0x40,0x80,0x85,0x29,0x0a,0x43,0x0a,0x0d,0x7b,
+    0x22,0x62,0x61,0x72,0x22,0x3a,0x22,0x62,0x61,0x7a,0x22,0x7d,0x12,0x10,0x61,0x70,
+    0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x2a,0x16,
+    0x33,0x4c,0x7a,0x56,0x6b,0x6f,0x4e,0x4f,0x73,0x39,0x62,0x73,0x4c,0x41,0x63,0x63,
+    0x6d,0x73,0x33,0x52,0x41,0x48,0x38,0xbc,0x86,0x9f,0x95,0x05,0x40,0xeb,0xdc,0x34,
+    0x12,0x23,0x6b,0xce,0x61,0x60,0x60,0x60,0xcc,0x60,0xca,0x05,0x52,0x1c,0x47,0x83,
+    0x36,0x72,0x07,0x65,0x9d,0xfd,0x96,0xc1,0x94,0xc8,0x9c,0xc7,0xca,0xe0,0x64,0x2f,
+    0x73,0x86,0x2f,0x0b,0x00
+};
+
 void
 test_get_options_r() {
     riak_config *cfg;
@@ -249,27 +269,9 @@ test_get_decode_response() {
     riak_operation_set_bucket(rop, &bucket);
     riak_operation_set_key(rop, &key);
 
-    riak_uint8_t bytes[] = {
-        0x0a,0x0a,0x43,0x0a,0x0d,0x7b,0x22,0x62,0x61,0x72,0x22,0x3a,0x22,0x62,0x61,0x7a,
-        0x22,0x7d,0x12,0x10,0x61,0x70,0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,
-        0x6a,0x73,0x6f,0x6e,0x2a,0x16,0x31,0x70,0x66,0x49,0x76,0x38,0x51,0x52,0x74,0x6c,
-        0x31,0x36,0x65,0x64,0x4c,0x42,0x51,0x6b,0x68,0x54,0x7a,0x63,0x38,0xc2,0x86,0x9f,
-        0x95,0x05,0x40,0xec,0xf5,0x31,0x0a,0x43,0x0a,0x0d,0x7b,0x22,0x62,0x61,0x72,0x22,
-        0x3a,0x22,0x62,0x61,0x7a,0x22,0x7d,0x12,0x10,0x61,0x70,0x70,0x6c,0x69,0x63,0x61,
-        0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x2a,0x16,0x33,0x4b,0x5a,0x57,0x77,
-        0x6a,0x31,0x69,0x54,0x63,0x51,0x70,0x6f,0x58,0x37,0x74,0x36,0x50,0x6c,0x72,0x54,
-        0x53,0x38,0xbf,0x86,0x9f,0x95,0x05,0x40,0x80,0x85,0x29,0x0a,0x43,0x0a,0x0d,0x7b,
-        0x22,0x62,0x61,0x72,0x22,0x3a,0x22,0x62,0x61,0x7a,0x22,0x7d,0x12,0x10,0x61,0x70,
-        0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x2a,0x16,
-        0x33,0x4c,0x7a,0x56,0x6b,0x6f,0x4e,0x4f,0x73,0x39,0x62,0x73,0x4c,0x41,0x63,0x63,
-        0x6d,0x73,0x33,0x52,0x41,0x48,0x38,0xbc,0x86,0x9f,0x95,0x05,0x40,0xeb,0xdc,0x34,
-        0x12,0x23,0x6b,0xce,0x61,0x60,0x60,0x60,0xcc,0x60,0xca,0x05,0x52,0x1c,0x47,0x83,
-        0x36,0x72,0x07,0x65,0x9d,0xfd,0x96,0xc1,0x94,0xc8,0x9c,0xc7,0xca,0xe0,0x64,0x2f,
-        0x73,0x86,0x2f,0x0b,0x00
-    };
     riak_pb_message    pb_response;
-    pb_response.data = bytes;
-    pb_response.len  = sizeof(bytes);
+    pb_response.data = test_get_response_frame;
+    pb_response.len  = sizeof(test_get_response_frame);
     riak_get_response *response = NULL;
     riak_boolean_t     done;
     err = riak_get_response_decode(rop, &pb_response, &response, &done);
@@ -300,6 +302,82 @@ test_get_decode_response() {
     CU_PASS("test_get_decode_response passed")
 }
 
+void
+test_get_view_decode_response() {
+    riak_config              *cfg;
+    riak_operation           *rop = NULL;
+    riak_connection          *cxn = NULL;
+
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_binary bucket;
+    bucket.data = (riak_uint8_t*)"test";
+    bucket.len = 4;
+    riak_binary key;
+    key.data = (riak_uint8_t*)"riakc";
+    key.len = 5;
+    riak_operation_set_bucket(rop, &bucket);
+    riak_operation_set_key(rop, &key);
+
+    // A frame still in the receive buffer is copied once, then viewed
+    riak_pb_message    pb_response;
+    pb_response.data = test_get_response_frame;
+    pb_response.len  = sizeof(test_get_response_frame);
+    riak_get_response *response = NULL;
+    riak_boolean_t     done;
+    err = riak_get_view_response_decode(rop, &pb_response, &response, &done);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(done, RIAK_TRUE)
+    CU_ASSERT_EQUAL(riak_get_get_has_vclock(response), RIAK_TRUE)
+    riak_binary *vclock = riak_get_get_vclock(response);
+    CU_ASSERT_EQUAL(riak_binary_len(vclock), 35)
+    CU_ASSERT_EQUAL(riak_binary_data(vclock)[0], 0x6b)
+    CU_ASSERT_EQUAL(riak_get_get_n_content(response), 3)
+    riak_uint8_t *frame = response->_frame;
+    CU_ASSERT_FATAL(frame != NULL)
+    CU_ASSERT(frame != test_get_response_frame)
+    riak_object **objects = riak_get_get_content(response);
+    for(int i = 0; i < riak_get_get_n_content(response); i++) {
+        riak_binary *value = riak_object_get_value(objects[i]);
+        CU_ASSERT_EQUAL_FATAL(memcmp(riak_binary_data(value), "{\"bar\":\"baz\"}", riak_binary_len(value)), 0)
+        CU_ASSERT(riak_binary_data(value) > frame)
+        CU_ASSERT(riak_binary_data(value) < frame + sizeof(test_get_response_frame))
+        CU_ASSERT_EQUAL(riak_binary_len(riak_object_get_content_type(objects[i])), 16)
+        CU_ASSERT_EQUAL(riak_binary_len(riak_object_get_key(objects[i])), 5)
+    }
+    riak_get_response_free(cfg, &response);
+
+    // A frame assembled in the operation is kept without copying
+    rop->msgbuf = (riak_uint8_t*)riak_config_allocate(cfg, sizeof(test_get_response_frame));
+    CU_ASSERT_FATAL(rop->msgbuf != NULL)
+    memcpy(rop->msgbuf, test_get_response_frame, sizeof(test_get_response_frame));
+    pb_response.data = rop->msgbuf;
+    err = riak_get_view_response_decode(rop, &pb_response, &response, &done);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT(response->_frame == pb_response.data)
+    CU_ASSERT(rop->msgbuf == NULL)
+    CU_ASSERT_EQUAL(riak_get_get_n_content(response), 3)
+
+    // Truncated frames are rejected
+    riak_get_response *truncated = NULL;
+    pb_response.data = test_get_response_frame;
+    pb_response.len  = 40;
+    err = riak_get_view_response_decode(rop, &pb_response, &truncated, &done);
+    CU_ASSERT_EQUAL(err, ERIAK_MESSAGE_FORMAT)
+    CU_ASSERT(truncated == NULL)
+
+    riak_operation_free(&rop);
+    riak_connection_free(&cxn);
+    riak_get_response_free(cfg, &response);
+    riak_config_free(&cfg);
+    CU_PASS("test_get_view_decode_response passed")
+}
+
 void
 test_integration_get_value() {
     riak_config     *cfg;
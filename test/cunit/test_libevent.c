@@ -0,0 +1,327 @@
+/*********************************************************************
+ *
+ * test_libevent.c: Riak C Unit testing for the libevent adapter
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_async.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_connection-internal.h"
+#include "test.h"
+
+// What the callbacks of a test ping were told
+typedef struct _test_libevent_state {
+    riak_config    *cfg;
+    riak_operation *rop;
+    int             answered;
+    int             errors;
+    riak_error      err;       // Operation error seen by the error callback
+    riak_error      abandoned; // Reason given to the abandon callback
+} test_libevent_state;
+
+static void
+test_libevent_response_cb(void *response,
+                          void *ptr) {
+    test_libevent_state *state = (test_libevent_state*)ptr;
+    riak_ping_response  *pong  = (riak_ping_response*)response;
+    state->answered++;
+    riak_ping_response_free(state->cfg, &pong);
+}
+
+static void
+test_libevent_error_cb(void *response,
+                       void *ptr) {
+    test_libevent_state *state = (test_libevent_state*)ptr;
+    CU_ASSERT_PTR_NULL(response)
+    state->errors++;
+    state->err = riak_operation_get_error(state->rop);
+}
+
+static void
+test_libevent_abandon_cb(riak_error err,
+                         void      *ptr) {
+    ((test_libevent_state*)ptr)->abandoned = err;
+}
+
+/**
+ * @brief Build a ping which records what became of it
+ */
+static riak_operation*
+test_libevent_ping(riak_connection     *cxn,
+                   test_libevent_state *state) {
+    riak_operation *rop = NULL;
+    riak_error err = riak_operation_new(cxn, &rop, NULL, NULL, state);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_libevent_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_operation_set_error_cb(rop, test_libevent_error_cb);
+    riak_operation_set_abandon_cb(rop, test_libevent_abandon_cb);
+    state->rop = rop;
+    return rop;
+}
+
+void
+test_libevent_pipeline_hangup() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0)|O_NONBLOCK);
+    cxn->fd = sv[0];
+    struct event_base *base = event_base_new();
+    CU_ASSERT_FATAL(base != NULL)
+    riak_libevent *rev = NULL;
+    err = riak_libevent_pipeline_new(&rev, cxn, base);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    test_libevent_state state = { cfg };
+    err = riak_libevent_pipeline_send(test_libevent_ping(cxn, &state), rev);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    // Take the request off the wire, then hang up
+    riak_uint8_t frame[5];
+    event_base_loop(base, EVLOOP_ONCE);
+    CU_ASSERT_EQUAL(recv(sv[1], frame, sizeof(frame), MSG_WAITALL), sizeof(frame))
+    close(sv[1]);
+    event_base_dispatch(base);
+    CU_ASSERT_EQUAL(state.abandoned, ERIAK_READ)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+
+    // Sending after the hang-up is refused rather than written to a freed bufferevent
+    test_libevent_state unused = { cfg };
+    riak_operation *rop = test_libevent_ping(cxn, &unused);
+    err = riak_libevent_pipeline_send(rop, rev);
+    CU_ASSERT_EQUAL(err, ERIAK_READ)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+    riak_operation_free(&rop);
+
+    riak_libevent_free(cfg, &rev);
+    event_base_free(base);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_libevent_pipeline_hangup passed")
+}
+
+void
+test_libevent_pipeline_desync() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0)|O_NONBLOCK);
+    cxn->fd = sv[0];
+    struct event_base *base = event_base_new();
+    CU_ASSERT_FATAL(base != NULL)
+    riak_libevent *rev = NULL;
+    err = riak_libevent_pipeline_new(&rev, cxn, base);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // An empty frame leaves the stream out of step
+    test_libevent_state state = { cfg };
+    err = riak_libevent_pipeline_send(test_libevent_ping(cxn, &state), rev);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_uint8_t empty[] = { 0, 0, 0, 0 };
+    CU_ASSERT_FATAL(write(sv[1], empty, sizeof(empty)) == sizeof(empty))
+    int i;
+    for(i = 0; i < 100 && state.abandoned == ERIAK_OK; i++) {
+        event_base_loop(base, EVLOOP_ONCE);
+    }
+    CU_ASSERT_EQUAL(state.abandoned, ERIAK_READ)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+
+    // Nothing more goes out, so a later request is never paired with a stray answer
+    test_libevent_state unused = { cfg };
+    riak_operation *rop = test_libevent_ping(cxn, &unused);
+    err = riak_libevent_pipeline_send(rop, rev);
+    CU_ASSERT_EQUAL(err, ERIAK_READ)
+    riak_operation_free(&rop);
+    riak_uint8_t frame[5];
+    CU_ASSERT_EQUAL(recv(sv[1], frame, sizeof(frame), MSG_DONTWAIT), sizeof(frame))
+    CU_ASSERT_EQUAL(recv(sv[1], frame, sizeof(frame), MSG_DONTWAIT), -1)
+
+    riak_libevent_free(cfg, &rev);
+    event_base_free(base);
+    close(sv[1]);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_libevent_pipeline_desync passed")
+}
+
+/**
+ * @brief Send one ping over a socketpair with the single-operation adapter
+ */
+static void
+test_libevent_send_ping(riak_connection     *cxn,
+                        struct event_base   *base,
+                        riak_libevent      **rev,
+                        test_libevent_state *state,
+                        riak_uint32_t        timeout_ms) {
+    riak_operation *rop = test_libevent_ping(cxn, state);
+    riak_operation_set_timeout(rop, timeout_ms);
+    riak_error err = riak_libevent_new(rev, rop, base);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_libevent_send(rop, *rev);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+}
+
+void
+test_libevent_send_timeout() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0)|O_NONBLOCK);
+    cxn->fd = sv[0];
+    struct event_base *base = event_base_new();
+    CU_ASSERT_FATAL(base != NULL)
+
+    // The server never answers, so the deadline ends the wait
+    riak_libevent *rev = NULL;
+    test_libevent_state state = { cfg };
+    riak_uint64_t started = riak_time_usecs();
+    test_libevent_send_ping(cxn, base, &rev, &state, 50);
+    event_base_dispatch(base);
+    CU_ASSERT_EQUAL(state.errors, 1)
+    CU_ASSERT_EQUAL(state.err, ERIAK_TIMEOUT)
+    CU_ASSERT(riak_time_usecs() - started >= 50000)
+    CU_ASSERT_EQUAL(riak_libevent_send(state.rop, rev), ERIAK_WRITE)
+
+    riak_operation_free(&(state.rop));
+    riak_libevent_free(cfg, &rev);
+    event_base_free(base);
+    close(sv[1]);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_libevent_send_timeout passed")
+}
+
+void
+test_libevent_send_read_error() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0)|O_NONBLOCK);
+    cxn->fd = sv[0];
+    struct event_base *base = event_base_new();
+    CU_ASSERT_FATAL(base != NULL)
+
+    // A frame which cannot be decoded reaches the error callback rather than vanishing
+    riak_libevent *rev = NULL;
+    test_libevent_state state = { cfg };
+    test_libevent_send_ping(cxn, base, &rev, &state, 0);
+    riak_uint8_t empty[] = { 0, 0, 0, 0 };
+    CU_ASSERT_FATAL(write(sv[1], empty, sizeof(empty)) == sizeof(empty))
+    int i;
+    for(i = 0; i < 100 && state.errors == 0; i++) {
+        event_base_loop(base, EVLOOP_ONCE);
+    }
+    CU_ASSERT_EQUAL(state.errors, 1)
+    CU_ASSERT_EQUAL(state.err, ERIAK_READ)
+
+    riak_operation_free(&(state.rop));
+    riak_libevent_free(cfg, &rev);
+    event_base_free(base);
+    close(sv[1]);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_libevent_send_read_error passed")
+}
+
+void
+test_libevent_pipeline_retry() {
+    // A node which restarts while the first ping is in flight
+    test_node server;
+    memset(&server, '\0', sizeof(server));
+    server.connections = 2;
+    server.msgid       = MSG_RPBPINGRESP;
+    server.hangups     = (1 << 0);
+    CU_ASSERT_FATAL(test_node_start(&server) == ERIAK_OK)
+
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_config_set_retry_policy(cfg, 3, 100, 100);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "127.0.0.1", server.portnum, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    evutil_make_socket_nonblocking(riak_connection_get_fd(cxn));
+    struct event_base *base = event_base_new();
+    CU_ASSERT_FATAL(base != NULL)
+    riak_libevent *rev = NULL;
+    err = riak_libevent_pipeline_new(&rev, cxn, base);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    test_libevent_state state = { cfg };
+    err = riak_libevent_pipeline_send(test_libevent_ping(cxn, &state), rev);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    // The hang-up schedules a retry; a send during the backoff waits for the new socket
+    int i;
+    for(i = 0; i < 100 && !riak_connection_is_stale(cxn); i++) {
+        event_base_loop(base, EVLOOP_ONCE);
+    }
+    CU_ASSERT_FATAL(riak_connection_is_stale(cxn))
+    err = riak_libevent_pipeline_send(test_libevent_ping(cxn, &state), rev);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 2)
+
+    // Both pings go out on the new socket and are answered
+    for(i = 0; i < 100 && riak_pipeline_get_depth(cxn) > 0; i++) {
+        event_base_loop(base, EVLOOP_ONCE);
+    }
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+    CU_ASSERT_EQUAL(state.answered, 2)
+    CU_ASSERT_EQUAL(state.abandoned, ERIAK_OK)
+    CU_ASSERT_EQUAL(server.requests, 3)
+    CU_ASSERT(!riak_connection_is_stale(cxn))
+
+    riak_libevent_free(cfg, &rev);
+    event_base_free(base);
+    riak_connection_free(&cxn);
+    test_node_stop(&server);
+    riak_config_free(&cfg);
+    CU_PASS("test_libevent_pipeline_retry passed")
+}
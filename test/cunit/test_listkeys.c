@@ -73,6 +73,80 @@ test_listkeys_response_decode() {
     CU_PASS("test_liskeys_response_decode passed")
 }
 
+typedef struct _test_listkeys_stream_state {
+    riak_int32_t   chunks;
+    riak_int32_t   keys;
+    riak_boolean_t done;
+    riak_boolean_t matched;
+} test_listkeys_stream_state;
+
+void
+test_listkeys_stream_cb(riak_listkeys_response *chunk,
+                        void                   *ptr) {
+    test_listkeys_stream_state *state = (test_listkeys_stream_state*)ptr;
+    riak_binary **keys = riak_listkeys_get_keys(chunk);
+    riak_uint32_t i;
+    for(i = 0; i < riak_listkeys_get_n_keys(chunk); i++) {
+        const char *expected = (state->keys == 0) ? "393310013865066496" : "bam";
+        if (memcmp(riak_binary_data(keys[i]), expected, riak_binary_len(keys[i])) != 0) {
+            state->matched = RIAK_FALSE;
+        }
+        state->keys++;
+    }
+    state->chunks++;
+    state->done = chunk->done;
+}
+
+void
+test_listkeys_stream_decode() {
+    riak_config     *cfg;
+    riak_operation  *rop = NULL;
+    riak_connection *cxn = NULL;
+
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    test_listkeys_stream_state state;
+    memset(&state, 0, sizeof(state));
+    state.matched = RIAK_TRUE;
+    riak_operation_set_stream_cb(rop, (riak_stream_callback)test_listkeys_stream_cb, &state);
+
+    riak_uint8_t bytes0[] = { 0x12,0x0a,0x12,0x33,0x39,0x33,0x33,0x31,0x30,0x30,0x31,0x33,0x38,0x36,0x35,0x30,0x36,0x36,0x34,0x39,0x36 };
+    riak_uint8_t bytes1[] = { 0x12,0x0a,0x03,0x62,0x61,0x6d };
+    riak_uint8_t bytes2[] = { 0x12,0x10,0x01 };
+    riak_uint8_t *bytes[] = { bytes0, bytes1, bytes2 };
+    riak_int32_t len[]    = { sizeof(bytes0), sizeof(bytes1), sizeof(bytes2) };
+
+    riak_pb_message         pb_response;
+    riak_listkeys_response *response = NULL;
+    riak_boolean_t          done = RIAK_FALSE;
+    for(int i = 0; i < 3; i++) {
+        pb_response.data = bytes[i];
+        pb_response.len  = len[i];
+        err = riak_listkeys_response_decode(rop, &pb_response, &response, &done);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        // Nothing is kept between chunks
+        CU_ASSERT_EQUAL(response == NULL, i < 2)
+    }
+    CU_ASSERT_EQUAL(done, RIAK_TRUE)
+    CU_ASSERT_EQUAL(state.chunks, 3)
+    CU_ASSERT_EQUAL(state.keys, 2)
+    CU_ASSERT_EQUAL(state.done, RIAK_TRUE)
+    CU_ASSERT_EQUAL(state.matched, RIAK_TRUE)
+    CU_ASSERT_FATAL(response != NULL)
+    CU_ASSERT_EQUAL(riak_listkeys_get_n_keys(response), 0)
+
+    riak_operation_free(&rop);
+    riak_connection_free(&cxn);
+    riak_listkeys_response_free(cfg, &response);
+    riak_config_free(&cfg);
+    CU_PASS("test_listkeys_stream_decode passed")
+}
+
 void
 test_integration_listkeys() {
     riak_config     *cfg;
@@ -0,0 +1,186 @@
+/*********************************************************************
+ *
+ * test_log_buffer.c: Riak C Unit testing for the log ring buffer
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "test.h"
+
+/**
+ * @brief Everything written to a log file so far
+ */
+static void
+test_log_buffer_contents(FILE  *out,
+                         char  *text,
+                         size_t size) {
+    rewind(out);
+    size_t got = fread(text, 1, size - 1, out);
+    text[got] = '\0';
+}
+
+void
+test_log_buffer_format() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    FILE *out = tmpfile();
+    CU_ASSERT_FATAL(out != NULL)
+    riak_log_buffer *buffer = NULL;
+    err = riak_log_buffer_new(&buffer, cfg, out, 0);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_config_set_logging(cfg, buffer, riak_log_buffer_log, riak_log_buffer_start, riak_log_buffer_stop);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // The string is copied when logged, not when formatted later
+    char name[16];
+    strcpy(name, "bucket");
+    riak_log_error_config(cfg, "%s %d %.*s %5.2f %lu%% %x %c", name, -42, 3, "xyzzy", 3.14159, 7UL, 255, '!');
+    strcpy(name, "changed");
+    riak_log_warn_config(cfg, "%s", "second");
+
+    riak_log_buffer_flush(buffer);
+    char text[1024];
+    test_log_buffer_contents(out, text, sizeof(text));
+    CU_ASSERT(strstr(text, "ERRO") != NULL)
+    CU_ASSERT(strstr(text, "bucket -42 xyz  3.14 7% ff !\n") != NULL)
+    CU_ASSERT(strstr(text, "WARN") != NULL)
+    CU_ASSERT(strstr(text, "second\n") != NULL)
+    CU_ASSERT(strstr(text, "changed") == NULL)
+    CU_ASSERT_EQUAL(riak_log_buffer_get_dropped(buffer), 0)
+
+    // Stops the drain thread
+    riak_config_free(&cfg);
+    riak_log_buffer_free(&buffer);
+    CU_ASSERT(buffer == NULL)
+    fclose(out);
+    CU_PASS("test_log_buffer_format passed")
+}
+
+typedef struct _test_log_buffer_writer {
+    riak_config *cfg;
+    int          id;
+} test_log_buffer_writer;
+
+static void*
+test_log_buffer_thread(void *ptr) {
+    test_log_buffer_writer *writer = (test_log_buffer_writer*)ptr;
+    int i;
+    for(i = 0; i < 6; i++) {
+        riak_log_error_config(writer->cfg, "writer %d message %d", writer->id, i);
+    }
+    return NULL;
+}
+
+void
+test_log_buffer_overflow() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    FILE *out = tmpfile();
+    CU_ASSERT_FATAL(out != NULL)
+    riak_log_buffer *buffer = NULL;
+    err = riak_log_buffer_new(&buffer, cfg, out, 3);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    // No drain thread, so every ring fills up and stays full
+    err = riak_config_set_logging(cfg, buffer, riak_log_buffer_log, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // Each thread has a ring of its own, rounded up to 4 records
+    test_log_buffer_writer writers[2];
+    pthread_t threads[2];
+    int i;
+    for(i = 0; i < 2; i++) {
+        writers[i].cfg = cfg;
+        writers[i].id  = i;
+        CU_ASSERT_FATAL(pthread_create(&(threads[i]), NULL, test_log_buffer_thread, &(writers[i])) == 0)
+    }
+    for(i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CU_ASSERT_EQUAL(riak_log_buffer_get_dropped(buffer), 4)
+    CU_ASSERT_EQUAL(riak_log_buffer_flush(buffer), 8)
+    CU_ASSERT_EQUAL(riak_log_buffer_flush(buffer), 0)
+
+    char text[2048];
+    test_log_buffer_contents(out, text, sizeof(text));
+    CU_ASSERT(strstr(text, "writer 0 message 3\n") != NULL)
+    CU_ASSERT(strstr(text, "writer 1 message 3\n") != NULL)
+    CU_ASSERT(strstr(text, "message 4") == NULL)
+
+    riak_config_free(&cfg);
+    riak_log_buffer_free(&buffer);
+    fclose(out);
+    CU_PASS("test_log_buffer_overflow passed")
+}
+
+// Blocks handed back to the allocator by test_log_buffer_free_fn
+static int test_log_buffer_frees = 0;
+
+static void
+test_log_buffer_free_fn(void *ptr) {
+    test_log_buffer_frees++;
+    free(ptr);
+}
+
+void
+test_log_buffer_thread_exit() {
+    riak_config *cfg;
+    riak_error err = riak_config_new(&cfg, NULL, NULL, test_log_buffer_free_fn, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    FILE *out = tmpfile();
+    CU_ASSERT_FATAL(out != NULL)
+    riak_log_buffer *buffer = NULL;
+    // Rounding up past 2^31 would never end
+    err = riak_log_buffer_new(&buffer, cfg, out, 0xFFFFFFFF);
+    CU_ASSERT_EQUAL(err, ERIAK_OUT_OF_RANGE)
+    err = riak_log_buffer_new(&buffer, cfg, out, RIAK_LOG_BUFFER_MAX_RECORDS + 1);
+    CU_ASSERT_EQUAL(err, ERIAK_OUT_OF_RANGE)
+    err = riak_log_buffer_new(&buffer, cfg, out, 4);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_config_set_logging(cfg, buffer, riak_log_buffer_log, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    // The ring of a thread which has exited goes once its messages are written out
+    test_log_buffer_writer writer = { cfg, 0 };
+    pthread_t thread;
+    CU_ASSERT_FATAL(pthread_create(&thread, NULL, test_log_buffer_thread, &writer) == 0)
+    pthread_join(thread, NULL);
+    test_log_buffer_frees = 0;
+    CU_ASSERT_EQUAL(riak_log_buffer_flush(buffer), 4)
+    CU_ASSERT_EQUAL(test_log_buffer_frees, 2)
+    CU_ASSERT_EQUAL(riak_log_buffer_flush(buffer), 0)
+    CU_ASSERT_EQUAL(test_log_buffer_frees, 2)
+
+    char text[1024];
+    test_log_buffer_contents(out, text, sizeof(text));
+    CU_ASSERT(strstr(text, "writer 0 message 3\n") != NULL)
+
+    riak_config_free(&cfg);
+    riak_log_buffer_free(&buffer);
+    fclose(out);
+    CU_PASS("test_log_buffer_thread_exit passed")
+}
@@ -0,0 +1,217 @@
+/*********************************************************************
+ *
+ * test_metrics.c: Riak C Unit testing for operation metrics
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "test.h"
+
+typedef struct _test_metrics_wire {
+    riak_uint8_t buf[256];
+    riak_size_t  len;
+    riak_size_t  pos;
+} test_metrics_wire;
+
+static riak_ssize_t
+test_metrics_write_cb(void       *ptr,
+                      void       *data,
+                      riak_size_t size) {
+    test_metrics_wire *wire = (test_metrics_wire*)ptr;
+    if (wire->len + size > sizeof(wire->buf)) {
+        return 0;
+    }
+    memcpy(wire->buf + wire->len, data, size);
+    wire->len += size;
+    return size;
+}
+
+static riak_ssize_t
+test_metrics_read_cb(void       *ptr,
+                     void       *data,
+                     riak_size_t size) {
+    test_metrics_wire *wire = (test_metrics_wire*)ptr;
+    riak_size_t remaining = wire->len - wire->pos;
+    if (size > remaining) {
+        size = remaining;
+    }
+    memcpy(data, wire->buf + wire->pos, size);
+    wire->pos += size;
+    return size;
+}
+
+static void
+test_metrics_response_cb(void *response,
+                         void *ptr) {
+    riak_config        *cfg  = (riak_config*)ptr;
+    riak_ping_response *pong = (riak_ping_response*)response;
+    riak_ping_response_free(cfg, &pong);
+}
+
+void
+test_metrics_counters() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_metrics_snapshot snapshot;
+    err = riak_config_get_metrics(cfg, &snapshot);
+    CU_ASSERT_EQUAL(err, ERIAK_UNINITIALIZED)
+    err = riak_config_enable_metrics(cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    test_metrics_wire wire;
+    memset(&wire, '\0', sizeof(wire));
+    int i;
+    for(i = 0; i < 2; i++) {
+        riak_operation *rop = NULL;
+        err = riak_operation_new(cxn, &rop, NULL, NULL, cfg);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_async_register_ping(rop, test_metrics_response_cb);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_pipeline_send(rop, test_metrics_write_cb, &wire);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    err = riak_config_get_metrics(cfg, &snapshot);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(snapshot.requests[RIAK_METRICS_OTHER], 2)
+    CU_ASSERT_EQUAL(snapshot.bytes_written, 10)
+    CU_ASSERT_EQUAL(snapshot.in_flight, 2)
+
+    // Answer both pings
+    riak_uint8_t pong[] = { 0, 0, 0, 1, MSG_RPBPINGRESP };
+    wire.len = 0;
+    for(i = 0; i < 2; i++) {
+        test_metrics_write_cb(&wire, pong, sizeof(pong));
+    }
+    err = riak_pipeline_read(cxn, test_metrics_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+
+    err = riak_config_get_metrics(cfg, &snapshot);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(snapshot.outcomes[ERIAK_OK], 2)
+    CU_ASSERT_EQUAL(snapshot.bytes_read, 10)
+    CU_ASSERT_EQUAL(snapshot.in_flight, 0)
+    riak_metrics_histogram *latency = &(snapshot.latency[RIAK_METRICS_OTHER]);
+    CU_ASSERT_EQUAL(latency->count, 2)
+    CU_ASSERT(riak_metrics_get_percentile(latency, 50.0) <= latency->max_usecs)
+    CU_ASSERT_EQUAL(snapshot.latency[RIAK_METRICS_GET].count, 0)
+    CU_ASSERT_EQUAL(riak_metrics_get_percentile(&(snapshot.latency[RIAK_METRICS_GET]), 99.0), 0)
+
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_metrics_counters passed")
+}
+
+// Response callback which checks the operation's breakdown before it is freed
+typedef struct _test_metrics_breakdown {
+    riak_config    *cfg;
+    riak_operation *rop;
+    riak_uint64_t   usecs;
+} test_metrics_breakdown;
+
+static void
+test_metrics_phases_cb(void *response,
+                       void *ptr) {
+    test_metrics_breakdown *phases = (test_metrics_breakdown*)ptr;
+    riak_ping_response  *pong   = (riak_ping_response*)response;
+    int i;
+    for(i = 0; i < RIAK_PHASE_N_PHASES; i++) {
+        phases->usecs += riak_operation_get_phase_usecs(phases->rop, (riak_phase)i);
+    }
+    riak_ping_response_free(phases->cfg, &pong);
+}
+
+void
+test_metrics_phases() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_config_enable_metrics(cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    test_metrics_wire wire;
+    memset(&wire, '\0', sizeof(wire));
+    test_metrics_breakdown phases;
+    memset(&phases, '\0', sizeof(phases));
+    phases.cfg = cfg;
+    err = riak_operation_new(cxn, &(phases.rop), NULL, NULL, &phases);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(phases.rop, test_metrics_phases_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_pipeline_send(phases.rop, test_metrics_write_cb, &wire);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    usleep(2000);
+
+    riak_uint8_t pong[] = { 0, 0, 0, 1, MSG_RPBPINGRESP };
+    wire.len = 0;
+    test_metrics_write_cb(&wire, pong, sizeof(pong));
+    err = riak_pipeline_read(cxn, test_metrics_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+
+    riak_metrics_snapshot snapshot;
+    err = riak_config_get_metrics(cfg, &snapshot);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+#ifdef RIAK_PHASE_TIMING
+    // The pause between sending and reading lands on the wire
+    CU_ASSERT(phases.usecs >= 2000)
+    CU_ASSERT(snapshot.phases[RIAK_PHASE_WIRE].max_usecs >= 2000)
+    int i;
+    for(i = 0; i < RIAK_PHASE_N_PHASES; i++) {
+        CU_ASSERT_EQUAL(snapshot.phases[i].count, 1)
+    }
+#else
+    CU_ASSERT_EQUAL(phases.usecs, 0)
+    CU_ASSERT_EQUAL(snapshot.phases[RIAK_PHASE_WIRE].count, 0)
+#endif
+
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_metrics_phases passed")
+}
+
+void
+test_metrics_percentile() {
+    riak_metrics_histogram histogram;
+    memset(&histogram, '\0', sizeof(histogram));
+    // Below 8 usecs every value has a bucket of its own
+    histogram.buckets[1] = 90;
+    histogram.buckets[7] = 10;
+    histogram.count      = 100;
+    histogram.max_usecs  = 7;
+    CU_ASSERT_EQUAL(riak_metrics_get_percentile(&histogram, 50.0), 1)
+    CU_ASSERT_EQUAL(riak_metrics_get_percentile(&histogram, 99.0), 7)
+    CU_ASSERT_EQUAL(riak_metrics_get_percentile(&histogram, 100.0), 7)
+    CU_PASS("test_metrics_percentile passed")
+}
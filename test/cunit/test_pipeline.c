@@ -0,0 +1,395 @@
+/*********************************************************************
+ *
+ * test_pipeline.c: Riak C Unit testing for pipelined operations
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+
+// In-memory stand-in for a socket; reads stop at `available` to mimic partial arrival
+typedef struct _test_pipeline_wire {
+    riak_uint8_t buf[72*1024];
+    riak_size_t  len;
+    riak_size_t  pos;
+    riak_size_t  available;
+    int          calls;
+} test_pipeline_wire;
+
+static riak_ssize_t
+test_pipeline_write_cb(void       *ptr,
+                       void       *data,
+                       riak_size_t size) {
+    test_pipeline_wire *wire = (test_pipeline_wire*)ptr;
+    if (wire->len + size > sizeof(wire->buf)) {
+        return 0;
+    }
+    memcpy(wire->buf + wire->len, data, size);
+    wire->len += size;
+    return size;
+}
+
+// Gathered write which accepts at most 4 bytes per call, forcing short writes
+static riak_ssize_t
+test_pipeline_writev_cb(void         *ptr,
+                        struct iovec *iov,
+                        int           iovcnt) {
+    test_pipeline_wire *wire = (test_pipeline_wire*)ptr;
+    riak_size_t wrote = 0;
+    int i;
+    wire->calls++;
+    for(i = 0; i < iovcnt && wrote < 4; i++) {
+        riak_size_t len = iov[i].iov_len;
+        if (len > 4 - wrote) {
+            len = 4 - wrote;
+        }
+        test_pipeline_write_cb(wire, iov[i].iov_base, len);
+        wrote += len;
+    }
+    return wrote;
+}
+
+// Gathered write which takes one short piece, then finds the socket broken
+static riak_ssize_t
+test_pipeline_broken_writev_cb(void         *ptr,
+                               struct iovec *iov,
+                               int           iovcnt) {
+    test_pipeline_wire *wire = (test_pipeline_wire*)ptr;
+    if (wire->calls > 0) {
+        return -1;
+    }
+    return test_pipeline_writev_cb(ptr, iov, iovcnt);
+}
+
+static riak_ssize_t
+test_pipeline_read_cb(void       *ptr,
+                      void       *data,
+                      riak_size_t size) {
+    test_pipeline_wire *wire = (test_pipeline_wire*)ptr;
+    wire->calls++;
+    riak_size_t remaining = wire->available - wire->pos;
+    if (size > remaining) {
+        size = remaining;
+    }
+    memcpy(data, wire->buf + wire->pos, size);
+    wire->pos += size;
+    return size;
+}
+
+// Per-operation callback state: responses must arrive in the order requests were sent
+typedef struct _test_pipeline_expect {
+    riak_config *cfg;
+    int         *delivered;
+    int          index;
+} test_pipeline_expect;
+
+static void
+test_pipeline_response_cb(void *response,
+                          void *ptr) {
+    test_pipeline_expect *expect = (test_pipeline_expect*)ptr;
+    riak_ping_response   *pong   = (riak_ping_response*)response;
+    CU_ASSERT_EQUAL(*(expect->delivered), expect->index)
+    (*(expect->delivered))++;
+    riak_ping_response_free(expect->cfg, &pong);
+}
+
+void
+test_pipeline_in_order() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    int delivered = 0;
+    test_pipeline_expect expect[3];
+    test_pipeline_wire wire;
+    memset(&wire, '\0', sizeof(wire));
+    int i;
+    for(i = 0; i < 3; i++) {
+        expect[i].cfg       = cfg;
+        expect[i].delivered = &delivered;
+        expect[i].index     = i;
+        riak_operation *rop = NULL;
+        err = riak_operation_new(cxn, &rop, NULL, NULL, &(expect[i]));
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_async_register_ping(rop, test_pipeline_response_cb);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_pipeline_send(rop, test_pipeline_write_cb, &wire);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    // Every request hit the wire before any response: 3 x (length + msgid)
+    CU_ASSERT_EQUAL(wire.len, 15)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 3)
+
+    // Replay three pongs, first cutting the second frame short
+    riak_uint8_t pong[] = { 0, 0, 0, 1, MSG_RPBPINGRESP };
+    wire.len = 0;
+    for(i = 0; i < 3; i++) {
+        test_pipeline_write_cb(&wire, pong, sizeof(pong));
+    }
+    wire.available = 7;
+    err = riak_pipeline_read(cxn, test_pipeline_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(delivered, 1)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 2)
+
+    wire.available = wire.len;
+    err = riak_pipeline_read(cxn, test_pipeline_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(delivered, 3)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_pipeline_in_order passed")
+}
+
+void
+test_pipeline_send_batch() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    riak_operation *rops[3];
+    riak_uint8_t clientid[] = { 'a', 'b', 'c' };
+    err = riak_operation_new(cxn, &(rops[0]), NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_ping_request_encode(rops[0], &(rops[0]->pb_request));
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_operation_new(cxn, &(rops[1]), NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    rops[1]->pb_request = riak_pb_message_new(cfg, MSG_RPBSETCLIENTIDREQ, sizeof(clientid), clientid);
+    CU_ASSERT_FATAL(rops[1]->pb_request != NULL)
+    err = riak_operation_new(cxn, &(rops[2]), NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_ping_request_encode(rops[2], &(rops[2]->pb_request));
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    test_pipeline_wire wire;
+    memset(&wire, '\0', sizeof(wire));
+    err = riak_pipeline_send_batch(rops, 3, test_pipeline_writev_cb, &wire);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 3)
+
+    // Frames arrive intact and in order despite 4-byte short writes
+    riak_uint8_t expected[] = { 0, 0, 0, 1, MSG_RPBPINGREQ,
+                                0, 0, 0, 4, MSG_RPBSETCLIENTIDREQ, 'a', 'b', 'c',
+                                0, 0, 0, 1, MSG_RPBPINGREQ };
+    CU_ASSERT_EQUAL(wire.len, sizeof(expected))
+    CU_ASSERT_EQUAL(memcmp(wire.buf, expected, sizeof(expected)), 0)
+    CU_ASSERT_EQUAL(wire.calls, (sizeof(expected) + 3) / 4)
+
+    // A write which breaks partway through queues nothing but leaves the stream out of step
+    riak_operation *more[2];
+    int i;
+    for(i = 0; i < 2; i++) {
+        err = riak_operation_new(cxn, &(more[i]), NULL, NULL, NULL);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_ping_request_encode(more[i], &(more[i]->pb_request));
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    CU_ASSERT(!riak_connection_is_stale(cxn))
+    wire.calls = 0;
+    err = riak_pipeline_send_batch(more, 2, test_pipeline_broken_writev_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_WRITE)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 3)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+    for(i = 0; i < 2; i++) {
+        riak_operation_free(&(more[i]));
+    }
+
+    // Abandoning the connection releases the queued operations (but not our stack buffer)
+    rops[1]->pb_request->data = NULL;
+    CU_ASSERT_EQUAL(riak_pipeline_reset(cxn), 3)
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_pipeline_send_batch passed")
+}
+
+void
+test_pipeline_buffered_reads() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    int delivered = 0;
+    test_pipeline_expect expect[4];
+    test_pipeline_wire wire;
+    memset(&wire, '\0', sizeof(wire));
+    int i;
+    for(i = 0; i < 4; i++) {
+        expect[i].cfg       = cfg;
+        expect[i].delivered = &delivered;
+        expect[i].index     = i;
+        riak_operation *rop = NULL;
+        err = riak_operation_new(cxn, &rop, NULL, NULL, &(expect[i]));
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_async_register_ping(rop, test_pipeline_response_cb);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        err = riak_pipeline_send(rop, test_pipeline_write_cb, &wire);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+
+    // Three small pongs arrive together and are decoded from a single read
+    riak_uint8_t pong[] = { 0, 0, 0, 1, MSG_RPBPINGRESP };
+    wire.len = 0;
+    for(i = 0; i < 3; i++) {
+        test_pipeline_write_cb(&wire, pong, sizeof(pong));
+    }
+    wire.available = wire.len;
+    wire.calls     = 0;
+    err = riak_pipeline_read(cxn, test_pipeline_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(delivered, 3)
+    CU_ASSERT_EQUAL(wire.calls, 2)  // One read with data, one finding nothing more
+    riak_buffer_stats stats;
+    riak_connection_get_buffer_stats(cxn, &stats);
+    CU_ASSERT_EQUAL(stats.heap_allocs, 1)  // Just the receive buffer
+
+    // A pong larger than the receive buffer falls back to reading in place
+    riak_uint32_t bodylen = 70000;
+    riak_uint32_t msglen  = htonl(bodylen);
+    wire.len = wire.pos = 0;
+    test_pipeline_write_cb(&wire, &msglen, sizeof(msglen));
+    wire.buf[wire.len] = MSG_RPBPINGRESP;
+    wire.len += bodylen;
+    wire.available = wire.len;
+    err = riak_pipeline_read(cxn, test_pipeline_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(delivered, 4)
+    CU_ASSERT_EQUAL(wire.pos, wire.len)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_pipeline_buffered_reads passed")
+}
+
+static void
+test_pipeline_abandon_cb(riak_error err,
+                         void      *ptr) {
+    *((riak_error*)ptr) = err;
+}
+
+void
+test_pipeline_timeout() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    cxn->fd = sv[0];
+
+    // A server that never answers: pipelined operations are abandoned at their deadline
+    riak_error abandoned = ERIAK_OK;
+    riak_operation *rop = NULL;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, &abandoned);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_pipeline_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_operation_set_abandon_cb(rop, test_pipeline_abandon_cb);
+    riak_operation_set_timeout(rop, 20);
+    CU_ASSERT_EQUAL(riak_pipeline_get_timeout(cxn), -1)
+    err = riak_pipeline_sync_send(rop);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    int remaining = riak_pipeline_get_timeout(cxn);
+    CU_ASSERT(remaining > 0 && remaining <= 20)
+    err = riak_pipeline_sync_wait(cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_TIMEOUT)
+    CU_ASSERT_EQUAL(abandoned, ERIAK_TIMEOUT)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+
+    // Synchronous calls take the connection's default and time out too
+    cxn->stale = RIAK_FALSE;
+    riak_connection_set_timeout(cxn, 50);
+    riak_uint64_t started = riak_time_usecs();
+    err = riak_ping(cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_TIMEOUT)
+    CU_ASSERT(riak_time_usecs() - started >= 50000)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+
+    // The late pong must not be mistaken for the next answer, so the socket is reopened first
+    riak_uint8_t pong[] = { 0, 0, 0, 1, MSG_RPBPINGRESP };
+    CU_ASSERT_EQUAL(write(sv[1], pong, sizeof(pong)), sizeof(pong))
+    err = riak_ping(cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_CONNECT)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+
+    close(sv[1]);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_pipeline_timeout passed")
+}
+
+void
+test_pipeline_hangup() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    cxn->fd = sv[0];
+
+    // Without a retry policy, a server which hangs up fails whatever it left unanswered
+    riak_error abandoned = ERIAK_OK;
+    riak_operation *rop = NULL;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, &abandoned);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_pipeline_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_operation_set_abandon_cb(rop, test_pipeline_abandon_cb);
+    err = riak_pipeline_sync_send(rop);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    close(sv[1]);
+    err = riak_pipeline_sync_wait(cxn);
+    CU_ASSERT_EQUAL(err, ERIAK_READ)
+    CU_ASSERT_EQUAL(abandoned, ERIAK_READ)
+    CU_ASSERT_EQUAL(riak_pipeline_get_depth(cxn), 0)
+    CU_ASSERT(riak_connection_is_stale(cxn))
+
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_pipeline_hangup passed")
+}
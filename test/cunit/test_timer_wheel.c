@@ -0,0 +1,141 @@
+/*********************************************************************
+ *
+ * test_timer_wheel.c: Riak C Unit testing for the timer wheel
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_operation-internal.h"
+
+// Milliseconds past the start; spans every level and beyond the wheel's reach
+#define TEST_TW_TIMERS 10
+static const riak_uint64_t test_tw_offsets[TEST_TW_TIMERS] = {
+    1, 5, 63, 64, 65, 4095, 4096, 300000, 20000000, 20000000
+};
+// Due together with another; its partner cancels it by freeing it
+#define TEST_TW_BATCH 1000
+
+typedef struct _test_tw_state {
+    riak_operation **rops;
+    riak_uint32_t    fired;
+    int              last;
+} test_tw_state;
+
+static void
+test_tw_expire_cb(riak_operation *rop,
+                  void           *ptr) {
+    test_tw_state *state = (test_tw_state*)ptr;
+    int i;
+    for(i = 0; i < TEST_TW_TIMERS; i++) {
+        if (state->rops[i] == rop) break;
+    }
+    state->fired++;
+    state->last = i;
+    // The first of the last pair frees its twin, which must then never fire
+    if (i == TEST_TW_TIMERS - 2) {
+        riak_operation_free(&(state->rops[TEST_TW_TIMERS - 1]));
+    }
+    if (i < TEST_TW_TIMERS) {
+        riak_operation_free(&(state->rops[i]));
+    } else {
+        riak_operation_free(&rop);
+    }
+}
+
+void
+test_timer_wheel_deadlines() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    riak_timer_wheel *tw = NULL;
+    err = riak_timer_wheel_new(&tw, cfg, 1);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(riak_timer_wheel_get_timeout(tw), -1)
+
+    // Drive the wheel from a made-up clock, starting on a tick boundary
+    riak_uint64_t   start = (tw->now + 1) * 1000;
+    riak_operation *rops[TEST_TW_TIMERS];
+    test_tw_state   state = { rops, 0, -1 };
+    int i;
+    for(i = 0; i < TEST_TW_TIMERS; i++) {
+        err = riak_operation_new(cxn, &(rops[i]), NULL, NULL, NULL);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        rops[i]->deadline_usecs = start + test_tw_offsets[i] * 1000;
+        riak_timer_wheel_add(tw, rops[i], &state);
+    }
+    // Operations without a deadline are not scheduled; cancelled ones never fire
+    riak_operation *untimed = NULL;
+    err = riak_operation_new(cxn, &untimed, NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_timer_wheel_add(tw, untimed, &state);
+    riak_operation *cancelled = NULL;
+    err = riak_operation_new(cxn, &cancelled, NULL, NULL, NULL);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    cancelled->deadline_usecs = start + 64000;
+    riak_timer_wheel_add(tw, cancelled, &state);
+    riak_timer_wheel_cancel(cancelled);
+    CU_ASSERT_EQUAL(riak_timer_wheel_get_count(tw), TEST_TW_TIMERS)
+    CU_ASSERT(riak_timer_wheel_get_timeout(tw) >= 0)
+
+    // Each deadline fires exactly when reached, never a tick early
+    for(i = 0; i < TEST_TW_TIMERS - 1; i++) {
+        riak_uint64_t deadline = start + test_tw_offsets[i] * 1000;
+        riak_uint32_t fired    = state.fired;
+        riak_timer_wheel_advance_to(tw, deadline - 1, test_tw_expire_cb);
+        CU_ASSERT_EQUAL(state.fired, fired)
+        riak_timer_wheel_advance_to(tw, deadline, test_tw_expire_cb);
+        CU_ASSERT_EQUAL(state.fired, fired + 1)
+        CU_ASSERT_EQUAL(state.last, i)
+    }
+    CU_ASSERT_EQUAL(riak_timer_wheel_get_count(tw), 0)
+    CU_ASSERT_EQUAL(riak_timer_wheel_get_timeout(tw), -1)
+
+    // A crowd sharing a deadline expires in one pass
+    riak_uint64_t now = start + test_tw_offsets[TEST_TW_TIMERS - 1] * 1000;
+    state.fired = 0;
+    for(i = 0; i < TEST_TW_BATCH; i++) {
+        riak_operation *rop = NULL;
+        err = riak_operation_new(cxn, &rop, NULL, NULL, NULL);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+        rop->deadline_usecs = now + 2000;
+        riak_timer_wheel_add(tw, rop, &state);
+    }
+    CU_ASSERT_EQUAL(riak_timer_wheel_get_count(tw), TEST_TW_BATCH)
+    CU_ASSERT_EQUAL(riak_timer_wheel_advance_to(tw, now + 1000, test_tw_expire_cb), 0)
+    CU_ASSERT_EQUAL(riak_timer_wheel_advance_to(tw, now + 2000, test_tw_expire_cb), TEST_TW_BATCH)
+    CU_ASSERT_EQUAL(state.fired, TEST_TW_BATCH)
+
+    riak_operation_free(&untimed);
+    riak_operation_free(&cancelled);
+    riak_timer_wheel_free(&tw);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_timer_wheel_deadlines passed")
+}
@@ -0,0 +1,167 @@
+/*********************************************************************
+ *
+ * test_trace.c: Riak C Unit testing for tracing hooks
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_messages-internal.h"
+#include "riak_utils-internal.h"
+#include "test.h"
+
+typedef struct _test_trace_wire {
+    riak_uint8_t buf[256];
+    riak_size_t  len;
+    riak_size_t  pos;
+} test_trace_wire;
+
+static riak_ssize_t
+test_trace_write_cb(void       *ptr,
+                    void       *data,
+                    riak_size_t size) {
+    test_trace_wire *wire = (test_trace_wire*)ptr;
+    if (wire->len + size > sizeof(wire->buf)) {
+        return 0;
+    }
+    memcpy(wire->buf + wire->len, data, size);
+    wire->len += size;
+    return size;
+}
+
+static riak_ssize_t
+test_trace_read_cb(void       *ptr,
+                   void       *data,
+                   riak_size_t size) {
+    test_trace_wire *wire = (test_trace_wire*)ptr;
+    riak_size_t remaining = wire->len - wire->pos;
+    if (size > remaining) {
+        size = remaining;
+    }
+    memcpy(data, wire->buf + wire->pos, size);
+    wire->pos += size;
+    return size;
+}
+
+// Copy of the last span seen by the tracer, plus a handle it hands out
+typedef struct _test_trace_tracer {
+    int             starts;
+    int             finishes;
+    riak_trace_span last;
+    char            key[32];
+    int             handle;
+} test_trace_tracer;
+
+static void
+test_trace_fn(void            *ptr,
+              riak_trace_span *span) {
+    test_trace_tracer *tracer = (test_trace_tracer*)ptr;
+    if (span->point == RIAK_TRACE_START) {
+        tracer->starts++;
+        span->span = &(tracer->handle);
+    } else {
+        tracer->finishes++;
+    }
+    tracer->last = *span;
+    tracer->key[0] = '\0';
+    if (span->key) {
+        riak_binary_print(span->key, tracer->key, sizeof(tracer->key));
+    }
+}
+
+static void
+test_trace_get_cb(void *response,
+                  void *ptr) {
+    riak_config       *cfg = (riak_config*)ptr;
+    riak_get_response *get = (riak_get_response*)response;
+    riak_get_response_free(cfg, &get);
+}
+
+void
+test_trace_spans() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    test_trace_tracer tracer;
+    memset(&tracer, '\0', sizeof(tracer));
+    err = riak_config_set_tracing(cfg, test_trace_fn, &tracer, RIAK_FALSE);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+
+    riak_binary *bucket = riak_binary_copy_from_string(cfg, "bucket");
+    riak_binary *key    = riak_binary_copy_from_string(cfg, "key");
+    test_trace_wire wire;
+    memset(&wire, '\0', sizeof(wire));
+    riak_operation *rop = NULL;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_get(rop, NULL, bucket, key, NULL, test_trace_get_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_pipeline_send(rop, test_trace_write_cb, &wire);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(tracer.starts, 1)
+    CU_ASSERT_EQUAL(tracer.finishes, 0)
+    CU_ASSERT_EQUAL(tracer.last.msgid, MSG_RPBGETREQ)
+    CU_ASSERT_EQUAL(tracer.last.bytes_written, wire.len)
+    CU_ASSERT_EQUAL(strcmp(tracer.key, "key"), 0)
+    CU_ASSERT_EQUAL(strcmp(tracer.last.host, "localhost"), 0)
+    CU_ASSERT_EQUAL(strcmp(tracer.last.port, "1"), 0)
+
+    // An empty RpbGetResp is a not found
+    riak_uint8_t notfound[] = { 0, 0, 0, 1, MSG_RPBGETRESP };
+    wire.len = 0;
+    test_trace_write_cb(&wire, notfound, sizeof(notfound));
+    err = riak_pipeline_read(cxn, test_trace_read_cb, &wire);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(tracer.finishes, 1)
+    CU_ASSERT_EQUAL(tracer.last.error, ERIAK_OK)
+    CU_ASSERT_EQUAL(tracer.last.bytes_read, sizeof(notfound))
+    CU_ASSERT_EQUAL(tracer.last.retries, 0)
+    CU_ASSERT(tracer.last.span == &(tracer.handle))
+
+    // Hashed keys hide the raw values; an operation freed unanswered still closes its span
+    err = riak_config_set_tracing(cfg, test_trace_fn, &tracer, RIAK_TRUE);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    wire.len = wire.pos = 0;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_get(rop, NULL, bucket, key, NULL, test_trace_get_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_write(rop, test_trace_write_cb, &wire);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    CU_ASSERT_EQUAL(tracer.starts, 2)
+    CU_ASSERT(tracer.last.key == NULL)
+    CU_ASSERT(tracer.last.key_hash != 0)
+    riak_operation_free(&rop);
+    CU_ASSERT_EQUAL(tracer.finishes, 2)
+    CU_ASSERT_EQUAL(tracer.last.error, ERIAK_UNINITIALIZED)
+
+    riak_binary_free(cfg, &bucket);
+    riak_binary_free(cfg, &key);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_trace_spans passed")
+}
@@ -0,0 +1,168 @@
+/*********************************************************************
+ *
+ * test_uring.c: Riak C Unit testing for the io_uring reactor
+ *
+ * Copyright (c) 2007-2014 Basho Technologies, Inc.  All Rights Reserved.
+ *
+ * This file is provided to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file
+ * except in compliance with the License.  You may obtain
+ * a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ *********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Basic.h>
+#include "riak.h"
+#include "riak_uring.h"
+#include "riak_messages-internal.h"
+#include "riak_operation-internal.h"
+#include "riak_connection-internal.h"
+
+// Server error whose message spans several receive buffers
+#define TEST_URING_ERRMSG_LEN 40000
+
+typedef struct _test_uring_state {
+    riak_config *cfg;
+    int          delivered;
+    int          errors;
+} test_uring_state;
+
+static void
+test_uring_response_cb(void *response,
+                       void *ptr) {
+    test_uring_state   *state = (test_uring_state*)ptr;
+    riak_ping_response *pong  = (riak_ping_response*)response;
+    state->delivered++;
+    riak_ping_response_free(state->cfg, &pong);
+}
+
+static void
+test_uring_error_cb(void *response,
+                    void *ptr) {
+    test_uring_state *state = (test_uring_state*)ptr;
+    state->errors++;
+}
+
+static void
+test_uring_ping(riak_connection       *cxn,
+                riak_uring_connection *uconn,
+                test_uring_state      *state) {
+    riak_operation *rop = NULL;
+    riak_error err = riak_operation_new(cxn, &rop, NULL, test_uring_error_cb, state);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_uring_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_uring_send(rop, uconn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+}
+
+void
+test_uring_pipeline() {
+    riak_config *cfg;
+    riak_error err = riak_config_new_default(&cfg);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    riak_connection *cxn = NULL;
+    err = riak_connection_new(cfg, &cxn, "localhost", "1", NULL);
+    CU_ASSERT_FATAL(err == ERIAK_CONNECT)
+    int sv[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0)
+    cxn->fd = sv[0];
+
+    // Either backend must behave the same way
+    riak_uring            *ur    = NULL;
+    riak_uring_connection *uconn = NULL;
+    err = riak_uring_new(&ur, cfg, 0);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_uring_connection_new(&uconn, ur, cxn);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+
+    test_uring_state state = { cfg, 0, 0 };
+    int i;
+    for(i = 0; i < 4; i++) {
+        test_uring_ping(cxn, uconn, &state);
+    }
+    CU_ASSERT_EQUAL(riak_uring_get_pending(ur), 4)
+
+    // Nothing reaches the socket until the reactor runs, then all four go out together
+    riak_uint8_t wire[64];
+    CU_ASSERT_EQUAL(recv(sv[1], wire, sizeof(wire), MSG_DONTWAIT), -1)
+    while (recv(sv[1], wire, sizeof(wire), MSG_DONTWAIT) < 0) {
+        err = riak_uring_run_once(ur, 100);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+
+    // Answer with the second pong cut short
+    riak_uint8_t pongs[] = { 0, 0, 0, 1, MSG_RPBPINGRESP,
+                             0, 0, 0, 1, MSG_RPBPINGRESP,
+                             0, 0, 0, 1, MSG_RPBPINGRESP };
+    CU_ASSERT_EQUAL(write(sv[1], pongs, 7), 7)
+    while (state.delivered < 1) {
+        err = riak_uring_run_once(ur, 1000);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    CU_ASSERT_EQUAL(state.delivered, 1)
+    CU_ASSERT_EQUAL(riak_uring_get_pending(ur), 3)
+
+    // Then the rest, and a server error too large for any one receive
+    riak_size_t   error_len = 4 + 1 + 1 + 3 + TEST_URING_ERRMSG_LEN + 2;
+    riak_uint8_t *error = (riak_uint8_t*)malloc(error_len);
+    CU_ASSERT_FATAL(error != NULL)
+    riak_uint32_t msglen = htonl(error_len - 4);
+    memcpy(error, &msglen, sizeof(msglen));
+    error[4] = MSG_RPBERRORRESP;
+    error[5] = 0x0a;
+    error[6] = 0xc0;
+    error[7] = 0xb8;
+    error[8] = 0x02;
+    memset(error + 9, 'x', TEST_URING_ERRMSG_LEN);
+    error[error_len - 2] = 0x10;
+    error[error_len - 1] = 0x01;
+    CU_ASSERT_EQUAL(write(sv[1], pongs + 7, sizeof(pongs) - 7), sizeof(pongs) - 7)
+    CU_ASSERT_EQUAL(write(sv[1], error, error_len), error_len)
+    free(error);
+    err = riak_uring_run(ur);
+    CU_ASSERT_EQUAL(err, ERIAK_OK)
+    CU_ASSERT_EQUAL(state.delivered, 3)
+    CU_ASSERT_EQUAL(state.errors, 1)
+    CU_ASSERT_EQUAL(riak_uring_get_pending(ur), 0)
+    CU_ASSERT_EQUAL(riak_uring_connection_get_error(uconn), ERIAK_OK)
+
+    // A hang-up is noticed and refuses further requests
+    close(sv[1]);
+    while (riak_uring_connection_get_error(uconn) == ERIAK_OK) {
+        err = riak_uring_run_once(ur, 1000);
+        CU_ASSERT_FATAL(err == ERIAK_OK)
+    }
+    CU_ASSERT_EQUAL(riak_uring_connection_get_error(uconn), ERIAK_READ)
+    riak_operation *rop = NULL;
+    err = riak_operation_new(cxn, &rop, NULL, NULL, &state);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_async_register_ping(rop, test_uring_response_cb);
+    CU_ASSERT_FATAL(err == ERIAK_OK)
+    err = riak_uring_send(rop, uconn);
+    CU_ASSERT_EQUAL(err, ERIAK_READ)
+    riak_operation_free(&rop);
+
+    riak_uring_connection_free(&uconn);
+    CU_ASSERT(uconn == NULL)
+    riak_uring_free(&ur);
+    riak_connection_free(&cxn);
+    riak_config_free(&cfg);
+    CU_PASS("test_uring_pipeline passed")
+}